@@ -21,6 +21,7 @@ ARTIFACTS=(
     "mongo_ops.o"
     "utils.o"
     "aes_gcm.o"
+    "chunked_gcm.o"
     "blake3.o"
     "blake3_dispatch.o"
     "blake3_portable.o"
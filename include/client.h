@@ -14,6 +14,9 @@ typedef enum {
     CMD_DOWNLOAD,
     CMD_LIST,
     CMD_UNKNOWN,
+    CMD_UPLOAD_CHUNKED = 4, // загрузка по чанкам: передаются только чанки, которых нет на сервере
+    CMD_UPLOAD_PART = 5,    // дополнительный поток параллельной чанковой загрузки (file_hash = токен)
+    CMD_UPLOAD_STATUS = 6,  // сколько байт незавершённой загрузки уже на сервере (в filesize)
     CMD_CONNECT = 99,  // клиент хочет подключиться и ждать
     CMD_CHECK = 100,   // Команда для администратора: проверить отпечаток
     CMD_APPROVE = 101  // Команда для администратора: подтвердить подключение
@@ -38,6 +41,7 @@ typedef enum {
     RESP_INVALID_OFFSET,
     RESP_INTEGRITY_ERROR,
     RESP_UNKNOWN_COMMAND,
+    RESP_ALREADY_STORED,  // Содержимое уже на сервере: тело файла не передаётся
     RESP_WAITING_APPROVAL = 100, 
     RESP_APPROVED = 101,         // Подключение подтверждено
     RESP_REJECTED = 102          // Подключение отклонено
@@ -52,12 +56,83 @@ typedef struct {
 
     int64_t offset;
 
-    uint8_t flags; // bit 0 = public
+    uint8_t flags; // bit 0 = public, остальные биты — REQ_FLAG_*
 
     uint8_t file_hash[BLAKE3_HASH_LEN]; // для download/list
     char recipient[FINGERPRINT_LEN]; // для upload
 } RequestHeader;
 
+// Возобновляемая загрузка (CMD_UPLOAD). CMD_UPLOAD_STATUS с тем же заголовком (имя, размер,
+// file_hash) отвечает RESP_SUCCESS и filesize — сколько байт прерванной загрузки этого файла
+// тем же клиентом сервер уже хранит (кратно 64 КиБ, 0 — начинать сначала). CMD_UPLOAD с
+// offset, равным этому числу, продолжает с него: клиент шлёт байты файла с offset. Другой
+// offset — RESP_INVALID_OFFSET. Незавершённая загрузка живёт, пока сервер не перезапущен,
+// и не дольше суток без изменений.
+
+// Чанковая загрузка (CMD_UPLOAD_CHUNKED):
+//  1. клиент -> RequestHeader; сервер -> ResponseHeader (RESP_SUCCESS — можно слать манифест)
+//  2. клиент -> uint32_t число чанков, затем ChunkRef на каждый чанк по порядку
+//  3. сервер -> ResponseHeader (filesize = байт к передаче) и битовая карта нужных чанков
+//     ((count + 7) / 8 байт, бит i = (map[i / 8] >> (i % 8)) & 1)
+//  4. клиент -> содержимое отмеченных чанков подряд; сервер -> итоговый ResponseHeader
+#define CHUNKED_UPLOAD_MAX_CHUNKS 65536
+
+// Параллельная передача (--streams N). Дополнительное соединение того же сертификата
+// не шлёт CMD_CONNECT: сервер без администратора выполняет по нему одну команду —
+// CMD_UPLOAD_PART с токеном открытой загрузки или CMD_DOWNLOAD с REQ_FLAG_RANGE для файла,
+// который подтверждённое соединение этого клиента сейчас скачивает по диапазонам.
+//  - CMD_UPLOAD_CHUNKED с REQ_FLAG_PARALLEL: после битовой карты сервер присылает токен
+//    (BLAKE3_HASH_LEN байт). Каждое соединение (основное и CMD_UPLOAD_PART с токеном в
+//    file_hash, после ответа RESP_SUCCESS) шлёт части: uint32_t номер чанка, затем его
+//    содержимое; конец — CHUNKED_UPLOAD_PART_END. Вспомогательное соединение получает свой
+//    ResponseHeader, основное — итоговый, когда приняты чанки всех соединений.
+//  - CMD_DOWNLOAD с REQ_FLAG_RANGE: сервер отдаёт не больше filesize байт с offset
+//    (0 — только размер файла в ответе), а после данных — BLAKE3 отправленного диапазона.
+#define REQ_FLAG_PARALLEL 0x02
+#define REQ_FLAG_RANGE    0x04
+#define CHUNKED_UPLOAD_PART_END 0xFFFFFFFFu
+
+// Сжатие чанков (--compress). CMD_UPLOAD_CHUNKED с REQ_FLAG_COMPRESS: сервер, собранный
+// с zstd, отвечает на шаге 1 filesize = CHUNKED_UPLOAD_COMPRESSED; иначе (в том числе
+// старый сервер) — 0, и чанки идут как раньше. После согласия каждый чанк (и в
+// параллельных частях) предваряется uint32_t длиной на проводе: равна ChunkRef.len —
+// чанк как есть, меньше — один кадр zstd, распаковывающийся ровно в len байт.
+// Манифест, bitmap и BLAKE3 чанков всегда относятся к несжатому содержимому.
+#define REQ_FLAG_COMPRESS 0x08
+#define CHUNKED_UPLOAD_COMPRESSED 1
+
+// Постраничный LIST. CMD_LIST с REQ_FLAG_PAGED: filesize — размер страницы (0 —
+// LIST_PAGE_DEFAULT, больше LIST_PAGE_MAX урезается), file_hash — токен продолжения
+// из прошлой страницы (нули — первая страница). Сервер отвечает ResponseHeader с
+// filesize = LIST_STREAMED и шлёт записи по мере чтения из базы: ListEntry, за ним
+// имя (name_len байт) и отпечаток (peer_len байт): у своих файлов — получателя, у
+// чужих — владельца. Конец страницы — ListEntry с name_len = 0: size — число записей
+// страницы, flags — LIST_END_*; при LIST_END_MORE за ним идёт токен следующей
+// страницы (BLAKE3_HASH_LEN байт). Неверный токен — RESP_INVALID_OFFSET.
+// Сервер без постраничного LIST отвечает filesize >= 0 и присылает весь список JSON.
+#define REQ_FLAG_PAGED 0x10
+#define LIST_STREAMED (-1LL)
+#define LIST_PAGE_DEFAULT 200
+#define LIST_PAGE_MAX 1000
+
+#define LIST_ENTRY_OWN    0x01 // файл клиента
+#define LIST_ENTRY_PUBLIC 0x02
+#define LIST_END_MORE     0x01 // есть следующая страница
+#define LIST_END_ERROR    0x02 // выдача оборвалась из-за ошибки на сервере
+
+typedef struct {
+    int64_t size;        // размер файла; в конце страницы — число записей
+    int64_t uploaded_at; // мс с эпохи
+    uint16_t name_len;
+    uint8_t peer_len;
+    uint8_t flags;       // LIST_ENTRY_* или LIST_END_*
+} ListEntry;
+
+typedef struct {
+    uint8_t id[BLAKE3_HASH_LEN]; // BLAKE3 содержимого чанка
+    uint32_t len;                // длина чанка в байтах
+} ChunkRef;
+
 // Заголовок ответа от сервера к клиенту
 typedef struct {
     ResponseStatus status;
@@ -37,9 +37,70 @@ typedef enum {
     CMD_ECDH_RESP = 103,   // ECDH key exchange response
     CMD_SESSION_KEY = 104, // Session key establishment
     CMD_PING = 105,        // Keep-alive ping
-    CMD_DISCONNECT = 106   // Graceful disconnect
+    CMD_DISCONNECT = 106,  // Graceful disconnect
+    CMD_UPLOAD_STATUS = 107, // Bytes of a partial upload the server holds (in filesize)
+    CMD_HELLO = 108          // Protocol version negotiation (see PROTOCOL_VERSION_*)
 } CommandType;
 
+// Protocol versions. A connection speaks v1 (RequestHeader, raw bytes,
+// ResponseHeader, one request at a time) until the client sends CMD_HELLO
+// with the highest version it supports in `offset`. The reply carries the
+// agreed version in `filesize`. Servers without CMD_HELLO answer
+// RESP_UNKNOWN_COMMAND, so the client simply stays on v1.
+#define PROTOCOL_VERSION_1 1
+#define PROTOCOL_VERSION_FRAMED 2
+#define PROTOCOL_VERSION_COMPACT 3 // v2 framing; headers in the compact encoding (src/common/wire_codec.h)
+#define PROTOCOL_VERSION_MAX PROTOCOL_VERSION_COMPACT
+
+// v2 framing. After the CMD_HELLO reply every byte in both directions is a
+// frame: a FRAME_HEADER_LEN header (stream id u32, type u8, flags u8,
+// payload length u32, all little-endian) followed by the payload.
+// The client opens a stream by sending DATA on an id above every id it
+// used before. The DATA payloads of a stream concatenate to exactly the
+// bytes of a v1 connection, so one stream runs one v1 exchange after
+// another, and streams run concurrently: a LIST or PING is answered while
+// other streams upload or download.
+//   FRAME_DATA  - stream bytes
+//   FRAME_CLOSE - client: no more requests on this stream; server: stream done
+//   FRAME_RESET - stream aborted, unsent bytes dropped; the id is not reused
+#define FRAME_HEADER_LEN 10
+#define FRAME_MAX_PAYLOAD (64 * 1024)
+
+typedef enum {
+    FRAME_DATA = 0,
+    FRAME_CLOSE = 1,
+    FRAME_RESET = 2
+} FrameType;
+
+typedef struct {
+    uint32_t stream_id; // Never 0
+    uint8_t type;       // FrameType
+    uint8_t flags;      // Reserved, must be 0
+    uint32_t length;    // Payload bytes; 0 for CLOSE and RESET
+} FrameHeader;
+
+static inline void frame_header_pack(const FrameHeader *h, uint8_t *out) {
+    for (int i = 0; i < 4; i++) out[i] = (uint8_t)(h->stream_id >> (8 * i));
+    out[4] = h->type;
+    out[5] = h->flags;
+    for (int i = 0; i < 4; i++) out[6 + i] = (uint8_t)(h->length >> (8 * i));
+}
+
+// Returns 0, or -1 if no peer may send this header
+static inline int frame_header_unpack(const uint8_t *in, FrameHeader *h) {
+    h->stream_id = 0;
+    h->length = 0;
+    for (int i = 0; i < 4; i++) h->stream_id |= (uint32_t)in[i] << (8 * i);
+    h->type = in[4];
+    h->flags = in[5];
+    for (int i = 0; i < 4; i++) h->length |= (uint32_t)in[6 + i] << (8 * i);
+
+    if (h->stream_id == 0 || h->flags != 0 || h->type > FRAME_RESET) return -1;
+    if (h->length > FRAME_MAX_PAYLOAD) return -1;
+    if (h->type != FRAME_DATA && h->length != 0) return -1;
+    return 0;
+}
+
 // Server options
 typedef enum {
     OPEN_SERVER,
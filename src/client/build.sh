@@ -21,10 +21,17 @@
 set -e
 
 # Общие объекты (без SIMD)
+# Необязательно: сжатие чанков zstd (без libzstd --compress не действует)
+ZSTD_CFLAGS=$(pkg-config --exists libzstd 2>/dev/null && echo "-DHAVE_ZSTD $(pkg-config --cflags libzstd)" || true)
+ZSTD_LIBS=$(pkg-config --libs libzstd 2>/dev/null || true)
+
 gcc -c client.c -o client.o -Iinclude -Ideps/blake3 -Wall -Wextra $(pkg-config --cflags libmongoc-1.0)
 gcc -c ../db/mongo_ops.c -o mongo_ops.o -Iinclude -Ideps/blake3 -Wall -Wextra $(pkg-config --cflags libmongoc-1.0)
 gcc -c ../utils/utils.c -o utils.o -Iinclude -Ideps/blake3 -Wall -Wextra
 gcc -c ../crypto/aes_gcm.c -o aes_gcm.o -Iinclude -Ideps/blake3 -Wall -Wextra
+gcc -c ../common/fastcdc.c -o fastcdc.o -Wall -Wextra
+gcc -c ../common/chunk_compress.c -o chunk_compress.o -Wall -Wextra $ZSTD_CFLAGS
+gcc -c ../common/tls_session.c -o tls_session.o -Wall -Wextra
 
 BLAKE3_DIR=../../deps/blake3
 # Компилируем BLAKE3 без AVX512
@@ -36,7 +43,7 @@ gcc -c $BLAKE3_DIR/blake3_sse41.c -o blake3_sse41.o -I$BLAKE3_DIR -Wall -Wextra
 gcc -c $BLAKE3_DIR/blake3_avx2.c -o blake3_avx2.o -I$BLAKE3_DIR -Wall -Wextra -mavx2
 
 # НЕ компилируем blake3_avx512.c
-gcc -o client client.o mongo_ops.o utils.o aes_gcm.o \
+gcc -o client client.o mongo_ops.o utils.o aes_gcm.o fastcdc.o chunk_compress.o tls_session.o \
     blake3.o blake3_dispatch.o blake3_portable.o \
     blake3_sse2.o blake3_sse41.o blake3_avx2.o \
-    $(pkg-config --libs libmongoc-1.0) -lssl -lcrypto -lpthread
\ No newline at end of file
+    $(pkg-config --libs libmongoc-1.0) $ZSTD_LIBS -lssl -lcrypto -lpthread -lm
\ No newline at end of file
@@ -14,6 +14,7 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <time.h>
 #include <errno.h>
@@ -28,6 +29,9 @@
 
 // только для клиента
 #include "../../include/client.h"
+#include "../common/fastcdc.h"
+#include "../common/chunk_compress.h"
+#include "../common/tls_session.h"
 
 #define BLAKE3_IMPLEMENTATION
 #include "blake3.h"
@@ -39,6 +43,9 @@
 #define FILENAME_MAX_LEN 256                 // Максимальная длина имени файла
 #define BAR_LENGTH 20                        // Длина прогресс-бара
 #define FINGERPRINT_LEN 65                   // Длина отпечатка (64 hex + '\0')
+#define MAX_STREAMS 16                       // Предел --streams
+#define MIN_RANGE_SIZE (1024 * 1024)         // Меньшие диапазоны скачивания не дробятся дальше
+#define RANGE_BUFFER_SIZE (64 * 1024)        // Буфер приёма одного потока скачивания
 
 // Глобальная структура для хранения информации о сессии
 typedef struct {
@@ -79,6 +86,18 @@ void display_progress(float progress);
 
 static volatile sig_atomic_t g_shutdown = 0;
 
+// Параллельная передача: число соединений на одну передачу (--streams) и адрес
+// сервера для дополнительных соединений
+static int g_streams = 1;
+static char g_server_ip[16] = "127.0.0.1";
+static int g_server_port = DEFAULT_PORT;
+
+// --compress: просить сервер принимать чанки, сжатые zstd
+static int g_compress = 0;
+
+// --tls-cache: файл, в котором сессия TLS переживает запуск клиента
+static const char *g_tls_cache_path = NULL;
+
 static volatile sig_atomic_t g_command_loop_running = 0;
 
 /*
@@ -114,6 +133,10 @@ static SSL_CTX *init_client_ssl_ctx(void) {
     
     // Настройка обязательной проверки сертификата сервера
     SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+
+    // Повторные подключения (переподключение, --streams, следующий запуск с --tls-cache)
+    // возобновляют сессию вместо полного рукопожатия
+    tls_session_client_init(ctx, g_tls_cache_path);
     
     return ctx;
 }
@@ -270,6 +293,400 @@ int is_connected() {
     return connected;
 }
 
+/*
+ * Открытие дополнительного соединения для параллельной передачи
+ * CMD_CONNECT не отправляется: сервер без администратора принимает по такому
+ * соединению одну команду, продолжающую передачу основного соединения с тем же
+ * сертификатом (CMD_UPLOAD_PART с токеном или диапазон скачиваемого файла)
+ * Возвращает SSL-соединение или NULL при ошибке
+ */
+static SSL *open_stream(SSL_CTX *ctx) {
+    struct sockaddr_in serv_addr;
+    memset(&serv_addr, 0, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_port = htons(g_server_port);
+    if (inet_pton(AF_INET, g_server_ip, &serv_addr.sin_addr) <= 0) return NULL;
+
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) return NULL;
+    if (connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
+        close(sock);
+        return NULL;
+    }
+
+    SSL *ssl = SSL_new(ctx);
+    if (!ssl) {
+        close(sock);
+        return NULL;
+    }
+    SSL_set_fd(ssl, sock);
+    tls_session_client_prepare(ssl);
+
+    if (SSL_connect(ssl) <= 0) {
+        SSL_free(ssl);
+        close(sock);
+        return NULL;
+    }
+    tls_session_count(ssl);
+    return ssl;
+}
+
+static void close_stream(SSL *ssl) {
+    int sock = SSL_get_fd(ssl);
+    SSL_shutdown(ssl);
+    SSL_free(ssl);
+    close(sock);
+}
+
+/*
+ * Разбиение файла на чанки по содержимому (FastCDC) с BLAKE3-хешем каждого чанка
+ * Файл читается потоково, в памяти держится не больше двух максимальных чанков
+ * Возвращает 0 при успехе (манифест в *out, освобождается вызывающим), -1 при ошибке
+ */
+static int build_chunk_manifest(FILE *fp, ChunkRef **out, uint32_t *out_count) {
+    const size_t window = FASTCDC_MAX_SIZE * 2;
+    uint8_t *buf = malloc(window);
+    size_t cap = 256;
+    ChunkRef *chunks = malloc(cap * sizeof(ChunkRef));
+    uint32_t count = 0;
+    size_t have = 0;
+    int eof = 0;
+
+    if (!buf || !chunks) goto fail;
+
+    for (;;) {
+        // Пока файл не кончился, в буфере должно быть не меньше максимального чанка
+        while (!eof && have < window) {
+            size_t n = fread(buf + have, 1, window - have, fp);
+            if (n == 0) {
+                if (ferror(fp)) goto fail;
+                eof = 1;
+            }
+            have += n;
+        }
+        if (have == 0) break;
+
+        if (count == CHUNKED_UPLOAD_MAX_CHUNKS) goto fail;
+        if (count == cap) {
+            ChunkRef *grown = realloc(chunks, cap * 2 * sizeof(ChunkRef));
+            if (!grown) goto fail;
+            chunks = grown;
+            cap *= 2;
+        }
+
+        size_t cut = fastcdc_cut(buf, have);
+        blake3_hasher hasher;
+        blake3_hasher_init(&hasher);
+        blake3_hasher_update(&hasher, buf, cut);
+        blake3_hasher_finalize(&hasher, chunks[count].id, BLAKE3_HASH_LEN);
+        chunks[count].len = (uint32_t)cut;
+        count++;
+
+        memmove(buf, buf + cut, have - cut);
+        have -= cut;
+    }
+
+    free(buf);
+    *out = chunks;
+    *out_count = count;
+    return 0;
+
+fail:
+    free(buf);
+    free(chunks);
+    return -1;
+}
+
+// Часть параллельной загрузки, которую отправляет одно соединение
+typedef struct {
+    SSL *ssl;                    // Основное соединение; NULL — поток открывает своё
+    SSL_CTX *ctx;
+    int fd;                      // Загружаемый файл (читается через pread)
+    const ChunkRef *chunks;
+    const long long *offsets;    // Смещение каждого чанка в файле
+    const uint32_t *indices;     // Номера чанков этого соединения
+    uint32_t n;
+    const RequestHeader *header;
+    const uint8_t *token;        // Токен загрузки от сервера
+    long long *sent;             // Общий счётчик отправленных байт (до сжатия)
+    long long *wire;             // Общий счётчик байт на проводе
+    long long to_send;           // Больше нуля — выводить прогресс
+    int rc;
+} upload_stream_job_t;
+
+/*
+ * Чтение чанка из файла по смещению (pread: позиция FILE не меняется)
+ * Возвращает 0 при успехе, -1 при ошибке
+ */
+static int read_chunk(int fd, uint8_t *buf, size_t len, off_t offset) {
+    size_t got = 0;
+    while (got < len) {
+        ssize_t r = pread(fd, buf + got, len - got, offset + (off_t)got);
+        if (r <= 0) {
+            if (r < 0 && errno == EINTR) continue;
+            fprintf(stderr, "Ошибка чтения локального файла: файл изменился во время загрузки?\n");
+            return -1;
+        }
+        got += (size_t)r;
+    }
+    return 0;
+}
+
+/*
+ * Отправка содержимого чанка. Если сервер согласился на сжатие (REQ_FLAG_COMPRESS
+ * в заголовке), сначала идёт uint32_t длина на проводе, затем кадр zstd или сам чанк,
+ * когда сжимать нечего (см. chunk_compress). packed — буфер не меньше len
+ * Возвращает число отправленных байт чанка или -1 при ошибке
+ */
+static long long send_chunk(SSL *ssl, const RequestHeader *header, const uint8_t *data, uint32_t len, uint8_t *packed) {
+    if (!(header->flags & REQ_FLAG_COMPRESS)) {
+        return ssl_send_all(ssl, data, len) == 0 ? (long long)len : -1;
+    }
+
+    size_t n = chunk_compress(data, len, packed, len);
+    uint32_t wire_len = n > 0 ? (uint32_t)n : len;
+    if (ssl_send_all(ssl, &wire_len, sizeof(wire_len)) == -1 ||
+        ssl_send_all(ssl, n > 0 ? packed : data, wire_len) == -1) {
+        return -1;
+    }
+    return (long long)wire_len;
+}
+
+/*
+ * Отправка частей параллельной загрузки: номер чанка, затем его содержимое,
+ * в конце CHUNKED_UPLOAD_PART_END
+ * Возвращает 0 при успехе, -1 при ошибке
+ */
+static int send_parts(SSL *ssl, const upload_stream_job_t *job) {
+    uint8_t *buf = malloc(2 * FASTCDC_MAX_SIZE);
+    if (!buf) return -1;
+    uint8_t *packed = buf + FASTCDC_MAX_SIZE;
+
+    for (uint32_t k = 0; k < job->n; k++) {
+        uint32_t idx = job->indices[k];
+        uint32_t len = job->chunks[idx].len;
+        long long wire = -1;
+        if (read_chunk(job->fd, buf, len, job->offsets[idx]) == 0 &&
+            ssl_send_all(ssl, &idx, sizeof(idx)) == 0) {
+            wire = send_chunk(ssl, job->header, buf, len, packed);
+        }
+        if (wire < 0) {
+            free(buf);
+            return -1;
+        }
+        __atomic_add_fetch(job->wire, wire, __ATOMIC_RELAXED);
+        long long total = __atomic_add_fetch(job->sent, (long long)len, __ATOMIC_RELAXED);
+        if (job->to_send > 0) display_progress((float)total / (float)job->to_send);
+    }
+    free(buf);
+
+    uint32_t end = CHUNKED_UPLOAD_PART_END;
+    return ssl_send_all(ssl, &end, sizeof(end));
+}
+
+// Поток дополнительного соединения параллельной загрузки
+static void *upload_stream_thread(void *arg) {
+    upload_stream_job_t *job = arg;
+    job->rc = -1;
+
+    SSL *ssl = open_stream(job->ctx);
+    if (!ssl) {
+        fprintf(stderr, "Не удалось открыть дополнительное соединение для загрузки.\n");
+        return NULL;
+    }
+
+    RequestHeader part;
+    ResponseHeader resp;
+    memset(&part, 0, sizeof(part));
+    part.command = CMD_UPLOAD_PART;
+    memcpy(part.filename, job->header->filename, FILENAME_MAX_LEN);
+    memcpy(part.file_hash, job->token, BLAKE3_HASH_LEN);
+
+    if (ssl_send_all(ssl, &part, sizeof(part)) == 0 &&
+        ssl_recv_all(ssl, &resp, sizeof(resp)) == 0 && resp.status == RESP_SUCCESS &&
+        send_parts(ssl, job) == 0 &&
+        ssl_recv_all(ssl, &resp, sizeof(resp)) == 0 && resp.status == RESP_SUCCESS) {
+        job->rc = 0;
+    }
+    close_stream(ssl);
+    return NULL;
+}
+
+/*
+ * Параллельная отправка запрошенных чанков по g_streams соединениям
+ * Чанки делятся на непрерывные группы примерно равного объёма; первая идёт по
+ * основному соединению, остальные — по дополнительным
+ * Возвращает 0 при успехе, -1 при ошибке основного соединения
+ */
+static int upload_parts_parallel(SSL *ssl, int fd, const ChunkRef *chunks, uint32_t count, const uint8_t *need,
+                                 const uint8_t *token, const RequestHeader *header, long long to_send,
+                                 long long *sent, long long *wire) {
+    long long *offsets = malloc(count * sizeof(long long));
+    uint32_t *indices = malloc(count * sizeof(uint32_t));
+    upload_stream_job_t jobs[MAX_STREAMS];
+    pthread_t threads[MAX_STREAMS];
+    int started[MAX_STREAMS] = {0};
+    int rc = -1;
+
+    if (!offsets || !indices) goto out;
+
+    uint32_t n = 0;
+    long long offset = 0;
+    for (uint32_t i = 0; i < count; offset += chunks[i].len, i++) {
+        offsets[i] = offset;
+        if (need[i / 8] & (1u << (i % 8))) indices[n++] = i;
+    }
+
+    // Границы групп: группа k заканчивается, когда набрано (k + 1) / streams байт
+    int streams = g_streams;
+    uint32_t start = 0;
+    long long acc = 0;
+    for (int k = 0; k < streams; k++) {
+        uint32_t end = start;
+        long long goal = to_send * (k + 1) / streams;
+        while (end < n && (acc < goal || k == streams - 1)) {
+            acc += chunks[indices[end]].len;
+            end++;
+        }
+        jobs[k] = (upload_stream_job_t) {
+            .ssl = k == 0 ? ssl : NULL, .ctx = SSL_get_SSL_CTX(ssl), .fd = fd,
+            .chunks = chunks, .offsets = offsets, .indices = indices + start, .n = end - start,
+            .header = header, .token = token, .sent = sent, .wire = wire,
+            .to_send = k == 0 ? to_send : 0, .rc = 0
+        };
+        start = end;
+    }
+
+    for (int k = 1; k < streams; k++) {
+        if (jobs[k].n == 0) continue;
+        if (pthread_create(&threads[k], NULL, upload_stream_thread, &jobs[k]) == 0) {
+            started[k] = 1;
+        } else {
+            jobs[k].rc = -1;
+        }
+    }
+
+    rc = send_parts(ssl, &jobs[0]);
+
+    for (int k = 1; k < streams; k++) {
+        if (started[k]) pthread_join(threads[k], NULL);
+        if (jobs[k].rc != 0) {
+            fprintf(stderr, "\nДополнительное соединение %d не смогло передать свои чанки.\n", k);
+        }
+    }
+
+out:
+    free(indices);
+    free(offsets);
+    return rc;
+}
+
+/*
+ * Чанковая загрузка (CMD_UPLOAD_CHUNKED): отправляет манифест чанков, затем только те
+ * чанки, которых нет на сервере. Заголовок уже заполнен вызывающим
+ * С --streams больше 1 чанки идут параллельно по нескольким соединениям
+ * Возвращает 0 при успехе, -1 при ошибке
+ */
+static int upload_chunks_ssl(SSL *ssl, FILE *fp, RequestHeader *header) {
+    ChunkRef *chunks = NULL;
+    uint32_t count = 0;
+    uint8_t *need = NULL;
+    uint8_t *buf = NULL;
+    ResponseHeader response;
+    int rc = -1;
+
+    if (build_chunk_manifest(fp, &chunks, &count) != 0) {
+        fprintf(stderr, "Ошибка: Не удалось разбить файл на чанки.\n");
+        return -1;
+    }
+
+    header->command = CMD_UPLOAD_CHUNKED;
+    if (g_streams > 1) header->flags |= REQ_FLAG_PARALLEL;
+    if (g_compress && chunk_compress_available()) header->flags |= REQ_FLAG_COMPRESS;
+    if (ssl_send_all(ssl, header, sizeof(RequestHeader)) == -1 ||
+        ssl_recv_all(ssl, &response, sizeof(ResponseHeader)) == -1) {
+        goto out;
+    }
+    if (response.status != RESP_SUCCESS) {
+        fprintf(stderr, "Сервер отклонил загрузку: Статус %d\n", response.status);
+        goto out;
+    }
+    // Сервер без zstd (или старый) отвечает filesize = 0: чанки идут несжатыми
+    if ((header->flags & REQ_FLAG_COMPRESS) && response.filesize != CHUNKED_UPLOAD_COMPRESSED) {
+        header->flags &= (uint8_t)~REQ_FLAG_COMPRESS;
+        printf("Сервер не поддерживает сжатие, чанки будут отправлены как есть.\n");
+    }
+
+    // Манифест: число чанков и ссылки на них по порядку
+    if (ssl_send_all(ssl, &count, sizeof(count)) == -1 ||
+        ssl_send_all(ssl, chunks, count * sizeof(ChunkRef)) == -1 ||
+        ssl_recv_all(ssl, &response, sizeof(ResponseHeader)) == -1) {
+        goto out;
+    }
+    if (response.status != RESP_SUCCESS) {
+        fprintf(stderr, "Сервер отклонил манифест: Статус %d\n", response.status);
+        goto out;
+    }
+
+    // Битовая карта чанков, которые сервер просит прислать
+    need = malloc((count + 7) / 8);
+    if (!need || ssl_recv_all(ssl, need, (count + 7) / 8) == -1) {
+        goto out;
+    }
+
+    long long to_send = response.filesize;
+    printf("Чанков: %u, к передаче %lld из %lld байт. Отправка данных...\n", count, to_send, header->filesize);
+
+    long long total_sent = 0;
+    long long wire_sent = 0;
+    if (header->flags & REQ_FLAG_PARALLEL) {
+        uint8_t token[BLAKE3_HASH_LEN];
+        if (ssl_recv_all(ssl, token, sizeof(token)) == -1 ||
+            upload_parts_parallel(ssl, fileno(fp), chunks, count, need, token, header, to_send,
+                                  &total_sent, &wire_sent) != 0) {
+            goto out;
+        }
+    } else {
+        buf = malloc(2 * FASTCDC_MAX_SIZE);
+        if (!buf) goto out;
+
+        long long offset = 0;
+        for (uint32_t i = 0; i < count; offset += chunks[i].len, i++) {
+            if (!(need[i / 8] & (1u << (i % 8)))) continue;
+
+            if (read_chunk(fileno(fp), buf, chunks[i].len, offset) != 0) goto out;
+            long long wire = send_chunk(ssl, header, buf, chunks[i].len, buf + FASTCDC_MAX_SIZE);
+            if (wire < 0) {
+                fprintf(stderr, "Не удалось отправить данные файла.\n");
+                goto out;
+            }
+            total_sent += chunks[i].len;
+            wire_sent += wire;
+            display_progress(to_send > 0 ? (float)total_sent / (float)to_send : 1.0f);
+        }
+    }
+
+    // Получение финального статуса от сервера
+    if (ssl_recv_all(ssl, &response, sizeof(ResponseHeader)) == -1) {
+        goto out;
+    }
+    if (response.status == RESP_SUCCESS) {
+        printf("\nЗагрузка успешно завершена! Передано %lld байт из %lld.\n", total_sent, header->filesize);
+        if (header->flags & REQ_FLAG_COMPRESS) {
+            printf("Со сжатием на проводе: %lld байт.\n", wire_sent);
+        }
+        rc = 0;
+    } else {
+        fprintf(stderr, "\nЗагрузка не удалась на сервере: Статус %d\n", response.status);
+    }
+
+out:
+    free(buf);
+    free(need);
+    free(chunks);
+    return rc;
+}
+
 /*
  * Загрузка файла на сервер через защищенное SSL-соединение
  * Выполняет проверку целостности данных с помощью BLAKE3 хеша
@@ -300,6 +717,7 @@ static int upload_file_ssl(SSL *ssl, const char *local_filepath, const char *rem
     }
     
     // Подготовка заголовка запроса на загрузку
+    memset(&header, 0, sizeof(header));
     header.command = CMD_UPLOAD;
     strncpy(header.filename, remote_filename, FILENAME_MAX_LEN - 1);
     header.filename[FILENAME_MAX_LEN - 1] = '\0';
@@ -322,29 +740,66 @@ static int upload_file_ssl(SSL *ssl, const char *local_filepath, const char *rem
     }
     
     printf("Загрузка '%s' (%lld байт) как '%s'...\n", local_filepath, filesize, remote_filename);
-    
-    // Отправка заголовка запроса
-    if (ssl_send_all(ssl, &header, sizeof(RequestHeader)) == -1) {
+
+    // Файлы больше одного чанка загружаются по чанкам: новые версии больших файлов
+    // передают только изменившиеся части
+    if (filesize > FASTCDC_MAX_SIZE) {
+        int rc = upload_chunks_ssl(ssl, fp, &header);
         fclose(fp);
-        return -1;
+        return rc;
     }
     
-    // Ожидание подтверждения готовности сервера
-    if (ssl_recv_all(ssl, &response, sizeof(ResponseHeader)) == -1) {
+    // Прошлая попытка могла оборваться: сервер хранит принятую часть и говорит, сколько байт
+    // у него уже есть. Старый сервер ответит RESP_UNKNOWN_COMMAND — тогда с начала.
+    header.command = CMD_UPLOAD_STATUS;
+    if (ssl_send_all(ssl, &header, sizeof(RequestHeader)) == -1 ||
+        ssl_recv_all(ssl, &response, sizeof(ResponseHeader)) == -1) {
         fclose(fp);
         return -1;
     }
+    header.command = CMD_UPLOAD;
+    if (response.status == RESP_SUCCESS && response.filesize > 0 && response.filesize < filesize) {
+        header.offset = response.filesize;
+    }
+
+    // Отправка заголовка запроса и ожидание подтверждения готовности сервера.
+    // Если точка возобновления успела пропасть, загрузка начинается сначала.
+    for (;;) {
+        if (ssl_send_all(ssl, &header, sizeof(RequestHeader)) == -1 ||
+            ssl_recv_all(ssl, &response, sizeof(ResponseHeader)) == -1) {
+            fclose(fp);
+            return -1;
+        }
+        if (response.status != RESP_INVALID_OFFSET || header.offset == 0) break;
+        header.offset = 0;
+    }
     
+    // Сервер уже хранит файл с таким хешем: имя привязано без передачи данных
+    if (response.status == RESP_ALREADY_STORED) {
+        printf("Файл с таким содержимым уже есть на сервере — загрузка завершена без передачи данных.\n");
+        fclose(fp);
+        return 0;
+    }
+
     if (response.status != RESP_SUCCESS) {
         fprintf(stderr, "Сервер отклонил загрузку: Статус %d\n", response.status);
         fclose(fp);
         return -1;
     }
     
-    printf("Сервер готов к приёму файла. Отправка данных...\n");
+    if (header.offset > 0) {
+        printf("Сервер уже принял %lld байт, продолжаем с этого места...\n", (long long)header.offset);
+        if (fseeko(fp, header.offset, SEEK_SET) != 0) {
+            perror("fseeko");
+            fclose(fp);
+            return -1;
+        }
+    } else {
+        printf("Сервер готов к приёму файла. Отправка данных...\n");
+    }
     
     // Отправка содержимого файла с отображением прогресса
-    long long total_sent = 0;
+    long long total_sent = header.offset;
     ssize_t bytes_read;
     while ((bytes_read = fread(buffer, 1, BUFFER_SIZE, fp)) > 0) {
         if (ssl_send_all(ssl, buffer, bytes_read) == -1) {
@@ -368,7 +823,7 @@ static int upload_file_ssl(SSL *ssl, const char *local_filepath, const char *rem
         return -1;
     }
     
-    printf("Данные файла отправлены. Всего: %lld байт.\n", total_sent);
+    printf("Данные файла отправлены. Всего: %lld байт.\n", total_sent - (long long)header.offset);
     
     // Получение финального статуса от сервера
     if (ssl_recv_all(ssl, &response, sizeof(ResponseHeader)) == -1) {
@@ -420,6 +875,167 @@ int compute_file_blake3(const char *filepath, uint8_t out_hash[BLAKE3_HASH_LEN])
     return 0;
 }
 
+/*
+ * Скачивание диапазона [start, start + len) в fd с проверкой BLAKE3 диапазона
+ * len == 0 — только узнать размер файла (*filesize)
+ * Возвращает 0 при успехе, -1 при ошибке
+ */
+static int download_range(SSL *ssl, const char *remote_filename, int fd, long long start, long long len,
+                          long long *filesize, long long *received, long long total) {
+    RequestHeader header;
+    ResponseHeader response;
+    memset(&header, 0, sizeof(header));
+    header.command = CMD_DOWNLOAD;
+    strncpy(header.filename, remote_filename, FILENAME_MAX_LEN - 1);
+    header.offset = start;
+    header.filesize = len;
+    header.flags = REQ_FLAG_RANGE;
+
+    if (ssl_send_all(ssl, &header, sizeof(header)) == -1 ||
+        ssl_recv_all(ssl, &response, sizeof(response)) == -1) {
+        return -1;
+    }
+    if (response.status != RESP_SUCCESS) {
+        fprintf(stderr, "Сервер отклонил запрос диапазона: Статус %d\n", response.status);
+        return -1;
+    }
+    if (filesize) *filesize = response.filesize;
+
+    uint8_t *buf = malloc(RANGE_BUFFER_SIZE);
+    if (!buf) return -1;
+
+    blake3_hasher hasher;
+    blake3_hasher_init(&hasher);
+    long long done = 0;
+    while (done < len) {
+        size_t want = len - done < RANGE_BUFFER_SIZE ? (size_t)(len - done) : RANGE_BUFFER_SIZE;
+        int n = SSL_read(ssl, buf, (int)want);
+        if (n <= 0) {
+            free(buf);
+            return -1;
+        }
+        for (int w = 0; w < n; ) {
+            ssize_t r = pwrite(fd, buf + w, (size_t)(n - w), start + done + w);
+            if (r < 0) {
+                if (errno == EINTR) continue;
+                perror("pwrite");
+                free(buf);
+                return -1;
+            }
+            w += (int)r;
+        }
+        blake3_hasher_update(&hasher, buf, (size_t)n);
+        done += n;
+
+        long long all = __atomic_add_fetch(received, (long long)n, __ATOMIC_RELAXED);
+        if (total > 0) display_progress((float)all / (float)total);
+    }
+    free(buf);
+
+    uint8_t expected[BLAKE3_HASH_LEN], actual[BLAKE3_HASH_LEN];
+    if (ssl_recv_all(ssl, expected, sizeof(expected)) == -1) return -1;
+    blake3_hasher_finalize(&hasher, actual, BLAKE3_HASH_LEN);
+    if (memcmp(expected, actual, BLAKE3_HASH_LEN) != 0) {
+        fprintf(stderr, "BLAKE3 диапазона %lld+%lld не совпал с присланным сервером.\n", start, len);
+        return -1;
+    }
+    return 0;
+}
+
+// Диапазон параллельного скачивания для одного соединения
+typedef struct {
+    SSL *ssl;                    // Основное соединение; NULL — поток открывает своё
+    SSL_CTX *ctx;
+    const char *remote_filename;
+    int fd;
+    long long start;
+    long long len;
+    long long *received;         // Общий счётчик принятых байт
+    long long total;             // Больше нуля — выводить прогресс
+    int rc;
+} download_stream_job_t;
+
+static void *download_stream_thread(void *arg) {
+    download_stream_job_t *job = arg;
+    job->rc = -1;
+
+    SSL *ssl = open_stream(job->ctx);
+    if (!ssl) {
+        fprintf(stderr, "Не удалось открыть дополнительное соединение для скачивания.\n");
+        return NULL;
+    }
+    job->rc = download_range(ssl, job->remote_filename, job->fd, job->start, job->len, NULL, job->received, 0);
+    close_stream(ssl);
+    return NULL;
+}
+
+/*
+ * Параллельное скачивание: размер файла узнаётся пустым диапазоном, затем файл
+ * делится на g_streams диапазонов (не меньше MIN_RANGE_SIZE), первый идёт по основному
+ * соединению, остальные — по дополнительным. Каждый диапазон проверяется BLAKE3
+ * Возвращает 0 при успехе, -1 при ошибке
+ */
+static int download_file_parallel(SSL *ssl, const char *remote_filename, const char *local_filepath) {
+    long long filesize = 0;
+    long long received = 0;
+    if (download_range(ssl, remote_filename, -1, 0, 0, &filesize, &received, 0) != 0) {
+        return -1;
+    }
+    if (filesize <= 0) {
+        fprintf(stderr, "Сервер сообщил о недопустимом размере файла (%lld) для скачивания.\n", filesize);
+        return -1;
+    }
+
+    int fd = open(local_filepath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1 || ftruncate(fd, filesize) != 0) {
+        perror("open");
+        fprintf(stderr, "Ошибка: Не удалось открыть файл %s для записи.\n", local_filepath);
+        if (fd != -1) close(fd);
+        return -1;
+    }
+
+    int streams = g_streams;
+    if ((filesize + MIN_RANGE_SIZE - 1) / MIN_RANGE_SIZE < streams) {
+        streams = (int)((filesize + MIN_RANGE_SIZE - 1) / MIN_RANGE_SIZE);
+    }
+    printf("Скачивание '%s' (%lld байт) по %d соединениям...\n", remote_filename, filesize, streams);
+
+    download_stream_job_t jobs[MAX_STREAMS];
+    pthread_t threads[MAX_STREAMS];
+    int started[MAX_STREAMS] = {0};
+    for (int k = 0; k < streams; k++) {
+        long long start = filesize * k / streams;
+        long long end = filesize * (k + 1) / streams;
+        jobs[k] = (download_stream_job_t) {
+            .ssl = k == 0 ? ssl : NULL, .ctx = SSL_get_SSL_CTX(ssl), .remote_filename = remote_filename,
+            .fd = fd, .start = start, .len = end - start, .received = &received,
+            .total = k == 0 ? filesize : 0, .rc = 0
+        };
+    }
+    for (int k = 1; k < streams; k++) {
+        if (pthread_create(&threads[k], NULL, download_stream_thread, &jobs[k]) == 0) {
+            started[k] = 1;
+        } else {
+            jobs[k].rc = -1;
+        }
+    }
+
+    int rc = download_range(ssl, remote_filename, fd, jobs[0].start, jobs[0].len, NULL, &received, filesize);
+    for (int k = 1; k < streams; k++) {
+        if (started[k]) pthread_join(threads[k], NULL);
+        if (jobs[k].rc != 0) {
+            fprintf(stderr, "\nДиапазон %d (%lld+%lld) не скачан.\n", k, jobs[k].start, jobs[k].len);
+            rc = -1;
+        }
+    }
+
+    if (close(fd) != 0) rc = -1;
+    if (rc == 0) {
+        printf("Скачивание успешно завершено! Сохранено в '%s'. Всего: %lld байт.\n", local_filepath, received);
+    }
+    return rc;
+}
+
 /*
  * Скачивание файла с сервера через защищенное SSL-соединение
  * Отображает прогресс загрузки
@@ -430,8 +1046,13 @@ static int download_file_ssl(SSL *ssl, const char *remote_filename, const char *
     char buffer[BUFFER_SIZE];
     RequestHeader header;
     ResponseHeader response;
+
+    if (g_streams > 1) {
+        return download_file_parallel(ssl, remote_filename, local_filepath);
+    }
     
     // Подготовка заголовка запроса на скачивание
+    memset(&header, 0, sizeof(header));
     header.command = CMD_DOWNLOAD;
     strncpy(header.filename, remote_filename, FILENAME_MAX_LEN - 1);
     header.filename[FILENAME_MAX_LEN - 1] = '\0';
@@ -538,18 +1159,89 @@ void display_progress(float progress) {
     printf("%s", output);  // Вывод прогресс-бара
 }
 
+// Токен следующей страницы LIST (см. REQ_FLAG_PAGED) и есть ли она
+static uint8_t g_list_token[BLAKE3_HASH_LEN];
+static int g_list_has_more = 0;
+
 /*
- * Запрос списка файлов с сервера
+ * Вывод списка целиком (сервер без постраничного LIST присылает JSON)
  * Возвращает 0 при успехе, -1 при ошибке
  */
-static int list_files_ssl(SSL *ssl) {
+static int list_print_blob(SSL *ssl, long long list_len) {
+    if (list_len <= 0) {
+        printf("На сервере нет файлов.\n");
+        return 0;
+    }
+    
+    printf("Список файлов с сервера (%lld байт):\n", list_len);
+    
+    // Прием и отображение списка файлов
+    long long total_received = 0;
+    char buffer[BUFFER_SIZE];
+    
+    while (total_received < list_len) {
+        size_t bytes_to_read = (list_len - total_received < BUFFER_SIZE) ?
+                              (size_t)(list_len - total_received) : BUFFER_SIZE;
+                              
+        int bytes_received = SSL_read(ssl, buffer, bytes_to_read);
+        if (bytes_received <= 0) {
+            perror("SSL_read");
+            return -1;
+        }
+
+        // Вывод полученных данных
+        fwrite(buffer, 1, bytes_received, stdout);
+        total_received += bytes_received;
+    }
+    
+    printf("\n");
+    return 0;
+}
+
+/*
+ * Вывод одной записи постраничного LIST
+ */
+static void list_print_entry(const ListEntry *entry, const char *name, const char *peer) {
+    char date[32] = "-";
+    time_t seconds = (time_t)(entry->uploaded_at / 1000);
+    struct tm tm;
+    if (entry->uploaded_at > 0 && localtime_r(&seconds, &tm)) {
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M", &tm);
+    }
+
+    // Отпечаток сокращаем до 16 символов: этого хватает, чтобы узнать собеседника
+    char who[64];
+    if (entry->flags & LIST_ENTRY_OWN) {
+        if (peer[0]) snprintf(who, sizeof(who), "мой -> %.16s", peer);
+        else snprintf(who, sizeof(who), "мой%s", (entry->flags & LIST_ENTRY_PUBLIC) ? ", публичный" : "");
+    } else {
+        snprintf(who, sizeof(who), "%sот %.16s", (entry->flags & LIST_ENTRY_PUBLIC) ? "публичный, " : "",
+                 peer[0] ? peer : "?");
+    }
+    printf("%-40s %14lld  %-16s  %s\n", name, (long long)entry->size, date, who);
+}
+
+/*
+ * Запрос страницы списка файлов с сервера: первой или, если next_page, следующей
+ * за прошлой. Записи выводятся по мере приёма.
+ * Возвращает 0 при успехе, -1 при ошибке
+ */
+static int list_files_ssl(SSL *ssl, int next_page) {
     RequestHeader header;
     ResponseHeader response;
+
+    if (next_page && !g_list_has_more) {
+        printf("Больше файлов нет. Список с начала: list\n");
+        return 0;
+    }
     
     // Подготовка заголовка запроса списка файлов
+    memset(&header, 0, sizeof(header));
     header.command = CMD_LIST;
-    header.filename[0] = '\0';
-    header.filesize = 0;
+    header.flags = REQ_FLAG_PAGED;
+    header.filesize = 0; // Размер страницы выбирает сервер (LIST_PAGE_DEFAULT)
+    if (next_page) memcpy(header.file_hash, g_list_token, BLAKE3_HASH_LEN);
+    g_list_has_more = 0;
     
     printf("Запрос списка файлов с сервера...\n");
     
@@ -563,39 +1255,63 @@ static int list_files_ssl(SSL *ssl) {
         return -1;
     }
     
+    if (response.status == RESP_INVALID_OFFSET) {
+        fprintf(stderr, "Сервер не принял продолжение списка. Список с начала: list\n");
+        return -1;
+    }
     if (response.status != RESP_SUCCESS) {
         fprintf(stderr, "Сервер отклонил запрос на получение списка: Статус %d\n", response.status);
         return -1;
     }
     
-    long long list_len = response.filesize;
-    if (list_len <= 0) {
-        printf("На сервере нет файлов.\n");
-        return 0;
+    if (response.filesize != LIST_STREAMED) {
+        return list_print_blob(ssl, response.filesize);
     }
-    
-    printf("Список файлов с сервера (%lld байт):\n", list_len);
-    
-    // Прием и отображение списка файлов
-    long long total_received = 0;
-    char buffer[BUFFER_SIZE];
-    
-    while (total_received < list_len) {
-        size_t bytes_to_read = (list_len - total_received < BUFFER_SIZE) ?
-                              (size_t)(list_len - total_received) : BUFFER_SIZE;
-                              
-        int bytes_received = SSL_read(ssl, buffer, bytes_to_read);
-        if (bytes_received <= 0) {
-            perror("SSL_read");
+
+    // Записи до завершающей (name_len = 0)
+    ListEntry entry;
+    char name[FILENAME_MAX_LEN];
+    char peer[UINT8_MAX + 1];
+    int printed = 0;
+    for (;;) {
+        if (ssl_recv_all(ssl, &entry, sizeof(entry)) == -1) {
+            return -1;
+        }
+        if (entry.name_len == 0) break;
+        if (entry.name_len >= FILENAME_MAX_LEN) {
+            fprintf(stderr, "Некорректная запись списка (имя %u байт)\n", (unsigned)entry.name_len);
+            return -1;
+        }
+        if (ssl_recv_all(ssl, name, entry.name_len) == -1 ||
+            (entry.peer_len && ssl_recv_all(ssl, peer, entry.peer_len) == -1)) {
             return -1;
         }
+        name[entry.name_len] = '\0';
+        peer[entry.peer_len] = '\0';
 
-        // Вывод полученных данных
-        fwrite(buffer, 1, bytes_received, stdout);
-        total_received += bytes_received;
+        if (!printed && !next_page) {
+            printf("%-40s %14s  %-16s  %s\n", "Имя", "Размер", "Загружен", "Чей");
+        }
+        list_print_entry(&entry, name, peer);
+        printed++;
+    }
+
+    if (entry.flags & LIST_END_MORE) {
+        if (ssl_recv_all(ssl, g_list_token, BLAKE3_HASH_LEN) == -1) {
+            return -1;
+        }
+        g_list_has_more = 1;
+    }
+
+    if (entry.flags & LIST_END_ERROR) {
+        fprintf(stderr, "Сервер прервал список из-за ошибки базы данных\n");
+        return -1;
+    }
+    if (printed == 0 && !next_page) {
+        printf("На сервере нет файлов.\n");
+    } else if (g_list_has_more) {
+        printf("Показано %d. Следующая страница: list more\n", printed);
     }
-    
-    printf("\n");
     return 0;
 }
 
@@ -664,14 +1380,14 @@ void *command_reader_thread(void* arg) {
                 printf("Error: Not connected or SSL session not ready.");
             }
         } else if (strcmp(cmd, "list") == 0) {
-            if (parsed_args != 1) {
-                printf("Usage: list");
+            if (parsed_args > 2 || (parsed_args == 2 && strcmp(arg1, "more") != 0)) {
+                printf("Usage: list [more]");
                 free(input);
                 continue;
             }
             SSL *current_ssl = get_current_ssl();
             if (current_ssl && is_connected()) {
-                int res = list_files_ssl(current_ssl);
+                int res = list_files_ssl(current_ssl, parsed_args == 2);
                 printf("List %s.", res == 0 ? "fetched" : "failed");
             } else {
                 printf("Error: Not connected or SSL session not ready.");
@@ -682,7 +1398,7 @@ void *command_reader_thread(void* arg) {
             reset_session(); // Сигнализируем основному потоку о завершении
             break;
         } else {
-            printf("Unknown command: %s. Available: upload, download, list, exit/quit", cmd);
+            printf("Unknown command: %s. Available: upload, download, list [more], exit/quit", cmd);
         }
         free(input);
     }
@@ -823,6 +1539,7 @@ static void *connection_thread(void* arg) {
         }
 
         SSL_set_fd(ssl, sock);
+        tls_session_client_prepare(ssl);
         if (SSL_connect(ssl) <= 0) {
             fprintf(stderr, "Не удалось выполнить SSL handshake с сервером в потоке");
             ERR_print_errors_fp(stderr);
@@ -832,7 +1549,8 @@ static void *connection_thread(void* arg) {
             continue;
         }
 
-        printf("Успешное подключение к серверу через SSL в потоке");
+        printf("Успешное подключение к серверу через SSL в потоке%s",
+               tls_session_count(ssl) ? " (сессия TLS возобновлена)" : "");
 
         X509 *client_cert = SSL_get_certificate(ssl);
         if (client_cert) {
@@ -940,10 +1658,13 @@ static void *connection_thread(void* arg) {
     struct option long_options[] = {
         {"ip",    required_argument, 0, 'i'},
         {"port",  required_argument, 0, 'p'},
+        {"streams", required_argument, 0, 's'},
+        {"compress", no_argument, 0, 'z'},
+        {"tls-cache", required_argument, 0, 'T'},
         {0, 0, 0, 0}
     };
 
-    while ((opt = getopt_long(argc, argv, "i:p:", long_options, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "i:p:s:zT:", long_options, NULL)) != -1) {
         switch (opt) {
             case 'i':
                 strncpy(server_ip, optarg, 15);
@@ -958,8 +1679,26 @@ static void *connection_thread(void* arg) {
                 }
                 port = (int)val;
                 break;
+            case 's':
+                errno = 0;
+                long streams = strtol(optarg, NULL, 10);
+                if (errno != 0 || streams < 1 || streams > MAX_STREAMS) {
+                    fprintf(stderr, "Ошибка: Неверное число потоков '%s'. Допустимо от 1 до %d.", optarg, MAX_STREAMS);
+                    return EXIT_FAILURE;
+                }
+                g_streams = (int)streams;
+                break;
+            case 'z':
+                if (!chunk_compress_available()) {
+                    fprintf(stderr, "Предупреждение: клиент собран без zstd, --compress не действует.\n");
+                }
+                g_compress = 1;
+                break;
+            case 'T':
+                g_tls_cache_path = optarg;
+                break;
             default:
-                fprintf(stderr, "Использование: %s [--ip <IP>] [--port <PORT>] <команда> [аргументы...]", argv[0]);
+                fprintf(stderr, "Использование: %s [--ip <IP>] [--port <PORT>] [--streams <N>] [--compress] [--tls-cache <файл>] <команда> [аргументы...]", argv[0]);
                 fprintf(stderr, "Команды:");
                 fprintf(stderr, "  connect - Подключиться и ждать подтверждения");
                 fprintf(stderr, "  upload <локальный_файл> <имя_на_сервере> [отпечаток_получателя]");
@@ -972,7 +1711,7 @@ static void *connection_thread(void* arg) {
     if (optind >= argc) {
         print_startup_logo();
         fprintf(stderr, "Ошибка: Не указана команда.");
-        fprintf(stderr, "Использование: %s [--ip <IP>] [--port <PORT>] <команда> [аргументы...]", argv[0]);
+        fprintf(stderr, "Использование: %s [--ip <IP>] [--port <PORT>] [--streams <N>] [--compress] [--tls-cache <файл>] <команда> [аргументы...]", argv[0]);
         fprintf(stderr, "Команды:");
         fprintf(stderr, "  connect - Подключиться и ждать подтверждения");
         fprintf(stderr, "  upload <локальный_файл> <имя_на_сервере> [отпечаток_получателя]");
@@ -999,6 +1738,8 @@ static void *connection_thread(void* arg) {
         thread_args->port = port;
         strncpy(thread_args->ip, server_ip, 15);
         thread_args->ip[15] = '\0';
+        g_server_port = port;
+        snprintf(g_server_ip, sizeof(g_server_ip), "%s", server_ip);
 
         pthread_t conn_thread;
         if (pthread_create(&conn_thread, NULL, connection_thread, thread_args) != 0) {
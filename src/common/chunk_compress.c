@@ -0,0 +1,135 @@
+#include "chunk_compress.h"
+
+#include <math.h>
+
+#ifdef HAVE_ZSTD
+#include <pthread.h>
+#include <stdlib.h>
+#include <zstd.h>
+#endif
+
+#define CHUNK_ENTROPY_WINDOWS 16 // Samples are spread so a text header does not hide binary content
+
+double chunk_entropy(const uint8_t *data, size_t len) {
+    if (len == 0) return 0.0;
+
+    uint32_t hist[256] = {0};
+    size_t total = 0;
+    if (len <= CHUNK_ENTROPY_SAMPLE) {
+        for (size_t i = 0; i < len; i++) hist[data[i]]++;
+        total = len;
+    } else {
+        const size_t window = CHUNK_ENTROPY_SAMPLE / CHUNK_ENTROPY_WINDOWS;
+        const size_t stride = (len - window) / (CHUNK_ENTROPY_WINDOWS - 1);
+        for (size_t w = 0; w < CHUNK_ENTROPY_WINDOWS; w++) {
+            const uint8_t *p = data + w * stride;
+            for (size_t i = 0; i < window; i++) hist[p[i]]++;
+        }
+        total = window * CHUNK_ENTROPY_WINDOWS;
+    }
+
+    double bits = 0.0;
+    for (int b = 0; b < 256; b++) {
+        if (hist[b] == 0) continue;
+        double p = (double)hist[b] / (double)total;
+        bits -= p * log2(p);
+    }
+    return bits;
+}
+
+bool chunk_compressible(const uint8_t *data, size_t len) {
+    return len >= CHUNK_COMPRESS_MIN_SIZE && chunk_entropy(data, len) < CHUNK_ENTROPY_LIMIT;
+}
+
+#ifdef HAVE_ZSTD
+
+// One compression and one decompression context per thread, created on first
+// use: contexts are expensive to set up and not safe to share
+typedef struct {
+    ZSTD_CCtx *cctx;
+    ZSTD_DCtx *dctx;
+} zstd_contexts_t;
+
+static pthread_key_t g_contexts_key;
+static pthread_once_t g_contexts_once = PTHREAD_ONCE_INIT;
+
+static void contexts_free(void *arg) {
+    zstd_contexts_t *ctx = arg;
+    ZSTD_freeCCtx(ctx->cctx);
+    ZSTD_freeDCtx(ctx->dctx);
+    free(ctx);
+}
+
+static void contexts_key_init(void) {
+    pthread_key_create(&g_contexts_key, contexts_free);
+}
+
+static zstd_contexts_t *thread_contexts(void) {
+    pthread_once(&g_contexts_once, contexts_key_init);
+    zstd_contexts_t *ctx = pthread_getspecific(g_contexts_key);
+    if (ctx) return ctx;
+
+    ctx = calloc(1, sizeof(*ctx));
+    if (!ctx) return NULL;
+    ctx->cctx = ZSTD_createCCtx();
+    ctx->dctx = ZSTD_createDCtx();
+    if (!ctx->cctx || !ctx->dctx || pthread_setspecific(g_contexts_key, ctx) != 0) {
+        contexts_free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+bool chunk_compress_available(void) {
+    return true;
+}
+
+size_t chunk_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap) {
+    if (!chunk_compressible(src, len)) return 0;
+
+    zstd_contexts_t *ctx = thread_contexts();
+    if (!ctx) return 0;
+
+    // Output past this limit is not worth the decompression on the other end
+    size_t limit = len - len / 16;
+    if (cap > limit) cap = limit;
+
+    size_t n = ZSTD_compressCCtx(ctx->cctx, dst, cap, src, len, CHUNK_COMPRESS_LEVEL);
+    return ZSTD_isError(n) ? 0 : n;
+}
+
+int chunk_decompress(const uint8_t *src, size_t src_len, uint8_t *dst, size_t len) {
+    // The frame header must declare the expected size, so a frame cannot
+    // claim less and expand into memory it does not own
+    if (ZSTD_getFrameContentSize(src, src_len) != (unsigned long long)len) return -1;
+
+    zstd_contexts_t *ctx = thread_contexts();
+    if (!ctx) return -1;
+
+    size_t n = ZSTD_decompressDCtx(ctx->dctx, dst, len, src, src_len);
+    return !ZSTD_isError(n) && n == len ? 0 : -1;
+}
+
+#else
+
+bool chunk_compress_available(void) {
+    return false;
+}
+
+size_t chunk_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap) {
+    (void)src;
+    (void)len;
+    (void)dst;
+    (void)cap;
+    return 0;
+}
+
+int chunk_decompress(const uint8_t *src, size_t src_len, uint8_t *dst, size_t len) {
+    (void)src;
+    (void)src_len;
+    (void)dst;
+    (void)len;
+    return -1;
+}
+
+#endif
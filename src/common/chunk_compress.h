@@ -0,0 +1,44 @@
+#ifndef CHUNK_COMPRESS_H
+#define CHUNK_COMPRESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Optional zstd compression of upload chunks.
+//
+// Before compressing, a chunk is probed: the byte histogram of a few spread
+// samples gives its order-0 entropy, and chunks close to 8 bits per byte
+// (already compressed media, archives, encrypted data) are sent as they
+// are without spending CPU on zstd. A compressed chunk is only used when
+// it saves at least 1/16 of the original size.
+//
+// Built without HAVE_ZSTD, compression is never available: chunk_compress()
+// always returns 0 and chunk_decompress() always fails.
+
+#define CHUNK_COMPRESS_LEVEL 3           // zstd level: fast, still good on text and logs
+#define CHUNK_COMPRESS_MIN_SIZE 512      // Smaller chunks are never compressed
+#define CHUNK_ENTROPY_SAMPLE 4096        // Bytes the entropy probe looks at
+#define CHUNK_ENTROPY_LIMIT 7.5          // Bits per byte above which a chunk is skipped
+
+// True if this build can compress and decompress chunks
+bool chunk_compress_available(void);
+
+// Estimated order-0 entropy of data in bits per byte, 0.0 to 8.0, from at
+// most CHUNK_ENTROPY_SAMPLE bytes taken from evenly spaced windows
+double chunk_entropy(const uint8_t *data, size_t len);
+
+// True if data is worth handing to zstd
+bool chunk_compressible(const uint8_t *data, size_t len);
+
+// Compresses src into one zstd frame in dst. Returns the frame size, or 0
+// if the chunk is skipped by the probe, compresses poorly, does not fit in
+// cap, or compression is not available. Thread-safe.
+size_t chunk_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap);
+
+// Decompresses one frame of src_len bytes that must expand to exactly
+// len bytes. Returns 0 on success, -1 if the frame is malformed, has a
+// different size, or decompression is not available. Thread-safe.
+int chunk_decompress(const uint8_t *src, size_t src_len, uint8_t *dst, size_t len);
+
+#endif // CHUNK_COMPRESS_H
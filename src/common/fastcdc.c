@@ -0,0 +1,96 @@
+#include "fastcdc.h"
+
+// 18 and 14 one-bits spread over the top 48 bits of the hash: cut
+// probability 2^-18 before the average size and 2^-14 after it
+// (normalization level 2 around a 64 KiB average). The low bits are
+// skipped because they only depend on the last few bytes.
+#define FASTCDC_MASK_S 0x9292524a49490000ULL
+#define FASTCDC_MASK_L 0x8912224448910000ULL
+
+// Random 64-bit value per byte (splitmix64 from a fixed seed); must never
+// change, or previously stored chunks stop matching
+static const uint64_t gear[256] = {
+    0x1ac046dda8e86e2aULL, 0xbe2c3b00b1d348c8ULL, 0x9b1a66a95412ff75ULL, 0xc448c2b1f05f7e4cULL,
+    0xc111ca6b8f6e73c4ULL, 0xb54861920d05b01dULL, 0x8d61500f4a7bbe16ULL, 0x5e0c25471f89e02eULL,
+    0x48105a3d28f0e221ULL, 0x2169f8846b637746ULL, 0x3d628782e0c0d863ULL, 0xa5ddb2216078aa40ULL,
+    0xc8119d17f0571101ULL, 0x98e2e2eb8f33280fULL, 0x8cd1e28860679cc4ULL, 0x9dca6189c923aef3ULL,
+    0x9d8d3071ba4f04c4ULL, 0x5d395ada34220c26ULL, 0xe6de42a441a1e28eULL, 0x308fbf68cc864f59ULL,
+    0x216a3c81332862f9ULL, 0xbaceca0a77f3132eULL, 0xdf2a2215339ca69cULL, 0x3e4c11a103a5d859ULL,
+    0x6d0f173ffec5f603ULL, 0x0bf4bc630d193bb6ULL, 0x5f76c4ad104b57fdULL, 0x99ca459f4e93f651ULL,
+    0x4751799d68cf88a0ULL, 0xa6b1639e3b42b61cULL, 0x278b01031924ea35ULL, 0x430253eb7e993605ULL,
+    0x5f4e14147961f2e8ULL, 0x52aead5ef08ac45fULL, 0x583dca09af910274ULL, 0x4a8b9d4b576480cbULL,
+    0xbee913dc4ef28b44ULL, 0x7de79c7a57af8587ULL, 0x1ecf42b9e34cd874ULL, 0x38adac4ab1f3aad1ULL,
+    0x80ff3025878a34b8ULL, 0xf10a8816c7ac2d95ULL, 0xeff8dc4b1fa1c5d4ULL, 0x0b0ebe1144fe022fULL,
+    0x4d46a271e58e80a2ULL, 0x09cd31f10075274fULL, 0xa82f74eaa55bc441ULL, 0x497f6541631d47a4ULL,
+    0x888b7ede7346db17ULL, 0x256147dc71c784e0ULL, 0x8a5d6ed77045cd6cULL, 0xa9fc0986de332f0bULL,
+    0x2f597787e8c75c47ULL, 0x3648fb06e09eefe8ULL, 0xceac1655a16aee55ULL, 0x614c72624b61148dULL,
+    0x4cbdd6aec064c0f0ULL, 0x6620e70990008130ULL, 0x0f7c12bf3c7e6fc3ULL, 0x33a8b131d6275b9bULL,
+    0xfa11bd2037c759caULL, 0x720ddad5e616729aULL, 0xf7d65a62aa36f6cdULL, 0x79c452ac75db451dULL,
+    0xb67b17d3a1221ec5ULL, 0xa121663523494b41ULL, 0xb0299b3ec41c4cedULL, 0x6fc29450adcad869ULL,
+    0x47e9b8ec3fc8cbb7ULL, 0x62fdc189d1af50f0ULL, 0xe2a4894d230c71c5ULL, 0x2b29e84f96f10a17ULL,
+    0x6a06d8f31cc8127bULL, 0xd2cff0ec00d51e42ULL, 0x53a34f9751fa14dbULL, 0x5527bdf3764839bdULL,
+    0x5b2b498aa588f2d2ULL, 0x036c60fb15914351ULL, 0x796dff2c504ae68cULL, 0xa0b68b3deb4a26eeULL,
+    0x538d384072828564ULL, 0x5c8365c92d8e618eULL, 0xadcbd6468938043eULL, 0xa62e0a7bfd3c7a87ULL,
+    0xf94882172a2802d2ULL, 0xe1460d5af30b3df4ULL, 0x875af97cf2a77a1eULL, 0xcd4ced68dc5d03feULL,
+    0x34b85bbb2ed2cbb8ULL, 0x14382eba487c2a39ULL, 0x1bf2b642ec0d725eULL, 0x3180c22f85fd4a6eULL,
+    0x6287e68c688b0a6aULL, 0xc781dbd269c1579bULL, 0x967fba740d8851eeULL, 0x8bcb6289f451eab1ULL,
+    0xb00af395b957706aULL, 0xd66f731a7ebc0d9aULL, 0x0753e0b1e260c0ffULL, 0x9123b3fc244c22f0ULL,
+    0xea18df1333df68c7ULL, 0x9eec6b6e47ee4d7fULL, 0xfb67ca727d5a7eecULL, 0xff8b16c00c21c99eULL,
+    0x358784cdb4cb66ecULL, 0x03216b3236e1a9f0ULL, 0xb04c2b63efd0ff13ULL, 0x7c706fdd841f7fdeULL,
+    0x7d73537d5868a02aULL, 0x79d2f0856b8f869bULL, 0x3ed8cd3a1f18f1dcULL, 0xa63e972135a79123ULL,
+    0xbae6b248ea01376fULL, 0xc6a62efd6e07e935ULL, 0x95bd020eb8287729ULL, 0xddc64b8aa63f411bULL,
+    0xe3b876db230a4b8cULL, 0xfc2662a03a990c51ULL, 0xc4164ab8549560b2ULL, 0x03661ab91fdc46cfULL,
+    0x407d681d863d005eULL, 0x748cad2bdea25f24ULL, 0xa6af3a8fbbe02591ULL, 0x4fe003a7ae850547ULL,
+    0x016d512803fe9519ULL, 0xd3c80ba79b797d64ULL, 0x519a33023219d39fULL, 0xa9b8738fd7958fcaULL,
+    0xb068afbcd3e6cfacULL, 0x12d82d1c233b6a89ULL, 0x52ff395050d637efULL, 0x0b9289abd111c12bULL,
+    0x280a50d348204e9dULL, 0xc3e4bfbbb3b183f7ULL, 0x460ac41c779fb804ULL, 0x50a570f9e185ec4bULL,
+    0x3f4da17a82d062a7ULL, 0xd09ec8514e2854b2ULL, 0xd693ad5620641415ULL, 0xa7b39dbe6975c0caULL,
+    0xa0d0f63f4d9aef1aULL, 0x15af0cbc4969c7d5ULL, 0x278011eaab5c3f0eULL, 0x5e1cf19380ce0c38ULL,
+    0xb1ba4d9029a2956dULL, 0x73f08e7440c16206ULL, 0x6f9b01ffb859822eULL, 0x5a11189a2b6728e2ULL,
+    0xa8558b99a4170496ULL, 0x7f2f938318e74c32ULL, 0xbea616a7fd5e3bc4ULL, 0xdbfeafdd8425000dULL,
+    0x38c230df150c847fULL, 0x17ec72a519accd61ULL, 0x036fa2fbc835b4f6ULL, 0x3f4902d125ddcaeeULL,
+    0xc9dc1fec3a0ac22fULL, 0x4fc8d70c9ee4d990ULL, 0xaae8a531b1c93da2ULL, 0xe1fa0e077e0cec8cULL,
+    0x90356a76ca9c574bULL, 0x2a26cc7a2879d838ULL, 0xcf4ed251a2ae162bULL, 0x098b973c62c609eaULL,
+    0x1be77277ef4b9126ULL, 0x2acb7cac64d26155ULL, 0xd876dbe01e1e90acULL, 0x51ad90e39ff2711dULL,
+    0x56c2dbc758d198b0ULL, 0x1f4e0301f8842f44ULL, 0x708969745130b1a1ULL, 0x9a4311b95a6a991dULL,
+    0x9afcede497e4ddb6ULL, 0xcf3169e617e9ca2dULL, 0x1b4ecbbf8e54cf3dULL, 0x5e9ce5d535be41b4ULL,
+    0xe7faa5baf8248ea5ULL, 0x3675637ace70bdceULL, 0xd980d9032ec07c88ULL, 0xec6e37a873ecf8b1ULL,
+    0xf9d4074f810c18dbULL, 0xb60a4b86daa6ef2aULL, 0x4e899a8f297395dbULL, 0x7165c4bd2470cda3ULL,
+    0x8253b43083c02137ULL, 0x3e025a61ee7fd941ULL, 0x322e76006c21fe35ULL, 0x0ad2377d2e13ed73ULL,
+    0x46c5cca798eb198eULL, 0x0f73c7b0b88be5a0ULL, 0x9bdbeb2841204b09ULL, 0x4d196436aae8e99bULL,
+    0x7f3bba1f8a36d062ULL, 0xe65247c253ec319fULL, 0x536ec5f02d4e4335ULL, 0x13a17a653a4e29abULL,
+    0x6eb9f62ff9e69bcdULL, 0x9be0c43eee73606bULL, 0x42aa9b137474a26aULL, 0x38d992c2b7969b10ULL,
+    0x00584830af6dcb06ULL, 0x21fbd546ca9dc7b4ULL, 0x613143aef10f037eULL, 0x249018dd3524b6ebULL,
+    0x625f5025eb78a5dbULL, 0x89dffc140591ea45ULL, 0xeabe2cb345bb7fa9ULL, 0xb3d74fdd70015b81ULL,
+    0xd31bf6ac6e6eff00ULL, 0xffa32024d7e7a05eULL, 0x32675789370b11c1ULL, 0x26cf04b6940262d0ULL,
+    0x7016e72357d61660ULL, 0x25818a6720cebd3fULL, 0xdb731160b31e0635ULL, 0x380407a507c37907ULL,
+    0xcadf246dd50299f4ULL, 0xbf8f0f184d6c4a16ULL, 0x38119a0902b7a6d0ULL, 0x06ac8fe2ec3606b2ULL,
+    0x7abc00c02cc859ccULL, 0xf93819575bbf449eULL, 0x2d9dc57e43f28641ULL, 0xea5df4a5436eaf2fULL,
+    0xcab3b92f92d36e8bULL, 0x211bcfa592b9e1bfULL, 0x67ae1da4c7d43427ULL, 0xad700ad7ccaea894ULL,
+    0x2b107d3d815d86d8ULL, 0x0010b23e14c8bef3ULL, 0x2b1d0f1d75d26f7bULL, 0x3b4ff56c622e7f43ULL,
+    0x6cacaa7ec6e2f69eULL, 0xf134b52034eb99ddULL, 0x9a2f4c1d1b73a531ULL, 0xf3e4ad23b672706dULL,
+    0x5c39b33babb430d6ULL, 0xb3c783a4732b3fd5ULL, 0xefd45192ceb437adULL, 0x7d16c00ff3817bc1ULL,
+    0xf69003865fca895eULL, 0xbd83805faee0202eULL, 0x398c44e739df0decULL, 0x7b190c1260f2583eULL,
+    0xf33479f42bf6780cULL, 0x1e4b54e22fbe719dULL, 0x03d1f2ee77632020ULL, 0x2a7414b98717fdc8ULL,
+    0x8534a1646babf432ULL, 0x55af162af065b106ULL, 0x47cdbd2911f272e8ULL, 0x7d9f49a5d5fce2e7ULL,
+    0x0196fe50064dbca7ULL, 0x69c325a23ab5755fULL, 0xb9cabfd1de7de997ULL, 0x869756f713a06d5eULL,
+};
+
+size_t fastcdc_cut(const uint8_t *data, size_t len) {
+    if (len <= FASTCDC_MIN_SIZE) return len;
+
+    size_t max = len < FASTCDC_MAX_SIZE ? len : FASTCDC_MAX_SIZE;
+    size_t normal = max < FASTCDC_AVG_SIZE ? max : FASTCDC_AVG_SIZE;
+    uint64_t hash = 0;
+    size_t i = FASTCDC_MIN_SIZE; // No cut can fall inside the minimum size
+
+    for (; i < normal; i++) {
+        hash = (hash << 1) + gear[data[i]];
+        if (!(hash & FASTCDC_MASK_S)) return i + 1;
+    }
+    for (; i < max; i++) {
+        hash = (hash << 1) + gear[data[i]];
+        if (!(hash & FASTCDC_MASK_L)) return i + 1;
+    }
+    return max;
+}
@@ -0,0 +1,25 @@
+#ifndef FASTCDC_H
+#define FASTCDC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Content-defined chunking (FastCDC with normalized chunking).
+//
+// A Gear rolling hash runs over the data and a chunk ends where the hash
+// matches a mask, so boundaries follow the content rather than file offsets:
+// inserting or deleting bytes only changes the chunks around the edit, and
+// the rest of a new file version produces the same chunks as before. Below
+// the average size a stricter mask is used and above it a looser one, which
+// keeps chunk sizes close to FASTCDC_AVG_SIZE.
+
+#define FASTCDC_MIN_SIZE (16 * 1024)
+#define FASTCDC_AVG_SIZE (64 * 1024)
+#define FASTCDC_MAX_SIZE (256 * 1024)
+
+// Length of the chunk that starts at data[0], in [1, len]. Unless the input
+// ends within len bytes, pass at least FASTCDC_MAX_SIZE bytes so the result
+// does not depend on how the caller buffers the stream.
+size_t fastcdc_cut(const uint8_t *data, size_t len);
+
+#endif // FASTCDC_H
@@ -0,0 +1,100 @@
+#include "mpsc_ring.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define RING_CACHE_LINE 64
+
+// A slot is its sequence number followed by the item bytes. Sequence values:
+// pos = free for the producer claiming pos, pos + 1 = item published.
+typedef struct {
+    uint64_t seq;
+    unsigned char data[];
+} ring_slot_t;
+
+struct mpsc_ring {
+    // Producers and the consumer write different counters; keep them on
+    // separate cache lines
+    _Alignas(RING_CACHE_LINE) uint64_t tail;
+    _Alignas(RING_CACHE_LINE) uint64_t head;
+    _Alignas(RING_CACHE_LINE) size_t mask;
+    size_t item_size;
+    size_t stride;
+    unsigned char *slots;
+};
+
+static ring_slot_t *slot_at(const mpsc_ring_t *ring, uint64_t pos) {
+    return (ring_slot_t *)(ring->slots + (size_t)(pos & ring->mask) * ring->stride);
+}
+
+mpsc_ring_t *mpsc_ring_new(size_t capacity, size_t item_size) {
+    if (capacity == 0 || item_size == 0) return NULL;
+    size_t cap = 1;
+    while (cap < capacity) cap <<= 1;
+
+    mpsc_ring_t *ring = aligned_alloc(RING_CACHE_LINE, sizeof(*ring));
+    if (!ring) return NULL;
+    memset(ring, 0, sizeof(*ring));
+    ring->mask = cap - 1;
+    ring->item_size = item_size;
+    ring->stride = (sizeof(ring_slot_t) + item_size + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+    ring->slots = malloc(cap * ring->stride);
+    if (!ring->slots) {
+        free(ring);
+        return NULL;
+    }
+    for (size_t i = 0; i < cap; i++) slot_at(ring, i)->seq = i;
+    return ring;
+}
+
+void mpsc_ring_free(mpsc_ring_t *ring) {
+    if (!ring) return;
+    free(ring->slots);
+    free(ring);
+}
+
+bool mpsc_ring_push(mpsc_ring_t *ring, const void *item) {
+    uint64_t pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    ring_slot_t *slot;
+    for (;;) {
+        slot = slot_at(ring, pos);
+        uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        int64_t diff = (int64_t)(seq - pos);
+        if (diff == 0) {
+            // The slot is free for pos; claim it (a failed CAS reloads pos)
+            if (__atomic_compare_exchange_n(&ring->tail, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false; // The consumer has not freed this slot yet: full
+        } else {
+            pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED); // Another producer took it
+        }
+    }
+    memcpy(slot->data, item, ring->item_size);
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool mpsc_ring_pop(mpsc_ring_t *ring, void *out) {
+    uint64_t pos = ring->head;
+    ring_slot_t *slot = slot_at(ring, pos);
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1) return false;
+
+    memcpy(out, slot->data, ring->item_size);
+    // Free the slot for the producer one lap ahead
+    __atomic_store_n(&slot->seq, pos + ring->mask + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->head, pos + 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+size_t mpsc_ring_depth(const mpsc_ring_t *ring) {
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    return tail > head ? (size_t)(tail - head) : 0;
+}
+
+size_t mpsc_ring_capacity(const mpsc_ring_t *ring) {
+    return ring->mask + 1;
+}
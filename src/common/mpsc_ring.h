@@ -0,0 +1,35 @@
+#ifndef MPSC_RING_H
+#define MPSC_RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bounded lock-free queue with many producers and a single consumer.
+//
+// Items are fixed-size and copied in and out. Every slot carries a sequence
+// number: a producer claims the next position with one compare-and-swap on
+// the tail, copies its item and publishes it by advancing the slot's
+// sequence. The consumer reads a slot only once it has been published, so a
+// producer that is slow between claiming and publishing holds back the
+// consumer but never other producers. Push and pop never block and never
+// allocate; a full queue makes push fail, and the caller decides whether to
+// wait or give up.
+
+typedef struct mpsc_ring mpsc_ring_t;
+
+// capacity is rounded up to a power of two. Returns NULL on allocation failure.
+mpsc_ring_t *mpsc_ring_new(size_t capacity, size_t item_size);
+void mpsc_ring_free(mpsc_ring_t *ring);
+
+// Any thread. Returns false if the queue is full.
+bool mpsc_ring_push(mpsc_ring_t *ring, const void *item);
+
+// Consumer thread only. Returns false if no published item is waiting.
+bool mpsc_ring_pop(mpsc_ring_t *ring, void *out);
+
+// Items pushed and not yet popped; approximate while producers are active
+size_t mpsc_ring_depth(const mpsc_ring_t *ring);
+size_t mpsc_ring_capacity(const mpsc_ring_t *ring);
+
+#endif // MPSC_RING_H
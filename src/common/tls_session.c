@@ -0,0 +1,234 @@
+#include "tls_session.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rand.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#else
+#include <openssl/hmac.h>
+#endif
+
+#define TICKET_NAME_LEN 16
+#define TICKET_AES_LEN 32
+#define TICKET_HMAC_LEN 32
+
+typedef struct {
+    uint8_t name[TICKET_NAME_LEN];
+    uint8_t aes[TICKET_AES_LEN];
+    uint8_t hmac[TICKET_HMAC_LEN];
+    time_t created;
+    int valid;
+} ticket_key_t;
+
+// g_keys[0] encrypts new tickets; all valid keys decrypt
+static ticket_key_t g_keys[TLS_TICKET_KEYS];
+static pthread_mutex_t g_keys_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static SSL_SESSION *g_client_session;
+static char g_cache_path[PATH_MAX];
+static pthread_mutex_t g_client_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static tls_session_stats_t g_stats;
+
+// Caller holds g_keys_mutex
+static int rotate_locked(void) {
+    ticket_key_t fresh;
+    if (RAND_bytes(fresh.name, sizeof(fresh.name)) != 1 ||
+        RAND_bytes(fresh.aes, sizeof(fresh.aes)) != 1 ||
+        RAND_bytes(fresh.hmac, sizeof(fresh.hmac)) != 1) {
+        OPENSSL_cleanse(&fresh, sizeof(fresh));
+        return -1;
+    }
+    fresh.created = time(NULL);
+    fresh.valid = 1;
+
+    OPENSSL_cleanse(&g_keys[TLS_TICKET_KEYS - 1], sizeof(ticket_key_t));
+    memmove(&g_keys[1], &g_keys[0], (TLS_TICKET_KEYS - 1) * sizeof(ticket_key_t));
+    g_keys[0] = fresh;
+    OPENSSL_cleanse(&fresh, sizeof(fresh));
+    __atomic_add_fetch(&g_stats.key_rotations, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+void tls_session_rotate_keys(void) {
+    pthread_mutex_lock(&g_keys_mutex);
+    rotate_locked();
+    pthread_mutex_unlock(&g_keys_mutex);
+}
+
+// Copies the key that encrypts (name == NULL) or the one that has this name.
+// Returns its slot, or -1 if there is none.
+static int find_key(const uint8_t *name, ticket_key_t *out) {
+    int slot = -1;
+    pthread_mutex_lock(&g_keys_mutex);
+    if (!name) {
+        if (!g_keys[0].valid || time(NULL) - g_keys[0].created >= TLS_TICKET_ROTATE_SEC) {
+            rotate_locked();
+        }
+        if (g_keys[0].valid) slot = 0;
+    } else {
+        for (int i = 0; i < TLS_TICKET_KEYS; i++) {
+            if (g_keys[i].valid && memcmp(g_keys[i].name, name, TICKET_NAME_LEN) == 0) {
+                slot = i;
+                break;
+            }
+        }
+    }
+    if (slot >= 0) *out = g_keys[slot];
+    pthread_mutex_unlock(&g_keys_mutex);
+    return slot;
+}
+
+// Ticket callback: 1 = ticket encrypted, 2 = decrypted and to be replaced
+// with a fresh one, 0 = unknown key (full handshake), -1 = error. Every
+// decrypted ticket is renewed: the client drops a TLS 1.3 ticket once it has
+// used it, and a ticket from an older key should move to the current one.
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+static int ticket_key_cb(SSL *ssl, unsigned char *key_name, unsigned char *iv,
+                         EVP_CIPHER_CTX *cctx, EVP_MAC_CTX *hctx, int enc) {
+#else
+static int ticket_key_cb(SSL *ssl, unsigned char *key_name, unsigned char *iv,
+                         EVP_CIPHER_CTX *cctx, HMAC_CTX *hctx, int enc) {
+#endif
+    (void)ssl;
+    ticket_key_t key;
+    int slot = find_key(enc ? NULL : key_name, &key);
+    if (slot < 0) return enc ? -1 : 0;
+
+    int ok;
+    if (enc) {
+        memcpy(key_name, key.name, TICKET_NAME_LEN);
+        ok = RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) == 1 &&
+             EVP_EncryptInit_ex(cctx, EVP_aes_256_cbc(), NULL, key.aes, iv) == 1;
+    } else {
+        ok = EVP_DecryptInit_ex(cctx, EVP_aes_256_cbc(), NULL, key.aes, iv) == 1;
+    }
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key.hmac, sizeof(key.hmac)),
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, "SHA256", 0),
+        OSSL_PARAM_construct_end()
+    };
+    ok = ok && EVP_MAC_CTX_set_params(hctx, params) == 1;
+#else
+    ok = ok && HMAC_Init_ex(hctx, key.hmac, sizeof(key.hmac), EVP_sha256(), NULL) == 1;
+#endif
+    OPENSSL_cleanse(&key, sizeof(key));
+
+    if (!ok) return -1;
+    return enc ? 1 : 2;
+}
+
+int tls_session_server_init(SSL_CTX *ctx, const char *id_context) {
+    pthread_mutex_lock(&g_keys_mutex);
+    int rc = g_keys[0].valid ? 0 : rotate_locked();
+    pthread_mutex_unlock(&g_keys_mutex);
+    if (rc != 0) return -1;
+
+    // Required for resumption when client certificates are verified
+    size_t id_len = strlen(id_context);
+    if (id_len > SSL_MAX_SID_CTX_LENGTH) id_len = SSL_MAX_SID_CTX_LENGTH;
+    SSL_CTX_set_session_id_context(ctx, (const unsigned char *)id_context, (unsigned int)id_len);
+
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx, TLS_SESSION_CACHE_SIZE);
+    SSL_CTX_set_timeout(ctx, TLS_SESSION_LIFETIME_SEC);
+    SSL_CTX_clear_options(ctx, SSL_OP_NO_TICKET);
+#ifdef TLS1_3_VERSION
+    SSL_CTX_set_max_early_data(ctx, 0);
+#endif
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, ticket_key_cb);
+#else
+    SSL_CTX_set_tlsext_ticket_key_cb(ctx, ticket_key_cb);
+#endif
+    return 0;
+}
+
+// Write the session to the cache file through a temporary file, so a crash
+// never leaves half a session behind. Caller holds g_client_mutex.
+static void save_session_locked(SSL_SESSION *sess) {
+    char tmp[PATH_MAX + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", g_cache_path);
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (fd == -1) return;
+    FILE *fp = fdopen(fd, "w");
+    if (!fp) {
+        close(fd);
+        unlink(tmp);
+        return;
+    }
+    int ok = PEM_write_SSL_SESSION(fp, sess) == 1;
+    ok = fclose(fp) == 0 && ok;
+    if (!ok || rename(tmp, g_cache_path) != 0) unlink(tmp);
+}
+
+static int session_usable(SSL_SESSION *sess) {
+    return SSL_SESSION_is_resumable(sess) &&
+           (time_t)SSL_SESSION_get_time(sess) + (time_t)SSL_SESSION_get_timeout(sess) > time(NULL);
+}
+
+// OpenSSL hands over every new session (each TLS 1.3 ticket); keep the latest
+static int new_session_cb(SSL *ssl, SSL_SESSION *sess) {
+    (void)ssl;
+    pthread_mutex_lock(&g_client_mutex);
+    if (g_client_session) SSL_SESSION_free(g_client_session);
+    g_client_session = sess;
+    if (g_cache_path[0] != '\0') save_session_locked(sess);
+    pthread_mutex_unlock(&g_client_mutex);
+    return 1; // The reference is ours now
+}
+
+int tls_session_client_init(SSL_CTX *ctx, const char *cache_path) {
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx, new_session_cb);
+    if (!cache_path) return 0;
+
+    pthread_mutex_lock(&g_client_mutex);
+    snprintf(g_cache_path, sizeof(g_cache_path), "%s", cache_path);
+    FILE *fp = fopen(cache_path, "r");
+    if (fp) {
+        SSL_SESSION *sess = PEM_read_SSL_SESSION(fp, NULL, NULL, NULL);
+        fclose(fp);
+        if (sess && session_usable(sess) && !g_client_session) {
+            g_client_session = sess;
+        } else if (sess) {
+            SSL_SESSION_free(sess);
+        }
+    }
+    pthread_mutex_unlock(&g_client_mutex);
+    return 0;
+}
+
+void tls_session_client_prepare(SSL *ssl) {
+    pthread_mutex_lock(&g_client_mutex);
+    if (g_client_session && session_usable(g_client_session)) {
+        SSL_set_session(ssl, g_client_session);
+    }
+    pthread_mutex_unlock(&g_client_mutex);
+}
+
+int tls_session_count(SSL *ssl) {
+    int resumed = SSL_session_reused(ssl) ? 1 : 0;
+    __atomic_add_fetch(&g_stats.handshakes, 1, __ATOMIC_RELAXED);
+    if (resumed) __atomic_add_fetch(&g_stats.resumed, 1, __ATOMIC_RELAXED);
+    return resumed;
+}
+
+void tls_session_get_stats(tls_session_stats_t *out) {
+    out->handshakes = __atomic_load_n(&g_stats.handshakes, __ATOMIC_RELAXED);
+    out->resumed = __atomic_load_n(&g_stats.resumed, __ATOMIC_RELAXED);
+    out->key_rotations = __atomic_load_n(&g_stats.key_rotations, __ATOMIC_RELAXED);
+}
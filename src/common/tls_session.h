@@ -0,0 +1,57 @@
+#ifndef TLS_SESSION_H
+#define TLS_SESSION_H
+
+#include <stdint.h>
+
+#include <openssl/ssl.h>
+
+// TLS session resumption for the servers and the client.
+//
+// Server: session tickets are encrypted with a key that rotates every
+// TLS_TICKET_ROTATE_SEC. The previous TLS_TICKET_KEYS - 1 keys still
+// decrypt, and a ticket from an older key is renewed on use. The advertised
+// lifetime is one rotation shorter than the keys cover: a ticket issued just
+// before a rotation must still decrypt for the whole lifetime. TLS 1.2
+// session IDs go to the SSL_CTX's own cache. That cache is locked
+// internally, so every worker thread sharing the context shares it. A
+// resumed session keeps the client certificate of the full handshake, so
+// fingerprint checks work unchanged. Early data (0-RTT) stays disabled:
+// requests are never replayable.
+//
+// Client: the latest session from the server is kept in memory and offered
+// on the next connection (reconnects, --streams). With a cache file it also
+// survives the process, for batch jobs that start one client per transfer.
+
+#define TLS_TICKET_KEYS 4               // Current key plus three that still decrypt
+#define TLS_TICKET_ROTATE_SEC 3600      // A new encryption key every hour
+#define TLS_SESSION_LIFETIME_SEC ((TLS_TICKET_KEYS - 2) * TLS_TICKET_ROTATE_SEC)
+#define TLS_SESSION_CACHE_SIZE 20480    // Server-side TLS 1.2 session IDs
+
+typedef struct {
+    uint64_t handshakes;    // Completed handshakes
+    uint64_t resumed;       // ...of which resumed a session
+    uint64_t key_rotations; // Ticket keys generated, the first one included
+} tls_session_stats_t;
+
+// Enables tickets with rotating keys and the shared session cache on a
+// server context. id_context scopes sessions to this service. Returns 0 on
+// success, -1 if no ticket key could be generated.
+int tls_session_server_init(SSL_CTX *ctx, const char *id_context);
+
+// Starts a new ticket encryption key now instead of at the next interval
+void tls_session_rotate_keys(void);
+
+// Enables session reuse on a client context. cache_path may be NULL; if
+// set, a saved session is loaded from it and every new one written back
+// (mode 0600: the file holds the session secret). Returns 0 on success.
+int tls_session_client_init(SSL_CTX *ctx, const char *cache_path);
+
+// Offers the cached session, if any, on a client connection before SSL_connect
+void tls_session_client_prepare(SSL *ssl);
+
+// Counts a finished handshake; returns 1 if it resumed a session
+int tls_session_count(SSL *ssl);
+
+void tls_session_get_stats(tls_session_stats_t *out);
+
+#endif // TLS_SESSION_H
@@ -0,0 +1,322 @@
+#include <string.h>
+
+#include "wire_codec.h"
+
+#define WIRE_TYPE_VARINT 0
+#define WIRE_TYPE_BYTES  2
+
+typedef struct {
+    uint8_t *buf;
+    size_t len;
+    size_t cap;
+    int overflow;
+} wire_writer_t;
+
+typedef struct {
+    const uint8_t *buf;
+    size_t len;
+    size_t pos;
+} wire_reader_t;
+
+size_t wire_varint_encode(uint64_t value, uint8_t *out) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+ssize_t wire_varint_decode(const uint8_t *in, size_t len, uint64_t *value) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < WIRE_VARINT_MAX; i++) {
+        if (i == len) return 0;
+        uint64_t byte = in[i] & 0x7f;
+        // The tenth byte only has room for the top bit of a 64-bit value
+        if (i == WIRE_VARINT_MAX - 1 && byte > 1) return -1;
+        v |= byte << (7 * i);
+        if (!(in[i] & 0x80)) {
+            *value = v;
+            return (ssize_t)(i + 1);
+        }
+    }
+    return -1;
+}
+
+static uint64_t zigzag_encode(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t zigzag_decode(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static void put_bytes(wire_writer_t *w, const void *data, size_t len) {
+    if (w->overflow || len > w->cap - w->len) {
+        w->overflow = 1;
+        return;
+    }
+    memcpy(w->buf + w->len, data, len);
+    w->len += len;
+}
+
+static void put_varint(wire_writer_t *w, uint64_t value) {
+    uint8_t tmp[WIRE_VARINT_MAX];
+    put_bytes(w, tmp, wire_varint_encode(value, tmp));
+}
+
+// Integer field, left out when zero
+static void put_uint_field(wire_writer_t *w, uint32_t number, uint64_t value) {
+    if (value == 0) return;
+    put_varint(w, (uint64_t)number << 3 | WIRE_TYPE_VARINT);
+    put_varint(w, value);
+}
+
+// Byte field without its trailing zeros, left out when all zero
+static void put_array_field(wire_writer_t *w, uint32_t number, const uint8_t *data, size_t len) {
+    while (len > 0 && data[len - 1] == 0) len--;
+    if (len == 0) return;
+    put_varint(w, (uint64_t)number << 3 | WIRE_TYPE_BYTES);
+    put_varint(w, len);
+    put_bytes(w, data, len);
+}
+
+// Length prefix and body into out; 0 if it does not fit
+static size_t finish_message(const wire_writer_t *body, uint8_t *out, size_t cap) {
+    if (body->overflow) return 0;
+    uint8_t prefix[WIRE_VARINT_MAX];
+    size_t n = wire_varint_encode(body->len, prefix);
+    if (n + body->len > cap || n + body->len > WIRE_MAX_MESSAGE) return 0;
+    memcpy(out, prefix, n);
+    memcpy(out + n, body->buf, body->len);
+    return n + body->len;
+}
+
+size_t wire_encode_request(const RequestHeader *req, uint8_t *out, size_t cap) {
+    uint8_t meta_buf[WIRE_MAX_MESSAGE];
+    wire_writer_t meta = { .buf = meta_buf, .cap = sizeof(meta_buf) };
+    const EncryptedMetadata *m = &req->metadata;
+    put_array_field(&meta, WIRE_META_FILENAME, m->encrypted_filename, sizeof(m->encrypted_filename));
+    put_array_field(&meta, WIRE_META_FILENAME_TAG, m->filename_auth_tag, sizeof(m->filename_auth_tag));
+    put_array_field(&meta, WIRE_META_SIZE, m->encrypted_size, sizeof(m->encrypted_size));
+    put_array_field(&meta, WIRE_META_SIZE_TAG, m->size_auth_tag, sizeof(m->size_auth_tag));
+    put_array_field(&meta, WIRE_META_RECIPIENT, m->encrypted_recipient, sizeof(m->encrypted_recipient));
+    put_array_field(&meta, WIRE_META_RECIPIENT_TAG, m->recipient_auth_tag, sizeof(m->recipient_auth_tag));
+    put_array_field(&meta, WIRE_META_NONCE, m->nonce, sizeof(m->nonce));
+    if (meta.overflow) return 0;
+
+    uint8_t body_buf[WIRE_MAX_MESSAGE];
+    wire_writer_t body = { .buf = body_buf, .cap = sizeof(body_buf) };
+    // The command is always sent, even CMD_UPLOAD (0)
+    put_varint(&body, (uint64_t)WIRE_REQ_COMMAND << 3 | WIRE_TYPE_VARINT);
+    put_varint(&body, (uint32_t)req->command);
+    put_uint_field(&body, WIRE_REQ_OFFSET, zigzag_encode(req->offset));
+    put_uint_field(&body, WIRE_REQ_FLAGS, req->flags);
+    put_array_field(&body, WIRE_REQ_FILE_HASH, req->file_hash, sizeof(req->file_hash));
+    put_array_field(&body, WIRE_REQ_PACKET_NONCE, req->packet_nonce, sizeof(req->packet_nonce));
+    put_array_field(&body, WIRE_REQ_AUTH_TAG, req->auth_tag, sizeof(req->auth_tag));
+    put_array_field(&body, WIRE_REQ_METADATA, meta.buf, meta.len);
+    return finish_message(&body, out, cap);
+}
+
+size_t wire_encode_response(const ResponseHeader *resp, uint8_t *out, size_t cap) {
+    uint8_t body_buf[WIRE_MAX_MESSAGE];
+    wire_writer_t body = { .buf = body_buf, .cap = sizeof(body_buf) };
+    put_varint(&body, (uint64_t)WIRE_RESP_STATUS << 3 | WIRE_TYPE_VARINT);
+    put_varint(&body, (uint32_t)resp->status);
+    put_uint_field(&body, WIRE_RESP_FILESIZE, zigzag_encode(resp->filesize));
+    put_array_field(&body, WIRE_RESP_NONCE, resp->response_nonce, sizeof(resp->response_nonce));
+    put_array_field(&body, WIRE_RESP_AUTH_TAG, resp->auth_tag, sizeof(resp->auth_tag));
+    return finish_message(&body, out, cap);
+}
+
+// Next field of a body. Returns 1 and the field's number and value (an
+// integer, or a byte range of the body), 0 at the end, -1 if malformed.
+static int next_field(wire_reader_t *r, uint32_t *number, uint64_t *value, const uint8_t **bytes) {
+    if (r->pos == r->len) return 0;
+
+    uint64_t key;
+    ssize_t n = wire_varint_decode(r->buf + r->pos, r->len - r->pos, &key);
+    if (n <= 0 || (key >> 3) == 0 || (key >> 3) > UINT32_MAX) return -1;
+    r->pos += (size_t)n;
+    *number = (uint32_t)(key >> 3);
+
+    n = wire_varint_decode(r->buf + r->pos, r->len - r->pos, value);
+    if (n <= 0) return -1;
+    r->pos += (size_t)n;
+
+    switch (key & 7) {
+        case WIRE_TYPE_VARINT:
+            *bytes = NULL;
+            return 1;
+        case WIRE_TYPE_BYTES:
+            if (*value > r->len - r->pos) return -1;
+            *bytes = r->buf + r->pos;
+            r->pos += (size_t)*value;
+            return 1;
+        default:
+            return -1;
+    }
+}
+
+// Marks a known field as seen; -1 if it was seen before
+static int seen_once(uint32_t *seen, uint32_t number) {
+    if (*seen & (1u << number)) return -1;
+    *seen |= 1u << number;
+    return 0;
+}
+
+// Byte field into a zero-filled array (trailing zeros were trimmed)
+static int get_array(uint8_t *dst, size_t cap, const uint8_t *bytes, uint64_t len) {
+    if (!bytes || len > cap) return -1;
+    memcpy(dst, bytes, (size_t)len);
+    return 0;
+}
+
+static int get_uint(uint64_t *dst, const uint8_t *bytes, uint64_t value, uint64_t max) {
+    if (bytes || value > max) return -1;
+    *dst = value;
+    return 0;
+}
+
+static int decode_metadata(const uint8_t *buf, size_t len, EncryptedMetadata *m) {
+    wire_reader_t r = { .buf = buf, .len = len };
+    uint32_t seen = 0, number;
+    uint64_t value;
+    const uint8_t *bytes;
+    int rc;
+
+    while ((rc = next_field(&r, &number, &value, &bytes)) == 1) {
+        int bad;
+        switch (number) {
+            case WIRE_META_FILENAME:
+                bad = get_array(m->encrypted_filename, sizeof(m->encrypted_filename), bytes, value);
+                break;
+            case WIRE_META_FILENAME_TAG:
+                bad = get_array(m->filename_auth_tag, sizeof(m->filename_auth_tag), bytes, value);
+                break;
+            case WIRE_META_SIZE:
+                bad = get_array(m->encrypted_size, sizeof(m->encrypted_size), bytes, value);
+                break;
+            case WIRE_META_SIZE_TAG:
+                bad = get_array(m->size_auth_tag, sizeof(m->size_auth_tag), bytes, value);
+                break;
+            case WIRE_META_RECIPIENT:
+                bad = get_array(m->encrypted_recipient, sizeof(m->encrypted_recipient), bytes, value);
+                break;
+            case WIRE_META_RECIPIENT_TAG:
+                bad = get_array(m->recipient_auth_tag, sizeof(m->recipient_auth_tag), bytes, value);
+                break;
+            case WIRE_META_NONCE:
+                bad = get_array(m->nonce, sizeof(m->nonce), bytes, value);
+                break;
+            default:
+                continue; // Unknown field: skipped
+        }
+        if (bad || seen_once(&seen, number)) return -1;
+    }
+    return rc;
+}
+
+// Body bounds of the message at the start of `in`: 1 if complete, 0 if more
+// input is needed, -1 if malformed
+static int message_body(const uint8_t *in, size_t len, wire_reader_t *body, size_t *total) {
+    uint64_t body_len;
+    ssize_t n = wire_varint_decode(in, len, &body_len);
+    if (n <= 0) return (int)n;
+    if (body_len > WIRE_MAX_MESSAGE - (size_t)n) return -1;
+    if (len - (size_t)n < body_len) return 0;
+
+    body->buf = in + n;
+    body->len = (size_t)body_len;
+    body->pos = 0;
+    *total = (size_t)n + (size_t)body_len;
+    return 1;
+}
+
+ssize_t wire_decode_request(const uint8_t *in, size_t len, RequestHeader *req) {
+    wire_reader_t r;
+    size_t total = 0;
+    int rc = message_body(in, len, &r, &total);
+    if (rc <= 0) return rc;
+
+    memset(req, 0, sizeof(*req));
+    uint32_t seen = 0, number;
+    uint64_t value, v;
+    const uint8_t *bytes;
+
+    while ((rc = next_field(&r, &number, &value, &bytes)) == 1) {
+        int bad;
+        v = 0;
+        switch (number) {
+            case WIRE_REQ_COMMAND:
+                bad = get_uint(&v, bytes, value, INT32_MAX);
+                req->command = (CommandType)v;
+                break;
+            case WIRE_REQ_OFFSET:
+                bad = get_uint(&v, bytes, value, UINT64_MAX);
+                req->offset = zigzag_decode(v);
+                break;
+            case WIRE_REQ_FLAGS:
+                bad = get_uint(&v, bytes, value, UINT8_MAX);
+                req->flags = (uint8_t)v;
+                break;
+            case WIRE_REQ_FILE_HASH:
+                bad = get_array(req->file_hash, sizeof(req->file_hash), bytes, value);
+                break;
+            case WIRE_REQ_PACKET_NONCE:
+                bad = get_array(req->packet_nonce, sizeof(req->packet_nonce), bytes, value);
+                break;
+            case WIRE_REQ_AUTH_TAG:
+                bad = get_array(req->auth_tag, sizeof(req->auth_tag), bytes, value);
+                break;
+            case WIRE_REQ_METADATA:
+                bad = !bytes || decode_metadata(bytes, (size_t)value, &req->metadata) != 0;
+                break;
+            default:
+                continue;
+        }
+        if (bad || seen_once(&seen, number)) return -1;
+    }
+    if (rc < 0 || !(seen & (1u << WIRE_REQ_COMMAND))) return -1;
+    return (ssize_t)total;
+}
+
+ssize_t wire_decode_response(const uint8_t *in, size_t len, ResponseHeader *resp) {
+    wire_reader_t r;
+    size_t total = 0;
+    int rc = message_body(in, len, &r, &total);
+    if (rc <= 0) return rc;
+
+    memset(resp, 0, sizeof(*resp));
+    uint32_t seen = 0, number;
+    uint64_t value, v;
+    const uint8_t *bytes;
+
+    while ((rc = next_field(&r, &number, &value, &bytes)) == 1) {
+        int bad;
+        v = 0;
+        switch (number) {
+            case WIRE_RESP_STATUS:
+                bad = get_uint(&v, bytes, value, INT32_MAX);
+                resp->status = (ResponseStatus)v;
+                break;
+            case WIRE_RESP_FILESIZE:
+                bad = get_uint(&v, bytes, value, UINT64_MAX);
+                resp->filesize = zigzag_decode(v);
+                break;
+            case WIRE_RESP_NONCE:
+                bad = get_array(resp->response_nonce, sizeof(resp->response_nonce), bytes, value);
+                break;
+            case WIRE_RESP_AUTH_TAG:
+                bad = get_array(resp->auth_tag, sizeof(resp->auth_tag), bytes, value);
+                break;
+            default:
+                continue;
+        }
+        if (bad || seen_once(&seen, number)) return -1;
+    }
+    if (rc < 0 || !(seen & (1u << WIRE_RESP_STATUS))) return -1;
+    return (ssize_t)total;
+}
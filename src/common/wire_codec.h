@@ -0,0 +1,69 @@
+#ifndef WIRE_CODEC_H
+#define WIRE_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "../../include/protocol.h"
+
+// Compact encoding of RequestHeader and ResponseHeader (protocol v3).
+//
+// A message is varint(body length) followed by the body; the body is a
+// sequence of fields, each varint(number << 3 | type) and a value. Type 0
+// is a varint, type 2 is varint(length) plus that many bytes. All integers
+// are little-endian base-128 varints, and signed ones are zigzag-encoded,
+// so the format does not depend on struct layout, padding or the host.
+//
+// Only fields that are set go on the wire: a zero integer or an all-zero
+// array is left out, and trailing zero bytes of an array are trimmed and
+// restored on decode. A CMD_PING is three bytes instead of a full
+// RequestHeader. Unknown field numbers are skipped, so fields can be added
+// without breaking older peers; a known field that appears twice or does
+// not fit its struct member makes the message malformed.
+
+#define WIRE_VARINT_MAX 10      // Bytes in the longest 64-bit varint
+#define WIRE_MAX_MESSAGE 1024   // Length prefix included; larger messages are malformed
+
+// Request fields
+#define WIRE_REQ_COMMAND      1 // varint
+#define WIRE_REQ_OFFSET       2 // zigzag varint
+#define WIRE_REQ_FLAGS        3 // varint
+#define WIRE_REQ_FILE_HASH    4 // bytes
+#define WIRE_REQ_PACKET_NONCE 5 // bytes
+#define WIRE_REQ_AUTH_TAG     6 // bytes
+#define WIRE_REQ_METADATA     7 // bytes: nested message of WIRE_META_* fields, no length prefix
+
+// EncryptedMetadata fields
+#define WIRE_META_FILENAME      1
+#define WIRE_META_FILENAME_TAG  2
+#define WIRE_META_SIZE          3
+#define WIRE_META_SIZE_TAG      4
+#define WIRE_META_RECIPIENT     5
+#define WIRE_META_RECIPIENT_TAG 6
+#define WIRE_META_NONCE         7
+
+// Response fields
+#define WIRE_RESP_STATUS   1 // varint
+#define WIRE_RESP_FILESIZE 2 // zigzag varint
+#define WIRE_RESP_NONCE    3 // bytes
+#define WIRE_RESP_AUTH_TAG 4 // bytes
+
+// Returns the number of bytes written to out (at most WIRE_VARINT_MAX)
+size_t wire_varint_encode(uint64_t value, uint8_t *out);
+
+// Returns bytes consumed, 0 if `in` ends inside the varint, -1 if it is
+// longer than WIRE_VARINT_MAX bytes or overflows 64 bits
+ssize_t wire_varint_decode(const uint8_t *in, size_t len, uint64_t *value);
+
+// Encode one length-prefixed message. Returns its size, or 0 if it does not
+// fit in `cap` bytes (WIRE_MAX_MESSAGE is always enough).
+size_t wire_encode_request(const RequestHeader *req, uint8_t *out, size_t cap);
+size_t wire_encode_response(const ResponseHeader *resp, uint8_t *out, size_t cap);
+
+// Decode the message at the start of `in` into a zeroed struct. Returns
+// bytes consumed, 0 if more input is needed, -1 if the message is malformed.
+ssize_t wire_decode_request(const uint8_t *in, size_t len, RequestHeader *req);
+ssize_t wire_decode_response(const uint8_t *in, size_t len, ResponseHeader *resp);
+
+#endif // WIRE_CODEC_H
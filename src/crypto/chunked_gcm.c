@@ -0,0 +1,341 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+//* заголовочные файлы
+#include "chunked_gcm.h"
+
+#define AAD_LEN 9 // chunk index (8) + final flag (1)
+
+static void put_be32(uint8_t *p, uint32_t v) {
+    for (int i = 3; i >= 0; i--) { p[i] = (uint8_t)v; v >>= 8; }
+}
+
+static void put_be64(uint8_t *p, uint64_t v) {
+    for (int i = 7; i >= 0; i--) { p[i] = (uint8_t)v; v >>= 8; }
+}
+
+static uint32_t get_be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint64_t get_be64(const uint8_t *p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v = (v << 8) | p[i];
+    return v;
+}
+
+// IV for record i: base IV with the chunk index XORed into the low 8 bytes
+static void record_iv(const uint8_t base_iv[GCM_IV_SIZE], uint64_t index, uint8_t iv[GCM_IV_SIZE]) {
+    uint8_t idx[8];
+    put_be64(idx, index);
+    memcpy(iv, base_iv, GCM_IV_SIZE);
+    for (int i = 0; i < 8; i++) iv[GCM_IV_SIZE - 8 + i] ^= idx[i];
+}
+
+static void record_aad(uint64_t index, bool final, uint8_t aad[AAD_LEN]) {
+    put_be64(aad, index);
+    aad[8] = final ? 1 : 0;
+}
+
+static int write_full(int fd, const void *buf, size_t len) {
+    const uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int pread_full(int fd, void *buf, size_t len, off_t off) {
+    uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = pread(fd, p, len, off);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) return -1; // Unexpected EOF
+        p += n;
+        off += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static void encode_header(const chunked_gcm_writer_t *w, uint8_t hdr[CHUNKED_GCM_HEADER_SIZE]) {
+    memset(hdr, 0, CHUNKED_GCM_HEADER_SIZE);
+    memcpy(hdr, CHUNKED_GCM_MAGIC, 4);
+    hdr[4] = CHUNKED_GCM_VERSION;
+    put_be32(hdr + 8, CHUNKED_GCM_CHUNK_SIZE);
+    put_be64(hdr + 12, w->plaintext_size);
+    memcpy(hdr + 20, w->base_iv, GCM_IV_SIZE);
+}
+
+// Encrypts the pending plaintext as record w->chunk_index and appends it to the file
+static error_status_t seal_record(chunked_gcm_writer_t *w, bool final) {
+    uint8_t iv[GCM_IV_SIZE];
+    uint8_t aad[AAD_LEN];
+    int len = 0;
+    int ct_len = 0;
+
+    record_iv(w->base_iv, w->chunk_index, iv);
+    record_aad(w->chunk_index, final, aad);
+
+    // Контекст переиспользуется: меняем только IV
+    if (EVP_EncryptInit_ex(w->ctx, NULL, NULL, w->key, iv) != 1 ||
+        EVP_EncryptUpdate(w->ctx, NULL, &len, aad, AAD_LEN) != 1 ||
+        EVP_EncryptUpdate(w->ctx, w->record, &len, w->pending, (int)w->pending_len) != 1) {
+        return MR_ERROR_CRYPTO;
+    }
+    ct_len = len;
+    if (EVP_EncryptFinal_ex(w->ctx, w->record + ct_len, &len) != 1) {
+        return MR_ERROR_CRYPTO;
+    }
+    ct_len += len;
+    if (EVP_CIPHER_CTX_ctrl(w->ctx, EVP_CTRL_GCM_GET_TAG, GCM_TAG_SIZE, w->record + ct_len) != 1) {
+        return MR_ERROR_CRYPTO;
+    }
+
+    if (write_full(w->fd, w->record, (size_t)ct_len + GCM_TAG_SIZE) != 0) {
+        return MR_ERROR_IO;
+    }
+
+    w->chunk_index++;
+    w->pending_len = 0;
+    return MR_SUCCESS;
+}
+
+static error_status_t writer_alloc(chunked_gcm_writer_t *w, int fd, const uint8_t *key) {
+    memset(w, 0, sizeof(*w));
+    w->fd = fd;
+    w->key = key;
+
+    w->pending = malloc(CHUNKED_GCM_CHUNK_SIZE);
+    w->record = malloc(CHUNKED_GCM_RECORD_SIZE(CHUNKED_GCM_CHUNK_SIZE));
+    w->ctx = EVP_CIPHER_CTX_new();
+    if (!w->pending || !w->record || !w->ctx) {
+        chunked_gcm_writer_cleanup(w);
+        return MR_ERROR_MEMORY;
+    }
+    if (EVP_EncryptInit_ex(w->ctx, EVP_aes_256_gcm(), NULL, NULL, NULL) != 1) {
+        chunked_gcm_writer_cleanup(w);
+        return MR_ERROR_CRYPTO;
+    }
+    return MR_SUCCESS;
+}
+
+error_status_t chunked_gcm_writer_init(chunked_gcm_writer_t *w, int fd, const uint8_t *key) {
+    if (!w || fd < 0 || !key) return MR_ERROR_INVALID_PARAM;
+
+    error_status_t rc = writer_alloc(w, fd, key);
+    if (rc != MR_SUCCESS) return rc;
+
+    if (RAND_bytes(w->base_iv, GCM_IV_SIZE) != 1) {
+        chunked_gcm_writer_cleanup(w);
+        return MR_ERROR_CRYPTO;
+    }
+
+    // Заголовок пишется сразу; размер открытого текста дописывается в final
+    uint8_t hdr[CHUNKED_GCM_HEADER_SIZE];
+    encode_header(w, hdr);
+    if (write_full(fd, hdr, sizeof(hdr)) != 0) {
+        chunked_gcm_writer_cleanup(w);
+        return MR_ERROR_IO;
+    }
+
+    return MR_SUCCESS;
+}
+
+error_status_t chunked_gcm_writer_update(chunked_gcm_writer_t *w, const uint8_t *data, size_t len) {
+    if (!w || !w->ctx || (!data && len > 0)) return MR_ERROR_INVALID_PARAM;
+
+    while (len > 0) {
+        // A full record is only sealed once more data arrives, so the last
+        // record is always sealed by final() with the final flag set
+        if (w->pending_len == CHUNKED_GCM_CHUNK_SIZE) {
+            error_status_t rc = seal_record(w, false);
+            if (rc != MR_SUCCESS) return rc;
+        }
+
+        size_t room = CHUNKED_GCM_CHUNK_SIZE - w->pending_len;
+        size_t take = len < room ? len : room;
+        memcpy(w->pending + w->pending_len, data, take);
+        w->pending_len += take;
+        w->plaintext_size += take;
+        data += take;
+        len -= take;
+    }
+
+    return MR_SUCCESS;
+}
+
+error_status_t chunked_gcm_writer_checkpoint(chunked_gcm_writer_t *w, chunked_gcm_position_t *pos) {
+    if (!w || !w->ctx || !pos) return MR_ERROR_INVALID_PARAM;
+
+    if (w->pending_len == CHUNKED_GCM_CHUNK_SIZE) {
+        error_status_t rc = seal_record(w, false);
+        if (rc != MR_SUCCESS) return rc;
+    }
+    if (w->pending_len != 0) return MR_ERROR_INVALID_PARAM;
+
+    memcpy(pos->base_iv, w->base_iv, GCM_IV_SIZE);
+    pos->chunk_index = w->chunk_index;
+    return MR_SUCCESS;
+}
+
+error_status_t chunked_gcm_writer_resume(chunked_gcm_writer_t *w, int fd, const uint8_t *key,
+                                         const chunked_gcm_position_t *pos) {
+    if (!w || fd < 0 || !key || !pos) return MR_ERROR_INVALID_PARAM;
+
+    // Заголовок тот же, что писал init: размер в нём так и остаётся нулевым до final
+    uint8_t hdr[CHUNKED_GCM_HEADER_SIZE];
+    if (pread_full(fd, hdr, sizeof(hdr), 0) != 0 || memcmp(hdr, CHUNKED_GCM_MAGIC, 4) != 0 ||
+        hdr[4] != CHUNKED_GCM_VERSION || get_be32(hdr + 8) != CHUNKED_GCM_CHUNK_SIZE ||
+        memcmp(hdr + 20, pos->base_iv, GCM_IV_SIZE) != 0) {
+        return MR_ERROR_INTEGRITY;
+    }
+
+    off_t end = (off_t)(CHUNKED_GCM_HEADER_SIZE +
+                        pos->chunk_index * CHUNKED_GCM_RECORD_SIZE((uint64_t)CHUNKED_GCM_CHUNK_SIZE));
+    struct stat st;
+    if (fstat(fd, &st) != 0) return MR_ERROR_IO;
+    if (st.st_size < end) return MR_ERROR_INTEGRITY;
+    if (ftruncate(fd, end) != 0 || lseek(fd, end, SEEK_SET) != end) return MR_ERROR_IO;
+
+    error_status_t rc = writer_alloc(w, fd, key);
+    if (rc != MR_SUCCESS) return rc;
+    memcpy(w->base_iv, pos->base_iv, GCM_IV_SIZE);
+    w->chunk_index = pos->chunk_index;
+    w->plaintext_size = pos->chunk_index * CHUNKED_GCM_CHUNK_SIZE;
+    return MR_SUCCESS;
+}
+
+error_status_t chunked_gcm_writer_final(chunked_gcm_writer_t *w) {
+    if (!w || !w->ctx) return MR_ERROR_INVALID_PARAM;
+
+    // Even an empty file has one (empty) final record carrying a tag
+    error_status_t rc = seal_record(w, true);
+    if (rc != MR_SUCCESS) return rc;
+
+    uint8_t hdr[CHUNKED_GCM_HEADER_SIZE];
+    encode_header(w, hdr);
+    if (pwrite(w->fd, hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr)) {
+        return MR_ERROR_IO;
+    }
+
+    return MR_SUCCESS;
+}
+
+void chunked_gcm_writer_cleanup(chunked_gcm_writer_t *w) {
+    if (!w) return;
+    if (w->pending) {
+        explicit_bzero(w->pending, CHUNKED_GCM_CHUNK_SIZE);
+        free(w->pending);
+    }
+    free(w->record);
+    EVP_CIPHER_CTX_free(w->ctx);
+    w->pending = NULL;
+    w->record = NULL;
+    w->ctx = NULL;
+}
+
+error_status_t chunked_gcm_reader_open(chunked_gcm_reader_t *r, int fd, const uint8_t *key) {
+    if (!r || fd < 0 || !key) return MR_ERROR_INVALID_PARAM;
+
+    memset(r, 0, sizeof(*r));
+    r->fd = fd;
+    r->key = key;
+
+    uint8_t hdr[CHUNKED_GCM_HEADER_SIZE];
+    if (pread_full(fd, hdr, sizeof(hdr), 0) != 0 ||
+        memcmp(hdr, CHUNKED_GCM_MAGIC, 4) != 0 || hdr[4] != CHUNKED_GCM_VERSION) {
+        return MR_ERROR_INVALID_PARAM;
+    }
+
+    r->chunk_size = get_be32(hdr + 8);
+    r->plaintext_size = get_be64(hdr + 12);
+    memcpy(r->base_iv, hdr + 20, GCM_IV_SIZE);
+    if (r->chunk_size == 0 || r->chunk_size > 16u * 1024 * 1024) {
+        return MR_ERROR_INVALID_PARAM;
+    }
+
+    r->chunk_count = r->plaintext_size == 0 ? 1 :
+                     (r->plaintext_size + r->chunk_size - 1) / r->chunk_size;
+
+    // Длина файла должна точно соответствовать заголовку
+    struct stat st;
+    if (fstat(fd, &st) != 0) return MR_ERROR_IO;
+    uint64_t expected = CHUNKED_GCM_HEADER_SIZE + r->plaintext_size + r->chunk_count * GCM_TAG_SIZE;
+    if ((uint64_t)st.st_size != expected) {
+        return MR_ERROR_INTEGRITY;
+    }
+
+    r->record = malloc(CHUNKED_GCM_RECORD_SIZE(r->chunk_size));
+    r->ctx = EVP_CIPHER_CTX_new();
+    if (!r->record || !r->ctx) {
+        chunked_gcm_reader_cleanup(r);
+        return MR_ERROR_MEMORY;
+    }
+    if (EVP_DecryptInit_ex(r->ctx, EVP_aes_256_gcm(), NULL, NULL, NULL) != 1) {
+        chunked_gcm_reader_cleanup(r);
+        return MR_ERROR_CRYPTO;
+    }
+
+    return MR_SUCCESS;
+}
+
+error_status_t chunked_gcm_reader_read(chunked_gcm_reader_t *r, uint64_t index,
+                                       uint8_t *out, size_t *out_len) {
+    if (!r || !r->ctx || !out || !out_len || index >= r->chunk_count) {
+        return MR_ERROR_INVALID_PARAM;
+    }
+    *out_len = 0;
+
+    bool final = (index == r->chunk_count - 1);
+    size_t pt_len = final ? (size_t)(r->plaintext_size - index * r->chunk_size) : r->chunk_size;
+    off_t off = (off_t)(CHUNKED_GCM_HEADER_SIZE + index * CHUNKED_GCM_RECORD_SIZE((uint64_t)r->chunk_size));
+
+    if (pread_full(r->fd, r->record, pt_len + GCM_TAG_SIZE, off) != 0) {
+        return MR_ERROR_IO;
+    }
+
+    uint8_t iv[GCM_IV_SIZE];
+    uint8_t aad[AAD_LEN];
+    int len = 0;
+    record_iv(r->base_iv, index, iv);
+    record_aad(index, final, aad);
+
+    if (EVP_DecryptInit_ex(r->ctx, NULL, NULL, r->key, iv) != 1 ||
+        EVP_DecryptUpdate(r->ctx, NULL, &len, aad, AAD_LEN) != 1 ||
+        EVP_DecryptUpdate(r->ctx, out, &len, r->record, (int)pt_len) != 1 ||
+        EVP_CIPHER_CTX_ctrl(r->ctx, EVP_CTRL_GCM_SET_TAG, GCM_TAG_SIZE, r->record + pt_len) != 1) {
+        return MR_ERROR_CRYPTO;
+    }
+
+    // Final проверяет тег: при несовпадении расшифрованные данные затираются
+    if (EVP_DecryptFinal_ex(r->ctx, out + len, &len) != 1) {
+        explicit_bzero(out, pt_len);
+        return MR_ERROR_INTEGRITY;
+    }
+
+    *out_len = pt_len;
+    return MR_SUCCESS;
+}
+
+void chunked_gcm_reader_cleanup(chunked_gcm_reader_t *r) {
+    if (!r) return;
+    free(r->record);
+    EVP_CIPHER_CTX_free(r->ctx);
+    r->record = NULL;
+    r->ctx = NULL;
+}
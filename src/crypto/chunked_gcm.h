@@ -0,0 +1,107 @@
+#ifndef CHUNKED_GCM_H
+#define CHUNKED_GCM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <openssl/evp.h>
+
+#include "aes_gcm.h"       // For AES_KEY_SIZE, GCM_IV_SIZE, GCM_TAG_SIZE
+#include "../lib/error.h"  // For error_status_t
+
+// Chunked AES-256-GCM at-rest format.
+//
+// A file is a fixed header followed by independently sealed records, so any
+// byte offset can be served by seeking to one record and decrypting it alone:
+//
+//   header:  magic "MXC1" | version u8 | reserved[3] | chunk_size u32 BE |
+//            plaintext_size u64 BE | base_iv[12]
+//   record:  ciphertext (chunk_size bytes, last one shorter) | tag[16]
+//
+// Record i uses IV = base_iv XOR i (big-endian in the low 8 bytes) and AAD =
+// i (u64 BE) | final flag (u8), so records cannot be reordered, dropped or
+// truncated without failing authentication.
+
+#define CHUNKED_GCM_MAGIC        "MXC1"
+#define CHUNKED_GCM_VERSION      1
+#define CHUNKED_GCM_FORMAT_NAME  "chunked-gcm-v1"  // Value of the "format" metadata field
+#define CHUNKED_GCM_CHUNK_SIZE   (64 * 1024)
+#define CHUNKED_GCM_HEADER_SIZE  32
+#define CHUNKED_GCM_RECORD_SIZE(chunk_size) ((chunk_size) + GCM_TAG_SIZE)
+
+// Sequential writer: buffers at most one chunk of plaintext
+typedef struct {
+    EVP_CIPHER_CTX *ctx;
+    int fd;
+    const uint8_t *key;
+    uint8_t base_iv[GCM_IV_SIZE];
+    uint64_t plaintext_size;   // Bytes accepted so far
+    uint64_t chunk_index;      // Next record to seal
+    uint8_t *pending;          // Plaintext of the record being filled
+    size_t pending_len;
+    uint8_t *record;           // Scratch for ciphertext + tag
+} chunked_gcm_writer_t;
+
+// Writer position on a record boundary: everything before chunk_index is
+// sealed on disk. With the hash of that plaintext it is enough to continue
+// the file later (see chunked_gcm_writer_resume).
+typedef struct {
+    uint8_t base_iv[GCM_IV_SIZE];
+    uint64_t chunk_index;
+} chunked_gcm_position_t;
+
+// Random-access reader: decrypts one record at a time
+typedef struct {
+    EVP_CIPHER_CTX *ctx;
+    int fd;
+    const uint8_t *key;
+    uint8_t base_iv[GCM_IV_SIZE];
+    uint32_t chunk_size;
+    uint64_t plaintext_size;
+    uint64_t chunk_count;
+    uint8_t *record;
+} chunked_gcm_reader_t;
+
+// Starts a new file on fd (must be empty and positioned at 0). key must stay
+// valid until cleanup. Returns MR_SUCCESS or an error code.
+error_status_t chunked_gcm_writer_init(chunked_gcm_writer_t *w, int fd, const uint8_t *key);
+
+// Appends plaintext; full records are sealed and written as they fill up.
+error_status_t chunked_gcm_writer_update(chunked_gcm_writer_t *w, const uint8_t *data, size_t len);
+
+// Seals a buffered full record so the writer sits on a record boundary and
+// reports that position. Only call it when more plaintext will follow: the
+// sealed record is not final. Returns MR_ERROR_INVALID_PARAM if a partial
+// record is buffered. The caller is responsible for fsync of fd.
+error_status_t chunked_gcm_writer_checkpoint(chunked_gcm_writer_t *w, chunked_gcm_position_t *pos);
+
+// Continues a file at a checkpoint taken on it: records from pos->chunk_index
+// on are cut off and the writer appends after the records before it. Returns
+// MR_ERROR_INTEGRITY if the file is shorter or was started with another IV.
+// Plaintext written after the resume must be the same as the first time
+// around: the cut-off records reuse their IVs.
+error_status_t chunked_gcm_writer_resume(chunked_gcm_writer_t *w, int fd, const uint8_t *key,
+                                         const chunked_gcm_position_t *pos);
+
+// Seals the final record and writes the plaintext size into the header.
+// The caller is responsible for fsync/close/rename of fd.
+error_status_t chunked_gcm_writer_final(chunked_gcm_writer_t *w);
+
+// Releases buffers and wipes pending plaintext. Does not close fd.
+void chunked_gcm_writer_cleanup(chunked_gcm_writer_t *w);
+
+// Parses and validates the header of fd. Returns MR_ERROR_INVALID_PARAM if the
+// file is not in chunked format and MR_ERROR_INTEGRITY if the header does not
+// match the file length.
+error_status_t chunked_gcm_reader_open(chunked_gcm_reader_t *r, int fd, const uint8_t *key);
+
+// Decrypts record `index` into out (at least chunk_size bytes).
+// On success stores the plaintext length in *out_len.
+error_status_t chunked_gcm_reader_read(chunked_gcm_reader_t *r, uint64_t index,
+                                       uint8_t *out, size_t *out_len);
+
+// Releases buffers. Does not close fd.
+void chunked_gcm_reader_cleanup(chunked_gcm_reader_t *r);
+
+#endif // CHUNKED_GCM_H
@@ -16,6 +16,9 @@
 #include <bson/bson.h>
 #include <mongoc/mongoc.h>
 
+#include "db/proc_events.h"
+#include "db/event_writer.h"
+
 // Конфигурация
 #define PID_FILE "/tmp/exchange-daemon.pid"
 #define EXCHANGE_DIR "/home/just/mesh_proto/oxxyen_storage/file_dir/filetrade"
@@ -23,13 +26,14 @@
 #define MONGODB_URI "mongodb://localhost:27017"
 #define DATABASE_NAME "file_exchange"
 #define COLLECTION_NAME "file_groups"
+#define EVENTS_SPILL_FILE "/var/tmp/exchange-daemon-events.spill"
 
 #define EVENT_BUFFER_SIZE (sizeof(struct inotify_event) + NAME_MAX + 1)
-#define MAX_KEY_LENGTH 32
 
 // Глобальные переменные
 static volatile sig_atomic_t g_shutdown = 0;
 static mongoc_client_t *g_mongo_client = NULL;
+static event_writer_t *g_event_writer = NULL;
 static FILE *g_log_file = NULL;
 
 // Уровни логирования
@@ -61,164 +65,10 @@ static void logger(log_level_t level, const char *format, ...) {
     fflush(g_log_file);
 }
 
-// Получение расширения файла
-static char* get_file_extension(const char *full_path) {
-    if (!full_path) return NULL;
-    
-    const char *filename = strrchr(full_path, '/');
-    if (!filename) filename = full_path;
-    else filename++;
-    
-    const char *dot = strrchr(filename, '.');
-    if (!dot || dot == filename) {
-        return strdup("");
-    }
-    
-    return strdup(dot);
-}
-
-// Получение имени файла без расширения
-static char* get_filename_without_extension(const char* full_filename) {
-    const char *filename = strrchr(full_filename, '/');
-    if (!filename) filename = full_filename;
-    else filename++;
-    
-    const char *dot = strrchr(filename, '.');
-    size_t name_len = dot ? (size_t)(dot - filename) : strlen(filename);
-    
-    char *result = malloc(name_len + 1);
-    if (!result) {
-        logger(LOG_ERROR, "Memory allocation failed in get_filename_without_extension");
-        return NULL;
-    }
-    
-    strncpy(result, filename, name_len);
-    result[name_len] = '\0';
-    return result;
-}
-
-// Получение следующего ключа для proc map
-static char* get_next_proc_key(const char *file_id) {
-    mongoc_collection_t *coll = mongoc_client_get_collection(
-        g_mongo_client, DATABASE_NAME, COLLECTION_NAME);
-    if (!coll) {
-        logger(LOG_ERROR, "Failed to get collection for file: %s", file_id);
-        return NULL;
-    }
-    
-    bson_t *query = BCON_NEW("_id", BCON_UTF8(file_id));
-    bson_t *projection = BCON_NEW("proc", BCON_INT32(1));
-    bson_error_t error;
-    
-    char *next_key = NULL;
-    const bson_t *doc;
-    mongoc_cursor_t *cursor = mongoc_collection_find_with_opts(
-        coll, query, NULL, NULL);
-    
-    int64_t max_key = 0;
-    
-    if (mongoc_cursor_next(cursor, &doc)) {
-        bson_iter_t iter;
-        if (bson_iter_init_find(&iter, doc, "proc") && 
-            BSON_ITER_HOLDS_DOCUMENT(&iter)) {
-            
-            bson_iter_t child;
-            bson_iter_recurse(&iter, &child);
-            
-            while (bson_iter_next(&child)) {
-                const char *key_str = bson_iter_key(&child);
-                char *endptr;
-                long num = strtol(key_str, &endptr, 10);
-                
-                if (errno == 0 && *endptr == '\0' && num > 0 && num > max_key) {
-                    max_key = num;
-                }
-            }
-        }
-    } else {
-        logger(LOG_DEBUG, "No existing document found for: %s, starting from key 1", file_id);
-    }
-    
-    if (mongoc_cursor_error(cursor, &error)) {
-        logger(LOG_ERROR, "Cursor error for file %s: %s", file_id, error.message);
-    }
-    
-    mongoc_cursor_destroy(cursor);
-    bson_destroy(query);
-    bson_destroy(projection);
-    mongoc_collection_destroy(coll);
-    
-    next_key = malloc(MAX_KEY_LENGTH);
-    if (!next_key) {
-        logger(LOG_ERROR, "Memory allocation failed for next_key");
-        return NULL;
-    }
-    
-    snprintf(next_key, MAX_KEY_LENGTH, "%" PRId64, max_key + 1);
-    logger(LOG_DEBUG, "Next proc key for %s: %s", file_id, next_key);
-    return next_key;
-}
-
-// Создание базового документа файла
-static bool create_base_document(const char *fullpath) {
-    mongoc_collection_t *coll = mongoc_client_get_collection(
-        g_mongo_client, DATABASE_NAME, COLLECTION_NAME);
-    if (!coll) {
-        logger(LOG_ERROR, "Failed to get collection for base document: %s", fullpath);
-        return false;
-    }
-    
-    char *filename = get_filename_without_extension(fullpath);
-    char *extension = get_file_extension(fullpath);
-    
-    if (!filename || !extension) {
-        logger(LOG_ERROR, "Failed to parse filename/extension for: %s", fullpath);
-        free(filename);
-        free(extension);
-        mongoc_collection_destroy(coll);
-        return false;
-    }
-    
-    bson_t *doc = bson_new();
-    BSON_APPEND_UTF8(doc, "_id", fullpath);
-    BSON_APPEND_UTF8(doc, "filename", filename);
-    BSON_APPEND_UTF8(doc, "extension", extension);
-    
-    // Инициализируем пустой proc map
-    bson_t proc;
-    bson_init(&proc);
-    BSON_APPEND_DOCUMENT(doc, "proc", &proc);
-    bson_destroy(&proc);
-    
-    bson_error_t error;
-    bool success = mongoc_collection_insert_one(coll, doc, NULL, NULL, &error);
-    
-    if (!success) {
-        // Если документ уже существует, это не ошибка
-        if (error.code != 11000) { // Duplicate key error
-            logger(LOG_ERROR, "Failed to create base document for %s: %s", fullpath, error.message);
-        } else {
-            logger(LOG_DEBUG, "Base document already exists for: %s", fullpath);
-            success = true; // Документ уже существует, продолжаем
-        }
-    } else {
-        logger(LOG_INFO, "Created base document for: %s", fullpath);
-    }
-    
-    bson_destroy(doc);
-    free(filename);
-    free(extension);
-    mongoc_collection_destroy(coll);
-    
-    return success;
-}
-
-// Добавление события в proc map
+// Добавление события в proc map: в очередь фоновой записи, без неё — один upsert
 static bool append_proc_event(const char *file_id, const char *change_type, const char *status) {
-    // Сначала убедимся, что базовый документ существует
-    if (!create_base_document(file_id)) {
-        logger(LOG_ERROR, "Failed to ensure base document for: %s", file_id);
-        return false;
+    if (g_event_writer) {
+        return event_writer_push(g_event_writer, file_id, change_type, status, proc_event_now_ms());
     }
     
     mongoc_collection_t *coll = mongoc_client_get_collection(
@@ -228,55 +78,15 @@ static bool append_proc_event(const char *file_id, const char *change_type, cons
         return false;
     }
     
-    char *next_key = get_next_proc_key(file_id);
-    if (!next_key) {
-        logger(LOG_ERROR, "Failed to get next proc key for: %s", file_id);
-        mongoc_collection_destroy(coll);
-        return false;
-    }
-    
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    int64_t now_ms = (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
-    
-    // Формируем путь для обновления: "proc.<next_key>"
-    char set_path[64];
-    snprintf(set_path, sizeof(set_path), "proc.%s", next_key);
-    
-    // Создаем документ события
-    bson_t event_doc;
-    bson_init(&event_doc);
-    BSON_APPEND_DATE_TIME(&event_doc, "date", now_ms);
-    
-    bson_t info_doc;
-    bson_init(&info_doc);
-    BSON_APPEND_UTF8(&info_doc, "type_of_changes", change_type);
-    BSON_APPEND_UTF8(&info_doc, "status", status);
-    BSON_APPEND_DOCUMENT(&event_doc, "info", &info_doc);
-    
-    // Формируем операцию обновления
-    bson_t *update = BCON_NEW("$set", "{", set_path, BCON_DOCUMENT(&event_doc), "}");
-    bson_t *query = BCON_NEW("_id", BCON_UTF8(file_id));
-    
     bson_error_t error;
-    bool success = mongoc_collection_update_one(
-        coll, query, update, NULL, NULL, &error);
-    
+    bool success = proc_event_append(coll, file_id, change_type, status, proc_event_now_ms(), &error);
     if (!success) {
         logger(LOG_ERROR, "Failed to append proc event for %s: %s", file_id, error.message);
     } else {
-        logger(LOG_INFO, "Added event %s to %s: %s - %s", 
-               next_key, file_id, change_type, status);
+        logger(LOG_INFO, "Added event to %s: %s - %s", file_id, change_type, status);
     }
     
-    // Очистка
-    bson_destroy(&info_doc);
-    bson_destroy(&event_doc);
-    bson_destroy(update);
-    bson_destroy(query);
-    free(next_key);
     mongoc_collection_destroy(coll);
-    
     return success;
 }
 
@@ -350,6 +160,11 @@ static bool write_pid_file(void) {
     return true;
 }
 
+// Сообщения фоновой записи событий
+static void log_event_writer(const char *message) {
+    logger(LOG_WARNING, "Event writer: %s", message);
+}
+
 // Инициализация MongoDB
 static bool init_mongodb(void) {
     mongoc_init();
@@ -372,6 +187,18 @@ static bool init_mongodb(void) {
         return false;
     }
     
+    event_writer_config_t events = {
+        .uri = MONGODB_URI,
+        .database = DATABASE_NAME,
+        .collection = COLLECTION_NAME,
+        .spill_path = EVENTS_SPILL_FILE,
+        .on_log = log_event_writer,
+    };
+    g_event_writer = event_writer_start(&events);
+    if (!g_event_writer) {
+        logger(LOG_WARNING, "Event writer not started, events are written synchronously");
+    }
+    
     logger(LOG_INFO, "Successfully connected to MongoDB");
     return true;
 }
@@ -380,6 +207,16 @@ static bool init_mongodb(void) {
 static void cleanup_resources(void) {
     logger(LOG_INFO, "Cleaning up resources");
     
+    // Дописываем очередь событий до закрытия MongoDB
+    if (g_event_writer) {
+        event_writer_stats_t ev;
+        event_writer_stop(g_event_writer, &ev);
+        g_event_writer = NULL;
+        logger(LOG_INFO, "Events: %llu queued, %llu written, %llu spilled, %llu replayed, %llu failed",
+               (unsigned long long)ev.queued, (unsigned long long)ev.written, (unsigned long long)ev.spilled,
+               (unsigned long long)ev.replayed, (unsigned long long)ev.failed);
+    }
+    
     if (g_mongo_client) {
         mongoc_client_destroy(g_mongo_client);
         g_mongo_client = NULL;
@@ -3,3 +3,5 @@ gcc -o mongo_client mongo_client.c \
     -I/usr/include/libbson-1.0 \
     -L/usr/lib \
     -lmongoc-1.0 -lbson-1.0 -lssl -lcrypto -lsasl2 -lz
+
+gcc -o query_bench query_bench.c file_queries.c $(pkg-config --cflags --libs libmongoc-1.0)
@@ -0,0 +1,569 @@
+// db/event_writer.c
+#include "event_writer.h"
+#include "proc_events.h"
+#include "../common/mpsc_ring.h"
+
+#include <bson/bson.h>
+#include <mongoc/mongoc.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define EVENT_FIELD_LEN 24
+#define SPILL_MAGIC 0x31564550u // "PEV1"
+#define SPILL_PATH_MAX 4096
+
+// Элемент очереди; file_id выделен в куче и освобождается фоновым потоком
+typedef struct {
+    char *file_id;
+    char change_type[EVENT_FIELD_LEN];
+    char status[EVENT_FIELD_LEN];
+    int64_t date_ms;
+} event_item_t;
+
+// Запись файла сброса: заголовок, затем path_len байт пути
+typedef struct {
+    uint32_t magic;
+    uint32_t path_len;
+    int64_t date_ms;
+    char change_type[EVENT_FIELD_LEN];
+    char status[EVENT_FIELD_LEN];
+} spill_record_t;
+
+typedef enum {
+    WRITE_OK,
+    WRITE_RETRY,  // MongoDB недоступна: пачку нужно сохранить и повторить
+    WRITE_FAILED  // MongoDB отвергла событие: его повтор не поможет
+} write_result_t;
+
+struct event_writer {
+    mpsc_ring_t *ring;
+    char *uri;
+    char *database;
+    char *collection;
+    char *spill_path;
+    uint32_t batch_size;
+    uint32_t flush_ms;
+    event_writer_log_fn on_log;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;    // Фоновому потоку: пора писать
+    pthread_cond_t space;   // Производителям: в очереди освободилось место
+    int stop;               // Под lock
+    uint32_t waiting;       // Производителей ждёт места (атомарно)
+
+    event_writer_stats_t stats; // Поля счётчиков меняются атомарно
+
+    // Дальше — только фоновый поток
+    mongoc_client_t *client;
+    mongoc_collection_t *coll;
+    bool spill_pending;
+    int64_t retry_at_us;
+};
+
+// Флаг читает и event_writer_get_stats из других потоков
+static void set_spill_pending(event_writer_t *w, bool pending) {
+    __atomic_store_n(&w->spill_pending, pending, __ATOMIC_RELAXED);
+}
+
+static int64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void stat_add(uint64_t *counter, uint64_t n) {
+    __atomic_add_fetch(counter, n, __ATOMIC_RELAXED);
+}
+
+static void stat_max(uint64_t *counter, uint64_t value) {
+    uint64_t cur = __atomic_load_n(counter, __ATOMIC_RELAXED);
+    while (value > cur &&
+           !__atomic_compare_exchange_n(counter, &cur, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static void report(event_writer_t *w, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void report(event_writer_t *w, const char *fmt, ...) {
+    if (!w->on_log) return;
+    char msg[512];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, args);
+    va_end(args);
+    w->on_log(msg);
+}
+
+// ---------------------------------------------------------------------------
+// MongoDB
+
+// Клиент создаётся в фоновом потоке и используется только им. Выбор сервера
+// ограничен EVENT_WRITER_SELECT_MS, чтобы недоступная база быстро уводила
+// пачки в файл сброса, а не держала очередь.
+static bool ensure_collection(event_writer_t *w, bson_error_t *error) {
+    if (w->coll) return true;
+
+    mongoc_uri_t *uri = mongoc_uri_new_with_error(w->uri, error);
+    if (!uri) return false;
+    mongoc_uri_set_option_as_int32(uri, MONGOC_URI_SERVERSELECTIONTIMEOUTMS, EVENT_WRITER_SELECT_MS);
+    w->client = mongoc_client_new_from_uri(uri);
+    mongoc_uri_destroy(uri);
+    if (!w->client) {
+        bson_set_error(error, MONGOC_ERROR_CLIENT, MONGOC_ERROR_CLIENT_NOT_READY, "cannot create client");
+        return false;
+    }
+    mongoc_client_set_error_api(w->client, MONGOC_ERROR_API_VERSION_2);
+    w->coll = mongoc_client_get_collection(w->client, w->database, w->collection);
+    return true;
+}
+
+static bool is_transient(const bson_error_t *error) {
+    return error->domain == MONGOC_ERROR_SERVER_SELECTION ||
+           error->domain == MONGOC_ERROR_STREAM ||
+           error->domain == MONGOC_ERROR_CLIENT;
+}
+
+// Сколько операций пачки база выполнила до первой ошибки. Упорядоченная
+// bulk-операция останавливается на отвергнутом событии, его номер — в
+// writeErrors.0.index. Без writeErrors (например, ошибка write concern)
+// выполненные операции считаются по nMatched + nUpserted.
+static size_t bulk_applied(const bson_t *reply, size_t n) {
+    bson_iter_t iter, field;
+    if (bson_iter_init(&iter, reply) && bson_iter_find_descendant(&iter, "writeErrors.0.index", &field)) {
+        int64_t index = bson_iter_as_int64(&field);
+        return index < 0 ? 0 : (size_t)index < n ? (size_t)index : n;
+    }
+    int64_t applied = 0;
+    if (bson_iter_init(&iter, reply) && bson_iter_find_descendant(&iter, "nMatched", &field)) {
+        applied += bson_iter_as_int64(&field);
+    }
+    if (bson_iter_init(&iter, reply) && bson_iter_find_descendant(&iter, "nUpserted", &field)) {
+        applied += bson_iter_as_int64(&field);
+    }
+    return applied < 0 ? 0 : (size_t)applied < n ? (size_t)applied : n;
+}
+
+// Одна упорядоченная bulk-операция: события одного файла идут в порядке очереди.
+// *done — сколько событий с начала пачки записано. При WRITE_FAILED событие
+// items[*done] (если *done < n) отвергнуто, следующие за ним не отправлялись.
+static write_result_t write_batch(event_writer_t *w, const event_item_t *items, size_t n,
+                                  size_t *done, bson_error_t *error) {
+    *done = 0;
+    if (!ensure_collection(w, error)) return WRITE_RETRY;
+
+    bson_t *bulk_opts = BCON_NEW("ordered", BCON_BOOL(true));
+    bson_t *upsert = BCON_NEW("upsert", BCON_BOOL(true));
+    mongoc_bulk_operation_t *bulk = mongoc_collection_create_bulk_operation_with_opts(w->coll, bulk_opts);
+
+    // Событие, которое нельзя добавить в операцию, отвергается, как отвергла бы база
+    size_t added = 0;
+    bool ok = true;
+    for (; added < n && ok; added++) {
+        bson_t selector, update;
+        proc_event_build(&selector, &update, items[added].file_id, items[added].change_type,
+                         items[added].status, items[added].date_ms);
+        ok = mongoc_bulk_operation_update_one_with_opts(bulk, &selector, &update, upsert, error);
+        bson_destroy(&update);
+        bson_destroy(&selector);
+    }
+    if (!ok) added--;
+
+    write_result_t rc = WRITE_FAILED;
+    if (added > 0) {
+        bson_t reply;
+        bson_error_t exec_error;
+        if (mongoc_bulk_operation_execute(bulk, &reply, &exec_error) != 0) {
+            *done = added;
+            rc = ok ? WRITE_OK : WRITE_FAILED;
+        } else if (is_transient(&exec_error)) {
+            *error = exec_error;
+            rc = WRITE_RETRY;
+        } else {
+            *error = exec_error;
+            *done = bulk_applied(&reply, added);
+        }
+        bson_destroy(&reply);
+    }
+
+    mongoc_bulk_operation_destroy(bulk);
+    bson_destroy(upsert);
+    bson_destroy(bulk_opts);
+    return rc;
+}
+
+// Пишет пачку, пропуская отвергнутые события: префикс до такого события
+// засчитывается в delivered, само оно — в failed, остаток отправляется
+// заново. Возвращает WRITE_OK или WRITE_RETRY; *sent — сколько событий с
+// начала пачки обработано, остальные нужно сохранить до следующей попытки.
+static write_result_t deliver_batch(event_writer_t *w, const event_item_t *items, size_t n,
+                                    uint64_t *delivered, size_t *sent, bson_error_t *error) {
+    size_t off = 0;
+    write_result_t res = WRITE_OK;
+    while (off < n) {
+        size_t done;
+        res = write_batch(w, items + off, n - off, &done, error);
+        if (res == WRITE_RETRY) break;
+        stat_add(delivered, done);
+        off += done;
+        if (res == WRITE_FAILED && off < n) {
+            stat_add(&w->stats.failed, 1);
+            report(w, "MongoDB rejected event %s/%s for %s: %s",
+                   items[off].change_type, items[off].status, items[off].file_id, error->message);
+            off++;
+        }
+    }
+    *sent = off;
+    return res == WRITE_RETRY ? WRITE_RETRY : WRITE_OK;
+}
+
+// ---------------------------------------------------------------------------
+// Файл сброса
+
+static int write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int spill_append(event_writer_t *w, const event_item_t *items, size_t n) {
+    int fd = open(w->spill_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (fd == -1) return -1;
+    // Недописанная пачка обрезается, чтобы следующие не легли за обрывком
+    off_t size = lseek(fd, 0, SEEK_END);
+
+    int rc = size < 0 ? -1 : 0;
+    for (size_t i = 0; i < n && rc == 0; i++) {
+        spill_record_t rec = {0};
+        rec.magic = SPILL_MAGIC;
+        rec.path_len = (uint32_t)strlen(items[i].file_id);
+        rec.date_ms = items[i].date_ms;
+        memcpy(rec.change_type, items[i].change_type, sizeof(rec.change_type));
+        memcpy(rec.status, items[i].status, sizeof(rec.status));
+        rc = write_all(fd, &rec, sizeof(rec));
+        if (rc == 0) rc = write_all(fd, items[i].file_id, rec.path_len);
+    }
+    if (rc == 0) rc = fdatasync(fd);
+    if (rc != 0 && size >= 0) {
+        int saved = errno;
+        if (ftruncate(fd, size) == 0) errno = saved;
+    }
+    close(fd);
+    return rc;
+}
+
+// Читает следующую запись; false в конце файла или на оборванной записи
+static bool spill_read(FILE *fp, event_item_t *item) {
+    spill_record_t rec;
+    if (fread(&rec, sizeof(rec), 1, fp) != 1) return false;
+    if (rec.magic != SPILL_MAGIC || rec.path_len == 0 || rec.path_len >= SPILL_PATH_MAX) return false;
+
+    item->file_id = malloc(rec.path_len + 1);
+    if (!item->file_id) return false;
+    if (fread(item->file_id, 1, rec.path_len, fp) != rec.path_len) {
+        free(item->file_id);
+        return false;
+    }
+    item->file_id[rec.path_len] = '\0';
+    item->date_ms = rec.date_ms;
+    memcpy(item->change_type, rec.change_type, sizeof(item->change_type));
+    memcpy(item->status, rec.status, sizeof(item->status));
+    item->change_type[EVENT_FIELD_LEN - 1] = '\0';
+    item->status[EVENT_FIELD_LEN - 1] = '\0';
+    return true;
+}
+
+// Оставляет в файле сброса только записи начиная с offset
+static int spill_keep_tail(event_writer_t *w, FILE *fp, long offset) {
+    if (offset == 0) return 0;
+
+    char tmp[SPILL_PATH_MAX + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", w->spill_path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1) return -1;
+
+    int rc = fseek(fp, offset, SEEK_SET);
+    char buf[65536];
+    size_t n;
+    while (rc == 0 && (n = fread(buf, 1, sizeof(buf), fp)) > 0) rc = write_all(fd, buf, n);
+    if (rc == 0 && ferror(fp)) rc = -1;
+    if (rc == 0) rc = fdatasync(fd);
+    close(fd);
+    if (rc == 0) rc = rename(tmp, w->spill_path);
+    if (rc != 0) unlink(tmp);
+    return rc;
+}
+
+// Переносит файл сброса в MongoDB. 0 — файл отправлен и удалён, -1 — база
+// снова недоступна; неотправленный хвост остаётся в файле.
+static int spill_replay(event_writer_t *w, event_item_t *items) {
+    FILE *fp = fopen(w->spill_path, "rb");
+    if (!fp) return errno == ENOENT ? 0 : -1;
+
+    int rc = 0;
+    for (;;) {
+        long start = ftell(fp);
+        size_t n = 0;
+        while (n < w->batch_size && spill_read(fp, &items[n])) n++;
+        if (n == 0) {
+            if (!feof(fp) && fgetc(fp) != EOF) {
+                report(w, "Spill file %s has a damaged record at offset %ld, the rest is dropped",
+                       w->spill_path, start);
+            }
+            break;
+        }
+
+        bson_error_t error;
+        size_t sent;
+        write_result_t res = deliver_batch(w, items, n, &w->stats.replayed, &sent, &error);
+        for (size_t i = 0; i < n; i++) free(items[i].file_id);
+
+        if (res == WRITE_RETRY) {
+            // Обработанные события пачки (записанные и отвергнутые) из файла уходят
+            long tail = start;
+            if (sent > 0 && fseek(fp, start, SEEK_SET) == 0) {
+                event_item_t skip;
+                for (size_t i = 0; i < sent && spill_read(fp, &skip); i++) free(skip.file_id);
+                tail = ftell(fp);
+            }
+            if (tail < 0 || spill_keep_tail(w, fp, tail) != 0) {
+                report(w, "Cannot trim spill file %s: %s", w->spill_path, strerror(errno));
+            }
+            rc = -1;
+            break;
+        }
+    }
+
+    fclose(fp);
+    if (rc == 0) unlink(w->spill_path);
+    return rc;
+}
+
+// ---------------------------------------------------------------------------
+// Фоновый поток
+
+static void flush(event_writer_t *w, event_item_t *items, size_t n, event_item_t *scratch) {
+    int64_t start = monotonic_us();
+
+    if (w->spill_pending && start >= w->retry_at_us) {
+        if (spill_replay(w, scratch) == 0) {
+            set_spill_pending(w, false);
+            report(w, "MongoDB is reachable again, spill file %s delivered", w->spill_path);
+        } else {
+            w->retry_at_us = start + (int64_t)EVENT_WRITER_RETRY_MS * 1000;
+        }
+    }
+    if (n == 0) return;
+
+    size_t sent = 0;
+    if (!w->spill_pending) {
+        bson_error_t error;
+        if (deliver_batch(w, items, n, &w->stats.written, &sent, &error) == WRITE_RETRY) {
+            report(w, "MongoDB unavailable (%s), events go to %s", error.message, w->spill_path);
+            set_spill_pending(w, true);
+            w->retry_at_us = monotonic_us() + (int64_t)EVENT_WRITER_RETRY_MS * 1000;
+        }
+    }
+
+    // Пока файл сброса не пуст, события идут за ним, чтобы не обогнать его
+    if (w->spill_pending && sent < n) {
+        size_t rest = n - sent;
+        if (spill_append(w, items + sent, rest) == 0) {
+            stat_add(&w->stats.spilled, rest);
+        } else {
+            stat_add(&w->stats.failed, rest);
+            report(w, "Cannot write spill file %s: %s; %zu events lost", w->spill_path, strerror(errno), rest);
+        }
+    }
+
+    uint64_t took = (uint64_t)(monotonic_us() - start);
+    stat_add(&w->stats.flushes, 1);
+    stat_add(&w->stats.flush_us_total, took);
+    stat_max(&w->stats.flush_us_max, took);
+}
+
+static void *writer_main(void *arg) {
+    event_writer_t *w = arg;
+    event_item_t *items = calloc(w->batch_size, sizeof(*items));
+    event_item_t *scratch = calloc(w->batch_size, sizeof(*scratch));
+    if (!items || !scratch) {
+        report(w, "Event writer out of memory, queue is not drained");
+        free(items);
+        free(scratch);
+        return NULL;
+    }
+
+    for (;;) {
+        pthread_mutex_lock(&w->lock);
+        if (!w->stop && mpsc_ring_depth(w->ring) < w->batch_size) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += (long)(w->flush_ms % 1000) * 1000000;
+            deadline.tv_sec += w->flush_ms / 1000 + deadline.tv_nsec / 1000000000;
+            deadline.tv_nsec %= 1000000000;
+            pthread_cond_timedwait(&w->wake, &w->lock, &deadline);
+        }
+        int stop = w->stop;
+        pthread_mutex_unlock(&w->lock);
+
+        size_t n = 0;
+        while (n < w->batch_size && mpsc_ring_pop(w->ring, &items[n])) n++;
+        if (n > 0 && __atomic_load_n(&w->waiting, __ATOMIC_RELAXED) > 0) {
+            pthread_mutex_lock(&w->lock);
+            pthread_cond_broadcast(&w->space);
+            pthread_mutex_unlock(&w->lock);
+        }
+
+        if (n > 0 || w->spill_pending) flush(w, items, n, scratch);
+        for (size_t i = 0; i < n; i++) free(items[i].file_id);
+
+        if (stop && n == 0) break;
+    }
+
+    free(scratch);
+    free(items);
+    return NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Интерфейс
+
+event_writer_t *event_writer_start(const event_writer_config_t *config) {
+    event_writer_t *w = calloc(1, sizeof(*w));
+    if (!w) return NULL;
+
+    w->batch_size = config->batch_size ? config->batch_size : EVENT_WRITER_BATCH;
+    w->flush_ms = config->flush_ms ? config->flush_ms : EVENT_WRITER_FLUSH_MS;
+    w->on_log = config->on_log;
+    w->uri = strdup(config->uri);
+    w->database = strdup(config->database);
+    w->collection = strdup(config->collection);
+    w->spill_path = strdup(config->spill_path);
+    w->ring = mpsc_ring_new(EVENT_WRITER_CAPACITY, sizeof(event_item_t));
+    if (!w->uri || !w->database || !w->collection || !w->spill_path || !w->ring) goto fail;
+
+    // События, не отправленные прошлым запуском, уходят первыми
+    w->spill_pending = access(w->spill_path, F_OK) == 0;
+
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->wake, NULL);
+    pthread_cond_init(&w->space, NULL);
+    if (pthread_create(&w->thread, NULL, writer_main, w) != 0) {
+        pthread_cond_destroy(&w->space);
+        pthread_cond_destroy(&w->wake);
+        pthread_mutex_destroy(&w->lock);
+        goto fail;
+    }
+    return w;
+
+fail:
+    mpsc_ring_free(w->ring);
+    free(w->spill_path);
+    free(w->collection);
+    free(w->database);
+    free(w->uri);
+    free(w);
+    return NULL;
+}
+
+bool event_writer_push(event_writer_t *w, const char *file_id,
+                       const char *change_type, const char *status, int64_t date_ms) {
+    event_item_t item;
+    item.file_id = strdup(file_id);
+    if (!item.file_id) return false;
+    snprintf(item.change_type, sizeof(item.change_type), "%s", change_type);
+    snprintf(item.status, sizeof(item.status), "%s", status);
+    item.date_ms = date_ms;
+
+    if (!mpsc_ring_push(w->ring, &item)) {
+        // Очередь полна: будим фоновый поток и ждём, пока он её разгрузит
+        stat_add(&w->stats.stalls, 1);
+        bool queued = false;
+        pthread_mutex_lock(&w->lock);
+        __atomic_add_fetch(&w->waiting, 1, __ATOMIC_RELAXED);
+        while (!w->stop && !(queued = mpsc_ring_push(w->ring, &item))) {
+            pthread_cond_signal(&w->wake);
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += 10 * 1000000;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000;
+            deadline.tv_nsec %= 1000000000;
+            pthread_cond_timedwait(&w->space, &w->lock, &deadline);
+        }
+        __atomic_sub_fetch(&w->waiting, 1, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&w->lock);
+        if (!queued) {
+            free(item.file_id);
+            return false;
+        }
+    }
+
+    stat_add(&w->stats.queued, 1);
+    size_t depth = mpsc_ring_depth(w->ring);
+    stat_max(&w->stats.depth_max, depth);
+    // Без мьютекса: пропущенный сигнал лишь откладывает запись до flush_ms
+    if (depth >= w->batch_size) pthread_cond_signal(&w->wake);
+    return true;
+}
+
+void event_writer_get_stats(event_writer_t *w, event_writer_stats_t *out) {
+    out->queued = __atomic_load_n(&w->stats.queued, __ATOMIC_RELAXED);
+    out->written = __atomic_load_n(&w->stats.written, __ATOMIC_RELAXED);
+    out->spilled = __atomic_load_n(&w->stats.spilled, __ATOMIC_RELAXED);
+    out->replayed = __atomic_load_n(&w->stats.replayed, __ATOMIC_RELAXED);
+    out->failed = __atomic_load_n(&w->stats.failed, __ATOMIC_RELAXED);
+    out->stalls = __atomic_load_n(&w->stats.stalls, __ATOMIC_RELAXED);
+    out->depth = mpsc_ring_depth(w->ring);
+    out->depth_max = __atomic_load_n(&w->stats.depth_max, __ATOMIC_RELAXED);
+    out->flushes = __atomic_load_n(&w->stats.flushes, __ATOMIC_RELAXED);
+    out->flush_us_total = __atomic_load_n(&w->stats.flush_us_total, __ATOMIC_RELAXED);
+    out->flush_us_max = __atomic_load_n(&w->stats.flush_us_max, __ATOMIC_RELAXED);
+    out->spill_pending = __atomic_load_n(&w->spill_pending, __ATOMIC_RELAXED);
+}
+
+void event_writer_stop(event_writer_t *w, event_writer_stats_t *final_stats) {
+    if (!w) return;
+
+    pthread_mutex_lock(&w->lock);
+    w->stop = 1;
+    pthread_cond_signal(&w->wake);
+    pthread_cond_broadcast(&w->space);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+
+    // Событие, попавшее в очередь во время остановки, уже некому записать
+    event_item_t item;
+    while (mpsc_ring_pop(w->ring, &item)) {
+        stat_add(&w->stats.failed, 1);
+        free(item.file_id);
+    }
+    if (final_stats) event_writer_get_stats(w, final_stats);
+
+    if (w->coll) mongoc_collection_destroy(w->coll);
+    if (w->client) mongoc_client_destroy(w->client);
+    pthread_cond_destroy(&w->space);
+    pthread_cond_destroy(&w->wake);
+    pthread_mutex_destroy(&w->lock);
+    mpsc_ring_free(w->ring);
+    free(w->spill_path);
+    free(w->collection);
+    free(w->database);
+    free(w->uri);
+    free(w);
+}
@@ -0,0 +1,90 @@
+// db/event_writer.h
+#ifndef EVENT_WRITER_H
+#define EVENT_WRITER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Асинхронная запись событий proc map (см. proc_events.h).
+ *
+ * Потоки запросов кладут событие в lock-free очередь (common/mpsc_ring.h) и
+ * сразу продолжают работу. Фоновый поток забирает события пачками и пишет
+ * их одной упорядоченной bulk-операцией: как только набралось batch_size
+ * событий или прошло flush_ms с прошлой записи. Порядок событий одного
+ * файла сохраняется.
+ * Событие, которое MongoDB отвергла, отбрасывается и считается в failed;
+ * события пачки до и после него записываются.
+ *
+ * Обратное давление: если очередь заполнена, event_writer_push ждёт, пока
+ * фоновый поток её разгрузит. Очередь не стоит и при недоступной MongoDB:
+ * тогда пачки дописываются в файл сброса (spill) с fdatasync. Раз в
+ * EVENT_WRITER_RETRY_MS поток пробует переотправить файл. Пока файл не
+ * пуст, новые события идут за ним в конец файла, и порядок сохраняется.
+ * Файл, оставшийся от прошлого запуска, отправляется первым. Доставка
+ * «хотя бы один раз»: если соединение оборвалось посреди пачки, часть её
+ * может записаться повторно.
+ */
+
+#define EVENT_WRITER_CAPACITY 8192   // Событий в очереди
+#define EVENT_WRITER_BATCH 256       // Событий в одной bulk-операции
+#define EVENT_WRITER_FLUSH_MS 200    // Наибольшая задержка записи неполной пачки
+#define EVENT_WRITER_RETRY_MS 5000   // Пауза между попытками отправить файл сброса
+#define EVENT_WRITER_SELECT_MS 2000  // Ожидание сервера MongoDB до перехода на файл сброса
+
+typedef struct event_writer event_writer_t;
+
+// Вызывается из фонового потока: сбой записи, переход на файл сброса и обратно
+typedef void (*event_writer_log_fn)(const char *message);
+
+typedef struct {
+    const char *uri;            // Строка подключения MongoDB
+    const char *database;
+    const char *collection;
+    const char *spill_path;     // Файл сброса
+    uint32_t batch_size;        // 0 — EVENT_WRITER_BATCH
+    uint32_t flush_ms;          // 0 — EVENT_WRITER_FLUSH_MS
+    event_writer_log_fn on_log; // Может быть NULL
+} event_writer_config_t;
+
+typedef struct {
+    uint64_t queued;            // Принято event_writer_push
+    uint64_t written;           // Записано в MongoDB напрямую
+    uint64_t spilled;           // Записано в файл сброса
+    uint64_t replayed;          // Перенесено из файла сброса в MongoDB
+    uint64_t failed;            // Отвергнуто MongoDB или не записано никуда
+    uint64_t stalls;            // push ждал места в полной очереди
+    uint64_t depth;             // Событий в очереди сейчас
+    uint64_t depth_max;
+    uint64_t flushes;           // Записанных пачек
+    uint64_t flush_us_total;    // Время записи пачек (MongoDB или файл)
+    uint64_t flush_us_max;
+    bool spill_pending;         // В файле сброса есть неотправленные события
+} event_writer_stats_t;
+
+/**
+ * @brief Запускает фоновый поток записи.
+ * @return Писатель или NULL, если не хватило памяти или поток не создался.
+ */
+event_writer_t *event_writer_start(const event_writer_config_t *config);
+
+/**
+ * @brief Ставит событие в очередь. Строки копируются.
+ *
+ * Ждёт, если очередь полна. @return false только после event_writer_stop
+ * или при нехватке памяти.
+ */
+bool event_writer_push(event_writer_t *writer, const char *file_id,
+                       const char *change_type, const char *status, int64_t date_ms);
+
+void event_writer_get_stats(event_writer_t *writer, event_writer_stats_t *out);
+
+/**
+ * @brief Записывает всё, что осталось в очереди (в MongoDB или в файл
+ * сброса), и останавливает поток. Писатель освобождается.
+ *
+ * @param final_stats Если не NULL, сюда попадают итоговые счётчики.
+ */
+void event_writer_stop(event_writer_t *writer, event_writer_stats_t *final_stats);
+
+#endif
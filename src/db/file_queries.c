@@ -0,0 +1,208 @@
+// db/file_queries.c
+#include "file_queries.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Индексы коллекции файлов. Ключи LIST заканчиваются uploaded_at и _id в том же
+// порядке, что и сортировка LIST: каждая ветка $or читается уже упорядоченной.
+static bson_t *index_specs(void) {
+    return BCON_NEW(
+        "0", "{",
+            "key", "{", "owner_fingerprint", BCON_INT32(1), "deleted", BCON_INT32(1),
+                        "uploaded_at", BCON_INT32(-1), "_id", BCON_INT32(-1), "}",
+            "name", BCON_UTF8("owner_uploaded"),
+        "}",
+        "1", "{",
+            "key", "{", "recipient_fingerprint", BCON_INT32(1), "deleted", BCON_INT32(1),
+                        "uploaded_at", BCON_INT32(-1), "_id", BCON_INT32(-1), "}",
+            "name", BCON_UTF8("recipient_uploaded"),
+        "}",
+        "2", "{",
+            "key", "{", "public", BCON_INT32(1), "deleted", BCON_INT32(1),
+                        "uploaded_at", BCON_INT32(-1), "_id", BCON_INT32(-1), "}",
+            "name", BCON_UTF8("public_uploaded"),
+        "}",
+        "3", "{",
+            "key", "{", "filename", BCON_INT32(1), "deleted", BCON_INT32(1), "}",
+            "name", BCON_UTF8("filename_deleted"),
+        "}",
+        "4", "{",
+            "key", "{", "blake3", BCON_INT32(1), "size", BCON_INT32(1), "}",
+            "name", BCON_UTF8("blake3_size"),
+        "}",
+        "5", "{",
+            "key", "{", "chunks.id", BCON_INT32(1), "}",
+            "name", BCON_UTF8("chunks_id"),
+        "}"
+    );
+}
+
+bool file_queries_ensure_indexes(mongoc_collection_t *files, bson_error_t *error) {
+    bson_t *specs = index_specs();
+    bson_t cmd;
+    bson_init(&cmd);
+    BSON_APPEND_UTF8(&cmd, "createIndexes", mongoc_collection_get_name(files));
+    BSON_APPEND_ARRAY(&cmd, "indexes", specs);
+
+    bool ok = mongoc_collection_command_simple(files, &cmd, NULL, NULL, error);
+
+    bson_destroy(&cmd);
+    bson_destroy(specs);
+    return ok;
+}
+
+// Ветка $or фильтра LIST. Условия deleted и позиции повторены в каждой ветке,
+// чтобы попасть в границы её индекса.
+static void list_branch(bson_t *branches, const char *key, const char *field, const char *fingerprint,
+                        const file_list_position_t *after) {
+    bson_t branch;
+    BSON_APPEND_DOCUMENT_BEGIN(branches, key, &branch);
+    if (fingerprint) BSON_APPEND_UTF8(&branch, field, fingerprint);
+    else BSON_APPEND_BOOL(&branch, field, true);
+    BSON_APPEND_BOOL(&branch, "deleted", false);
+
+    if (after) {
+        // uploaded_at <= T ограничивает просмотр индекса; при равном uploaded_at
+        // дальше идут только меньшие _id (их проверяет индекс, без чтения документа)
+        bson_t range, tie, tie_lt, tie_id, id_lt;
+        BSON_APPEND_DOCUMENT_BEGIN(&branch, "uploaded_at", &range);
+        BSON_APPEND_DATE_TIME(&range, "$lte", after->uploaded_at);
+        bson_append_document_end(&branch, &range);
+
+        BSON_APPEND_ARRAY_BEGIN(&branch, "$or", &tie);
+        BSON_APPEND_DOCUMENT_BEGIN(&tie, "0", &tie_lt);
+        BSON_APPEND_DOCUMENT_BEGIN(&tie_lt, "uploaded_at", &range);
+        BSON_APPEND_DATE_TIME(&range, "$lt", after->uploaded_at);
+        bson_append_document_end(&tie_lt, &range);
+        bson_append_document_end(&tie, &tie_lt);
+        BSON_APPEND_DOCUMENT_BEGIN(&tie, "1", &tie_id);
+        BSON_APPEND_DOCUMENT_BEGIN(&tie_id, "_id", &id_lt);
+        BSON_APPEND_OID(&id_lt, "$lt", &after->id);
+        bson_append_document_end(&tie_id, &id_lt);
+        bson_append_document_end(&tie, &tie_id);
+        bson_append_array_end(&branch, &tie);
+    }
+    bson_append_document_end(branches, &branch);
+}
+
+bson_t *file_queries_list_filter(const char *fingerprint, const file_list_position_t *after) {
+    bson_t *filter = bson_new();
+    bson_t branches;
+    BSON_APPEND_ARRAY_BEGIN(filter, "$or", &branches);
+    list_branch(&branches, "0", "owner_fingerprint", fingerprint, after);
+    list_branch(&branches, "1", "recipient_fingerprint", fingerprint, after);
+    list_branch(&branches, "2", "public", NULL, after);
+    bson_append_array_end(filter, &branches);
+    return filter;
+}
+
+bool file_queries_list_position(const bson_t *doc, file_list_position_t *out) {
+    bson_iter_t iter;
+    if (!bson_iter_init_find(&iter, doc, "uploaded_at") || !BSON_ITER_HOLDS_DATE_TIME(&iter)) return false;
+    out->uploaded_at = bson_iter_date_time(&iter);
+    if (!bson_iter_init_find(&iter, doc, "_id") || !BSON_ITER_HOLDS_OID(&iter)) return false;
+    bson_oid_copy(bson_iter_oid(&iter), &out->id);
+    return true;
+}
+
+bson_t *file_queries_list_opts(void) {
+    return BCON_NEW(
+        "projection", "{",
+            "filename", BCON_INT32(1),
+            "size", BCON_INT32(1),
+            "uploaded_at", BCON_INT32(1),
+            "public", BCON_INT32(1),
+            "owner_fingerprint", BCON_INT32(1),
+            "recipient_fingerprint", BCON_INT32(1),
+        "}",
+        "sort", "{", "uploaded_at", BCON_INT32(-1), "_id", BCON_INT32(-1), "}"
+    );
+}
+
+static void plan_append(file_query_plan_t *out, const char *text) {
+    size_t used = strlen(out->plan);
+    if (used + 1 >= sizeof(out->plan)) return;
+    int n = snprintf(out->plan + used, sizeof(out->plan) - used, "%s%s", used ? " > " : "", text);
+    // Не влезло: обрезаем многоточием
+    if (n < 0 || (size_t)n >= sizeof(out->plan) - used) {
+        memcpy(out->plan + sizeof(out->plan) - 4, "...", 4);
+    }
+}
+
+// Обходит дерево плана: стадия узла, затем вложенные (inputStage, inputStages, shards...)
+static void plan_walk(const bson_t *node, file_query_plan_t *out) {
+    bson_iter_t iter;
+    const char *stage = NULL, *index = NULL;
+    if (bson_iter_init_find(&iter, node, "stage") && BSON_ITER_HOLDS_UTF8(&iter)) {
+        stage = bson_iter_utf8(&iter, NULL);
+    }
+    if (bson_iter_init_find(&iter, node, "indexName") && BSON_ITER_HOLDS_UTF8(&iter)) {
+        index = bson_iter_utf8(&iter, NULL);
+    }
+    if (stage) {
+        char text[128];
+        if (index) snprintf(text, sizeof(text), "%s(%s)", stage, index);
+        else snprintf(text, sizeof(text), "%s", stage);
+        plan_append(out, text);
+        if (strcmp(stage, "COLLSCAN") == 0) out->collscan = true;
+    }
+
+    if (!bson_iter_init(&iter, node)) return;
+    while (bson_iter_next(&iter)) {
+        if (!BSON_ITER_HOLDS_DOCUMENT(&iter) && !BSON_ITER_HOLDS_ARRAY(&iter)) continue;
+        uint32_t len;
+        const uint8_t *data;
+        bson_t child;
+        if (BSON_ITER_HOLDS_DOCUMENT(&iter)) bson_iter_document(&iter, &len, &data);
+        else bson_iter_array(&iter, &len, &data);
+        if (bson_init_static(&child, data, len)) plan_walk(&child, out);
+    }
+}
+
+static int64_t stat_value(const bson_t *reply, const char *path) {
+    bson_iter_t iter, field;
+    if (bson_iter_init(&iter, reply) && bson_iter_find_descendant(&iter, path, &field)) {
+        return bson_iter_as_int64(&field);
+    }
+    return 0;
+}
+
+bool file_queries_explain(mongoc_collection_t *files, const bson_t *filter, const bson_t *opts,
+                          bool execute, file_query_plan_t *out, bson_error_t *error) {
+    memset(out, 0, sizeof(*out));
+
+    bson_t cmd, find;
+    bson_init(&cmd);
+    BSON_APPEND_DOCUMENT_BEGIN(&cmd, "explain", &find);
+    BSON_APPEND_UTF8(&find, "find", mongoc_collection_get_name(files));
+    BSON_APPEND_DOCUMENT(&find, "filter", filter);
+    if (opts) bson_concat(&find, opts);
+    bson_append_document_end(&cmd, &find);
+    BSON_APPEND_UTF8(&cmd, "verbosity", execute ? "executionStats" : "queryPlanner");
+
+    bson_t reply;
+    bool ok = mongoc_collection_command_simple(files, &cmd, NULL, &reply, error);
+    if (ok) {
+        bson_iter_t iter, plan;
+        if (bson_iter_init(&iter, &reply) && bson_iter_find_descendant(&iter, "queryPlanner.winningPlan", &plan) &&
+            BSON_ITER_HOLDS_DOCUMENT(&plan)) {
+            uint32_t len;
+            const uint8_t *data;
+            bson_t winning;
+            bson_iter_document(&plan, &len, &data);
+            if (bson_init_static(&winning, data, len)) plan_walk(&winning, out);
+        }
+        if (execute) {
+            out->executed = true;
+            out->returned = stat_value(&reply, "executionStats.nReturned");
+            out->keys_examined = stat_value(&reply, "executionStats.totalKeysExamined");
+            out->docs_examined = stat_value(&reply, "executionStats.totalDocsExamined");
+            out->millis = stat_value(&reply, "executionStats.executionTimeMillis");
+        }
+    }
+
+    bson_destroy(&reply);
+    bson_destroy(&cmd);
+    return ok;
+}
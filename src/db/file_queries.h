@@ -0,0 +1,79 @@
+// db/file_queries.h
+#ifndef FILE_QUERIES_H
+#define FILE_QUERIES_H
+
+#include <bson/bson.h>
+#include <mongoc/mongoc.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Горячие запросы к коллекции метаданных файлов (file_groups) и индексы под них.
+ *
+ * - LIST: свои файлы, адресованные мне и публичные, без удалённых, новые первыми.
+ *   Каждая ветка $or идёт по своему индексу (владелец, получатель, public), все
+ *   три уже упорядочены по uploaded_at, поэтому сервер сливает ветки
+ *   (SORT_MERGE) без сортировки в памяти. Следующая страница начинается с
+ *   позиции (uploaded_at, _id) последнего документа прошлой: граница попадает
+ *   в границы индекса, и страница не дороже первой.
+ * - Поиск текущей записи по имени (скачивание, замена при повторной загрузке).
+ * - Проверка «уже есть»: blake3 + size, и чанки по chunks.id.
+ *
+ * file_queries_explain() показывает план и статистику выполнения запроса;
+ * им пользуются проверка при запуске сервера и утилита query_bench.
+ */
+
+#define FILE_QUERIES_PLAN_LEN 256
+
+// Позиция документа в порядке LIST
+typedef struct {
+    int64_t uploaded_at; // мс с эпохи
+    bson_oid_t id;
+} file_list_position_t;
+
+typedef struct {
+    char plan[FILE_QUERIES_PLAN_LEN]; // Стадии выигравшего плана сверху вниз, для IXSCAN — имя индекса
+    bool collscan;                    // В плане есть полный просмотр коллекции
+    bool executed;                    // Заполнены поля ниже (verbosity executionStats)
+    int64_t returned;
+    int64_t keys_examined;
+    int64_t docs_examined;
+    int64_t millis;
+} file_query_plan_t;
+
+/**
+ * @brief Создаёт индексы коллекции файлов. Уже существующие не трогаются.
+ *
+ * Построение на большой коллекции идёт долго, но запросы при этом не блокирует.
+ * @return true при успехе; при ошибке заполняет error.
+ */
+bool file_queries_ensure_indexes(mongoc_collection_t *files, bson_error_t *error);
+
+/**
+ * @brief Фильтр LIST для клиента с отпечатком fingerprint. Освобождается bson_destroy.
+ *
+ * @param after Если не NULL, только документы после этой позиции (следующая страница).
+ */
+bson_t *file_queries_list_filter(const char *fingerprint, const file_list_position_t *after);
+
+/**
+ * @brief Позиция документа из результата LIST. @return false, если нет uploaded_at или _id.
+ */
+bool file_queries_list_position(const bson_t *doc, file_list_position_t *out);
+
+/**
+ * @brief Опции LIST: проекция и порядок (uploaded_at, затем _id, по убыванию).
+ */
+bson_t *file_queries_list_opts(void);
+
+/**
+ * @brief Выполняет команду explain для find с фильтром filter.
+ *
+ * @param opts    Опции find (sort, projection, limit...), может быть NULL.
+ * @param execute true — запрос выполняется (executionStats), false — только
+ *                выбор плана (queryPlanner), это дёшево на любой коллекции.
+ */
+bool file_queries_explain(mongoc_collection_t *files, const bson_t *filter, const bson_t *opts,
+                          bool execute, file_query_plan_t *out, bson_error_t *error);
+
+#endif
@@ -0,0 +1,181 @@
+// db/mongo_pool.c
+#include "mongo_pool.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Кешированный дескриптор коллекции
+typedef struct {
+    char *database;
+    char *name;
+    mongoc_collection_t *coll;
+} cached_collection_t;
+
+// Состояние потока: его клиент и коллекции этого клиента
+typedef struct {
+    mongoc_client_t *client;
+    cached_collection_t colls[MONGO_POOL_COLLECTIONS];
+    size_t count;
+    size_t next_evict;
+} thread_slot_t;
+
+static mongoc_client_pool_t *g_pool = NULL;
+static mongoc_uri_t *g_uri = NULL;
+
+static pthread_key_t g_slot_key;
+static pthread_once_t g_slot_once = PTHREAD_ONCE_INIT;
+
+static mongo_pool_stats_t g_stats;
+
+static void cached_collection_clear(cached_collection_t *entry) {
+    mongoc_collection_destroy(entry->coll);
+    free(entry->database);
+    free(entry->name);
+    entry->coll = NULL;
+    entry->database = NULL;
+    entry->name = NULL;
+}
+
+static void slot_release(thread_slot_t *slot) {
+    for (size_t i = 0; i < slot->count; i++) {
+        cached_collection_clear(&slot->colls[i]);
+    }
+    slot->count = 0;
+    slot->next_evict = 0;
+    if (slot->client) {
+        mongoc_client_pool_push(g_pool, slot->client);
+        slot->client = NULL;
+    }
+}
+
+// Деструктор ключа: поток завершился, клиент возвращается в пул
+static void slot_free(void *arg) {
+    thread_slot_t *slot = arg;
+    if (g_pool) slot_release(slot);
+    free(slot);
+}
+
+static void slot_key_init(void) {
+    pthread_key_create(&g_slot_key, slot_free);
+}
+
+static thread_slot_t *thread_slot(void) {
+    pthread_once(&g_slot_once, slot_key_init);
+    thread_slot_t *slot = pthread_getspecific(g_slot_key);
+    if (slot) return slot;
+
+    slot = calloc(1, sizeof(*slot));
+    if (!slot) return NULL;
+    if (pthread_setspecific(g_slot_key, slot) != 0) {
+        free(slot);
+        return NULL;
+    }
+    return slot;
+}
+
+bool mongo_pool_init(const char *uri, const char *appname, bson_error_t *error) {
+    g_uri = mongoc_uri_new_with_error(uri, error);
+    if (!g_uri) return false;
+
+    g_pool = mongoc_client_pool_new(g_uri);
+    if (!g_pool) {
+        bson_set_error(error, MONGOC_ERROR_CLIENT, MONGOC_ERROR_CLIENT_NOT_READY, "cannot create client pool");
+        mongoc_uri_destroy(g_uri);
+        g_uri = NULL;
+        return false;
+    }
+    mongoc_client_pool_set_error_api(g_pool, MONGOC_ERROR_API_VERSION_2);
+    mongoc_client_pool_max_size(g_pool, MONGO_POOL_MAX_SIZE);
+    if (appname) mongoc_client_pool_set_appname(g_pool, appname);
+
+    // Проверяем соединение клиентом из пула; он сразу возвращается
+    mongoc_client_t *client = mongoc_client_pool_pop(g_pool);
+    bson_t *ping = BCON_NEW("ping", BCON_INT32(1));
+    bool ok = mongoc_client_command_simple(client, "admin", ping, NULL, NULL, error);
+    bson_destroy(ping);
+    mongoc_client_pool_push(g_pool, client);
+
+    if (!ok) mongo_pool_shutdown();
+    return ok;
+}
+
+bool mongo_pool_ready(void) {
+    return g_pool != NULL;
+}
+
+mongoc_client_t *mongo_pool_client(void) {
+    thread_slot_t *slot = thread_slot();
+    if (!slot || !g_pool) return NULL;
+    if (!slot->client) {
+        slot->client = mongoc_client_pool_pop(g_pool);
+        __atomic_add_fetch(&g_stats.acquired, 1, __ATOMIC_RELAXED);
+    }
+    return slot->client;
+}
+
+mongoc_collection_t *mongo_pool_collection(const char *database, const char *collection) {
+    mongoc_client_t *client = mongo_pool_client();
+    if (!client) return NULL;
+    thread_slot_t *slot = pthread_getspecific(g_slot_key);
+
+    for (size_t i = 0; i < slot->count; i++) {
+        if (strcmp(slot->colls[i].name, collection) == 0 && strcmp(slot->colls[i].database, database) == 0) {
+            __atomic_add_fetch(&g_stats.collection_hits, 1, __ATOMIC_RELAXED);
+            return slot->colls[i].coll;
+        }
+    }
+
+    char *database_copy = strdup(database);
+    char *name_copy = strdup(collection);
+    mongoc_collection_t *coll = database_copy && name_copy
+                                    ? mongoc_client_get_collection(client, database, collection)
+                                    : NULL;
+    if (!coll) {
+        free(database_copy);
+        free(name_copy);
+        return NULL;
+    }
+    __atomic_add_fetch(&g_stats.collection_misses, 1, __ATOMIC_RELAXED);
+
+    // Кеш полон: вытесняем по кругу. Дескриптор вытесненной записи закрывается,
+    // поэтому он действителен лишь до MONGO_POOL_COLLECTIONS промахов кеша.
+    cached_collection_t *entry;
+    if (slot->count < MONGO_POOL_COLLECTIONS) {
+        entry = &slot->colls[slot->count++];
+    } else {
+        entry = &slot->colls[slot->next_evict];
+        slot->next_evict = (slot->next_evict + 1) % MONGO_POOL_COLLECTIONS;
+        cached_collection_clear(entry);
+    }
+    entry->database = database_copy;
+    entry->name = name_copy;
+    entry->coll = coll;
+    return coll;
+}
+
+void mongo_pool_release_thread(void) {
+    if (!g_pool) return;
+    pthread_once(&g_slot_once, slot_key_init);
+    thread_slot_t *slot = pthread_getspecific(g_slot_key);
+    if (slot) slot_release(slot);
+}
+
+void mongo_pool_get_stats(mongo_pool_stats_t *out) {
+    out->acquired = __atomic_load_n(&g_stats.acquired, __ATOMIC_RELAXED);
+    out->collection_hits = __atomic_load_n(&g_stats.collection_hits, __ATOMIC_RELAXED);
+    out->collection_misses = __atomic_load_n(&g_stats.collection_misses, __ATOMIC_RELAXED);
+}
+
+void mongo_pool_shutdown(void) {
+    mongo_pool_release_thread();
+    if (g_pool) {
+        mongoc_client_pool_destroy(g_pool);
+        g_pool = NULL;
+    }
+    if (g_uri) {
+        mongoc_uri_destroy(g_uri);
+        g_uri = NULL;
+    }
+}
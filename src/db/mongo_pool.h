@@ -0,0 +1,70 @@
+// db/mongo_pool.h
+#ifndef MONGO_POOL_H
+#define MONGO_POOL_H
+
+#include <bson/bson.h>
+#include <mongoc/mongoc.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Доступ к MongoDB из многих потоков.
+ *
+ * mongoc_client_t нельзя использовать из двух потоков одновременно, поэтому
+ * клиенты берутся из mongoc_client_pool_t. Поток получает клиента при первом
+ * обращении и держит его, пока не вызовет mongo_pool_release_thread() (или
+ * не завершится). Пока клиент у потока, дескрипторы коллекций кешируются:
+ * повторный mongo_pool_collection() не создаёт новый.
+ *
+ * Дескрипторы принадлежат потоку: не освобождайте их и не передавайте
+ * другим потокам. После mongo_pool_release_thread() они недействительны.
+ * Кеш вытесняет записи по кругу, поэтому дескриптор действителен лишь до
+ * MONGO_POOL_COLLECTIONS следующих запросов других коллекций в этом потоке:
+ * не храните его дольше одной операции.
+ */
+
+#define MONGO_POOL_MAX_SIZE 64      // Клиентов одновременно; сверх этого pop ждёт
+#define MONGO_POOL_COLLECTIONS 8    // Дескрипторов коллекций в кеше потока
+
+typedef struct {
+    uint64_t acquired;          // Клиентов выдано потокам
+    uint64_t collection_hits;   // Коллекция взята из кеша потока
+    uint64_t collection_misses; // Дескриптор создан
+} mongo_pool_stats_t;
+
+/**
+ * @brief Создаёт пул и проверяет соединение командой ping.
+ *
+ * mongoc_init() должен быть вызван заранее.
+ * @return true при успехе; при ошибке заполняет error.
+ */
+bool mongo_pool_init(const char *uri, const char *appname, bson_error_t *error);
+
+bool mongo_pool_ready(void);
+
+/**
+ * @brief Клиент текущего потока; при первом вызове берётся из пула (может ждать).
+ */
+mongoc_client_t *mongo_pool_client(void);
+
+/**
+ * @brief Дескриптор коллекции для текущего потока, из кеша или новый.
+ */
+mongoc_collection_t *mongo_pool_collection(const char *database, const char *collection);
+
+/**
+ * @brief Возвращает клиента текущего потока в пул и закрывает его дескрипторы.
+ *
+ * Вызывается, когда поток надолго перестаёт обращаться к базе. При
+ * завершении потока это происходит само.
+ */
+void mongo_pool_release_thread(void);
+
+void mongo_pool_get_stats(mongo_pool_stats_t *out);
+
+/**
+ * @brief Закрывает пул. Клиенты всех потоков должны быть уже возвращены.
+ */
+void mongo_pool_shutdown(void);
+
+#endif
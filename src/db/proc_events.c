@@ -0,0 +1,90 @@
+// db/proc_events.c
+#include "proc_events.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+int64_t proc_event_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Делит путь на имя без расширения и расширение (с точкой).
+ *
+ * Точка в начале имени (".bashrc") расширением не считается.
+ */
+static void split_filename(const char *path, char *name, size_t name_size, char *ext, size_t ext_size) {
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+
+    const char *dot = strrchr(base, '.');
+    if (!dot || dot == base) dot = base + strlen(base);
+
+    snprintf(name, name_size, "%.*s", (int)(dot - base), base);
+    snprintf(ext, ext_size, "%s", dot);
+}
+
+void proc_event_build(bson_t *selector, bson_t *update, const char *file_id,
+                      const char *change_type, const char *status, int64_t date_ms) {
+    char name[256];
+    char ext[64];
+    split_filename(file_id, name, sizeof(name), ext, sizeof(ext));
+
+    bson_t event;
+    bson_init(&event);
+    BSON_APPEND_DATE_TIME(&event, "date", date_ms);
+    bson_t info;
+    BSON_APPEND_DOCUMENT_BEGIN(&event, "info", &info);
+    BSON_APPEND_UTF8(&info, "type_of_changes", change_type);
+    BSON_APPEND_UTF8(&info, "status", status);
+    bson_append_document_end(&event, &info);
+
+    bson_init(selector);
+    BSON_APPEND_UTF8(selector, "_id", file_id);
+
+    // Строки пользователя идут через $literal: имя файла может начинаться с '$'
+    // и иначе было бы прочитано конвейером как путь к полю
+    bson_init(update);
+    BCON_APPEND(update,
+        // Шаг 1: метаданные при первом событии и следующий номер
+        "0", "{", "$set", "{",
+            "filename", "{", "$ifNull", "[", "$filename", "{", "$literal", BCON_UTF8(name), "}", "]", "}",
+            "extension", "{", "$ifNull", "[", "$extension", "{", "$literal", BCON_UTF8(ext), "}", "]", "}",
+            "proc_seq", "{", "$add", "[",
+                "{", "$ifNull", "[", "$proc_seq",
+                    "{", "$size", "{", "$objectToArray", "{", "$ifNull", "[", "$proc", "{", "}", "]", "}", "}", "}",
+                "]", "}",
+                BCON_INT64(1),
+            "]", "}",
+        "}", "}",
+        // Шаг 2: proc["<proc_seq>"] = событие
+        "1", "{", "$set", "{",
+            "proc", "{", "$mergeObjects", "[",
+                "{", "$ifNull", "[", "$proc", "{", "}", "]", "}",
+                "{", "$arrayToObject", "[", "[",
+                    "{", "k", "{", "$toString", "$proc_seq", "}",
+                         "v", "{", "$literal", BCON_DOCUMENT(&event), "}", "}",
+                "]", "]", "}",
+            "]", "}",
+        "}", "}");
+
+    bson_destroy(&event);
+}
+
+bool proc_event_append(mongoc_collection_t *coll, const char *file_id,
+                       const char *change_type, const char *status,
+                       int64_t date_ms, bson_error_t *error) {
+    bson_t selector, update;
+    proc_event_build(&selector, &update, file_id, change_type, status, date_ms);
+    bson_t *opts = BCON_NEW("upsert", BCON_BOOL(true));
+
+    bool success = mongoc_collection_update_one(coll, &selector, &update, opts, NULL, error);
+
+    bson_destroy(opts);
+    bson_destroy(&update);
+    bson_destroy(&selector);
+    return success;
+}
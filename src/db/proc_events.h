@@ -0,0 +1,53 @@
+// db/proc_events.h
+#ifndef PROC_EVENTS_H
+#define PROC_EVENTS_H
+
+#include <bson/bson.h>
+#include <mongoc/mongoc.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * История обработки файла ("proc map") в коллекции file_groups:
+ *
+ *   { _id: <полный путь>, filename, extension, proc_seq: N,
+ *     proc: { "1": {date, info: {type_of_changes, status}}, ..., "N": {...} } }
+ *
+ * proc_seq — счётчик последнего ключа в proc. Событие добавляется одним
+ * upsert-конвейером (MongoDB >= 4.2): счётчик увеличивается и новое событие
+ * записывается под ключом-номером на стороне сервера, без чтения документа.
+ * У документов, созданных до появления proc_seq, счётчик один раз берётся
+ * из числа ключей proc (ключи всегда шли подряд с "1").
+ */
+
+/**
+ * @brief Текущее время в миллисекундах Unix-эпохи (для поля date события).
+ */
+int64_t proc_event_now_ms(void);
+
+/**
+ * @brief Строит фильтр и обновление для добавления события.
+ *
+ * Нужен, когда событие отправляется в составе bulk-операции; опция upsert
+ * обязательна — документ файла создаётся первым событием.
+ *
+ * @param selector    Неинициализированный bson_t; вызывающий освобождает через bson_destroy().
+ * @param update      Неинициализированный bson_t для конвейера; освобождается так же.
+ * @param file_id     Полный путь файла (_id документа).
+ * @param change_type Тип изменения ("upload", "download", "deleted"...).
+ * @param status      Статус ("success", "n/a"...).
+ * @param date_ms     Время события, мс Unix-эпохи.
+ */
+void proc_event_build(bson_t *selector, bson_t *update, const char *file_id,
+                      const char *change_type, const char *status, int64_t date_ms);
+
+/**
+ * @brief Добавляет событие в историю файла за один запрос к MongoDB.
+ *
+ * @return true при успехе; при ошибке заполняет error (если не NULL).
+ */
+bool proc_event_append(mongoc_collection_t *coll, const char *file_id,
+                       const char *change_type, const char *status,
+                       int64_t date_ms, bson_error_t *error);
+
+#endif
@@ -0,0 +1,261 @@
+// db/query_bench.c
+//
+// Планы и задержки горячих запросов к коллекции файлов по мере её роста.
+//
+// Заполняет отдельную базу file_exchange_bench синтетическими метаданными
+// (1000 клиентов, у каждого свои и адресованные ему файлы, 2% публичных,
+// 10% прежних версий с deleted) и на каждом рубеже (10 тыс., 100 тыс.,
+// 1 млн документов...) выполняет запросы сервера: LIST целиком, страницу
+// LIST из середины выдачи, поиск по имени и поиск по содержимому. Для каждого печатает медиану и максимум времени
+// (запрос и чтение всех документов курсора) и explain: план, сколько
+// документов вернулось и сколько ключей и документов просмотрено.
+//
+//   ./query_bench [--no-indexes] [uri] [документов]
+//
+// С --no-indexes индексы не создаются: видно, как растёт цена полного
+// просмотра. База удаляется в начале и в конце.
+
+#include <mongoc/mongoc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "file_queries.h"
+
+#define BENCH_DATABASE "file_exchange_bench"
+#define BENCH_COLLECTION "file_groups"
+#define BENCH_USERS 1000
+#define BENCH_INSERT_BATCH 1000
+#define BENCH_RUNS 25
+#define BENCH_DEFAULT_DOCS 1000000
+#define BENCH_PAGE 200
+
+static uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// Все поля документа выводятся из его номера: запросы находят существующие значения
+static void user_fingerprint(uint64_t user, char out[65]) {
+    for (int i = 0; i < 4; i++) {
+        snprintf(out + i * 16, 17, "%016llx", (unsigned long long)splitmix64(user * 4 + i));
+    }
+}
+
+static void doc_blake3(uint64_t n, char out[65]) {
+    for (int i = 0; i < 4; i++) {
+        snprintf(out + i * 16, 17, "%016llx", (unsigned long long)splitmix64((n << 2 | i) ^ 0xB1A4E3ULL));
+    }
+}
+
+static void doc_filename(uint64_t n, char *out, size_t len) {
+    snprintf(out, len, "bench-%010llu.bin", (unsigned long long)n);
+}
+
+static int64_t doc_size(uint64_t n) {
+    return (int64_t)(splitmix64(n ^ 0x5123ULL) % 1000000000ULL);
+}
+
+static void build_doc(uint64_t n, int64_t base_ms, bson_t *doc) {
+    uint64_t r = splitmix64(n);
+    char owner[65], blake3[65], filename[64];
+    user_fingerprint(r % BENCH_USERS, owner);
+    doc_blake3(n, blake3);
+    doc_filename(n, filename, sizeof(filename));
+
+    BSON_APPEND_UTF8(doc, "filename", filename);
+    BSON_APPEND_INT64(doc, "size", doc_size(n));
+    BSON_APPEND_UTF8(doc, "blake3", blake3);
+    BSON_APPEND_BOOL(doc, "encrypted", true);
+    BSON_APPEND_BOOL(doc, "deleted", (r >> 20) % 10 == 0);
+    BSON_APPEND_UTF8(doc, "owner_fingerprint", owner);
+    if ((r >> 40) % 50 == 0) {
+        BSON_APPEND_BOOL(doc, "public", true);
+    } else {
+        char recipient[65];
+        user_fingerprint((r >> 10) % BENCH_USERS, recipient);
+        BSON_APPEND_UTF8(doc, "recipient_fingerprint", recipient);
+        BSON_APPEND_BOOL(doc, "public", false);
+    }
+    BSON_APPEND_DATE_TIME(doc, "uploaded_at", base_ms + (int64_t)n * 1000);
+}
+
+static bool fill(mongoc_collection_t *coll, uint64_t from, uint64_t to, int64_t base_ms, bson_error_t *error) {
+    bson_t *opts = BCON_NEW("ordered", BCON_BOOL(false));
+    bool ok = true;
+    for (uint64_t start = from; ok && start < to; start += BENCH_INSERT_BATCH) {
+        mongoc_bulk_operation_t *bulk = mongoc_collection_create_bulk_operation_with_opts(coll, opts);
+        uint64_t end = start + BENCH_INSERT_BATCH < to ? start + BENCH_INSERT_BATCH : to;
+        for (uint64_t n = start; ok && n < end; n++) {
+            bson_t doc;
+            bson_init(&doc);
+            build_doc(n, base_ms, &doc);
+            ok = mongoc_bulk_operation_insert_with_opts(bulk, &doc, NULL, error);
+            bson_destroy(&doc);
+        }
+        if (ok) ok = mongoc_bulk_operation_execute(bulk, NULL, error) != 0;
+        mongoc_bulk_operation_destroy(bulk);
+    }
+    bson_destroy(opts);
+    return ok;
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+typedef enum { QUERY_LIST, QUERY_LIST_PAGE, QUERY_FILENAME, QUERY_CONTENT } query_kind_t;
+
+static const char *query_names[] = { "LIST", "LIST page", "filename lookup", "content lookup" };
+
+// Запрос номер run для рубежа в docs документов
+static bson_t *make_query(query_kind_t kind, uint64_t run, uint64_t docs, int64_t base_ms, bson_t **opts) {
+    *opts = NULL;
+    uint64_t n = splitmix64(run ^ 0xC0FFEEULL) % docs;
+    switch (kind) {
+    case QUERY_LIST: {
+        char fingerprint[65];
+        user_fingerprint(splitmix64(run) % BENCH_USERS, fingerprint);
+        *opts = file_queries_list_opts();
+        return file_queries_list_filter(fingerprint, NULL);
+    }
+    case QUERY_LIST_PAGE: {
+        // Страница, начинающаяся с документа n: как после n-го «дальше» в клиенте
+        char fingerprint[65];
+        user_fingerprint(splitmix64(run) % BENCH_USERS, fingerprint);
+        file_list_position_t after = { .uploaded_at = base_ms + (int64_t)n * 1000 };
+        memset(&after.id, 0xff, sizeof(after.id));
+        *opts = file_queries_list_opts();
+        BSON_APPEND_INT64(*opts, "limit", BENCH_PAGE);
+        return file_queries_list_filter(fingerprint, &after);
+    }
+    case QUERY_FILENAME: {
+        char filename[64];
+        doc_filename(n, filename, sizeof(filename));
+        return BCON_NEW("filename", BCON_UTF8(filename), "deleted", BCON_BOOL(false));
+    }
+    case QUERY_CONTENT: {
+        char blake3[65];
+        doc_blake3(n, blake3);
+        return BCON_NEW("blake3", BCON_UTF8(blake3), "size", BCON_INT64(doc_size(n)), "deleted", BCON_BOOL(false));
+    }
+    }
+    return NULL;
+}
+
+static void measure(mongoc_collection_t *coll, query_kind_t kind, uint64_t docs, int64_t base_ms) {
+    double times[BENCH_RUNS];
+    bson_error_t error;
+
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        bson_t *opts;
+        bson_t *query = make_query(kind, (uint64_t)run, docs, base_ms, &opts);
+        double start = now_ms();
+        mongoc_cursor_t *cursor = mongoc_collection_find_with_opts(coll, query, opts, NULL);
+        const bson_t *doc;
+        while (mongoc_cursor_next(cursor, &doc)) {
+        }
+        if (mongoc_cursor_error(cursor, &error)) {
+            fprintf(stderr, "%s: %s\n", query_names[kind], error.message);
+        }
+        times[run] = now_ms() - start;
+        mongoc_cursor_destroy(cursor);
+        bson_destroy(query);
+        if (opts) bson_destroy(opts);
+    }
+    qsort(times, BENCH_RUNS, sizeof(times[0]), compare_double);
+
+    bson_t *opts;
+    bson_t *query = make_query(kind, 0, docs, base_ms, &opts);
+    file_query_plan_t plan;
+    if (file_queries_explain(coll, query, opts, true, &plan, &error)) {
+        printf("  %-16s median %8.2f ms  max %8.2f ms  returned %7lld  keys %8lld  docs %8lld%s\n"
+               "  %-16s %s\n",
+               query_names[kind], times[BENCH_RUNS / 2], times[BENCH_RUNS - 1], (long long)plan.returned,
+               (long long)plan.keys_examined, (long long)plan.docs_examined, plan.collscan ? "  COLLSCAN" : "",
+               "", plan.plan);
+    } else {
+        printf("  %-16s median %8.2f ms  max %8.2f ms  (explain failed: %s)\n", query_names[kind],
+               times[BENCH_RUNS / 2], times[BENCH_RUNS - 1], error.message);
+    }
+    bson_destroy(query);
+    if (opts) bson_destroy(opts);
+}
+
+int main(int argc, char *argv[]) {
+    const char *uri_string = "mongodb://localhost:27017";
+    uint64_t max_docs = BENCH_DEFAULT_DOCS;
+    bool indexes = true;
+
+    int arg = 1;
+    if (arg < argc && strcmp(argv[arg], "--no-indexes") == 0) {
+        indexes = false;
+        arg++;
+    }
+    if (arg < argc) uri_string = argv[arg++];
+    if (arg < argc) max_docs = strtoull(argv[arg++], NULL, 10);
+    if (max_docs == 0) {
+        fprintf(stderr, "usage: %s [--no-indexes] [uri] [documents]\n", argv[0]);
+        return 1;
+    }
+
+    mongoc_init();
+    bson_error_t error;
+    mongoc_uri_t *uri = mongoc_uri_new_with_error(uri_string, &error);
+    if (!uri) {
+        fprintf(stderr, "failed to parse URI: %s\n", error.message);
+        mongoc_cleanup();
+        return 1;
+    }
+    mongoc_client_t *client = mongoc_client_new_from_uri(uri);
+    mongoc_client_set_error_api(client, MONGOC_ERROR_API_VERSION_2);
+    mongoc_collection_t *coll = mongoc_client_get_collection(client, BENCH_DATABASE, BENCH_COLLECTION);
+
+    // Коллекции может не быть: ошибка удаления не важна
+    mongoc_collection_drop_with_opts(coll, NULL, NULL);
+
+    int rc = 0;
+    if (indexes && !file_queries_ensure_indexes(coll, &error)) {
+        fprintf(stderr, "createIndexes failed: %s\n", error.message);
+        rc = 1;
+    }
+
+    int64_t base_ms = (int64_t)time(NULL) * 1000 - (int64_t)max_docs * 1000;
+    uint64_t filled = 0;
+    for (uint64_t step = 10000; rc == 0 && filled < max_docs; step *= 10) {
+        uint64_t target = step < max_docs ? step : max_docs;
+        double start = now_ms();
+        if (!fill(coll, filled, target, base_ms, &error)) {
+            fprintf(stderr, "insert failed: %s\n", error.message);
+            rc = 1;
+            break;
+        }
+        printf("%llu documents (inserted %llu in %.1f s)%s\n", (unsigned long long)target,
+               (unsigned long long)(target - filled), (now_ms() - start) / 1000.0, indexes ? "" : ", no indexes");
+        filled = target;
+
+        measure(coll, QUERY_LIST, filled, base_ms);
+        measure(coll, QUERY_LIST_PAGE, filled, base_ms);
+        measure(coll, QUERY_FILENAME, filled, base_ms);
+        measure(coll, QUERY_CONTENT, filled, base_ms);
+        fflush(stdout);
+    }
+
+    mongoc_collection_drop_with_opts(coll, NULL, NULL);
+    mongoc_collection_destroy(coll);
+    mongoc_client_destroy(client);
+    mongoc_uri_destroy(uri);
+    mongoc_cleanup();
+    return rc;
+}
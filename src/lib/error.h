@@ -14,6 +14,7 @@ typedef enum {
     MR_ERROR_MEMORY,       // Memory allocation failure
     MR_ERROR_INVALID_PARAM, // Invalid input parameters
     MR_ERROR_INTEGRITY,    // Integrity check failed (e.g., tag mismatch)
+    MR_ERROR_IO,           // Read/write on the underlying file failed
 
 } error_status_t;
 
@@ -0,0 +1,95 @@
+/**
+ * Secure File Exchange Server - DRR Scheduler
+ * Circular list of active entries; the cursor marks whose turn it is
+ */
+
+#include <string.h>
+
+#include "drr_sched.h"
+
+void drr_init(drr_sched_t *sched, size_t quantum, drr_send_fn send) {
+    memset(sched, 0, sizeof(*sched));
+    sched->quantum = quantum;
+    sched->send = send;
+}
+
+void drr_wake(drr_sched_t *sched, sched_entry_t *entry) {
+    if (entry->active) return;
+
+    entry->active = 1;
+    entry->deficit = 0;
+    sched->active++;
+
+    if (!sched->cursor) {
+        entry->next = entry;
+        entry->prev = entry;
+        sched->cursor = entry;
+        sched->charged = 0;
+        return;
+    }
+
+    // Insert just before the cursor: last in the current round
+    entry->next = sched->cursor;
+    entry->prev = sched->cursor->prev;
+    entry->prev->next = entry;
+    sched->cursor->prev = entry;
+}
+
+void drr_remove(drr_sched_t *sched, sched_entry_t *entry) {
+    if (!entry->active) return;
+
+    if (sched->serving == entry) sched->serving = NULL;
+
+    if (entry->next == entry) {
+        sched->cursor = NULL;
+    } else {
+        if (sched->cursor == entry) {
+            sched->cursor = entry->next;
+            sched->charged = 0;
+        }
+        entry->prev->next = entry->next;
+        entry->next->prev = entry->prev;
+    }
+
+    entry->next = NULL;
+    entry->prev = NULL;
+    entry->active = 0;
+    entry->deficit = 0;
+    sched->active--;
+}
+
+size_t drr_run(drr_sched_t *sched, size_t budget) {
+    size_t used = 0;
+
+    while (sched->cursor && used < budget) {
+        sched_entry_t *entry = sched->cursor;
+        if (!sched->charged) {
+            entry->deficit += sched->quantum;
+            sched->charged = 1;
+        }
+
+        size_t left = budget - used;
+        size_t grant = entry->deficit < left ? entry->deficit : left;
+
+        sched->serving = entry;
+        size_t moved = sched->send(entry, grant);
+        if (moved > grant) moved = grant;
+        used += moved;
+
+        // Finished or closed inside send(): already unlinked
+        if (!sched->serving) continue;
+        sched->serving = NULL;
+
+        entry->deficit -= moved;
+        if (moved < grant) {
+            // Blocked (socket full, bucket dry) or done: idle until woken
+            drr_remove(sched, entry);
+        } else if (entry->deficit == 0) {
+            sched->cursor = entry->next;
+            sched->charged = 0;
+        } else {
+            break; // Budget ran out mid-turn; continue here next run
+        }
+    }
+    return used;
+}
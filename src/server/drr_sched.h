@@ -0,0 +1,41 @@
+/**
+ * DRR Scheduler Header
+ * Deficit round robin over active transfers. Each visit adds a quantum to
+ * the entry's deficit and lets it send up to that much, so transfers
+ * smaller than a quantum finish in their first turn while large ones share
+ * whatever budget is left. Entries embed sched_entry_t; not thread-safe.
+ */
+
+#ifndef DRR_SCHED_H
+#define DRR_SCHED_H
+
+#include <stddef.h>
+
+typedef struct sched_entry {
+    struct sched_entry *next;
+    struct sched_entry *prev;
+    size_t deficit;
+    int active;
+} sched_entry_t;
+
+// Move up to `grant` bytes for entry; returns the bytes actually moved.
+// Moving less than `grant` takes the entry out of the round until the
+// next drr_wake(). The callback may call drr_remove() on its own entry.
+typedef size_t (*drr_send_fn)(sched_entry_t *entry, size_t grant);
+
+typedef struct {
+    sched_entry_t *cursor;  // Entry served next
+    sched_entry_t *serving; // Entry inside send(); NULL once it removes itself
+    size_t active;
+    size_t quantum;
+    int charged;            // cursor already got its quantum for this visit
+    drr_send_fn send;
+} drr_sched_t;
+
+// Function declarations
+void drr_init(drr_sched_t *sched, size_t quantum, drr_send_fn send);
+void drr_wake(drr_sched_t *sched, sched_entry_t *entry);   // Join the round (no-op if active)
+void drr_remove(drr_sched_t *sched, sched_entry_t *entry); // Leave the round (no-op if idle)
+size_t drr_run(drr_sched_t *sched, size_t budget);         // Returns bytes moved
+
+#endif // DRR_SCHED_H
@@ -0,0 +1,180 @@
+/**
+ * Secure File Exchange Server - Job Pool
+ * Runs blocking work off the event loops and posts completions back to them
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "job_pool.h"
+
+typedef struct job {
+    const char *name;
+    job_work_fn work;
+    job_done_fn done;
+    void *arg;
+    struct event *done_ev;   // Manual event on the submitting base
+    uint64_t submitted_us;
+    struct job *next;
+} job_t;
+
+struct job_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    job_t *head;
+    job_t *tail;
+    int stopping;
+    int nthreads;
+    pthread_t *threads;
+    job_slow_fn on_slow;
+    job_pool_stats_t stats; // Protected by lock
+};
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+// Runs on the submitting loop once the work function has returned
+static void job_complete_cb(evutil_socket_t fd, short events, void *ctx) {
+    job_t *job = ctx;
+    (void)fd;
+    (void)events;
+
+    if (job->done) job->done(job->arg);
+    event_free(job->done_ev);
+    free(job);
+}
+
+static void *job_pool_thread(void *ctx) {
+    job_pool_t *pool = ctx;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->head && !pool->stopping) {
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        }
+        job_t *job = pool->head;
+        if (!job) { // Stopping and drained
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        pool->head = job->next;
+        if (!pool->head) pool->tail = NULL;
+        pthread_mutex_unlock(&pool->lock);
+
+        uint64_t started = now_us();
+        job->work(job->arg);
+        uint64_t finished = now_us();
+
+        uint64_t wait_us = started - job->submitted_us;
+        uint64_t run_us = finished - started;
+
+        pthread_mutex_lock(&pool->lock);
+        pool->stats.completed++;
+        pool->stats.queue_wait_us_total += wait_us;
+        pool->stats.run_us_total += run_us;
+        if (wait_us > pool->stats.queue_wait_us_max) pool->stats.queue_wait_us_max = wait_us;
+        if (run_us > pool->stats.run_us_max) pool->stats.run_us_max = run_us;
+        if (run_us > JOB_POOL_SLOW_US) pool->stats.slow_jobs++;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (run_us > JOB_POOL_SLOW_US && pool->on_slow) {
+            pool->on_slow(job->name, wait_us, run_us);
+        }
+
+        // Hand the job back to its loop; it frees the job after `done`
+        event_active(job->done_ev, EV_TIMEOUT, 0);
+    }
+}
+
+job_pool_t *job_pool_new(int threads, job_slow_fn on_slow) {
+    if (threads <= 0) return NULL;
+
+    job_pool_t *pool = calloc(1, sizeof(job_pool_t));
+    if (!pool) return NULL;
+
+    pool->threads = calloc(threads, sizeof(pthread_t));
+    if (!pool->threads) {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    pool->on_slow = on_slow;
+
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, job_pool_thread, pool) != 0) {
+            job_pool_free(pool);
+            return NULL;
+        }
+        pool->nthreads++;
+    }
+    return pool;
+}
+
+// Must be called from the thread running `base`. Returns 0 on success; on
+// failure neither callback will run and the caller still owns `arg`.
+int job_pool_submit(job_pool_t *pool, struct event_base *base, const char *name,
+                    job_work_fn work, job_done_fn done, void *arg) {
+    if (!pool || !base || !work) return -1;
+
+    job_t *job = calloc(1, sizeof(job_t));
+    if (!job) return -1;
+
+    job->done_ev = event_new(base, -1, 0, job_complete_cb, job);
+    if (!job->done_ev) {
+        free(job);
+        return -1;
+    }
+    job->name = name;
+    job->work = work;
+    job->done = done;
+    job->arg = arg;
+    job->submitted_us = now_us();
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->stopping) {
+        pthread_mutex_unlock(&pool->lock);
+        event_free(job->done_ev);
+        free(job);
+        return -1;
+    }
+    if (pool->tail) {
+        pool->tail->next = job;
+    } else {
+        pool->head = job;
+    }
+    pool->tail = job;
+    pool->stats.submitted++;
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+void job_pool_get_stats(job_pool_t *pool, job_pool_stats_t *out) {
+    pthread_mutex_lock(&pool->lock);
+    *out = pool->stats;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void job_pool_free(job_pool_t *pool) {
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->nthreads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool);
+}
@@ -0,0 +1,42 @@
+/**
+ * Job Pool Header
+ * Fixed-size thread pool for blocking work (disk, database) that must not
+ * run on an event loop. A job's completion callback is delivered back on the
+ * event_base that submitted it, via event_active().
+ */
+
+#ifndef JOB_POOL_H
+#define JOB_POOL_H
+
+#include <stdint.h>
+#include <event2/event.h>
+
+#define JOB_POOL_SLOW_US 100000 // Jobs running longer than 100 ms are reported
+
+typedef void (*job_work_fn)(void *arg); // Runs on a pool thread
+typedef void (*job_done_fn)(void *arg); // Runs on the submitting event_base's thread
+
+// Called on the pool thread for each job whose run time exceeds JOB_POOL_SLOW_US
+typedef void (*job_slow_fn)(const char *name, uint64_t queue_wait_us, uint64_t run_us);
+
+typedef struct job_pool job_pool_t;
+
+// Aggregate latency metrics since the pool was created
+typedef struct {
+    uint64_t submitted;
+    uint64_t completed;
+    uint64_t queue_wait_us_total; // Submit -> start on a pool thread
+    uint64_t queue_wait_us_max;
+    uint64_t run_us_total;        // Time spent in the work function
+    uint64_t run_us_max;
+    uint64_t slow_jobs;
+} job_pool_stats_t;
+
+// Function declarations
+job_pool_t *job_pool_new(int threads, job_slow_fn on_slow);
+int job_pool_submit(job_pool_t *pool, struct event_base *base, const char *name,
+                    job_work_fn work, job_done_fn done, void *arg);
+void job_pool_get_stats(job_pool_t *pool, job_pool_stats_t *out);
+void job_pool_free(job_pool_t *pool); // Runs queued work, then joins the threads
+
+#endif // JOB_POOL_H
@@ -0,0 +1,245 @@
+/**
+ * Secure File Exchange Server - Rate Limiter
+ * Token buckets in a linear-probing table with backward-shift deletion
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "rate_limiter.h"
+
+typedef struct {
+    uint8_t key[RATE_LIMITER_KEY_LEN];
+    uint8_t used;
+    double request_tokens;
+    double byte_tokens;
+    uint64_t last_ms; // Time of the last refill
+} rl_entry_t;
+
+struct rate_limiter {
+    rate_limiter_config_t config;
+    rl_entry_t *slots;
+    size_t mask;
+    size_t count;
+    size_t max_count; // Load limit: 3/4 of the slots
+};
+
+static size_t home_slot(const rate_limiter_t *rl, const uint8_t *key) {
+    uint32_t h = 2166136261u; // FNV-1a
+    for (int i = 0; i < RATE_LIMITER_KEY_LEN; i++) {
+        h = (h ^ key[i]) * 16777619u;
+    }
+    return h & rl->mask;
+}
+
+// Slot holding key, or the empty slot where it would go
+static size_t find_slot(const rate_limiter_t *rl, const uint8_t *key) {
+    size_t i = home_slot(rl, key);
+    while (rl->slots[i].used && memcmp(rl->slots[i].key, key, RATE_LIMITER_KEY_LEN) != 0) {
+        i = (i + 1) & rl->mask;
+    }
+    return i;
+}
+
+// Remove slot i and shift later members of its probe run back, so lookups
+// never need tombstones
+static void delete_slot(rate_limiter_t *rl, size_t i) {
+    size_t j = i;
+    for (;;) {
+        j = (j + 1) & rl->mask;
+        if (!rl->slots[j].used) break;
+
+        size_t k = home_slot(rl, rl->slots[j].key);
+        // Entry j stays if its home lies cyclically in (i, j]
+        int stays = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+        if (stays) continue;
+
+        rl->slots[i] = rl->slots[j];
+        i = j;
+    }
+    rl->slots[i].used = 0;
+    rl->count--;
+}
+
+static void refill(const rate_limiter_t *rl, rl_entry_t *e, uint64_t now_ms) {
+    if (now_ms <= e->last_ms) return;
+    double elapsed = (double)(now_ms - e->last_ms) / 1000.0;
+    e->last_ms = now_ms;
+
+    e->request_tokens += elapsed * rl->config.request_rate;
+    if (e->request_tokens > rl->config.request_burst) e->request_tokens = rl->config.request_burst;
+    e->byte_tokens += elapsed * rl->config.byte_rate;
+    if (e->byte_tokens > rl->config.byte_burst) e->byte_tokens = rl->config.byte_burst;
+}
+
+// Both buckets full: dropping the entry loses nothing
+static int is_idle(const rate_limiter_t *rl, rl_entry_t *e, uint64_t now_ms) {
+    refill(rl, e, now_ms);
+    return e->request_tokens >= rl->config.request_burst &&
+           (rl->config.byte_rate <= 0 || e->byte_tokens >= rl->config.byte_burst);
+}
+
+// Table at its load limit: drop an idle entry from the new key's probe
+// window, else the least recently refilled one there
+static void make_room(rate_limiter_t *rl, const uint8_t *key, uint64_t now_ms) {
+    size_t i = home_slot(rl, key);
+    size_t victim = i;
+    uint64_t oldest = UINT64_MAX;
+
+    for (int n = 0; n < RATE_LIMITER_PROBE_WINDOW; n++, i = (i + 1) & rl->mask) {
+        rl_entry_t *e = &rl->slots[i];
+        if (!e->used) continue;
+        if (is_idle(rl, e, now_ms)) {
+            victim = i;
+            break;
+        }
+        if (e->last_ms < oldest) {
+            oldest = e->last_ms;
+            victim = i;
+        }
+    }
+    if (rl->slots[victim].used) delete_slot(rl, victim);
+}
+
+static rl_entry_t *get_entry(rate_limiter_t *rl, const uint8_t *key, uint64_t now_ms) {
+    size_t i = find_slot(rl, key);
+    rl_entry_t *e = &rl->slots[i];
+    if (e->used) {
+        refill(rl, e, now_ms);
+        return e;
+    }
+
+    if (rl->count >= rl->max_count) {
+        make_room(rl, key, now_ms);
+        i = find_slot(rl, key);
+        e = &rl->slots[i];
+    }
+
+    // New clients start with full buckets
+    memcpy(e->key, key, RATE_LIMITER_KEY_LEN);
+    e->used = 1;
+    e->request_tokens = rl->config.request_burst;
+    e->byte_tokens = rl->config.byte_burst;
+    e->last_ms = now_ms;
+    rl->count++;
+    return e;
+}
+
+rate_limiter_t *rate_limiter_new(const rate_limiter_config_t *config) {
+    if (!config || config->request_rate <= 0 || config->request_burst < 1) return NULL;
+    if (config->byte_rate > 0 && config->byte_burst < 1) return NULL;
+
+    rate_limiter_t *rl = calloc(1, sizeof(rate_limiter_t));
+    if (!rl) return NULL;
+
+    size_t capacity = 16;
+    while (capacity < config->capacity) capacity <<= 1;
+
+    rl->slots = calloc(capacity, sizeof(rl_entry_t));
+    if (!rl->slots) {
+        free(rl);
+        return NULL;
+    }
+    rl->config = *config;
+    rl->mask = capacity - 1;
+    rl->max_count = capacity - capacity / 4;
+    return rl;
+}
+
+void rate_limiter_free(rate_limiter_t *rl) {
+    if (!rl) return;
+    free(rl->slots);
+    free(rl);
+}
+
+int rate_limiter_allow_request(rate_limiter_t *rl, const uint8_t *key, uint64_t now_ms) {
+    rl_entry_t *e = get_entry(rl, key, now_ms);
+    if (e->request_tokens < 1.0) return 0;
+    e->request_tokens -= 1.0;
+    return 1;
+}
+
+// Returns how many of `want` bytes may be sent now (possibly 0) and
+// charges them to the byte bucket
+size_t rate_limiter_take_bytes(rate_limiter_t *rl, const uint8_t *key, size_t want, uint64_t now_ms) {
+    if (rl->config.byte_rate <= 0) return want;
+
+    rl_entry_t *e = get_entry(rl, key, now_ms);
+    if (e->byte_tokens < 1.0) return 0;
+
+    size_t allowed = e->byte_tokens < (double)want ? (size_t)e->byte_tokens : want;
+    e->byte_tokens -= (double)allowed;
+    return allowed;
+}
+
+void rate_limiter_refund_bytes(rate_limiter_t *rl, const uint8_t *key, size_t unused) {
+    if (rl->config.byte_rate <= 0 || unused == 0) return;
+
+    size_t i = find_slot(rl, key);
+    rl_entry_t *e = &rl->slots[i];
+    if (!e->used) return; // Evicted meanwhile: it restarts with a full bucket anyway
+
+    e->byte_tokens += (double)unused;
+    if (e->byte_tokens > rl->config.byte_burst) e->byte_tokens = rl->config.byte_burst;
+}
+
+static uint32_t refill_ms(double rate, size_t bytes) {
+    if (rate <= 0) return 0;
+    double ms = (double)bytes * 1000.0 / rate;
+    return ms < 1.0 ? 1 : (ms > 60000.0 ? 60000 : (uint32_t)ms);
+}
+
+uint32_t rate_limiter_wait_ms(const rate_limiter_t *rl, size_t bytes) {
+    return refill_ms(rl->config.byte_rate, bytes);
+}
+
+size_t rate_limiter_expire(rate_limiter_t *rl, uint64_t now_ms) {
+    size_t removed = 0;
+    size_t i = 0;
+    while (i <= rl->mask) {
+        rl_entry_t *e = &rl->slots[i];
+        if (e->used && is_idle(rl, e, now_ms)) {
+            delete_slot(rl, i); // May pull a later entry into i: check it again
+            removed++;
+            continue;
+        }
+        i++;
+    }
+    return removed;
+}
+
+size_t rate_limiter_count(const rate_limiter_t *rl) {
+    return rl->count;
+}
+
+void token_bucket_init(token_bucket_t *b, double rate, double burst, uint64_t now_ms) {
+    b->rate = rate;
+    b->burst = burst < 1 ? 1 : burst;
+    b->tokens = b->burst;
+    b->last_ms = now_ms;
+}
+
+size_t token_bucket_take(token_bucket_t *b, size_t want, uint64_t now_ms) {
+    if (b->rate <= 0) return want;
+
+    if (now_ms > b->last_ms) {
+        b->tokens += (double)(now_ms - b->last_ms) / 1000.0 * b->rate;
+        if (b->tokens > b->burst) b->tokens = b->burst;
+        b->last_ms = now_ms;
+    }
+    if (b->tokens < 1.0) return 0;
+
+    size_t allowed = b->tokens < (double)want ? (size_t)b->tokens : want;
+    b->tokens -= (double)allowed;
+    return allowed;
+}
+
+void token_bucket_refund(token_bucket_t *b, size_t unused) {
+    if (b->rate <= 0) return;
+    b->tokens += (double)unused;
+    if (b->tokens > b->burst) b->tokens = b->burst;
+}
+
+uint32_t token_bucket_wait_ms(const token_bucket_t *b, size_t bytes) {
+    return refill_ms(b->rate, bytes);
+}
@@ -0,0 +1,56 @@
+/**
+ * Rate Limiter Header
+ * Per-client token buckets (requests/sec and bytes/sec) in a fixed-size
+ * open-addressing table. Idle entries are evicted, and when the table is
+ * full the least recently seen entry near the new key's home slot is
+ * replaced, so memory stays bounded however many addresses show up.
+ * Not thread-safe: each event loop owns its own limiter.
+ */
+
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RATE_LIMITER_KEY_LEN 16 // Binary IPv6 (or IPv4-mapped) address
+#define RATE_LIMITER_PROBE_WINDOW 8 // Slots searched for a victim when full
+
+typedef struct rate_limiter rate_limiter_t;
+
+// Single byte bucket for callers that own their state (e.g. per connection)
+typedef struct {
+    double rate;  // Bytes per second; <= 0 means unlimited
+    double burst;
+    double tokens;
+    uint64_t last_ms;
+} token_bucket_t;
+
+typedef struct {
+    double request_rate;  // Requests refilled per second
+    double request_burst; // Request bucket size
+    double byte_rate;     // Bytes refilled per second; <= 0 disables byte limiting
+    double byte_burst;    // Byte bucket size
+    size_t capacity;      // Table slots, rounded up to a power of two
+} rate_limiter_config_t;
+
+// Function declarations
+rate_limiter_t *rate_limiter_new(const rate_limiter_config_t *config);
+void rate_limiter_free(rate_limiter_t *rl);
+
+// `now_ms` is a monotonic, possibly coarse, millisecond clock supplied by
+// the caller (e.g. CLOCK_MONOTONIC_COARSE); it must not go backwards.
+int rate_limiter_allow_request(rate_limiter_t *rl, const uint8_t *key, uint64_t now_ms); // 1 = allowed
+size_t rate_limiter_take_bytes(rate_limiter_t *rl, const uint8_t *key, size_t want, uint64_t now_ms);
+void rate_limiter_refund_bytes(rate_limiter_t *rl, const uint8_t *key, size_t unused); // Taken but not sent
+uint32_t rate_limiter_wait_ms(const rate_limiter_t *rl, size_t bytes); // Refill time for `bytes`
+
+size_t rate_limiter_expire(rate_limiter_t *rl, uint64_t now_ms); // Drops idle entries, returns count
+size_t rate_limiter_count(const rate_limiter_t *rl);
+
+void token_bucket_init(token_bucket_t *b, double rate, double burst, uint64_t now_ms);
+size_t token_bucket_take(token_bucket_t *b, size_t want, uint64_t now_ms);
+void token_bucket_refund(token_bucket_t *b, size_t unused);
+uint32_t token_bucket_wait_ms(const token_bucket_t *b, size_t bytes);
+
+#endif // RATE_LIMITER_H
@@ -47,6 +47,8 @@
 #include <unistd.h>
 #include <time.h>
 #include <sys/inotify.h>
+#include <fcntl.h>
+#include <dirent.h>
 #include <sys/stat.h>
 #include <linux/limits.h>
 #include <unistd.h>
@@ -67,8 +69,16 @@
 
 // Подмодули
 #include "../db/mongo_ops_server.h"
-#include "../../include/protocol.h"
+#include "../db/proc_events.h"
+#include "../db/event_writer.h"
+#include "../db/mongo_pool.h"
+#include "../db/file_queries.h"
+#include "../../include/client.h"
 #include "../crypto/aes_gcm.h"
+#include "../crypto/chunked_gcm.h"
+#include "../common/fastcdc.h"
+#include "../common/chunk_compress.h"
+#include "../common/tls_session.h"
 #include "../lib/error.h"
 
 // GLib
@@ -86,14 +96,25 @@ typedef enum {
 // #define PORT 5151 // порт, на котором слушает сервер
 #define DEFAULT_PORT 1512  // дефолтный порт если параметр с терминала не отвечает или равен NULL
 #define BUFFER_SIZE 4096 // размер буфера для операций ввода-вывода
-#define MAX_KEY_LENGTH 32 // максимальная длина ключа (байты)
 #define LOG_FILE "/tmp/file-server.log" // файл для логов по умолчанию
 #define MONGODB_URI "mongodb://localhost:27017" // строка подключения к MongoDB
 #define DATABASE_NAME "file_exchange" // имя БД
 #define COLLECTION_NAME "file_groups" // имя коллекции
+#define EVENTS_SPILL_FILE "/var/tmp/file-server-events.spill" // события proc map, пока MongoDB недоступна
 #define STORAGE_DIR "filetrade" // путь к каталогу хранения
 #define MAX_USERS_LISTEN 3     // указываем сколько подключений слушаем.
 #define MAX_FILE_SIZE (100LL * 1024 * 1024) // максимальный размер файла 100MB
+#define STREAM_CHUNK_SIZE (64 * 1024) // размер порции при потоковом шифровании загрузок (кратен записи chunked-GCM)
+#define OBJECTS_DIR STORAGE_DIR "/objects" // содержимое файлов, адресуемое BLAKE3-хешем
+#define OBJECTS_COLLECTION "file_objects" // счётчики ссылок на объекты
+#define OBJECT_HEX_LEN (BLAKE3_HASH_LEN * 2 + 1) // hex-хеш + '\0'
+#define PARALLEL_STALL_SEC 60 // параллельная загрузка прерывается, если столько нет ни одного нового чанка
+#define PARTIAL_DIR STORAGE_DIR "/.partial" // незавершённые загрузки: <ключ>.data и <ключ>.state
+#define UPLOAD_CHECKPOINT_BYTES (16LL * 1024 * 1024) // как часто сохраняется точка возобновления (кратно STREAM_CHUNK_SIZE)
+#define UPLOAD_CHECKPOINT_MAGIC "FTRESM1"
+#define PARTIAL_TTL_SEC (24 * 60 * 60) // незавершённая загрузка, не менявшаяся столько, удаляется
+#define PARTIAL_SWEEP_SEC 3600 // как часто просматривается PARTIAL_DIR
+#define RANGE_PARENT_KEY_LEN (64 + 1 + FILENAME_MAX_LEN + 1) // "отпечаток/имя" + '\0'
 
 // Конфигурация демона
 #define PID_FILE "/tmp/exchange-daemon.pid"
@@ -112,11 +133,18 @@ typedef enum {
 // Объявлен как volatile sig_atomic_t для безопасного использования в обработчиках сигналов.
 static volatile sig_atomic_t g_shutdown = 0;
 
-// Глобальный клиент MongoDB — создаётся один раз при старте приложения и используется во всём проекте.
-mongoc_client_t *g_mongo_client = NULL;
+// MongoDB: каждый поток клиента берёт своего клиента из пула (см. db/mongo_pool.h).
+// Коллекция метаданных файлов и счётчиков ссылок на объекты для текущего потока:
+static mongoc_collection_t *files_collection(void) {
+    return mongo_pool_collection(DATABASE_NAME, COLLECTION_NAME);
+}
+
+static mongoc_collection_t *objects_collection(void) {
+    return mongo_pool_collection(DATABASE_NAME, OBJECTS_COLLECTION);
+}
 
-// Глобальная ссылка на коллекцию MongoDB, в которую записываются метаданные файлов.
-mongoc_collection_t *g_collection = NULL;
+// Фоновая запись событий proc map пачками (см. db/event_writer.h)
+static event_writer_t *g_event_writer = NULL;
 
 // Контекст OpenSSL для настройки TLS-соединений. Инициализируется один раз и используется всеми клиентами.
 static SSL_CTX *g_ssl_ctx = NULL;
@@ -124,6 +152,9 @@ static SSL_CTX *g_ssl_ctx = NULL;
 // Указатель на файл журнала. Открывается при запуске и закрывается при завершении работы.
 static FILE *g_log_file = NULL;
 
+// Слушающий сокет сервера (используется в accept_clients_loop).
+static int g_server_socket = -1;
+
 
 
 // Структура для хранения информации о клиенте, ожидающем подтверждения
@@ -140,6 +171,7 @@ typedef struct {
 // Содержит 256-битный ключ (32 байта) и флаг инициализации.
 typedef struct {
     uint8_t key[32];        // Симметричный ключ (например, для AES-256)
+    char key_id[17];        // Первые 8 байт BLAKE3 ключа (hex): каким ключом зашифрован объект
     int initialized;        // 1 — ключ задан, 0 — ключ не инициализирован
 } file_crypto_ctx_t;
 
@@ -161,6 +193,23 @@ static pthread_mutex_t pending_clients_mutex = PTHREAD_MUTEX_INITIALIZER;
 // Хеш-таблица для хранения ожидающих клиентов (ключ - отпечаток)
 static GHashTable *pending_clients = NULL;
 
+// Файлы, которые подтверждённые соединения скачивают по диапазонам: "отпечаток/имя" ->
+// число таких соединений (под pending_clients_mutex). Диапазоны того же файла по
+// дополнительным потокам (--streams) не ждут администратора.
+static GHashTable *g_range_parents = NULL;
+
+// Параллельные загрузки по hex-токену и мьютекс для таблицы и счётчиков ссылок
+static GHashTable *g_parallel_uploads = NULL;
+static pthread_mutex_t g_parallel_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Сериализует изменение счётчиков ссылок вместе с созданием и удалением файлов объектов
+static pthread_mutex_t g_objects_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Ключи незавершённых загрузок, которые сейчас принимает соединение или чистит просмотр
+// PARTIAL_DIR: у одной загрузки не бывает двух писателей
+static GHashTable *g_active_partials = NULL;
+static pthread_mutex_t g_partials_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 // Прототип функции администратора
 void *admin_interface_thread(void *arg);
 
@@ -230,280 +279,28 @@ static void print_module_loading(const char **modules, size_t count) {
 }
 
 
-// Функция для извлечения расширения файла из полного пути
-// Возвращает дубликат строки с расширением (включая точку), который должен быть освобождён вызывающей стороной.
-static char* get_file_extension(const char *full_path) {
-    // Защита от пустого указателя
-    if (!full_path) return NULL;
-
-    // Находим последний символ '/' в пути — всё после него считается именем файла
-    const char *filename = strrchr(full_path, '/');
-    if (!filename) filename = full_path; // если '/' нет, то весь путь — это имя файла
-    else filename++;                     // пропускаем сам символ '/'
-
-    // Ищем последнюю точку в имени файла — она указывает на начало расширения
-    const char *dot = strrchr(filename, '.');
-    // Если точки нет, или она первая (например, ".gitignore"), считаем, что расширения нет
-    if (!dot || dot == filename) {
-        return strdup(""); // Возвращаем пустую строку
-    }
-
-    // Создаём копию расширения (начиная с точки) и возвращаем её
-    return strdup(dot);
-}
-
-
-// Функция для получения имени файла без расширения
-// Принимает полный путь или просто имя файла.
-// Возвращает выделенную в куче строку с именем без расширения (требует free).
-static char* get_filename_without_extension(const char* full_filename) {
-    // Извлекаем имя файла из пути (всё после последнего '/')
-    const char *filename = strrchr(full_filename, '/');
-    if (!filename) filename = full_filename;
-    else filename++;
-
-    // Ищем последнюю точку — она разделяет имя и расширение
-    const char *dot = strrchr(filename, '.');
-    // Если точки нет, длина имени — вся строка; иначе — до точки
-    size_t name_len = dot ? (size_t)(dot - filename) : strlen(filename);
-
-    // Выделяем память под результат (длина + 1 для завершающего нуля)
-    char *result = malloc(name_len + 1);
-    if (!result) {
-        logger(LOG_ERROR, "Memory allocation failed in get_filename_without_extension");
-        return NULL;
-    }
-    
-    // Копируем только часть до точки
-    strncpy(result, filename, name_len);
-    result[name_len] = '\0';
-    // Заполняем буфер и завершаем нулём
-    memcpy(result, filename, name_len);
-    result[name_len] = '\0';
-    return result;
-}
-
-
-// Функция для вычисления хеша BLAKE3 от произвольного буфера данных
-// Принимает: указатель на данные, их длину и буфер для результата (должен быть размером BLAKE3_HASH_LEN)
-static void compute_buffer_blake3(const uint8_t *data, size_t len, uint8_t out_hash[BLAKE3_HASH_LEN]) {
-    // Создаём и инициализируем hasher
-    blake3_hasher hasher;
-    blake3_hasher_init(&hasher);
-    // Добавляем данные в hasher
-    blake3_hasher_update(&hasher, data, len);
-    // Завершаем хеширование и записываем результат в out_hash
-    blake3_hasher_finalize(&hasher, out_hash, BLAKE3_HASH_LEN);
-}
-// Получение следующего ключа для поля "proc" в документе MongoDB.
-// Поле "proc" представляет собой объект, где ключи — это строки с числами ("1", "2", ...),
-// а значения — события обработки файла. Функция находит максимальный числовой ключ и возвращает следующий.
-static char* get_next_proc_key(const char *file_id) {
-    // Получаем указатель на коллекцию MongoDB по глобальному клиенту и заданным имени БД и коллекции
-    mongoc_collection_t *coll = mongoc_client_get_collection(
-        g_mongo_client, DATABASE_NAME, COLLECTION_NAME);
-    if (!coll) {
-        logger(LOG_ERROR, "Failed to get collection for file: %s", file_id);
-        return NULL;
-    }
-    
-    // Формируем запрос: ищем документ по _id == file_id
-    bson_t *query = BCON_NEW("_id", BCON_UTF8(file_id));
-    // Проекция: запрашиваем только поле "proc"
-    bson_t *projection = BCON_NEW("proc", BCON_INT32(1));
-    bson_error_t error;
-    
-    char *next_key = NULL;
-    const bson_t *doc; //
-    // Выполняем запрос на чтение одного документа (find)
-    mongoc_cursor_t *cursor = mongoc_collection_find_with_opts(
-        coll, query, NULL, NULL);
-    
-    int64_t max_key = 0; // Будем искать максимальный числовой ключ в "proc"
-    
-    // Пытаемся получить документ
-    if (mongoc_cursor_next(cursor, &doc)) {
-        bson_iter_t iter;
-        // Ищем поле "proc" и проверяем, что оно — документ (объект)
-        if (bson_iter_init_find(&iter, doc, "proc") && 
-            BSON_ITER_HOLDS_DOCUMENT(&iter)) {
-            
-            // Рекурсивно проходим по всем полям объекта "proc"
-            bson_iter_t child;
-            bson_iter_recurse(&iter, &child);
-            
-            while (bson_iter_next(&child)) {
-                // Имя поля — потенциальный числовой ключ
-                const char *key_str = bson_iter_key(&child);
-                char *endptr;
-                // Пытаемся преобразовать его в число
-                long num = strtol(key_str, &endptr, 10);
-                
-                // Если преобразование прошло успешно и число положительное — обновляем максимум
-                if (errno == 0 && *endptr == '\0' && num > 0 && num > max_key) {
-                    max_key = num;
-                }
-            }
-        }
-    } else {
-        // Документ не найден — начинаем с ключа "1"
-        logger(LOG_DEBUG, "No existing document found for: %s, starting from key 1", file_id);
-    }
-    
-    // Проверяем, были ли ошибки в курсоре
-    if (mongoc_cursor_error(cursor, &error)) {
-        logger(LOG_ERROR, "Cursor error for file %s: %s", file_id, error.message);
-    }
-    
-    // Освобождаем ресурсы MongoDB
-    mongoc_cursor_destroy(cursor);
-    bson_destroy(query);
-    bson_destroy(projection);
-    mongoc_collection_destroy(coll);
-    
-    // Выделяем память под строку с новым ключом
-    next_key = malloc(MAX_KEY_LENGTH);
-    if (!next_key) {
-        logger(LOG_ERROR, "Memory allocation failed for next_key");
-        return NULL;
-    }
-    
-    // Формируем следующий ключ как строку (max_key + 1)
-    snprintf(next_key, MAX_KEY_LENGTH, "%" PRId64, max_key + 1);
-    return next_key;
-}
-
-
-// Создание базового документа файла в MongoDB при первом обращении.
-// Документ содержит метаданные: путь, имя без расширения, расширение и пустой объект "proc".
-static bool create_base_document(const char *fullpath) {
-    // Получаем коллекцию MongoDB
-    mongoc_collection_t *coll = mongoc_client_get_collection(
-        g_mongo_client, DATABASE_NAME, COLLECTION_NAME);
-    if (!coll) {
-        logger(LOG_ERROR, "Failed to get collection for base document: %s", fullpath);
-        return false;
-    }
-    
-    // Извлекаем имя файла и расширение из полного пути
-    char *filename = get_filename_without_extension(fullpath);
-    char *extension = get_file_extension(fullpath);
-    
-    if (!filename || !extension) {
-        logger(LOG_ERROR, "Failed to parse filename/extension for: %s", fullpath);
-        free(filename);
-        free(extension);
-        mongoc_collection_destroy(coll);
-        return false;
-    }
-    
-    // Формируем новый BSON-документ
-    bson_t *doc = bson_new();
-    BSON_APPEND_UTF8(doc, "_id", fullpath);               // _id — полный путь к файлу
-    BSON_APPEND_UTF8(doc, "filename", filename);          // Имя без расширения
-    BSON_APPEND_UTF8(doc, "extension", extension);        // Расширение (с точкой)
-    
-    // Инициализируем поле "proc" как пустой объект
-    bson_t proc;
-    bson_init(&proc);
-    BSON_APPEND_DOCUMENT(doc, "proc", &proc);
-    bson_destroy(&proc);
-    
-    bson_error_t error;
-    // Пытаемся вставить документ в коллекцию
-    bool success = mongoc_collection_insert_one(coll, doc, NULL, NULL, &error);
-    
-    if (!success) {
-        // Ошибка 11000 — дубликат ключа (_id уже существует). Это нормально.
-        if (error.code != 11000) {
-            logger(LOG_ERROR, "Failed to create base document for %s: %s", fullpath, error.message);
-        } else {
-            logger(LOG_DEBUG, "Base document already exists for: %s", fullpath);
-            success = true; // Считаем операцию успешной
-        }
-    } else {
-        logger(LOG_INFO, "Created base document for: %s", fullpath);
-    }
-    
-    // Освобождаем ресурсы
-    bson_destroy(doc);
-    free(filename);
-    free(extension);
-    mongoc_collection_destroy(coll);
-    
-    return success;
-}
-
-
 // Добавление нового события обработки в поле "proc" документа файла.
-// Событие включает тип изменения (например, "modified") и статус (например, "encrypted").
+// Событие включает тип изменения (например, "upload") и статус (например, "success").
+// Обычно событие только ставится в очередь фоновой записи и поток запроса не ждёт MongoDB;
+// без неё — один upsert: документ создаётся первым событием, номер берётся из счётчика proc_seq.
 static bool append_proc_event(const char *file_id, const char *change_type, const char *status) {
-    // Убеждаемся, что базовый документ существует (создаём, если нужно)
-    if (!create_base_document(file_id)) {
-        logger(LOG_ERROR, "Failed to ensure base document for: %s", file_id);
-        return false;
+    if (g_event_writer) {
+        return event_writer_push(g_event_writer, file_id, change_type, status, proc_event_now_ms());
     }
-    
-    // Получаем коллекцию MongoDB
-    mongoc_collection_t *coll = mongoc_client_get_collection(
-        g_mongo_client, DATABASE_NAME, COLLECTION_NAME);
+
+    mongoc_collection_t *coll = files_collection();
     if (!coll) {
         logger(LOG_ERROR, "Failed to get collection for event: %s", file_id);
         return false;
     }
-    
-    // Получаем следующий уникальный ключ для события в "proc"
-    char *next_key = get_next_proc_key(file_id);
-    if (!next_key) {
-        logger(LOG_ERROR, "Failed to get next proc key for: %s", file_id);
-        mongoc_collection_destroy(coll);
-        return false;
-    }
-    
-    // Получаем текущее время в миллисекундах с начала эпохи
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    int64_t now_ms = (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
-    
-    // Формируем путь обновления вида "proc.42"
-    char set_path[64];
-    snprintf(set_path, sizeof(set_path), "proc.%s", next_key);
-    
-    // Создаём вложенный документ события
-    bson_t event_doc;
-    bson_init(&event_doc);
-    BSON_APPEND_DATE_TIME(&event_doc, "date", now_ms); // Время события
-    
-    // Документ "info" внутри события
-    bson_t info_doc;
-    bson_init(&info_doc);
-    BSON_APPEND_UTF8(&info_doc, "type_of_changes", change_type);
-    BSON_APPEND_UTF8(&info_doc, "status", status);
-    BSON_APPEND_DOCUMENT(&event_doc, "info", &info_doc);
-    
-    // Формируем операцию обновления: $set: { "proc.<next_key>": event_doc }
-    bson_t *update = BCON_NEW("$set", "{", set_path, BCON_DOCUMENT(&event_doc), "}");
-    bson_t *query = BCON_NEW("_id", BCON_UTF8(file_id));
-    
+
     bson_error_t error;
-    // Выполняем обновление одного документа
-    bool success = mongoc_collection_update_one(
-        coll, query, update, NULL, NULL, &error);
-    
+    bool success = proc_event_append(coll, file_id, change_type, status, proc_event_now_ms(), &error);
     if (!success) {
         logger(LOG_ERROR, "Failed to append proc event for %s: %s", file_id, error.message);
     } else {
-        logger(LOG_INFO, "Added event %s to %s: %s - %s", next_key, file_id, change_type, status);
+        logger(LOG_INFO, "Added event to %s: %s - %s", file_id, change_type, status);
     }
-    
-    // Освобождаем все выделенные BSON-структуры и память
-    bson_destroy(&info_doc);
-    bson_destroy(&event_doc);
-    bson_destroy(update);
-    bson_destroy(query);
-    free(next_key);
-    mongoc_collection_destroy(coll);
-    
     return success;
 }
 
@@ -546,399 +343,1999 @@ static int ssl_recv_all(SSL *ssl, void *buffer, size_t len) {
 }
 
 
-// Шифрование данных с использованием AES-256-GCM.
-// Принимает: открытый текст, длину, ключ (32 байта), IV (12 байт).
-// Выводит: зашифрованный текст (той же длины, что и вход) и 16-байтный аутентификационный тег.
-// Возвращает длину шифротекста (>0) или -1 при ошибке.
-static int enhanced_aes_gcm_encrypt(const uint8_t *plaintext, int plaintext_len, const uint8_t *key, const uint8_t *iv, uint8_t *ciphertext, uint8_t *tag) {
-    EVP_CIPHER_CTX *ctx;
-    int len;
-    int ciphertext_len;
-
-    // Создаём контекст шифрования OpenSSL
-    if (!(ctx = EVP_CIPHER_CTX_new())) {
-        logger(LOG_ERROR, "Failed to allocate EVP_CIPHER_CTX");
+// Контекст потоковой загрузки: файл не держится в памяти целиком.
+// Каждая порция сразу хешируется BLAKE3 и передаётся в chunked-GCM писатель,
+// который пишет независимые записи по CHUNKED_GCM_CHUNK_SIZE во временный файл.
+// Временный файл переименовывается только после успешной проверки хеша.
+typedef struct {
+    chunked_gcm_writer_t writer; // Шифрование записями (формат chunked-gcm-v1)
+    blake3_hasher hasher;        // Инкрементальный хешер открытого текста
+    int fd;                      // Дескриптор временного файла
+    char tmp_path[PATH_MAX];     // Путь временного файла (для rename/unlink)
+} upload_stream_t;
+
+// Открывает временный файл рядом с итоговым и инициализирует шифр и хешер.
+// Возвращает 0 при успехе, -1 при ошибке (ресурсы уже освобождены).
+static int upload_stream_open(upload_stream_t *us, const char *filename) {
+    memset(us, 0, sizeof(*us));
+
+    // Временный файл в том же каталоге, чтобы rename() был атомарным
+    snprintf(us->tmp_path, sizeof(us->tmp_path), "%s/.%s.XXXXXX", STORAGE_DIR, filename);
+    us->fd = mkstemp(us->tmp_path);
+    if (us->fd == -1) {
+        logger(LOG_ERROR, "mkstemp() failed for %s: %s", us->tmp_path, strerror(errno));
         return -1;
     }
 
-    // Инициализация для AES-256-GCM в два этапа:
-    // 1. Указываем алгоритм без ключа/IV (требуется OpenSSL API)
-    if (EVP_EncryptInit_ex(ctx, EVP_aes_256_gcm(), NULL, NULL, NULL) != 1) {
-        EVP_CIPHER_CTX_free(ctx);
-        logger(LOG_ERROR, "EVP_EncryptInit_ex (cipher setup) failed");
+    error_status_t rc = chunked_gcm_writer_init(&us->writer, us->fd, g_file_crypto.key);
+    if (rc != MR_SUCCESS) {
+        logger(LOG_ERROR, "Failed to start encrypted stream for %s (status %d)", filename, (int)rc);
+        close(us->fd);
+        us->fd = -1;
+        unlink(us->tmp_path);
         return -1;
     }
 
-    // 2. Устанавливаем ключ и IV
-    if (EVP_EncryptInit_ex(ctx, NULL, NULL, key, iv) != 1) {
-        EVP_CIPHER_CTX_free(ctx);
-        logger(LOG_ERROR, "EVP_EncryptInit_ex (key/IV setup) failed");
+    blake3_hasher_init(&us->hasher);
+    return 0;
+}
+
+// Обрабатывает очередную порцию открытого текста: хеш, шифрование, запись на диск.
+static int upload_stream_write(upload_stream_t *us, const uint8_t *chunk, size_t len) {
+    blake3_hasher_update(&us->hasher, chunk, len);
+
+    error_status_t rc = chunked_gcm_writer_update(&us->writer, chunk, len);
+    if (rc != MR_SUCCESS) {
+        logger(LOG_ERROR, "Encrypted write to %s failed (status %d)", us->tmp_path, (int)rc);
         return -1;
     }
+    return 0;
+}
+
+// Завершает хеш и последнюю запись, сбрасывает временный файл на диск и закрывает его.
+// Итоговый хеш открытого текста возвращается в out_hash.
+static int upload_stream_finish(upload_stream_t *us, uint8_t out_hash[BLAKE3_HASH_LEN]) {
+    blake3_hasher_finalize(&us->hasher, out_hash, BLAKE3_HASH_LEN);
 
-    // Шифруем основную часть данных
-    if (EVP_EncryptUpdate(ctx, ciphertext, &len, plaintext, plaintext_len) != 1) {
-        EVP_CIPHER_CTX_free(ctx);
-        logger(LOG_ERROR, "EVP_EncryptUpdate failed");
+    error_status_t rc = chunked_gcm_writer_final(&us->writer);
+    if (rc != MR_SUCCESS) {
+        logger(LOG_ERROR, "Failed to finalize encrypted stream for %s (status %d)", us->tmp_path, (int)rc);
         return -1;
     }
-    ciphertext_len = len;
 
-    // Завершаем шифрование (в GCM обычно добавляет 0 байт, но вызов обязателен)
-    if (EVP_EncryptFinal_ex(ctx, ciphertext + len, &len) != 1) {
-        EVP_CIPHER_CTX_free(ctx);
-        logger(LOG_ERROR, "EVP_EncryptFinal_ex failed");
+    if (fsync(us->fd) != 0) {
+        logger(LOG_ERROR, "Failed to flush %s: %s", us->tmp_path, strerror(errno));
         return -1;
     }
-    ciphertext_len += len;
+    int res = close(us->fd);
+    us->fd = -1;
+    return res == 0 ? 0 : -1;
+}
 
-    // Извлекаем 16-байтный GCM-тег для последующей проверки целостности при расшифровке
-    if (EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, 16, tag) != 1) {
-        EVP_CIPHER_CTX_free(ctx);
-        logger(LOG_ERROR, "Failed to retrieve GCM tag");
-        return -1;
+// Освобождает ресурсы потока. Если файл не был переименован (commit), он удаляется.
+static void upload_stream_close(upload_stream_t *us, bool committed) {
+    chunked_gcm_writer_cleanup(&us->writer);
+    if (us->fd != -1) {
+        close(us->fd);
+        us->fd = -1;
     }
+    if (!committed) {
+        unlink(us->tmp_path);
+    }
+    explicit_bzero(&us->hasher, sizeof(us->hasher));
+}
 
-    EVP_CIPHER_CTX_free(ctx);
-    return ciphertext_len; // Должно совпадать с plaintext_len
+
+// --- Хранилище объектов ---
+// Содержимое хранится один раз в filetrade/objects/ab/cdef... (hex BLAKE3 открытого текста),
+// а filetrade/<filename> — жёсткая ссылка на объект. Число имён, ссылающихся на объект,
+// хранится в коллекции OBJECTS_COLLECTION; объект без ссылок удаляется с диска.
+// Ключ файлов создаётся заново при каждом запуске, поэтому запись объекта помнит key_id
+// ключа, которым он зашифрован: объекты прежних запусков не участвуют в дедупликации,
+// а новая копия того же содержимого заменяет такой объект на диске.
+
+static void object_hex(const uint8_t hash[BLAKE3_HASH_LEN], char out[OBJECT_HEX_LEN]) {
+    for (int i = 0; i < BLAKE3_HASH_LEN; i++) {
+        sprintf(&out[i * 2], "%02x", hash[i]);
+    }
+    out[OBJECT_HEX_LEN - 1] = '\0';
 }
 
+// Первые два символа хеша — подкаталог, чтобы каталоги не разрастались
+static void object_path(const char *hex, char *out, size_t out_len) {
+    snprintf(out, out_len, "%s/%.2s/%s", OBJECTS_DIR, hex, hex + 2);
+}
 
-// Расшифровка данных, зашифрованных AES-256-GCM.
-// Принимает: шифротекст, его длину, ключ, IV, 16-байтный тег.
-// Выводит: восстановленный открытый текст.
-// Возвращает длину расшифрованного текста (>0) или -1 при ошибке (включая несоответствие тега).
-static int enhanced_aes_gcm_decrypt(const uint8_t *ciphertext, int ciphertext_len, const uint8_t *key, const uint8_t *iv, const uint8_t *tag, uint8_t *plaintext) {
-    EVP_CIPHER_CTX *ctx;
-    int len;
-    int plaintext_len;
+// Добавляет ссылку на объект; первая ссылка создаёт запись. Вызывать под g_objects_mutex.
+// Коллекцию objects берут до захвата мьютекса: клиент из пула может ждать, пока другие
+// потоки вернут своих, а они сами могут ждать мьютекс.
+// size — размер содержимого, stored_size — размер на диске до шифрования (меньше size
+// у сжатых чанков); его знает только тот, кто только что записал файл объекта, и вместе
+// с ним пишется key_id текущего ключа. Остальные передают -1.
+static bool object_ref_locked(mongoc_collection_t *coll, const char *hex, long long size, long long stored_size) {
+    bson_t *query = BCON_NEW("_id", BCON_UTF8(hex));
+    bson_t *update = BCON_NEW("$inc", "{", "refs", BCON_INT64(1), "}");
+    bson_t fields;
+    if (stored_size >= 0) {
+        BSON_APPEND_DOCUMENT_BEGIN(update, "$set", &fields);
+        BSON_APPEND_INT64(&fields, "size", size);
+        BSON_APPEND_INT64(&fields, "stored_size", stored_size);
+        BSON_APPEND_UTF8(&fields, "key_id", g_file_crypto.key_id);
+        bson_append_document_end(update, &fields);
+    }
+    BSON_APPEND_DOCUMENT_BEGIN(update, "$setOnInsert", &fields);
+    if (stored_size < 0) BSON_APPEND_INT64(&fields, "size", size);
+    BSON_APPEND_DATE_TIME(&fields, "created_at", time(NULL) * 1000LL);
+    bson_append_document_end(update, &fields);
+    bson_t *opts = BCON_NEW("upsert", BCON_BOOL(true));
 
-    if (!(ctx = EVP_CIPHER_CTX_new())) {
-        logger(LOG_ERROR, "Failed to allocate EVP_CIPHER_CTX for decryption");
-        return -1;
+    bson_error_t error;
+    bool success = mongoc_collection_update_one(coll, query, update, opts, NULL, &error);
+    if (!success) {
+        logger(LOG_ERROR, "Failed to add reference to object %s: %s", hex, error.message);
     }
 
-    // Инициализация для AES-256-GCM (аналогично шифрованию)
-    if (EVP_DecryptInit_ex(ctx, EVP_aes_256_gcm(), NULL, NULL, NULL) != 1) {
-        EVP_CIPHER_CTX_free(ctx);
-        logger(LOG_ERROR, "EVP_DecryptInit_ex (cipher setup) failed");
-        return -1;
+    bson_destroy(opts);
+    bson_destroy(update);
+    bson_destroy(query);
+    return success;
+}
+
+// Объект hex сохранён под текущим ключом файлов. Вызывать под g_objects_mutex.
+static bool object_key_current_locked(mongoc_collection_t *coll, const char *hex) {
+    bson_t *query = BCON_NEW("_id", BCON_UTF8(hex), "key_id", BCON_UTF8(g_file_crypto.key_id));
+    bson_error_t error;
+    int64_t count = mongoc_collection_count_documents(coll, query, NULL, NULL, NULL, &error);
+    if (count < 0) {
+        logger(LOG_ERROR, "Key lookup failed for object %s: %s", hex, error.message);
     }
+    bson_destroy(query);
+    return count > 0;
+}
 
-    if (EVP_DecryptInit_ex(ctx, NULL, NULL, key, iv) != 1) {
-        EVP_CIPHER_CTX_free(ctx);
-        logger(LOG_ERROR, "EVP_DecryptInit_ex (key/IV setup) failed");
-        return -1;
+// Снимает ссылку на объект. Последняя ссылка удаляет запись и файл объекта.
+static void object_unref(const char *hex) {
+    mongoc_collection_t *coll = objects_collection();
+    pthread_mutex_lock(&g_objects_mutex);
+    bson_error_t error;
+
+    bson_t *query = BCON_NEW("_id", BCON_UTF8(hex), "refs", "{", "$gt", BCON_INT64(0), "}");
+    bson_t *update = BCON_NEW("$inc", "{", "refs", BCON_INT64(-1), "}");
+    if (!mongoc_collection_update_one(coll, query, update, NULL, NULL, &error)) {
+        logger(LOG_ERROR, "Failed to drop reference to object %s: %s", hex, error.message);
     }
 
-    // Расшифровываем основную часть
-    if (EVP_DecryptUpdate(ctx, plaintext, &len, ciphertext, ciphertext_len) != 1) {
-        EVP_CIPHER_CTX_free(ctx);
-        logger(LOG_ERROR, "EVP_DecryptUpdate failed");
-        return -1;
+    // Удаляем запись только если ссылок не осталось; удалённая запись = удаляем файл
+    bson_t *orphan = BCON_NEW("_id", BCON_UTF8(hex), "refs", "{", "$lte", BCON_INT64(0), "}");
+    bson_t reply;
+    if (mongoc_collection_delete_one(coll, orphan, NULL, &reply, &error)) {
+        bson_iter_t iter;
+        if (bson_iter_init_find(&iter, &reply, "deletedCount") && bson_iter_as_int64(&iter) == 1) {
+            char objpath[PATH_MAX];
+            object_path(hex, objpath, sizeof(objpath));
+            if (unlink(objpath) != 0 && errno != ENOENT) {
+                logger(LOG_WARNING, "Failed to remove unreferenced object %s: %s", objpath, strerror(errno));
+            } else {
+                logger(LOG_INFO, "Removed unreferenced object %s", hex);
+            }
+        }
+    } else {
+        logger(LOG_ERROR, "Failed to remove record of object %s: %s", hex, error.message);
     }
-    plaintext_len = len;
+    bson_destroy(&reply);
+
+    bson_destroy(orphan);
+    bson_destroy(update);
+    bson_destroy(query);
+    pthread_mutex_unlock(&g_objects_mutex);
+}
 
-    // Устанавливаем ожидаемый GCM-тег ДО вызова Final — критически важно!
-    if (EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, 16, (void*)tag) != 1) {
-        EVP_CIPHER_CTX_free(ctx);
-        logger(LOG_ERROR, "Failed to set GCM tag for verification");
+// Переносит проверенный временный файл в хранилище объектов и берёт на него ссылку.
+// Если такой объект уже есть под текущим ключом, новая копия просто удаляется; объект
+// прежнего ключа она заменяет (имена, ссылавшиеся на старый файл, его и так не прочтут).
+static int object_store(const char *tmp_path, const char *hex, long long size, long long stored_size) {
+    char dirpath[PATH_MAX];
+    char objpath[PATH_MAX];
+    snprintf(dirpath, sizeof(dirpath), "%s/%.2s", OBJECTS_DIR, hex);
+    object_path(hex, objpath, sizeof(objpath));
+
+    mongoc_collection_t *objects = objects_collection();
+    pthread_mutex_lock(&g_objects_mutex);
+    if (mkdir(dirpath, 0755) != 0 && errno != EEXIST) {
+        logger(LOG_ERROR, "Failed to create object directory %s: %s", dirpath, strerror(errno));
+        pthread_mutex_unlock(&g_objects_mutex);
         return -1;
     }
-
-    // Final проверяет тег: если не совпадает — вернёт ошибку
-    if (EVP_DecryptFinal_ex(ctx, plaintext + len, &len) != 1) {
-        EVP_CIPHER_CTX_free(ctx);
-        logger(LOG_ERROR, "GCM authentication failed (tag mismatch)");
+    bool stored = true;
+    if (object_key_current_locked(objects, hex)) {
+        if (link(tmp_path, objpath) != 0) {
+            if (errno != EEXIST) {
+                logger(LOG_ERROR, "link() failed for %s -> %s: %s", tmp_path, objpath, strerror(errno));
+                pthread_mutex_unlock(&g_objects_mutex);
+                return -1;
+            }
+            stored = false;
+        }
+        unlink(tmp_path);
+    } else if (rename(tmp_path, objpath) != 0) {
+        logger(LOG_ERROR, "rename() failed for %s -> %s: %s", tmp_path, objpath, strerror(errno));
+        pthread_mutex_unlock(&g_objects_mutex);
         return -1;
     }
-    plaintext_len += len;
 
-    EVP_CIPHER_CTX_free(ctx);
-    return plaintext_len; // Должно совпадать с ciphertext_len
+    bool ok = object_ref_locked(objects, hex, size, stored ? stored_size : -1);
+    pthread_mutex_unlock(&g_objects_mutex);
+    return ok ? 0 : -1;
 }
 
+// Проверка have-hash: если объект уже хранится и клиент и так может скачать файл
+// с таким содержимым (свой, адресованный ему или публичный), берём на объект ссылку.
+// Требование доступа не даёт получить чужой файл, зная лишь его хеш. Доступ доказывают
+// только записи целых файлов: их хеш сервер посчитал сам при приёме.
+static bool object_claim_existing(const char *hex, long long size, const char *client_fingerprint) {
+    char objpath[PATH_MAX];
+    object_path(hex, objpath, sizeof(objpath));
 
-// Обработка команды UPLOAD: приём, проверка, шифрование и сохранение файла от клиента.
-// Предполагается, что SSL-соединение уже установлено и аутентифицировано.
-void handle_upload_request(SSL *ssl, RequestHeader *req, const char *client_fingerprint) {
-    // Убедимся, что глобальный криптографический контекст инициализирован
-    if (!g_file_crypto.initialized) {
-        logger(LOG_ERROR, "Crypto context not initialized — upload aborted");
-        ResponseHeader resp = { .status = RESP_ERROR };
-        ssl_send_all(ssl, &resp, sizeof(resp));
-        return;
+    bson_t *query = BCON_NEW(
+        "blake3", BCON_UTF8(hex),
+        "size", BCON_INT64(size),
+        "deleted", BCON_BOOL(false),
+        "chunks", "{", "$exists", BCON_BOOL(false), "}",
+        "$or", "[",
+            "{", "owner_fingerprint", BCON_UTF8(client_fingerprint), "}",
+            "{", "recipient_fingerprint", BCON_UTF8(client_fingerprint), "}",
+            "{", "public", BCON_BOOL(true), "}",
+        "]"
+    );
+
+    mongoc_collection_t *files = files_collection();
+    mongoc_collection_t *objects = objects_collection();
+    pthread_mutex_lock(&g_objects_mutex);
+    bson_error_t error;
+    int64_t visible = mongoc_collection_count_documents(files, query, NULL, NULL, NULL, &error);
+    if (visible < 0) {
+        logger(LOG_ERROR, "have-hash lookup failed for %s: %s", hex, error.message);
     }
 
-    // Защита от path traversal: запрещаем ".." и любые подкаталоги в имени файла
-    if (strstr(req->filename, "..") || strchr(req->filename, '/') || strlen(req->filename) == 0 || strlen(req->filename) > FILENAME_MAX_LEN - 1) {
-        logger(LOG_WARNING, "Path traversal or invalid filename blocked: %s", req->filename);
-        ResponseHeader resp = { .status = RESP_PERMISSION_DENIED };
-        ssl_send_all(ssl, &resp, sizeof(resp));
-        return;
+    struct stat st;
+    bool claimed = visible > 0 && stat(objpath, &st) == 0 && object_key_current_locked(objects, hex) &&
+                   object_ref_locked(objects, hex, size, -1);
+    pthread_mutex_unlock(&g_objects_mutex);
+
+    bson_destroy(query);
+    return claimed;
+}
+
+// Публикует объект под именем filetrade/<filename>: жёсткая ссылка во временное имя
+// и rename() поверх прежнего файла, так что читатели видят либо старое, либо новое содержимое.
+static int object_link_name(const char *hex, const char *filename, char *filepath, size_t filepath_len) {
+    char objpath[PATH_MAX];
+    char tmp_link[PATH_MAX];
+    object_path(hex, objpath, sizeof(objpath));
+    snprintf(filepath, filepath_len, "%s/%s", STORAGE_DIR, filename);
+    snprintf(tmp_link, sizeof(tmp_link), "%s/.%s.%lu.link", STORAGE_DIR, filename, (unsigned long)pthread_self());
+
+    unlink(tmp_link);
+    if (link(objpath, tmp_link) != 0) {
+        logger(LOG_ERROR, "link() failed for %s -> %s: %s", objpath, tmp_link, strerror(errno));
+        return -1;
+    }
+    if (rename(tmp_link, filepath) != 0) {
+        logger(LOG_ERROR, "rename() failed for %s -> %s: %s", tmp_link, filepath, strerror(errno));
+        unlink(tmp_link);
+        return -1;
     }
+    return 0;
+}
 
-    // Проверка размера файла
-    if (req->filesize <= 0 || req->filesize > MAX_FILE_SIZE) {
-        logger(LOG_WARNING, "File size out of bounds: %lld bytes", req->filesize);
-        ResponseHeader resp = { .status = RESP_PERMISSION_DENIED };
-        ssl_send_all(ssl, &resp, sizeof(resp));
-        return;
+// Помечает прежние записи с этим именем удалёнными и снимает их ссылки на объекты
+static void retire_file_name(const char *filename) {
+    bson_t *query = BCON_NEW("filename", BCON_UTF8(filename), "deleted", BCON_BOOL(false));
+    bson_t *opts = BCON_NEW("projection", "{", "blake3", BCON_INT32(1), "chunks.id", BCON_INT32(1), "}");
+    mongoc_cursor_t *cursor = mongoc_collection_find_with_opts(files_collection(), query, opts, NULL);
+
+    // Файл целиком ссылается на объект blake3, файл из чанков — на каждый чанк манифеста
+    GPtrArray *hashes = g_ptr_array_new_with_free_func(g_free);
+    const bson_t *doc;
+    bson_iter_t iter;
+    while (mongoc_cursor_next(cursor, &doc)) {
+        if (bson_iter_init_find(&iter, doc, "chunks") && BSON_ITER_HOLDS_ARRAY(&iter)) {
+            bson_iter_t chunk;
+            bson_iter_recurse(&iter, &chunk);
+            while (bson_iter_next(&chunk)) {
+                bson_iter_t id;
+                if (BSON_ITER_HOLDS_DOCUMENT(&chunk) && bson_iter_recurse(&chunk, &id) &&
+                    bson_iter_find(&id, "id") && BSON_ITER_HOLDS_UTF8(&id)) {
+                    g_ptr_array_add(hashes, g_strdup(bson_iter_utf8(&id, NULL)));
+                }
+            }
+        } else if (bson_iter_init_find(&iter, doc, "blake3") && BSON_ITER_HOLDS_UTF8(&iter)) {
+            g_ptr_array_add(hashes, g_strdup(bson_iter_utf8(&iter, NULL)));
+        }
     }
+    mongoc_cursor_destroy(cursor);
 
-    // Если указан получатель — проверяем, что это корректный SHA-256 отпечаток (64 hex-символа)
-    if (req->recipient[0] != '\0') {
-        if (strlen(req->recipient) != FINGERPRINT_LEN - 1) {
-            logger(LOG_WARNING, "Invalid recipient fingerprint length for: %s", req->filename);
-            ResponseHeader resp = { .status = RESP_PERMISSION_DENIED };
-            ssl_send_all(ssl, &resp, sizeof(resp));
-            return;
+    bson_error_t error;
+    bson_t *update = BCON_NEW("$set", "{", "deleted", BCON_BOOL(true), "}");
+    if (!mongoc_collection_update_many(files_collection(), query, update, NULL, NULL, &error)) {
+        logger(LOG_ERROR, "Failed to retire previous records of %s: %s", filename, error.message);
+    } else {
+        for (guint i = 0; i < hashes->len; i++) {
+            object_unref(g_ptr_array_index(hashes, i));
         }
-        for (int i = 0; i < 64; i++) {
-            char c = req->recipient[i];
-            if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) {
-                logger(LOG_WARNING, "Invalid character in recipient fingerprint: %c (pos %d)", c, i);
-                ResponseHeader resp = { .status = RESP_PERMISSION_DENIED };
-                ssl_send_all(ssl, &resp, sizeof(resp));
-                return;
-            }
+    }
+
+    g_ptr_array_free(hashes, TRUE);
+    bson_destroy(update);
+    bson_destroy(opts);
+    bson_destroy(query);
+}
+
+// Сохраняет метаданные загруженного файла. Для файла из чанков chunk_hex содержит
+// hex-хеши чанков по порядку, и в документ записывается манифест. Хеш всего файла из
+// чанков сервер не считал — это слова клиента, поэтому он пишется в claimed_blake3, а
+// не в blake3, по которому проверяется доступ к объекту. Возвращает true при успехе.
+static bool insert_file_metadata(const RequestHeader *req, const char *client_fingerprint, const char *hex,
+                                 const ChunkRef *chunks, char (*chunk_hex)[OBJECT_HEX_LEN], uint32_t chunk_count) {
+    bson_t *doc = bson_new();
+    BSON_APPEND_UTF8(doc, "filename", req->filename);
+    BSON_APPEND_INT64(doc, "size", req->filesize);
+    BSON_APPEND_UTF8(doc, chunks ? "claimed_blake3" : "blake3", hex);
+
+    if (chunks) {
+        bson_t list;
+        BSON_APPEND_ARRAY_BEGIN(doc, "chunks", &list);
+        for (uint32_t i = 0; i < chunk_count; i++) {
+            char index[16];
+            const char *key;
+            bson_uint32_to_string(i, &key, index, sizeof(index));
+
+            bson_t entry;
+            BSON_APPEND_DOCUMENT_BEGIN(&list, key, &entry);
+            BSON_APPEND_UTF8(&entry, "id", chunk_hex[i]);
+            BSON_APPEND_INT32(&entry, "len", (int32_t)chunks[i].len);
+            bson_append_document_end(&list, &entry);
         }
-        // recipient прошёл валидацию — разрешено
+        bson_append_array_end(doc, &list);
+    }
+    BSON_APPEND_BOOL(doc, "encrypted", true);
+    // IV и теги хранятся в самом файле (заголовок + тег каждой записи)
+    BSON_APPEND_UTF8(doc, "format", CHUNKED_GCM_FORMAT_NAME);
+    BSON_APPEND_INT32(doc, "chunk_size", CHUNKED_GCM_CHUNK_SIZE);
+    BSON_APPEND_BOOL(doc, "deleted", false);
+    BSON_APPEND_UTF8(doc, "owner_fingerprint", client_fingerprint);
+
+    // Указываем, публичный файл или предназначенный конкретному получателю
+    if (req->recipient[0] != '\0') {
+        BSON_APPEND_UTF8(doc, "recipient_fingerprint", req->recipient);
+        BSON_APPEND_BOOL(doc, "public", false);
+    } else {
+        BSON_APPEND_BOOL(doc, "public", true);
+    }
+
+    // Временная метка загрузки (в миллисекундах с эпохи)
+    BSON_APPEND_DATE_TIME(doc, "uploaded_at", g_get_real_time() / 1000);
+
+    bson_error_t error;
+    bool success = mongoc_collection_insert_one(files_collection(), doc, NULL, NULL, &error);
+    if (!success) {
+        logger(LOG_ERROR, "MongoDB metadata insertion failed for %s: [code=%d] %s", req->filename, error.code, error.message);
     }
 
-    // Формируем полный путь до файла в безопасной директории хранения
+    bson_destroy(doc);
+    return success;
+}
+
+// Завершает загрузку, на объект которой уже взята ссылка: публикует имя, заменяет
+// прежние записи с этим именем и сохраняет метаданные. Возвращает статус для клиента.
+static ResponseStatus publish_upload(const RequestHeader *req, const char *client_fingerprint, const char *hex) {
     char filepath[PATH_MAX];
-    snprintf(filepath, sizeof(filepath), "%s/%s", STORAGE_DIR, req->filename);
+    if (object_link_name(hex, req->filename, filepath, sizeof(filepath)) != 0) {
+        object_unref(hex);
+        return RESP_ERROR;
+    }
+
+    retire_file_name(req->filename);
+
+    if (!insert_file_metadata(req, client_fingerprint, hex, NULL, NULL, 0)) {
+        unlink(filepath);
+        object_unref(hex);
+        return RESP_ERROR;
+    }
+
+    // Записываем событие обработки в историю (для аудита и отслеживания)
+    if (!append_proc_event(filepath, "upload", "success")) {
+        logger(LOG_WARNING, "Failed to log upload event in proc map for: %s", filepath);
+    }
+    return RESP_SUCCESS;
+}
+
+
+// --- Возобновляемая загрузка (CMD_UPLOAD с offset) ---
+// Принимаемый файл лежит в PARTIAL_DIR/<ключ>.data; ключ — BLAKE3 отпечатка клиента, имени,
+// размера и заявленного хеша, так что продолжить можно только свою загрузку того же файла.
+// Точка возобновления — граница записи chunked-GCM: base_iv, номер записи и состояние
+// хешера в <ключ>.state. Она сохраняется каждые UPLOAD_CHECKPOINT_BYTES и при обрыве
+// соединения, а при продолжении файл обрезается до неё. Состояние зашифровано ключом
+// файлов (в хешере остаётся хвост открытого текста), поэтому загрузки прошлого запуска
+// сервера не продолжаются и удаляются через PARTIAL_TTL_SEC.
+
+typedef struct {
+    char magic[8];                   // UPLOAD_CHECKPOINT_MAGIC
+    uint32_t hasher_size;            // sizeof(blake3_hasher) сборки, записавшей состояние
+    chunked_gcm_position_t position; // записи до position.chunk_index уже на диске
+    blake3_hasher hasher;            // хеш открытого текста этих записей
+} upload_checkpoint_t;
+
+static void partial_key(const char *client_fingerprint, const RequestHeader *req, char key[OBJECT_HEX_LEN]) {
+    uint8_t size_le[8];
+    for (int i = 0; i < 8; i++) {
+        size_le[i] = (uint8_t)((unsigned long long)req->filesize >> (8 * i));
+    }
+
+    uint8_t digest[BLAKE3_HASH_LEN];
+    blake3_hasher hasher;
+    blake3_hasher_init(&hasher);
+    blake3_hasher_update(&hasher, client_fingerprint, strlen(client_fingerprint) + 1);
+    blake3_hasher_update(&hasher, req->filename, strlen(req->filename) + 1);
+    blake3_hasher_update(&hasher, size_le, sizeof(size_le));
+    blake3_hasher_update(&hasher, req->file_hash, BLAKE3_HASH_LEN);
+    blake3_hasher_finalize(&hasher, digest, BLAKE3_HASH_LEN);
+    object_hex(digest, key);
+}
+
+static void partial_path(const char *key, const char *suffix, char *out, size_t out_len) {
+    snprintf(out, out_len, "%s/%s.%s", PARTIAL_DIR, key, suffix);
+}
+
+// Закрепляет загрузку за вызывающим потоком. false — её уже принимает другое соединение
+static bool partial_claim(const char *key) {
+    pthread_mutex_lock(&g_partials_mutex);
+    bool claimed = !g_hash_table_contains(g_active_partials, key);
+    if (claimed) g_hash_table_add(g_active_partials, g_strdup(key));
+    pthread_mutex_unlock(&g_partials_mutex);
+    return claimed;
+}
+
+static void partial_release(const char *key) {
+    pthread_mutex_lock(&g_partials_mutex);
+    g_hash_table_remove(g_active_partials, key);
+    pthread_mutex_unlock(&g_partials_mutex);
+}
+
+static void partial_remove(const char *key) {
+    char path[PATH_MAX];
+    partial_path(key, "data", path, sizeof(path));
+    unlink(path);
+    partial_path(key, "state", path, sizeof(path));
+    unlink(path);
+}
+
+// Читает точку возобновления. -1, если её нет или текущим ключом её не расшифровать
+static int partial_load(const char *key, upload_checkpoint_t *cp) {
+    char path[PATH_MAX];
+    partial_path(key, "state", path, sizeof(path));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return -1;
+
+    int rc = -1;
+    uint8_t *buf = malloc(CHUNKED_GCM_CHUNK_SIZE);
+    chunked_gcm_reader_t reader;
+    if (buf && chunked_gcm_reader_open(&reader, fd, g_file_crypto.key) == MR_SUCCESS) {
+        size_t len = 0;
+        if (reader.chunk_size == CHUNKED_GCM_CHUNK_SIZE && reader.plaintext_size == sizeof(*cp) &&
+            chunked_gcm_reader_read(&reader, 0, buf, &len) == MR_SUCCESS) {
+            memcpy(cp, buf, sizeof(*cp));
+            explicit_bzero(buf, sizeof(*cp));
+            if (memcmp(cp->magic, UPLOAD_CHECKPOINT_MAGIC, sizeof(cp->magic)) == 0 &&
+                cp->hasher_size == sizeof(blake3_hasher)) {
+                rc = 0;
+            } else {
+                explicit_bzero(cp, sizeof(*cp));
+            }
+        }
+        chunked_gcm_reader_cleanup(&reader);
+    }
+    free(buf);
+    close(fd);
+    return rc;
+}
+
+// Сохраняет точку возобновления на текущей границе записи: данные сбрасываются на диск,
+// затем состояние пишется во временный файл и заменяет прежнее через rename().
+static int partial_save(upload_stream_t *us, const char *key) {
+    upload_checkpoint_t cp;
+    memset(&cp, 0, sizeof(cp));
+    memcpy(cp.magic, UPLOAD_CHECKPOINT_MAGIC, sizeof(cp.magic));
+    cp.hasher_size = sizeof(blake3_hasher);
+    if (chunked_gcm_writer_checkpoint(&us->writer, &cp.position) != MR_SUCCESS || fsync(us->fd) != 0) {
+        logger(LOG_ERROR, "Cannot checkpoint partial upload %s", key);
+        return -1;
+    }
+    cp.hasher = us->hasher;
+
+    char tmp_path[PATH_MAX];
+    char path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s/.%s.XXXXXX", PARTIAL_DIR, key);
+    partial_path(key, "state", path, sizeof(path));
+
+    int rc = -1;
+    int fd = mkstemp(tmp_path);
+    if (fd != -1) {
+        chunked_gcm_writer_t writer;
+        if (chunked_gcm_writer_init(&writer, fd, g_file_crypto.key) == MR_SUCCESS) {
+            if (chunked_gcm_writer_update(&writer, (const uint8_t *)&cp, sizeof(cp)) == MR_SUCCESS &&
+                chunked_gcm_writer_final(&writer) == MR_SUCCESS && fsync(fd) == 0) {
+                rc = 0;
+            }
+            chunked_gcm_writer_cleanup(&writer);
+        }
+        if (close(fd) != 0) rc = -1;
+        if (rc == 0 && rename(tmp_path, path) != 0) rc = -1;
+        if (rc != 0) unlink(tmp_path);
+    }
+    if (rc != 0) {
+        logger(LOG_ERROR, "Failed to save state of partial upload %s: %s", key, strerror(errno));
+    }
+
+    explicit_bzero(&cp, sizeof(cp));
+    return rc;
+}
+
+// Открывает файл загрузки: продолжение с точки cp или новый файл, если cp == NULL
+static int upload_stream_open_partial(upload_stream_t *us, const char *key, const upload_checkpoint_t *cp) {
+    memset(us, 0, sizeof(*us));
+    partial_path(key, "data", us->tmp_path, sizeof(us->tmp_path));
+    us->fd = open(us->tmp_path, O_RDWR | O_CREAT | O_CLOEXEC | (cp ? 0 : O_TRUNC), 0600);
+    if (us->fd == -1) {
+        logger(LOG_ERROR, "open() failed for %s: %s", us->tmp_path, strerror(errno));
+        return -1;
+    }
+
+    error_status_t rc = cp ? chunked_gcm_writer_resume(&us->writer, us->fd, g_file_crypto.key, &cp->position)
+                           : chunked_gcm_writer_init(&us->writer, us->fd, g_file_crypto.key);
+    if (rc != MR_SUCCESS) {
+        logger(LOG_ERROR, "Failed to %s encrypted stream %s (status %d)", cp ? "resume" : "start", us->tmp_path, (int)rc);
+        close(us->fd);
+        us->fd = -1;
+        return -1;
+    }
+
+    if (cp) {
+        us->hasher = cp->hasher;
+    } else {
+        blake3_hasher_init(&us->hasher);
+    }
+    return 0;
+}
+
+// Соединение оборвалось: сохраняем точку возобновления и оставляем файл на диске.
+// Если сохранить не удалось, загрузку придётся начать заново.
+static void upload_stream_suspend(upload_stream_t *us, const char *key) {
+    bool saved = partial_save(us, key) == 0;
+    unsigned long long kept = (unsigned long long)us->writer.plaintext_size;
+    upload_stream_close(us, saved);
+    if (saved) {
+        logger(LOG_INFO, "Partial upload %s kept at %llu bytes", key, kept);
+    } else {
+        partial_remove(key);
+    }
+}
+
+// Загрузка не удалась по вине данных или сервера: продолжать нечего
+static void upload_stream_abort(upload_stream_t *us, const char *key) {
+    upload_stream_close(us, false);
+    partial_remove(key);
+}
+
+// Чанки прерванной чанковой загрузки: ссылки на уже принятые объекты остаются за файлом
+// <ключ>.chunks (строка hex на ссылку), и повтор той же загрузки их не передаёт заново.
+// Снимает ссылки повтор (взяв свои) или partial_sweep.
+
+// Читает отложенные ссылки; NULL, если списка нет
+static GPtrArray *partial_chunks_load(const char *key) {
+    char path[PATH_MAX];
+    partial_path(key, "chunks", path, sizeof(path));
+    FILE *fp = fopen(path, "r");
+    if (!fp) return NULL;
+
+    GPtrArray *hexes = g_ptr_array_new_with_free_func(g_free);
+    char line[OBJECT_HEX_LEN + 1];
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\n")] = '\0';
+        if (strlen(line) == OBJECT_HEX_LEN - 1 && strspn(line, "0123456789abcdef") == OBJECT_HEX_LEN - 1) {
+            g_ptr_array_add(hexes, g_strdup(line));
+        }
+    }
+    fclose(fp);
+    return hexes;
+}
+
+// Снимает отложенные ссылки. Список удаляется первым: после сбоя посередине
+// объект лучше потерять счётчиком лишнюю ссылку, чем удалить живой.
+static void partial_chunks_drop(const char *key, GPtrArray *hexes) {
+    char path[PATH_MAX];
+    partial_path(key, "chunks", path, sizeof(path));
+    unlink(path);
+    for (guint i = 0; i < hexes->len; i++) {
+        object_unref(g_ptr_array_index(hexes, i));
+    }
+}
+
+// Откладывает ссылки refs за ключом. false — сохранить не удалось, их нужно снять
+static bool partial_chunks_park(const char *key, GPtrArray *refs) {
+    char tmp_path[PATH_MAX];
+    char path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s/.%s.XXXXXX", PARTIAL_DIR, key);
+    partial_path(key, "chunks", path, sizeof(path));
+
+    int fd = mkstemp(tmp_path);
+    if (fd == -1) return false;
+    FILE *fp = fdopen(fd, "w");
+    if (!fp) {
+        close(fd);
+        unlink(tmp_path);
+        return false;
+    }
+    bool ok = true;
+    for (guint i = 0; ok && i < refs->len; i++) {
+        ok = fprintf(fp, "%s\n", (const char *)g_ptr_array_index(refs, i)) > 0;
+    }
+    ok = ok && fflush(fp) == 0 && fsync(fd) == 0;
+    if (fclose(fp) != 0) ok = false;
+    if (ok && rename(tmp_path, path) != 0) ok = false;
+    if (!ok) {
+        logger(LOG_ERROR, "Failed to keep chunks of partial upload %s: %s", key, strerror(errno));
+        unlink(tmp_path);
+    }
+    return ok;
+}
+
+// Удаляет файлы незавершённых загрузок, не менявшиеся PARTIAL_TTL_SEC. Каталог
+// просматривается из потока очередной загрузки не чаще раза в PARTIAL_SWEEP_SEC.
+static void partial_sweep(void) {
+    static time_t last_sweep = 0;
+    time_t now = time(NULL);
+    pthread_mutex_lock(&g_partials_mutex);
+    bool due = now - last_sweep >= PARTIAL_SWEEP_SEC;
+    if (due) last_sweep = now;
+    pthread_mutex_unlock(&g_partials_mutex);
+    if (!due) return;
+
+    DIR *dir = opendir(PARTIAL_DIR);
+    if (!dir) return;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        // <ключ>.data, <ключ>.state, <ключ>.chunks и временные .<ключ>.XXXXXX
+        const char *name = entry->d_name[0] == '.' ? entry->d_name + 1 : entry->d_name;
+        if (strlen(name) < OBJECT_HEX_LEN || name[OBJECT_HEX_LEN - 1] != '.') continue;
+        char key[OBJECT_HEX_LEN];
+        memcpy(key, name, OBJECT_HEX_LEN - 1);
+        key[OBJECT_HEX_LEN - 1] = '\0';
+
+        char path[PATH_MAX];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", PARTIAL_DIR, entry->d_name);
+        if (stat(path, &st) != 0 || now - st.st_mtime < PARTIAL_TTL_SEC) continue;
+
+        // Загрузку, которую сейчас принимают, не трогаем
+        if (!partial_claim(key)) continue;
+        GPtrArray *parked = entry->d_name[0] != '.' && strcmp(name + OBJECT_HEX_LEN, "chunks") == 0
+                                ? partial_chunks_load(key) : NULL;
+        if (parked) {
+            partial_chunks_drop(key, parked);
+            logger(LOG_INFO, "Released %u chunks of stale partial upload %s", parked->len, key);
+            g_ptr_array_free(parked, TRUE);
+        } else if (unlink(path) == 0) {
+            logger(LOG_INFO, "Removed stale partial upload file %s", entry->d_name);
+        }
+        partial_release(key);
+    }
+    closedir(dir);
+}
+
+// Общие проверки заголовка загрузки. При ошибке отправляет клиенту статус и возвращает false.
+static bool upload_header_valid(SSL *ssl, const RequestHeader *req) {
+    // Убедимся, что глобальный криптографический контекст инициализирован
+    if (!g_file_crypto.initialized) {
+        logger(LOG_ERROR, "Crypto context not initialized — upload aborted");
+        ResponseHeader resp = { .status = RESP_ERROR };
+        ssl_send_all(ssl, &resp, sizeof(resp));
+        return false;
+    }
+
+    // Защита от path traversal: запрещаем ".." и любые подкаталоги в имени файла
+    if (strstr(req->filename, "..") || strchr(req->filename, '/') || strlen(req->filename) == 0 || strlen(req->filename) > FILENAME_MAX_LEN - 1) {
+        logger(LOG_WARNING, "Path traversal or invalid filename blocked: %s", req->filename);
+        ResponseHeader resp = { .status = RESP_PERMISSION_DENIED };
+        ssl_send_all(ssl, &resp, sizeof(resp));
+        return false;
+    }
+
+    // Проверка размера файла
+    if (req->filesize <= 0 || req->filesize > MAX_FILE_SIZE) {
+        logger(LOG_WARNING, "File size out of bounds: %lld bytes", req->filesize);
+        ResponseHeader resp = { .status = RESP_PERMISSION_DENIED };
+        ssl_send_all(ssl, &resp, sizeof(resp));
+        return false;
+    }
+
+    // Если указан получатель — проверяем, что это корректный SHA-256 отпечаток (64 hex-символа)
+    if (req->recipient[0] != '\0') {
+        if (strlen(req->recipient) != FINGERPRINT_LEN - 1) {
+            logger(LOG_WARNING, "Invalid recipient fingerprint length for: %s", req->filename);
+            ResponseHeader resp = { .status = RESP_PERMISSION_DENIED };
+            ssl_send_all(ssl, &resp, sizeof(resp));
+            return false;
+        }
+        for (int i = 0; i < 64; i++) {
+            char c = req->recipient[i];
+            if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) {
+                logger(LOG_WARNING, "Invalid character in recipient fingerprint: %c (pos %d)", c, i);
+                ResponseHeader resp = { .status = RESP_PERMISSION_DENIED };
+                ssl_send_all(ssl, &resp, sizeof(resp));
+                return false;
+            }
+        }
+        // recipient прошёл валидацию — разрешено
+    }
+
+    return true;
+}
+
+// Обработка команды UPLOAD: приём, проверка, шифрование и сохранение файла от клиента.
+// Предполагается, что SSL-соединение уже установлено и аутентифицировано.
+// offset > 0 продолжает прерванную загрузку с точки, которую сообщил UPLOAD_STATUS.
+void handle_upload_request(SSL *ssl, RequestHeader *req, const char *client_fingerprint) {
+    if (!upload_header_valid(ssl, req)) return;
+    partial_sweep();
+
+    char hex[OBJECT_HEX_LEN];
+    object_hex(req->file_hash, hex);
+
+    // Такое содержимое уже хранится и доступно клиенту: тело не передаётся
+    if (object_claim_existing(hex, req->filesize, client_fingerprint)) {
+        ResponseHeader resp = { .status = publish_upload(req, client_fingerprint, hex) };
+        if (resp.status == RESP_SUCCESS) {
+            resp.status = RESP_ALREADY_STORED;
+            logger(LOG_INFO, "Upload of %s deduplicated against object %s", req->filename, hex);
+        }
+        ssl_send_all(ssl, &resp, sizeof(resp));
+        return;
+    }
+
+    char key[OBJECT_HEX_LEN];
+    partial_key(client_fingerprint, req, key);
+    if (!partial_claim(key)) {
+        logger(LOG_WARNING, "Upload of %s is already being received on another connection", req->filename);
+        ResponseHeader resp = { .status = RESP_FAILURE };
+        ssl_send_all(ssl, &resp, sizeof(resp));
+        return;
+    }
+
+    // Продолжить можно только с сохранённой точки; новая загрузка отменяет прежнюю
+    ResponseHeader resp = { .status = RESP_SUCCESS };
+    upload_checkpoint_t cp;
+    bool resume = req->offset > 0;
+    if (req->offset < 0 || (resume && partial_load(key, &cp) != 0)) {
+        resp.status = RESP_INVALID_OFFSET;
+    } else if (resume && (long long)cp.position.chunk_index * CHUNKED_GCM_CHUNK_SIZE != req->offset) {
+        explicit_bzero(&cp, sizeof(cp));
+        resp.status = RESP_INVALID_OFFSET;
+    }
+    if (resp.status == RESP_SUCCESS && !resume) {
+        partial_remove(key);
+    }
+
+    // Потоковый приём: память на загрузку ограничена буфером приёма и одной записью шифра
+    upload_stream_t us;
+    if (resp.status == RESP_SUCCESS) {
+        if (upload_stream_open_partial(&us, key, resume ? &cp : NULL) != 0) {
+            partial_remove(key);
+            resp.status = resume ? RESP_INVALID_OFFSET : RESP_ERROR;
+        }
+        if (resume) explicit_bzero(&cp, sizeof(cp));
+    }
+    if (resp.status != RESP_SUCCESS) {
+        partial_release(key);
+        ssl_send_all(ssl, &resp, sizeof(resp));
+        return;
+    }
+
+    // Тело может идти долго: клиент пула на это время возвращаем, object_store возьмёт новый
+    mongo_pool_release_thread();
+
+    uint8_t *chunk = malloc(STREAM_CHUNK_SIZE);
+    if (!chunk) {
+        logger(LOG_ERROR, "Memory allocation failed for upload buffers: %s", req->filename);
+        upload_stream_suspend(&us, key);
+        partial_release(key);
+        resp.status = RESP_ERROR;
+        ssl_send_all(ssl, &resp, sizeof(resp));
+        return;
+    }
+
+    // Отправляем клиенту подтверждение, что можно начинать передачу
+    if (ssl_send_all(ssl, &resp, sizeof(resp)) != 0) {
+        logger(LOG_ERROR, "Failed to send upload permission for: %s", req->filename);
+        free(chunk);
+        upload_stream_suspend(&us, key);
+        partial_release(key);
+        return;
+    }
+    if (resume) {
+        logger(LOG_INFO, "Resuming upload of %s at %lld bytes", req->filename, (long long)req->offset);
+    }
+
+    // Приём файла по частям через SSL: каждая порция сразу хешируется, шифруется и пишется на диск.
+    // Порции целые записи chunked-GCM, так что при обрыве писатель стоит на границе записи.
+    long long remaining = req->filesize - req->offset;
+    while (remaining > 0) {
+        size_t to_read = (remaining < STREAM_CHUNK_SIZE) ? (size_t)remaining : STREAM_CHUNK_SIZE;
+
+        if (ssl_recv_all(ssl, chunk, to_read) != (ssize_t)to_read) {
+            logger(LOG_ERROR, "Incomplete file reception for: %s", req->filename);
+            free(chunk);
+            // Принятое до обрыва остаётся: клиент продолжит с точки возобновления
+            upload_stream_suspend(&us, key);
+            partial_release(key);
+            return;
+        }
+
+        remaining -= to_read;
+        if (upload_stream_write(&us, chunk, to_read) != 0 ||
+            (remaining > 0 && us.writer.plaintext_size % UPLOAD_CHECKPOINT_BYTES == 0 && partial_save(&us, key) != 0)) {
+            logger(LOG_ERROR, "Encryption pipeline failed for: %s", req->filename);
+            free(chunk);
+            upload_stream_abort(&us, key);
+            partial_release(key);
+            resp.status = RESP_ERROR;
+            ssl_send_all(ssl, &resp, sizeof(resp));
+            return;
+        }
+    }
+
+    explicit_bzero(chunk, STREAM_CHUNK_SIZE);
+    free(chunk);
+
+    uint8_t computed_hash[BLAKE3_HASH_LEN];
+    if (upload_stream_finish(&us, computed_hash) != 0) {
+        upload_stream_abort(&us, key);
+        partial_release(key);
+        resp.status = RESP_ERROR;
+        ssl_send_all(ssl, &resp, sizeof(resp));
+        return;
+    }
+
+    // Проверяем целостность полученного файла через BLAKE3-хеш, присланный клиентом
+    if (memcmp(computed_hash, req->file_hash, BLAKE3_HASH_LEN) != 0) {
+        logger(LOG_ERROR, "BLAKE3 integrity check failed for: %s", req->filename);
+        upload_stream_abort(&us, key);
+        partial_release(key);
+        resp.status = RESP_INTEGRITY_ERROR;
+        ssl_send_all(ssl, &resp, sizeof(resp));
+        return;
+    }
+
+    // Хеш в порядке — кладём содержимое в хранилище объектов (или переиспользуем имеющееся)
+    if (object_store(us.tmp_path, hex, req->filesize, req->filesize) != 0) {
+        upload_stream_abort(&us, key);
+        partial_release(key);
+        resp.status = RESP_ERROR;
+        ssl_send_all(ssl, &resp, sizeof(resp));
+        return;
+    }
+    upload_stream_close(&us, true);
+    partial_remove(key);
+    partial_release(key);
+
+    resp.status = publish_upload(req, client_fingerprint, hex);
+    if (resp.status == RESP_SUCCESS) {
+        logger(LOG_INFO, "File upload completed successfully: %s (size=%lld, object %s)", req->filename, req->filesize, hex);
+    }
+
+    // Отправляем финальный статус клиенту
+    ssl_send_all(ssl, &resp, sizeof(resp));
+}
+
+// Обработка команды UPLOAD_STATUS: сколько байт незавершённой загрузки этого файла (тем же
+// клиентом, с тем же именем, размером и хешем) уже на сервере. 0 — начинать сначала.
+void handle_upload_status_request(SSL *ssl, RequestHeader *req, const char *client_fingerprint) {
+    if (!upload_header_valid(ssl, req)) return;
+
+    char key[OBJECT_HEX_LEN];
+    partial_key(client_fingerprint, req, key);
+
+    ResponseHeader resp = { .status = RESP_SUCCESS, .filesize = 0 };
+    upload_checkpoint_t cp;
+    if (partial_load(key, &cp) == 0) {
+        // Записи до точки возобновления должны быть в файле целиком
+        char path[PATH_MAX];
+        struct stat st;
+        partial_path(key, "data", path, sizeof(path));
+        uint64_t needed = CHUNKED_GCM_HEADER_SIZE +
+                          cp.position.chunk_index * CHUNKED_GCM_RECORD_SIZE((uint64_t)CHUNKED_GCM_CHUNK_SIZE);
+        if (stat(path, &st) == 0 && (uint64_t)st.st_size >= needed) {
+            resp.filesize = (long long)cp.position.chunk_index * CHUNKED_GCM_CHUNK_SIZE;
+        }
+        explicit_bzero(&cp, sizeof(cp));
+    }
+    ssl_send_all(ssl, &resp, sizeof(resp));
+}
+
+
+// Добавляет в current те объекты из candidates, что сохранены под текущим ключом;
+// строки ключей current принадлежат candidates. Вызывать под g_objects_mutex.
+static bool objects_key_current_locked(mongoc_collection_t *coll, GHashTable *candidates, GHashTable *current) {
+    bson_t query, cond, ids;
+    bson_init(&query);
+    BSON_APPEND_DOCUMENT_BEGIN(&query, "_id", &cond);
+    BSON_APPEND_ARRAY_BEGIN(&cond, "$in", &ids);
+    GHashTableIter it;
+    gpointer hex;
+    uint32_t n = 0;
+    g_hash_table_iter_init(&it, candidates);
+    while (g_hash_table_iter_next(&it, &hex, NULL)) {
+        char index[16];
+        const char *key;
+        bson_uint32_to_string(n++, &key, index, sizeof(index));
+        BSON_APPEND_UTF8(&ids, key, hex);
+    }
+    bson_append_array_end(&cond, &ids);
+    bson_append_document_end(&query, &cond);
+    BSON_APPEND_UTF8(&query, "key_id", g_file_crypto.key_id);
+    bson_t *opts = BCON_NEW("projection", "{", "_id", BCON_INT32(1), "}");
+
+    mongoc_cursor_t *cursor = mongoc_collection_find_with_opts(coll, &query, opts, NULL);
+    const bson_t *doc;
+    bson_iter_t iter;
+    while (mongoc_cursor_next(cursor, &doc)) {
+        gpointer orig;
+        if (bson_iter_init_find(&iter, doc, "_id") && BSON_ITER_HOLDS_UTF8(&iter) &&
+            g_hash_table_lookup_extended(candidates, bson_iter_utf8(&iter, NULL), &orig, NULL)) {
+            g_hash_table_add(current, orig);
+        }
+    }
+
+    bson_error_t error;
+    bool ok = !mongoc_cursor_error(cursor, &error);
+    if (!ok) {
+        logger(LOG_ERROR, "Object key lookup failed: %s", error.message);
+    }
+    mongoc_cursor_destroy(cursor);
+    bson_destroy(opts);
+    bson_destroy(&query);
+    return ok;
+}
+
+// Отмечает в present[] чанки, которые уже хранятся и входят в файлы, доступные клиенту
+// (свои, адресованные ему или публичные), и берёт ссылку на каждое такое вхождение.
+// Как и для целых файлов, знание хеша чанка без доступа к нему ничего не даёт.
+// Чанки из parked (отложенные прерванной попыткой этой же загрузки) клиент тоже видит.
+// Взятые ссылки добавляются в refs. Возвращает false при ошибке MongoDB.
+static bool chunks_claim_existing(char (*chunk_hex)[OBJECT_HEX_LEN], const ChunkRef *chunks, uint32_t count,
+                                  const char *client_fingerprint, GPtrArray *parked, bool *present, GPtrArray *refs) {
+    bson_t query;
+    bson_init(&query);
+    BSON_APPEND_BOOL(&query, "deleted", false);
+
+    bson_t cond, ids;
+    BSON_APPEND_DOCUMENT_BEGIN(&query, "chunks.id", &cond);
+    BSON_APPEND_ARRAY_BEGIN(&cond, "$in", &ids);
+    for (uint32_t i = 0; i < count; i++) {
+        char index[16];
+        const char *key;
+        bson_uint32_to_string(i, &key, index, sizeof(index));
+        BSON_APPEND_UTF8(&ids, key, chunk_hex[i]);
+    }
+    bson_append_array_end(&cond, &ids);
+    bson_append_document_end(&query, &cond);
+
+    bson_t *access = BCON_NEW(
+        "$or", "[",
+            "{", "owner_fingerprint", BCON_UTF8(client_fingerprint), "}",
+            "{", "recipient_fingerprint", BCON_UTF8(client_fingerprint), "}",
+            "{", "public", BCON_BOOL(true), "}",
+        "]"
+    );
+    bson_concat(&query, access);
+    bson_t *opts = BCON_NEW("projection", "{", "chunks.id", BCON_INT32(1), "}");
+
+    // Чанки манифестов, которые клиент и так может скачать
+    GHashTable *visible = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    mongoc_cursor_t *cursor = mongoc_collection_find_with_opts(files_collection(), &query, opts, NULL);
+    const bson_t *doc;
+    bson_iter_t iter;
+    while (mongoc_cursor_next(cursor, &doc)) {
+        if (!bson_iter_init_find(&iter, doc, "chunks") || !BSON_ITER_HOLDS_ARRAY(&iter)) continue;
+        bson_iter_t chunk;
+        bson_iter_recurse(&iter, &chunk);
+        while (bson_iter_next(&chunk)) {
+            bson_iter_t id;
+            if (BSON_ITER_HOLDS_DOCUMENT(&chunk) && bson_iter_recurse(&chunk, &id) &&
+                bson_iter_find(&id, "id") && BSON_ITER_HOLDS_UTF8(&id)) {
+                g_hash_table_add(visible, g_strdup(bson_iter_utf8(&id, NULL)));
+            }
+        }
+    }
+
+    bson_error_t error;
+    bool ok = !mongoc_cursor_error(cursor, &error);
+    if (!ok) {
+        logger(LOG_ERROR, "Chunk lookup failed: %s", error.message);
+    }
+    mongoc_cursor_destroy(cursor);
+    for (guint i = 0; parked && i < parked->len; i++) {
+        g_hash_table_add(visible, g_strdup(g_ptr_array_index(parked, i)));
+    }
+
+    // Из них нужны только чанки этого манифеста
+    GHashTable *wanted = g_hash_table_new(g_str_hash, g_str_equal);
+    for (uint32_t i = 0; i < count; i++) {
+        if (g_hash_table_contains(visible, chunk_hex[i])) g_hash_table_add(wanted, chunk_hex[i]);
+    }
+
+    // Ссылки берутся под мьютексом, пока файл объекта гарантированно на месте
+    mongoc_collection_t *objects = objects_collection();
+    pthread_mutex_lock(&g_objects_mutex);
+    GHashTable *current = g_hash_table_new(g_str_hash, g_str_equal);
+    if (ok && g_hash_table_size(wanted) > 0) {
+        ok = objects_key_current_locked(objects, wanted, current);
+    }
+    for (uint32_t i = 0; ok && i < count; i++) {
+        present[i] = false;
+        if (!g_hash_table_contains(current, chunk_hex[i])) continue;
+
+        char objpath[PATH_MAX];
+        struct stat st;
+        object_path(chunk_hex[i], objpath, sizeof(objpath));
+        if (stat(objpath, &st) != 0) continue;
+
+        if (!object_ref_locked(objects, chunk_hex[i], chunks[i].len, -1)) {
+            ok = false;
+            break;
+        }
+        g_ptr_array_add(refs, chunk_hex[i]);
+        present[i] = true;
+    }
+    pthread_mutex_unlock(&g_objects_mutex);
+
+    g_hash_table_destroy(current);
+    g_hash_table_destroy(wanted);
+    g_hash_table_destroy(visible);
+    bson_destroy(opts);
+    bson_destroy(access);
+    bson_destroy(&query);
+    return ok;
+}
+
+// Принимает сжатый чанк (wire_len байт кадра zstd). BLAKE3 сверяется по распакованному
+// содержимому, а на диск кадр ложится как есть: объект хранится сжатым, исходный размер
+// остаётся в манифесте (len) и в записи объекта (size).
+static ResponseStatus receive_packed_chunk(SSL *ssl, const RequestHeader *req, const ChunkRef *chunk,
+                                           const char *hex, uint32_t wire_len) {
+    uint8_t *packed = malloc(wire_len);
+    uint8_t *plain = malloc(chunk->len);
+    ResponseStatus status = RESP_ERROR;
+    upload_stream_t us;
+    bool opened = false;
+
+    if (!packed || !plain) goto out;
+    if (ssl_recv_all(ssl, packed, wire_len) != (int)wire_len) {
+        logger(LOG_ERROR, "Incomplete chunk reception for: %s", req->filename);
+        status = RESP_FAILURE;
+        goto out;
+    }
+
+    uint8_t computed[BLAKE3_HASH_LEN];
+    blake3_hasher hasher;
+    blake3_hasher_init(&hasher);
+    if (chunk_decompress(packed, wire_len, plain, chunk->len) == 0) {
+        blake3_hasher_update(&hasher, plain, chunk->len);
+    }
+    blake3_hasher_finalize(&hasher, computed, BLAKE3_HASH_LEN);
+    if (memcmp(computed, chunk->id, BLAKE3_HASH_LEN) != 0) {
+        logger(LOG_ERROR, "Compressed chunk %s of %s is malformed or fails BLAKE3 check", hex, req->filename);
+        status = RESP_INTEGRITY_ERROR;
+        goto out;
+    }
+
+    if (upload_stream_open(&us, req->filename) != 0) goto out;
+    opened = true;
+    if (upload_stream_write(&us, packed, wire_len) != 0 || upload_stream_finish(&us, computed) != 0 ||
+        object_store(us.tmp_path, hex, chunk->len, wire_len) != 0) {
+        goto out;
+    }
+    upload_stream_close(&us, true);
+    opened = false;
+    logger(LOG_DEBUG, "Chunk %s stored compressed: %u -> %u bytes", hex, chunk->len, wire_len);
+    status = RESP_SUCCESS;
+
+out:
+    if (opened) upload_stream_close(&us, false);
+    if (plain) explicit_bzero(plain, chunk->len);
+    free(plain);
+    free(packed);
+    return status;
+}
+
+// Принимает один чанк в хранилище объектов: шифрование во временный файл, проверка
+// BLAKE3 по манифесту, перенос в objects/. Возвращает статус для клиента.
+static ResponseStatus receive_chunk(SSL *ssl, const RequestHeader *req, const ChunkRef *chunk, const char *hex, uint8_t *buf) {
+    // С согласованным сжатием перед чанком идёт его длина на проводе
+    uint32_t wire_len = chunk->len;
+    if ((req->flags & REQ_FLAG_COMPRESS) && ssl_recv_all(ssl, &wire_len, sizeof(wire_len)) != (int)sizeof(wire_len)) {
+        return RESP_FAILURE;
+    }
+    if (wire_len == 0 || wire_len > chunk->len) {
+        logger(LOG_WARNING, "Chunk %s of %s announced %u bytes on the wire, expected at most %u",
+               hex, req->filename, wire_len, chunk->len);
+        return RESP_FAILURE;
+    }
+    if (wire_len < chunk->len) return receive_packed_chunk(ssl, req, chunk, hex, wire_len);
+
+    upload_stream_t us;
+    if (upload_stream_open(&us, req->filename) != 0) return RESP_ERROR;
+
+    size_t remaining = chunk->len;
+    while (remaining > 0) {
+        size_t to_read = remaining < STREAM_CHUNK_SIZE ? remaining : STREAM_CHUNK_SIZE;
+        if (ssl_recv_all(ssl, buf, to_read) != (int)to_read) {
+            logger(LOG_ERROR, "Incomplete chunk reception for: %s", req->filename);
+            upload_stream_close(&us, false);
+            return RESP_FAILURE;
+        }
+        if (upload_stream_write(&us, buf, to_read) != 0) {
+            upload_stream_close(&us, false);
+            return RESP_ERROR;
+        }
+        remaining -= to_read;
+    }
+
+    uint8_t computed[BLAKE3_HASH_LEN];
+    if (upload_stream_finish(&us, computed) != 0) {
+        upload_stream_close(&us, false);
+        return RESP_ERROR;
+    }
+    if (memcmp(computed, chunk->id, BLAKE3_HASH_LEN) != 0) {
+        logger(LOG_ERROR, "BLAKE3 check failed for chunk %s of %s", hex, req->filename);
+        upload_stream_close(&us, false);
+        return RESP_INTEGRITY_ERROR;
+    }
+    if (object_store(us.tmp_path, hex, chunk->len, chunk->len) != 0) {
+        upload_stream_close(&us, false);
+        return RESP_ERROR;
+    }
+    upload_stream_close(&us, true);
+    return RESP_SUCCESS;
+}
+
+// Параллельная чанковая загрузка (REQ_FLAG_PARALLEL): запрошенные чанки одного манифеста
+// принимаются по нескольким соединениям клиента. Манифест принадлежит основному потоку,
+// вспомогательные находят загрузку по токену и читают манифест только под мьютексом,
+// пока загрузка не закрыта.
+typedef enum {
+    PART_FREE,      // ещё никто не принимает
+    PART_RECEIVING, // принимается одним из соединений
+    PART_DONE       // сохранён, ссылка на объект взята
+} part_state_t;
+
+typedef struct {
+    char token[OBJECT_HEX_LEN];
+    char fingerprint[65];
+    RequestHeader req;                  // заголовок основного запроса (имя для временных файлов)
+    const ChunkRef *chunks;             // манифест основного потока
+    char (*chunk_hex)[OBJECT_HEX_LEN];
+    const uint8_t *need;                // битовая карта запрошенных чанков
+    uint32_t count;
+    uint8_t *state;                     // part_state_t каждого чанка
+    uint32_t pending;                   // запрошенные чанки, ещё не принятые
+    bool failed;
+    bool closed;                        // основной поток больше не ждёт: поздние чанки снимают ссылку сами
+    int refs;                           // под g_parallel_mutex
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} parallel_upload_t;
+
+// Регистрирует загрузку и возвращает её токен для вспомогательных соединений
+static parallel_upload_t *parallel_upload_start(const RequestHeader *req, const char *client_fingerprint,
+                                                const ChunkRef *chunks, char (*chunk_hex)[OBJECT_HEX_LEN],
+                                                const uint8_t *need, uint32_t count, uint8_t token[BLAKE3_HASH_LEN]) {
+    parallel_upload_t *pu = calloc(1, sizeof(parallel_upload_t));
+    if (!pu) return NULL;
+    pu->state = calloc(count, 1);
+    if (!pu->state || RAND_bytes(token, BLAKE3_HASH_LEN) != 1) {
+        free(pu->state);
+        free(pu);
+        return NULL;
+    }
+
+    object_hex(token, pu->token);
+    snprintf(pu->fingerprint, sizeof(pu->fingerprint), "%s", client_fingerprint);
+    pu->req = *req;
+    pu->chunks = chunks;
+    pu->chunk_hex = chunk_hex;
+    pu->need = need;
+    pu->count = count;
+    for (uint32_t i = 0; i < count; i++) {
+        if (need[i / 8] & (1u << (i % 8))) pu->pending++;
+    }
+    pu->refs = 1;
+    pthread_mutex_init(&pu->mutex, NULL);
+    pthread_cond_init(&pu->cond, NULL);
+
+    pthread_mutex_lock(&g_parallel_mutex);
+    g_hash_table_insert(g_parallel_uploads, pu->token, pu);
+    pthread_mutex_unlock(&g_parallel_mutex);
+    return pu;
+}
+
+// Находит загрузку по токену; чужой сертификат её не получит
+static parallel_upload_t *parallel_upload_get(const char *token, const char *client_fingerprint) {
+    pthread_mutex_lock(&g_parallel_mutex);
+    parallel_upload_t *pu = g_hash_table_lookup(g_parallel_uploads, token);
+    if (pu && strcmp(pu->fingerprint, client_fingerprint) == 0) {
+        pu->refs++;
+    } else {
+        pu = NULL;
+    }
+    pthread_mutex_unlock(&g_parallel_mutex);
+    return pu;
+}
+
+static void parallel_upload_unref(parallel_upload_t *pu) {
+    pthread_mutex_lock(&g_parallel_mutex);
+    bool last = --pu->refs == 0;
+    pthread_mutex_unlock(&g_parallel_mutex);
+    if (!last) return;
+
+    pthread_mutex_destroy(&pu->mutex);
+    pthread_cond_destroy(&pu->cond);
+    free(pu->state);
+    free(pu);
+}
+
+// Принимает части по одному соединению до CHUNKED_UPLOAD_PART_END. Каждый чанк
+// проверяется по своему BLAKE3 из манифеста. Ошибка означает, что поток
+// рассинхронизирован, и вся загрузка помечается неудачной.
+static ResponseStatus receive_parts(SSL *ssl, parallel_upload_t *pu, uint8_t *buf) {
+    for (;;) {
+        uint32_t index;
+        if (ssl_recv_all(ssl, &index, sizeof(index)) != (int)sizeof(index)) {
+            pthread_mutex_lock(&pu->mutex);
+            pu->failed = true;
+            pthread_cond_broadcast(&pu->cond);
+            pthread_mutex_unlock(&pu->mutex);
+            return RESP_FAILURE;
+        }
+        if (index == CHUNKED_UPLOAD_PART_END) return RESP_SUCCESS;
+
+        ChunkRef chunk;
+        char hex[OBJECT_HEX_LEN];
+        pthread_mutex_lock(&pu->mutex);
+        bool valid = !pu->closed && !pu->failed && index < pu->count &&
+                     (pu->need[index / 8] & (1u << (index % 8))) && pu->state[index] == PART_FREE;
+        if (valid) {
+            chunk = pu->chunks[index];
+            memcpy(hex, pu->chunk_hex[index], OBJECT_HEX_LEN);
+            pu->state[index] = PART_RECEIVING;
+        } else {
+            pu->failed = true;
+            pthread_cond_broadcast(&pu->cond);
+        }
+        pthread_mutex_unlock(&pu->mutex);
+        if (!valid) {
+            logger(LOG_WARNING, "Rejected part %u of parallel upload %s", index, pu->req.filename);
+            return RESP_PERMISSION_DENIED;
+        }
+
+        ResponseStatus status = receive_chunk(ssl, &pu->req, &chunk, hex, buf);
+
+        bool late = false;
+        pthread_mutex_lock(&pu->mutex);
+        if (status != RESP_SUCCESS) {
+            pu->state[index] = PART_FREE;
+            pu->failed = true;
+        } else if (pu->closed) {
+            late = true;
+        } else {
+            pu->state[index] = PART_DONE;
+            pu->pending--;
+        }
+        pthread_cond_broadcast(&pu->cond);
+        pthread_mutex_unlock(&pu->mutex);
+
+        if (late) object_unref(hex);
+        mongo_pool_release_thread(); // До следующего чанка база не нужна
+        if (status != RESP_SUCCESS) return status;
+    }
+}
+
+// Ждёт чанки остальных соединений. Загрузка прерывается, если PARALLEL_STALL_SEC
+// не принято ни одного чанка (например, вспомогательное соединение так и не пришло).
+static ResponseStatus parallel_upload_wait(parallel_upload_t *pu) {
+    pthread_mutex_lock(&pu->mutex);
+    while (pu->pending > 0 && !pu->failed) {
+        uint32_t before = pu->pending;
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += PARALLEL_STALL_SEC;
+
+        int rc = 0;
+        while (rc == 0 && pu->pending == before && !pu->failed) {
+            rc = pthread_cond_timedwait(&pu->cond, &pu->mutex, &deadline);
+        }
+        if (rc == ETIMEDOUT && pu->pending == before && !pu->failed) {
+            logger(LOG_WARNING, "Parallel upload %s stalled with %u chunks missing", pu->req.filename, pu->pending);
+            pu->failed = true;
+        }
+    }
+    ResponseStatus status = pu->failed ? RESP_FAILURE : RESP_SUCCESS;
+    pthread_mutex_unlock(&pu->mutex);
+    return status;
+}
+
+// Закрывает загрузку для вспомогательных соединений и передаёт ссылки на уже
+// принятые чанки в refs основного потока. После этого манифест можно освобождать.
+static void parallel_upload_close(parallel_upload_t *pu, GPtrArray *refs) {
+    pthread_mutex_lock(&g_parallel_mutex);
+    g_hash_table_remove(g_parallel_uploads, pu->token);
+    pthread_mutex_unlock(&g_parallel_mutex);
+
+    pthread_mutex_lock(&pu->mutex);
+    pu->closed = true;
+    for (uint32_t i = 0; i < pu->count; i++) {
+        if (pu->state[i] == PART_DONE) g_ptr_array_add(refs, pu->chunk_hex[i]);
+    }
+    pthread_mutex_unlock(&pu->mutex);
+
+    parallel_upload_unref(pu);
+}
+
+// Обработка команды UPLOAD_PART: дополнительное соединение параллельной загрузки.
+// Возвращает false, если поток рассинхронизирован и соединение нужно закрыть.
+bool handle_upload_part_request(SSL *ssl, RequestHeader *req, const char *client_fingerprint) {
+    char token[OBJECT_HEX_LEN];
+    object_hex(req->file_hash, token);
+
+    parallel_upload_t *pu = parallel_upload_get(token, client_fingerprint);
+    uint8_t *buf = pu ? malloc(STREAM_CHUNK_SIZE) : NULL;
+    if (!buf) {
+        ResponseHeader resp = { .status = pu ? RESP_ERROR : RESP_FILE_NOT_FOUND };
+        if (pu) parallel_upload_unref(pu);
+        return ssl_send_all(ssl, &resp, sizeof(resp)) == 0;
+    }
+
+    ResponseHeader resp = { .status = RESP_SUCCESS };
+    if (ssl_send_all(ssl, &resp, sizeof(resp)) != 0) {
+        free(buf);
+        parallel_upload_unref(pu);
+        return false;
+    }
+
+    resp.status = receive_parts(ssl, pu, buf);
+    free(buf);
+    parallel_upload_unref(pu);
+
+    ssl_send_all(ssl, &resp, sizeof(resp));
+    return resp.status == RESP_SUCCESS;
+}
+
+// Обработка команды UPLOAD_CHUNKED: клиент режет файл на чанки (FastCDC) и присылает
+// манифест, сервер запрашивает только чанки, которых у него нет, и сохраняет файл как
+// манифест. Чанки — обычные объекты хранилища со своими счётчиками ссылок.
+// Возвращает false, если поток рассинхронизирован и соединение нужно закрыть.
+bool handle_chunked_upload_request(SSL *ssl, RequestHeader *req, const char *client_fingerprint) {
+    if (!upload_header_valid(ssl, req)) return true;
+    partial_sweep();
+
+    // Сжатие чанков принимаем, только если сервер собран с zstd. Флаг остаётся в req,
+    // и по нему receive_chunk (в том числе для частей) ждёт длину на проводе.
+    if (!chunk_compress_available()) req->flags &= (uint8_t)~REQ_FLAG_COMPRESS;
+    ResponseHeader resp = {
+        .status = RESP_SUCCESS,
+        .filesize = (req->flags & REQ_FLAG_COMPRESS) ? CHUNKED_UPLOAD_COMPRESSED : 0
+    };
+    if (ssl_send_all(ssl, &resp, sizeof(resp)) != 0) return false;
+
+    uint32_t count = 0;
+    if (ssl_recv_all(ssl, &count, sizeof(count)) != (int)sizeof(count)) return false;
+    if (count == 0 || count > CHUNKED_UPLOAD_MAX_CHUNKS) {
+        logger(LOG_WARNING, "Invalid chunk count %u for: %s", count, req->filename);
+        return false;
+    }
+
+    ChunkRef *chunks = malloc(count * sizeof(ChunkRef));
+    char (*chunk_hex)[OBJECT_HEX_LEN] = malloc(count * sizeof(*chunk_hex));
+    bool *present = calloc(count, sizeof(bool));
+    uint8_t *need = calloc((count + 7) / 8, 1);
+    uint8_t *buf = malloc(STREAM_CHUNK_SIZE);
+    GPtrArray *refs = g_ptr_array_new();
+    GHashTable *requested = g_hash_table_new(g_str_hash, g_str_equal);
+    parallel_upload_t *parallel = NULL;
+    uint8_t token[BLAKE3_HASH_LEN];
+    char key[OBJECT_HEX_LEN];
+    bool keyed = false;
+    GPtrArray *parked = NULL;
+    bool keep_connection = false;
+    resp.status = RESP_ERROR;
+
+    if (!chunks || !chunk_hex || !present || !need || !buf) {
+        logger(LOG_ERROR, "Memory allocation failed for chunk manifest: %s", req->filename);
+        goto done;
+    }
+    if (ssl_recv_all(ssl, chunks, count * sizeof(ChunkRef)) != (int)(count * sizeof(ChunkRef))) {
+        goto done;
+    }
+    keep_connection = true; // Манифест принят целиком: ошибки дальше можно сообщить статусом
+
+    // Манифест должен в точности покрывать заявленный размер
+    long long total = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (chunks[i].len == 0 || chunks[i].len > FASTCDC_MAX_SIZE) {
+            logger(LOG_WARNING, "Chunk %u of %s has invalid length %u", i, req->filename, chunks[i].len);
+            resp.status = RESP_PERMISSION_DENIED;
+            goto done;
+        }
+        total += chunks[i].len;
+        object_hex(chunks[i].id, chunk_hex[i]);
+    }
+    if (total != req->filesize) {
+        logger(LOG_WARNING, "Chunk manifest of %s covers %lld bytes, expected %lld", req->filename, total, req->filesize);
+        resp.status = RESP_PERMISSION_DENIED;
+        goto done;
+    }
+
+    // Чанки, принятые прерванной попыткой этой же загрузки, повторно не запрашиваются
+    partial_key(client_fingerprint, req, key);
+    keyed = partial_claim(key);
+    if (keyed) parked = partial_chunks_load(key);
+
+    if (!chunks_claim_existing(chunk_hex, chunks, count, client_fingerprint, parked, present, refs)) {
+        goto done;
+    }
+    if (parked) {
+        // Ссылки взяты заново под этот манифест: отложенные больше не нужны
+        logger(LOG_INFO, "Resuming chunked upload %s with %u chunks kept from an interrupted attempt",
+               req->filename, parked->len);
+        partial_chunks_drop(key, parked);
+        g_ptr_array_free(parked, TRUE);
+        parked = NULL;
+    }
+
+    // Запрашиваем каждый отсутствующий чанк один раз, даже если он повторяется в файле
+    long long to_receive = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (present[i] || g_hash_table_contains(requested, chunk_hex[i])) continue;
+        g_hash_table_add(requested, chunk_hex[i]);
+        need[i / 8] |= (uint8_t)(1u << (i % 8));
+        to_receive += chunks[i].len;
+    }
+
+    logger(LOG_INFO, "Chunked upload %s: %u chunks, %u new, %lld of %lld bytes to transfer",
+           req->filename, count, g_hash_table_size(requested), to_receive, total);
+
+    if (req->flags & REQ_FLAG_PARALLEL) {
+        parallel = parallel_upload_start(req, client_fingerprint, chunks, chunk_hex, need, count, token);
+        if (!parallel) goto done;
+    }
+
+    // Пока чанки идут от клиента, клиент пула не держим: он нужен только на время
+    // сохранения каждого чанка, иначе медленные загрузки исчерпают пул
+    mongo_pool_release_thread();
+
+    resp.status = RESP_SUCCESS;
+    resp.filesize = to_receive;
+    if (ssl_send_all(ssl, &resp, sizeof(resp)) != 0 || ssl_send_all(ssl, need, (count + 7) / 8) != 0 ||
+        (parallel && ssl_send_all(ssl, token, sizeof(token)) != 0)) {
+        keep_connection = false;
+        goto done;
+    }
+
+    if (parallel) {
+        // Это соединение — один из потоков; остальные приходят с CMD_UPLOAD_PART
+        resp.status = receive_parts(ssl, parallel, buf);
+        if (resp.status != RESP_SUCCESS) {
+            keep_connection = false;
+            goto done;
+        }
+        // Вспомогательным соединениям тоже нужны клиенты пула: пока ждём их, свой возвращаем
+        mongo_pool_release_thread();
+        resp.status = parallel_upload_wait(parallel);
+        parallel_upload_close(parallel, refs);
+        parallel = NULL;
+        if (resp.status != RESP_SUCCESS) goto done;
+    } else {
+        for (uint32_t i = 0; i < count; i++) {
+            if (!(need[i / 8] & (1u << (i % 8)))) continue;
+            resp.status = receive_chunk(ssl, req, &chunks[i], chunk_hex[i], buf);
+            if (resp.status != RESP_SUCCESS) {
+                // Остаток тела уже в пути: продолжить протокол нельзя
+                keep_connection = false;
+                goto done;
+            }
+            g_ptr_array_add(refs, chunk_hex[i]);
+            mongo_pool_release_thread();
+        }
+    }
+
+    // Повторы новых чанков внутри файла: объект уже сохранён, нужна только ссылка
+    mongoc_collection_t *objects = objects_collection();
+    pthread_mutex_lock(&g_objects_mutex);
+    for (uint32_t i = 0; i < count; i++) {
+        if (present[i] || (need[i / 8] & (1u << (i % 8)))) continue;
+        if (!object_ref_locked(objects, chunk_hex[i], chunks[i].len, -1)) {
+            resp.status = RESP_ERROR;
+            break;
+        }
+        g_ptr_array_add(refs, chunk_hex[i]);
+    }
+    pthread_mutex_unlock(&g_objects_mutex);
+    if (resp.status != RESP_SUCCESS) goto done;
+
+    // Публикуем манифест: прежний файл с этим именем больше не нужен на диске
+    char filepath[PATH_MAX];
+    char file_hex[OBJECT_HEX_LEN];
+    snprintf(filepath, sizeof(filepath), "%s/%s", STORAGE_DIR, req->filename);
+    object_hex(req->file_hash, file_hex);
+
+    retire_file_name(req->filename);
+    if (unlink(filepath) != 0 && errno != ENOENT) {
+        logger(LOG_WARNING, "Failed to remove previous file %s: %s", filepath, strerror(errno));
+    }
+    if (!insert_file_metadata(req, client_fingerprint, file_hex, chunks, chunk_hex, count)) {
+        resp.status = RESP_ERROR;
+        goto done;
+    }
+    g_ptr_array_set_size(refs, 0); // Ссылки теперь принадлежат манифесту
+
+    if (!append_proc_event(filepath, "upload", "success")) {
+        logger(LOG_WARNING, "Failed to log upload event in proc map for: %s", filepath);
+    }
+    logger(LOG_INFO, "Chunked upload completed: %s (size=%lld, %lld bytes transferred)", req->filename, total, to_receive);
+
+done:
+    if (parallel) parallel_upload_close(parallel, refs);
+    // Ссылки остались — загрузка прервана. Чанки (и принятые, и найденные, в том числе
+    // отложенные прошлой попыткой) ждут повтора до истечения PARTIAL_TTL_SEC.
+    if (keyed && !parked && refs->len > 0 && partial_chunks_park(key, refs)) {
+        logger(LOG_INFO, "Partial chunked upload %s kept with %u chunks", req->filename, refs->len);
+        g_ptr_array_set_size(refs, 0);
+    }
+    for (guint i = 0; i < refs->len; i++) {
+        object_unref(g_ptr_array_index(refs, i));
+    }
+    if (parked) g_ptr_array_free(parked, TRUE);
+    if (keyed) partial_release(key);
+    if (keep_connection) {
+        resp.filesize = 0;
+        ssl_send_all(ssl, &resp, sizeof(resp));
+    }
+
+    g_hash_table_destroy(requested);
+    g_ptr_array_free(refs, TRUE);
+    free(buf);
+    free(need);
+    free(present);
+    free(chunk_hex);
+    free(chunks);
+    return keep_connection;
+}
+
+
+// Весь список одним JSON-массивом: ответ клиентам без постраничного LIST
+static void handle_list_json(SSL *ssl, const char *client_fingerprint) {
+    // Показываем:
+    // - файлы, загруженные мной (owner)
+    // - файлы, где я — получатель
+    // - публичные файлы
+    // Прежние версии перезагруженных файлов (deleted) не показываются; новые первыми
+    bson_t *opts = file_queries_list_opts();
+    bson_t *query = file_queries_list_filter(client_fingerprint, NULL);
+
+    mongoc_cursor_t *cursor = mongoc_collection_find_with_opts(files_collection(), query, opts, NULL);
+
+    bson_error_t error;
+    const bson_t *doc;
+    GString *full_list = g_string_new("[");
+
+    while (mongoc_cursor_next(cursor, &doc)) {
+        size_t len;
+        char *json_str = bson_as_canonical_extended_json(doc, &len);
+        if (!json_str) continue;
+
+        if (full_list->len > 1) g_string_append_c(full_list, ',');
+        g_string_append_len(full_list, json_str, (gssize)len);
+        bson_free(json_str);
+    }
+
+    if (mongoc_cursor_error(cursor, &error)) {
+        logger(LOG_ERROR, "Cursor error in list request: %s", error.message);
+    }
+    g_string_append_c(full_list, ']');
+
+    ResponseHeader resp = { .status = RESP_SUCCESS, .filesize = (long long)full_list->len };
+    if (ssl_send_all(ssl, &resp, sizeof(resp)) == 0) {
+        ssl_send_all(ssl, full_list->str, full_list->len);
+    }
+
+    g_string_free(full_list, TRUE);
+    mongoc_cursor_destroy(cursor);
+    bson_destroy(query);
+    bson_destroy(opts);
+}
+
+// Токен продолжения LIST: версия, uploaded_at (8 байт, little-endian) и _id
+// последнего документа страницы, остальное — нули. Клиент его не разбирает.
+#define LIST_TOKEN_VERSION 1
+
+static void list_token_encode(const file_list_position_t *pos, uint8_t token[BLAKE3_HASH_LEN]) {
+    memset(token, 0, BLAKE3_HASH_LEN);
+    token[0] = LIST_TOKEN_VERSION;
+    for (int i = 0; i < 8; i++) token[1 + i] = (uint8_t)((uint64_t)pos->uploaded_at >> (8 * i));
+    memcpy(token + 9, pos->id.bytes, sizeof(pos->id.bytes));
+}
 
-    // Отправляем клиенту подтверждение, что можно начинать передачу
-    ResponseHeader resp = { .status = RESP_SUCCESS };
-    if (ssl_send_all(ssl, &resp, sizeof(resp)) != 0) {
-        logger(LOG_ERROR, "Failed to send upload permission for: %s", req->filename);
-        return;
-    }
+// 1 — позиция прочитана, 0 — первая страница (токен из нулей), -1 — токен неверен
+static int list_token_decode(const uint8_t token[BLAKE3_HASH_LEN], file_list_position_t *pos) {
+    const size_t used = 9 + sizeof(pos->id.bytes);
+    bool zero = true;
+    for (size_t i = 0; i < BLAKE3_HASH_LEN; i++) {
+        if (token[i] != 0) zero = false;
+        if (i >= used && token[i] != 0) return -1;
+    }
+    if (zero) return 0;
+    if (token[0] != LIST_TOKEN_VERSION) return -1;
+
+    uint64_t uploaded_at = 0;
+    for (int i = 0; i < 8; i++) uploaded_at |= (uint64_t)token[1 + i] << (8 * i);
+    pos->uploaded_at = (int64_t)uploaded_at;
+    memcpy(pos->id.bytes, token + 9, sizeof(pos->id.bytes));
+    return 1;
+}
 
-    // Выделяем буфер под весь файл в памяти (ограничение архитектуры; в реальных системах — потоковая обработка)
-    uint8_t *plaintext = malloc(req->filesize);
-    if (!plaintext) {
-        logger(LOG_ERROR, "Memory allocation failed for file of size %zu: %s", req->filesize, req->filename);
-        resp.status = RESP_ERROR;
-        ssl_send_all(ssl, &resp, sizeof(resp));
-        return;
-    }
+// Записи страницы копятся здесь и уходят в SSL блоками, а не по одной
+#define LIST_STREAM_BUFFER (16 * 1024)
 
-    // Приём файла по частям через SSL
-    long long remaining = req->filesize;
-    uint8_t *ptr = plaintext;
+typedef struct {
+    SSL *ssl;
+    size_t len;
+    bool failed;
+    uint8_t data[LIST_STREAM_BUFFER];
+} list_stream_t;
+
+static bool list_stream_flush(list_stream_t *out) {
+    if (!out->failed && out->len > 0 && ssl_send_all(out->ssl, out->data, out->len) != 0) {
+        out->failed = true;
+    }
+    out->len = 0;
+    return !out->failed;
+}
 
-    while (remaining > 0) {
-        size_t to_read = (remaining < BUFFER_SIZE) ? (size_t)remaining : BUFFER_SIZE;
+// Запись всегда меньше буфера: ListEntry, имя и отпечаток не длиннее 255 байт
+static void list_stream_write(list_stream_t *out, const void *data, size_t len) {
+    if (out->len + len > sizeof(out->data) && !list_stream_flush(out)) return;
+    if (out->failed) return;
+    memcpy(out->data + out->len, data, len);
+    out->len += len;
+}
 
-        if (ssl_recv_all(ssl, ptr, to_read) != (ssize_t)to_read) {
-            logger(LOG_ERROR, "Incomplete file reception for: %s", req->filename);
-            free(plaintext);
-            return;
-        }
+// Запись одного документа. Возвращает false, если у документа нет имени
+static bool list_stream_entry(list_stream_t *out, const bson_t *doc, const char *client_fingerprint) {
+    const char *name = NULL, *owner = NULL, *recipient = NULL;
+    uint32_t name_len = 0, owner_len = 0, recipient_len = 0;
+    ListEntry entry = {0};
 
-        ptr += to_read;
-        remaining -= to_read;
+    bson_iter_t iter;
+    if (!bson_iter_init(&iter, doc)) return false;
+    while (bson_iter_next(&iter)) {
+        const char *key = bson_iter_key(&iter);
+        if (strcmp(key, "filename") == 0 && BSON_ITER_HOLDS_UTF8(&iter)) {
+            name = bson_iter_utf8(&iter, &name_len);
+        } else if (strcmp(key, "size") == 0) {
+            entry.size = bson_iter_as_int64(&iter);
+        } else if (strcmp(key, "uploaded_at") == 0 && BSON_ITER_HOLDS_DATE_TIME(&iter)) {
+            entry.uploaded_at = bson_iter_date_time(&iter);
+        } else if (strcmp(key, "public") == 0 && BSON_ITER_HOLDS_BOOL(&iter) && bson_iter_bool(&iter)) {
+            entry.flags |= LIST_ENTRY_PUBLIC;
+        } else if (strcmp(key, "owner_fingerprint") == 0 && BSON_ITER_HOLDS_UTF8(&iter)) {
+            owner = bson_iter_utf8(&iter, &owner_len);
+        } else if (strcmp(key, "recipient_fingerprint") == 0 && BSON_ITER_HOLDS_UTF8(&iter)) {
+            recipient = bson_iter_utf8(&iter, &recipient_len);
+        }
     }
+    if (!name || name_len == 0 || name_len >= FILENAME_MAX_LEN) return false;
 
-    // Проверяем целостность полученного файла через BLAKE3-хеш, присланный клиентом
-    uint8_t computed_hash[BLAKE3_HASH_LEN];
-    compute_buffer_blake3(plaintext, req->filesize, computed_hash);
-
-    if (memcmp(computed_hash, req->file_hash, BLAKE3_HASH_LEN) != 0) {
-        logger(LOG_ERROR, "BLAKE3 integrity check failed for: %s", req->filename);
-        ResponseHeader resp = { .status = RESP_INTEGRITY_ERROR };
-        ssl_send_all(ssl, &resp, sizeof(resp));
-        free(plaintext);
-        return;
+    // У своего файла интересен получатель, у чужого — владелец
+    const char *peer = owner;
+    uint32_t peer_len = owner_len;
+    if (owner && strcmp(owner, client_fingerprint) == 0) {
+        entry.flags |= LIST_ENTRY_OWN;
+        peer = recipient;
+        peer_len = recipient_len;
     }
+    if (!peer || peer_len > UINT8_MAX) peer_len = 0;
 
-    // Подготавливаем буферы для шифрования
-    uint8_t *ciphertext = malloc(req->filesize + 16); // +16 байт — место для тега (но тег отдельно)
-    uint8_t iv[12];                                   // Стандартный размер IV для AES-GCM (96 бит)
-    uint8_t tag[16];                                  // GCM-тег фиксированной длины
+    entry.name_len = (uint16_t)name_len;
+    entry.peer_len = (uint8_t)peer_len;
+    list_stream_write(out, &entry, sizeof(entry));
+    list_stream_write(out, name, name_len);
+    if (peer_len) list_stream_write(out, peer, peer_len);
+    return true;
+}
 
-    // Генерируем криптографически безопасный IV
-    if (RAND_bytes(iv, sizeof(iv)) != 1) {
-        logger(LOG_ERROR, "Failed to generate secure IV using RAND_bytes for: %s", req->filename);
-        free(plaintext);
-        free(ciphertext);
-        resp.status = RESP_ERROR;
+// Постраничный LIST (REQ_FLAG_PAGED): записи уходят клиенту по мере чтения
+// курсора, в памяти не больше одного буфера LIST_STREAM_BUFFER
+static void handle_list_page(SSL *ssl, const RequestHeader *req, const char *client_fingerprint) {
+    file_list_position_t after;
+    int resume = list_token_decode(req->file_hash, &after);
+    if (resume < 0) {
+        logger(LOG_WARNING, "Invalid list token from %s", client_fingerprint);
+        ResponseHeader resp = { .status = RESP_INVALID_OFFSET };
         ssl_send_all(ssl, &resp, sizeof(resp));
         return;
     }
 
-    // Выполняем шифрование с использованием глобального ключа
-    int ct_len = enhanced_aes_gcm_encrypt(plaintext, req->filesize, g_file_crypto.key, iv, ciphertext, tag);
+    long long limit = req->filesize;
+    if (limit <= 0) limit = LIST_PAGE_DEFAULT;
+    if (limit > LIST_PAGE_MAX) limit = LIST_PAGE_MAX;
 
-    // Освобождаем память под открытый текст сразу после шифрования
-    free(plaintext);
+    bson_t *query = file_queries_list_filter(client_fingerprint, resume > 0 ? &after : NULL);
+    bson_t *opts = file_queries_list_opts();
+    // Лишний документ показывает, есть ли следующая страница; вся страница — один ответ базы
+    BSON_APPEND_INT64(opts, "limit", limit + 1);
+    BSON_APPEND_INT32(opts, "batchSize", (int32_t)(limit + 1));
 
-    if (ct_len < 0) {
-        logger(LOG_ERROR, "Encryption pipeline failed for: %s", req->filename);
-        free(ciphertext);
-        resp.status = RESP_ERROR;
-        ssl_send_all(ssl, &resp, sizeof(resp));
+    mongoc_cursor_t *cursor = mongoc_collection_find_with_opts(files_collection(), query, opts, NULL);
+
+    list_stream_t *out = malloc(sizeof(*out));
+    ResponseHeader resp = { .status = out ? RESP_SUCCESS : RESP_ERROR, .filesize = LIST_STREAMED };
+    if (ssl_send_all(ssl, &resp, sizeof(resp)) != 0 || !out) {
+        free(out);
+        mongoc_cursor_destroy(cursor);
+        bson_destroy(query);
+        bson_destroy(opts);
         return;
     }
+    out->ssl = ssl;
+    out->len = 0;
+    out->failed = false;
 
-    // Сохраняем зашифрованный файл на диск
-    FILE *fp = fopen(filepath, "wb");
-    if (!fp) {
-        logger(LOG_ERROR, "fopen() failed for writing encrypted file: %s (errno=%d)", filepath, errno);
-        free(ciphertext);
-        resp.status = RESP_ERROR;
-        ssl_send_all(ssl, &resp, sizeof(resp));
-        unlink(filepath);
-        return;
+    ListEntry end = {0};
+    file_list_position_t last;
+    long long read = 0;
+    const bson_t *doc;
+    while (!out->failed && mongoc_cursor_next(cursor, &doc)) {
+        if (read == limit) {
+            end.flags |= LIST_END_MORE;
+            break;
+        }
+        if (!file_queries_list_position(doc, &last)) continue;
+        read++;
+        if (list_stream_entry(out, doc, client_fingerprint)) end.size++;
     }
 
-    size_t written = fwrite(ciphertext, 1, ct_len, fp);
-    fclose(fp);
-    free(ciphertext);
+    bson_error_t error;
+    if (mongoc_cursor_error(cursor, &error)) {
+        logger(LOG_ERROR, "Cursor error in list request: %s", error.message);
+        end.flags = LIST_END_ERROR;
+    }
 
-    if (written != (size_t)ct_len) {
-        logger(LOG_ERROR, "Short write to disk: expected %d, wrote %zu bytes for %s", ct_len, written, filepath);
-        resp.status = RESP_ERROR;
-        ssl_send_all(ssl, &resp, sizeof(resp));
-        return;
+    list_stream_write(out, &end, sizeof(end));
+    if (end.flags & LIST_END_MORE) {
+        uint8_t token[BLAKE3_HASH_LEN];
+        list_token_encode(&last, token);
+        list_stream_write(out, token, sizeof(token));
+    }
+    if (!list_stream_flush(out)) {
+        logger(LOG_WARNING, "List page to %s was not delivered", client_fingerprint);
     }
 
-    // Сохраняем метаданные в MongoDB
-    bson_t *doc = bson_new();
-    BSON_APPEND_UTF8(doc, "filename", req->filename);
-    BSON_APPEND_INT64(doc, "size", req->filesize);
-    BSON_APPEND_BOOL(doc, "encrypted", true);
-    BSON_APPEND_BINARY(doc, "iv", BSON_SUBTYPE_BINARY, iv, sizeof(iv));
-    BSON_APPEND_BINARY(doc, "tag", BSON_SUBTYPE_BINARY, tag, sizeof(tag));
-    BSON_APPEND_BOOL(doc, "deleted", false);
-    BSON_APPEND_UTF8(doc, "owner_fingerprint", client_fingerprint);
+    free(out);
+    mongoc_cursor_destroy(cursor);
+    bson_destroy(query);
+    bson_destroy(opts);
+}
 
-    // Указываем, публичный файл или предназначенный конкретному получателю
-    if (req->recipient[0] != '\0') {
-        BSON_APPEND_UTF8(doc, "recipient_fingerprint", req->recipient);
-        BSON_APPEND_BOOL(doc, "public", false);
+// Обработка команды LIST
+void handle_list_request(SSL *ssl, const RequestHeader *req, const char *client_fingerprint) {
+    if (req->flags & REQ_FLAG_PAGED) {
+        handle_list_page(ssl, req, client_fingerprint);
     } else {
-        BSON_APPEND_BOOL(doc, "public", true);
+        handle_list_json(ssl, client_fingerprint);
     }
+}
 
-    // Временная метка загрузки (в миллисекундах с эпохи)
-    BSON_APPEND_DATE_TIME(doc, "uploaded_at", bson_get_monotonic_time() / 1000);
 
-    bson_error_t error;
-    bool success = mongoc_collection_insert_one(g_collection, doc, NULL, NULL, &error);
+// Отправляет не больше limit байт расшифрованного текста файла chunked-GCM начиная с offset,
+// добавляя их в hasher, если он задан. Возвращает число отправленных байт; меньше
+// ожидаемого — ошибка тега или обрыв.
+static long long send_records(SSL *ssl, chunked_gcm_reader_t *reader, uint64_t offset, long long limit,
+                              uint8_t *plaintext, const char *path, blake3_hasher *hasher) {
+    long long sent = 0;
+    size_t skip = (size_t)(offset % reader->chunk_size);
+    for (uint64_t idx = offset / reader->chunk_size; idx < reader->chunk_count && sent < limit; idx++) {
+        size_t pt_len = 0;
+        error_status_t rc = chunked_gcm_reader_read(reader, idx, plaintext, &pt_len);
+        if (rc != MR_SUCCESS) {
+            logger(LOG_ERROR, "Record %llu of %s failed to decrypt (status %d)",
+                   (unsigned long long)idx, path, (int)rc);
+            break;
+        }
+        size_t n = pt_len - skip;
+        if ((long long)n > limit - sent) n = (size_t)(limit - sent);
+        if (hasher) blake3_hasher_update(hasher, plaintext + skip, n);
+        if (ssl_send_all(ssl, plaintext + skip, n) != 0) {
+            break;
+        }
+        sent += (long long)n;
+        skip = 0;
+    }
+    return sent;
+}
 
-    if (!success) {
-        logger(LOG_ERROR, "MongoDB metadata insertion failed for %s: [code=%d] %s", req->filename, error.code, error.message);
-        resp.status = RESP_ERROR;
-        unlink(filepath);
-    } else {
-        logger(LOG_INFO, "File upload completed successfully: %s (size=%zu)", req->filename, req->filesize);
-        resp.status = RESP_SUCCESS;
+// Расшифровывает и распаковывает объект, сохранённый сжатым чанком (его chunked-GCM
+// содержит кадр zstd короче len). Такие объекты не длиннее FASTCDC_MAX_SIZE, поэтому
+// распаковываются целиком. Возвращает буфер из len байт (освобождает вызывающий) или NULL.
+static uint8_t *object_inflate(chunked_gcm_reader_t *reader, long long len, const char *path) {
+    if (len > FASTCDC_MAX_SIZE || reader->plaintext_size >= (uint64_t)len) {
+        logger(LOG_ERROR, "Object %s has %llu stored bytes, which does not fit a compressed chunk of %lld",
+               path, (unsigned long long)reader->plaintext_size, len);
+        return NULL;
+    }
 
-        // Записываем событие обработки в историю (для аудита и отслеживания)
-        if (!append_proc_event(filepath, "upload", "success")) {
-            logger(LOG_WARNING, "Failed to log upload event in proc map for: %s", filepath);
+    size_t packed_len = (size_t)reader->plaintext_size;
+    uint8_t *packed = malloc(packed_len + reader->chunk_size);
+    uint8_t *plain = malloc((size_t)len);
+    size_t got = 0;
+    for (uint64_t idx = 0; packed && plain && idx < reader->chunk_count && got <= packed_len; idx++) {
+        size_t pt_len = 0;
+        error_status_t rc = chunked_gcm_reader_read(reader, idx, packed + got, &pt_len);
+        if (rc != MR_SUCCESS) {
+            logger(LOG_ERROR, "Record %llu of %s failed to decrypt (status %d)",
+                   (unsigned long long)idx, path, (int)rc);
+            break;
         }
+        got += pt_len;
     }
 
-    // Отправляем финальный статус клиенту
-    ssl_send_all(ssl, &resp, sizeof(resp));
-
-    // Освобождаем BSON-документ в любом случае
-    bson_destroy(doc);
+    bool ok = packed && plain && got == packed_len && chunk_decompress(packed, packed_len, plain, (size_t)len) == 0;
+    if (packed && plain && !ok && got == packed_len) {
+        logger(LOG_ERROR, "Compressed object %s cannot be decompressed", path);
+    }
+    free(packed);
+    if (!ok) {
+        free(plain);
+        return NULL;
+    }
+    return plain;
 }
 
+// Отправляет limit байт распакованного объекта начиная с offset, добавляя их в hasher,
+// если он задан. Возвращает число отправленных байт.
+static long long send_inflated(SSL *ssl, chunked_gcm_reader_t *reader, long long len, uint64_t offset,
+                               long long limit, const char *path, blake3_hasher *hasher) {
+    uint8_t *plain = object_inflate(reader, len, path);
+    if (!plain) return 0;
 
-// Обработка команды LIST
-void handle_list_request(SSL *ssl, const char *client_fingerprint) {
-    bson_t *opts = BCON_NEW(
-        "projection", "{",
-            "filename", BCON_INT32(1),
-            "size", BCON_INT32(1),
-            "uploaded_at", BCON_INT32(1),
-            "public", BCON_INT32(1),
-            "owner_fingerprint", BCON_INT32(1),
-            "recipient_fingerprint", BCON_INT32(1),
-        "}"
-    );
-
-    // Показываем:
-    // - файлы, загруженные мной (owner)
-    // - файлы, где я — получатель
-    // - публичные файлы
-    bson_t *query = BCON_NEW(
-        "$or", "[",
-            "{", "owner_fingerprint", BCON_UTF8(client_fingerprint), "}",
-            "{", "recipient_fingerprint", BCON_UTF8(client_fingerprint), "}",
-            "{", "public", BCON_BOOL(true), "}",
-        "]"
-    );
-
-    mongoc_cursor_t *cursor = mongoc_collection_find_with_opts(g_collection, query, opts, NULL);
+    long long sent = 0;
+    if (hasher) blake3_hasher_update(hasher, plain + offset, (size_t)limit);
+    if (ssl_send_all(ssl, plain + offset, (size_t)limit) == 0) sent = limit;
 
-    bson_error_t error;
-    const bson_t *doc;
-    char *json_str;
-    size_t total_len = 0;
-    char *full_list = NULL;
+    explicit_bzero(plain, (size_t)len);
+    free(plain);
+    return sent;
+}
 
-    while (mongoc_cursor_next(cursor, &doc)) {
-        json_str = bson_as_canonical_extended_json(doc, NULL);
-        if (!json_str) continue;
+// Сколько байт отдать по запросу: с REQ_FLAG_RANGE — не больше filesize из запроса,
+// иначе до конца файла. -1, если смещение или длина недопустимы.
+static long long download_length(const RequestHeader *req, long long filesize) {
+    if (req->offset < 0 || req->offset >= filesize) return -1;
+    long long left = filesize - req->offset;
+    if (!(req->flags & REQ_FLAG_RANGE)) return left;
+    if (req->filesize < 0) return -1;
+    return req->filesize < left ? req->filesize : left;
+}
 
-        size_t len = strlen(json_str);
+// Завершает диапазон REQ_FLAG_RANGE: BLAKE3 отправленных байт, клиент сверяет его со своим
+static bool send_range_digest(SSL *ssl, const RequestHeader *req, const blake3_hasher *hasher) {
+    if (!(req->flags & REQ_FLAG_RANGE)) return true;
+    uint8_t digest[BLAKE3_HASH_LEN];
+    blake3_hasher_finalize(hasher, digest, BLAKE3_HASH_LEN);
+    return ssl_send_all(ssl, digest, BLAKE3_HASH_LEN) == 0;
+}
 
-        if (total_len == 0) {
-            full_list = malloc(len + 3);
-            if (!full_list) {
-                bson_free(json_str);
-                continue;
-            }
-            strcpy(full_list, "[");
-            total_len = 1;
-        } else {
-            char *new_list = realloc(full_list, total_len + len + 2);
-            if (!new_list) {
-                bson_free(json_str);
-                continue;
-            }
-            full_list = new_list;
-            full_list[total_len++] = ',';
+// Отправка файла, сохранённого манифестом чанков: объекты чанков читаются по порядку,
+// начиная с того, в который попадает offset. Возвращает true, если файл отправлен целиком.
+static bool send_manifest_file(SSL *ssl, const RequestHeader *req, const bson_iter_t *chunks_iter) {
+    bson_iter_t chunk, field;
+
+    // Первый проход: размер файла по манифесту
+    long long filesize = 0;
+    bson_iter_recurse(chunks_iter, &chunk);
+    while (bson_iter_next(&chunk)) {
+        if (BSON_ITER_HOLDS_DOCUMENT(&chunk) && bson_iter_recurse(&chunk, &field) && bson_iter_find(&field, "len")) {
+            filesize += bson_iter_as_int64(&field);
         }
-
-        memcpy(full_list + total_len, json_str, len);
-        total_len += len;
-        bson_free(json_str);
     }
-
-    if (mongoc_cursor_error(cursor, &error)) {
-        logger(LOG_ERROR, "Cursor error in list request: %s", error.message);
+    long long bytes_to_send = download_length(req, filesize);
+    if (bytes_to_send < 0) {
+        ResponseHeader resp = { .status = RESP_INVALID_OFFSET };
+        ssl_send_all(ssl, &resp, sizeof(resp));
+        return false;
     }
 
-    if (total_len > 0) {
-        full_list[total_len++] = ']';
-        full_list[total_len] = '\0';
-    } else {
-        full_list = strdup("[]");
-        total_len = strlen(full_list);
+    uint8_t *plaintext = malloc(CHUNKED_GCM_CHUNK_SIZE);
+    if (!plaintext) {
+        ResponseHeader resp = { .status = RESP_ERROR };
+        ssl_send_all(ssl, &resp, sizeof(resp));
+        return false;
     }
 
-    ResponseHeader resp = { .status = RESP_SUCCESS, .filesize = total_len };
+    ResponseHeader resp = { .status = RESP_SUCCESS, .filesize = filesize };
     ssl_send_all(ssl, &resp, sizeof(resp));
 
-    if (full_list) {
-        ssl_send_all(ssl, full_list, total_len);
-        free(full_list);
+    // BLAKE3 диапазона считается, только если клиент его ждёт
+    blake3_hasher hasher;
+    blake3_hasher_init(&hasher);
+    blake3_hasher *range_hasher = (req->flags & REQ_FLAG_RANGE) ? &hasher : NULL;
+    long long bytes_sent = 0;
+    long long pos = 0; // Смещение начала текущего чанка в файле
+    bson_iter_recurse(chunks_iter, &chunk);
+    while (bson_iter_next(&chunk) && bytes_sent < bytes_to_send) {
+        const char *hex = NULL;
+        long long len = 0;
+        if (BSON_ITER_HOLDS_DOCUMENT(&chunk) && bson_iter_recurse(&chunk, &field) && bson_iter_find(&field, "id")) {
+            hex = bson_iter_utf8(&field, NULL);
+        }
+        if (BSON_ITER_HOLDS_DOCUMENT(&chunk) && bson_iter_recurse(&chunk, &field) && bson_iter_find(&field, "len")) {
+            len = bson_iter_as_int64(&field);
+        }
+        if (pos + len <= req->offset) {
+            pos += len;
+            continue;
+        }
+        if (!hex) break;
+
+        char objpath[PATH_MAX];
+        object_path(hex, objpath, sizeof(objpath));
+        int fd = open(objpath, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            logger(LOG_ERROR, "Chunk object %s is missing: %s", objpath, strerror(errno));
+            break;
+        }
+        // Объект короче чанка — сжатый кадр (см. receive_packed_chunk)
+        chunked_gcm_reader_t reader;
+        error_status_t rc = chunked_gcm_reader_open(&reader, fd, g_file_crypto.key);
+        if (rc != MR_SUCCESS || reader.chunk_size > CHUNKED_GCM_CHUNK_SIZE || (long long)reader.plaintext_size > len) {
+            logger(LOG_ERROR, "Cannot open chunk object %s (status %d)", objpath, (int)rc);
+            if (rc == MR_SUCCESS) chunked_gcm_reader_cleanup(&reader);
+            close(fd);
+            break;
+        }
+
+        uint64_t skip = req->offset > pos ? (uint64_t)(req->offset - pos) : 0;
+        long long want = len - (long long)skip;
+        if (want > bytes_to_send - bytes_sent) want = bytes_to_send - bytes_sent;
+        long long sent = (long long)reader.plaintext_size == len
+                         ? send_records(ssl, &reader, skip, want, plaintext, objpath, range_hasher)
+                         : send_inflated(ssl, &reader, len, skip, want, objpath, range_hasher);
+        chunked_gcm_reader_cleanup(&reader);
+        close(fd);
+
+        bytes_sent += sent;
+        if (sent != want) break;
+        pos += len;
     }
 
-    mongoc_cursor_destroy(cursor);
-    bson_destroy(query);
-    bson_destroy(opts);
+    explicit_bzero(plaintext, CHUNKED_GCM_CHUNK_SIZE);
+    free(plaintext);
 
-    logger(LOG_INFO, "Sent file list to client");
+    if (bytes_sent != bytes_to_send) {
+        logger(LOG_ERROR, "Download of '%s' aborted after %lld of %lld bytes", req->filename, bytes_sent, bytes_to_send);
+        return false;
+    }
+    return send_range_digest(ssl, req, &hasher);
 }
 
 // Обработка команды DOWNLOAD
@@ -952,15 +2349,21 @@ void handle_download_request(SSL *ssl, RequestHeader *req, const char *client_fi
     char filepath[PATH_MAX];
     snprintf(filepath, sizeof(filepath), "%s/%s", STORAGE_DIR, req->filename);
 
-    bson_t *query = BCON_NEW("_id", BCON_UTF8(filepath), "deleted", BCON_BOOL(false));
-    mongoc_cursor_t *cursor = mongoc_collection_find_with_opts(g_collection, query, NULL, NULL);
-    const bson_t *doc;
-    bool found = mongoc_cursor_next(cursor, &doc);
+    // Текущая запись имени (прежние помечаются deleted при повторной загрузке)
+    bson_t *query = BCON_NEW("filename", BCON_UTF8(req->filename), "deleted", BCON_BOOL(false));
+    mongoc_cursor_t *cursor = mongoc_collection_find_with_opts(files_collection(), query, NULL, NULL);
+    const bson_t *found;
+    bson_t *doc = mongoc_cursor_next(cursor, &found) ? bson_copy(found) : NULL;
 
-    if (!found) {
+    // Передача может идти долго: запись скопирована, курсор и клиент пула больше не нужны
+    mongoc_cursor_destroy(cursor);
+    bson_destroy(query);
+    mongo_pool_release_thread();
+
+    if (!doc) {
         ResponseHeader resp = { .status = RESP_FILE_NOT_FOUND };
         ssl_send_all(ssl, &resp, sizeof(resp));
-        goto cleanup;
+        return;
     }
 
     // Проверка прав доступа
@@ -986,88 +2389,83 @@ void handle_download_request(SSL *ssl, RequestHeader *req, const char *client_fi
         goto cleanup;
     }
 
-    // Проверяем существование файла на диске
-    struct stat st;
-    if (stat(filepath, &st) != 0) {
-        ResponseHeader resp = { .status = RESP_FILE_NOT_FOUND };
-        ssl_send_all(ssl, &resp, sizeof(resp));
-        goto cleanup;
-    }
-
-    long long filesize = st.st_size;
-    if (req->offset < 0 || req->offset >= filesize) {
-        ResponseHeader resp = { .status = RESP_INVALID_OFFSET };
-        ssl_send_all(ssl, &resp, sizeof(resp));
-        goto cleanup;
-    }
-
-    FILE *fp = fopen(filepath, "rb");
-    if (!fp) {
-        ResponseHeader resp = { .status = RESP_ERROR };
-        ssl_send_all(ssl, &resp, sizeof(resp));
+    // Файл из чанков: содержимое лежит в объектах чанков, а не под именем файла
+    if (bson_iter_init_find(&iter, doc, "chunks") && BSON_ITER_HOLDS_ARRAY(&iter)) {
+        if (send_manifest_file(ssl, req, &iter)) {
+            if (!append_proc_event(filepath, "download", "success")) {
+                logger(LOG_WARNING, "Failed to add proc event for download: %s", filepath);
+            }
+            logger(LOG_INFO, "Sent chunked file '%s' to client (offset %lld)", req->filename, req->offset);
+        }
         goto cleanup;
     }
 
-    uint8_t *ciphertext = malloc(filesize);
-    if (!ciphertext) {
-        fclose(fp);
-        ResponseHeader resp = { .status = RESP_ERROR };
+    // Файл хранится записями chunked-GCM: расшифровываем только то, что отправляем
+    int fd = open(filepath, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        ResponseHeader resp = { .status = RESP_FILE_NOT_FOUND };
         ssl_send_all(ssl, &resp, sizeof(resp));
         goto cleanup;
     }
 
-    if (fread(ciphertext, 1, filesize, fp) != (size_t)filesize) {
-        fclose(fp);
-        free(ciphertext);
+    chunked_gcm_reader_t reader;
+    error_status_t rc = chunked_gcm_reader_open(&reader, fd, g_file_crypto.key);
+    if (rc != MR_SUCCESS) {
+        logger(LOG_ERROR, "Cannot open stored file %s (status %d)", filepath, (int)rc);
+        close(fd);
         ResponseHeader resp = { .status = RESP_ERROR };
         ssl_send_all(ssl, &resp, sizeof(resp));
         goto cleanup;
     }
-    fclose(fp);
 
-    // Получаем IV и тег
-    const uint8_t *iv = NULL;
-    const uint8_t *tag = NULL;
-    uint32_t iv_len = 0, tag_len = 0;
-    if (bson_iter_init_find(&iter, doc, "iv") && BSON_ITER_HOLDS_BINARY(&iter)) {
-        bson_iter_binary(&iter, NULL, &iv_len, &iv);
+    // Имя может указывать на объект, который раньше сохранили сжатым чанком с тем же
+    // содержимым: тогда на диске меньше байт, чем size в метаданных
+    long long filesize = (long long)reader.plaintext_size;
+    if (bson_iter_init_find(&iter, doc, "size") && BSON_ITER_HOLDS_INT64(&iter) && bson_iter_int64(&iter) > filesize) {
+        filesize = bson_iter_int64(&iter);
     }
-    if (bson_iter_init_find(&iter, doc, "tag") && BSON_ITER_HOLDS_BINARY(&iter)) {
-        bson_iter_binary(&iter, NULL, &tag_len, &tag);
-    }
-    if (!iv || !tag || iv_len != 12 || tag_len != 16) {
-        free(ciphertext);
-        ResponseHeader resp = { .status = RESP_ERROR };
+    long long bytes_to_send = download_length(req, filesize);
+    if (bytes_to_send < 0) {
+        chunked_gcm_reader_cleanup(&reader);
+        close(fd);
+        ResponseHeader resp = { .status = RESP_INVALID_OFFSET };
         ssl_send_all(ssl, &resp, sizeof(resp));
         goto cleanup;
     }
 
-    // Расшифровка
-    uint8_t *plaintext = malloc(filesize);
+    uint8_t *plaintext = malloc(reader.chunk_size);
     if (!plaintext) {
-        free(ciphertext);
+        chunked_gcm_reader_cleanup(&reader);
+        close(fd);
         ResponseHeader resp = { .status = RESP_ERROR };
         ssl_send_all(ssl, &resp, sizeof(resp));
         goto cleanup;
     }
 
-    int pt_len = enhanced_aes_gcm_decrypt(ciphertext, filesize, g_file_crypto.key, iv, tag, plaintext);
-    free(ciphertext);
-    if (pt_len < 0) {
-        free(plaintext);
-        ResponseHeader resp = { .status = RESP_ERROR };
-        ssl_send_all(ssl, &resp, sizeof(resp));
+    // Отправка: заголовок с полным размером, затем данные с первой записи, содержащей offset.
+    // Ошибка тега посреди передачи обрывает соединение — клиент увидит неполный файл.
+    ResponseHeader resp = { .status = RESP_SUCCESS, .filesize = filesize };
+    ssl_send_all(ssl, &resp, sizeof(resp));
+
+    blake3_hasher hasher;
+    blake3_hasher_init(&hasher);
+    blake3_hasher *range_hasher = (req->flags & REQ_FLAG_RANGE) ? &hasher : NULL;
+    long long bytes_sent = (long long)reader.plaintext_size == filesize
+                           ? send_records(ssl, &reader, (uint64_t)req->offset, bytes_to_send, plaintext, filepath, range_hasher)
+                           : send_inflated(ssl, &reader, filesize, (uint64_t)req->offset, bytes_to_send, filepath, range_hasher);
+
+    explicit_bzero(plaintext, reader.chunk_size);
+    free(plaintext);
+    chunked_gcm_reader_cleanup(&reader);
+    close(fd);
+
+    if (bytes_sent != bytes_to_send) {
+        logger(LOG_ERROR, "Download of '%s' aborted after %lld of %lld bytes", req->filename, bytes_sent, bytes_to_send);
         goto cleanup;
     }
-
-    // Отправка
-    ResponseHeader resp = { .status = RESP_SUCCESS, .filesize = pt_len };
-    ssl_send_all(ssl, &resp, sizeof(resp));
-    long long bytes_to_send = pt_len - req->offset;
-    if (bytes_to_send > 0) {
-        ssl_send_all(ssl, plaintext + req->offset, bytes_to_send);
+    if (!send_range_digest(ssl, req, &hasher)) {
+        goto cleanup;
     }
-    free(plaintext);
 
     // Логируем событие
     if (!append_proc_event(filepath, "download", "success")) {
@@ -1077,9 +2475,63 @@ void handle_download_request(SSL *ssl, RequestHeader *req, const char *client_fi
     logger(LOG_INFO, "Sent %lld bytes of '%s' to client (offset %lld)", bytes_to_send, req->filename, req->offset);
 
 cleanup:
-    if (cursor) mongoc_cursor_destroy(cursor);
-    if (query) bson_destroy(query);
+    bson_destroy(doc);
+}
+static void range_parent_key(const char *fingerprint, const char *filename, char *out, size_t out_len) {
+    snprintf(out, out_len, "%s/%.*s", fingerprint, FILENAME_MAX_LEN, filename);
+}
+
+// Отмечает, что подтверждённое соединение скачивает файл по диапазонам. Соединение
+// держит не больше одной отметки: parent — её ключ, пустой, если отметки нет.
+static void range_parent_set(char *parent, size_t parent_len, const char *fingerprint, const char *filename) {
+    char key[RANGE_PARENT_KEY_LEN];
+    range_parent_key(fingerprint, filename, key, sizeof(key));
+    if (strcmp(key, parent) == 0) return;
+
+    pthread_mutex_lock(&pending_clients_mutex);
+    if (parent[0] != '\0') {
+        int count = GPOINTER_TO_INT(g_hash_table_lookup(g_range_parents, parent));
+        if (count <= 1) {
+            g_hash_table_remove(g_range_parents, parent);
+        } else {
+            g_hash_table_insert(g_range_parents, g_strdup(parent), GINT_TO_POINTER(count - 1));
+        }
+    }
+    if (key[0] != '\0' && filename[0] != '\0') {
+        int count = GPOINTER_TO_INT(g_hash_table_lookup(g_range_parents, key));
+        g_hash_table_insert(g_range_parents, g_strdup(key), GINT_TO_POINTER(count + 1));
+        snprintf(parent, parent_len, "%s", key);
+    } else {
+        parent[0] = '\0';
+    }
+    pthread_mutex_unlock(&pending_clients_mutex);
 }
+
+// Дополнительный поток (--streams) приходит без CMD_CONNECT, и ему разрешена ровно одна
+// команда, продолжающая передачу уже подтверждённого соединения того же сертификата:
+// CMD_UPLOAD_PART с токеном открытой параллельной загрузки или диапазон файла, который
+// такое соединение сейчас скачивает по диапазонам. Прочее по-прежнему ждёт администратора.
+static bool additional_stream_allowed(const RequestHeader *req, const char *fingerprint) {
+    if (fingerprint[0] == '\0') return false;
+
+    if (req->command == CMD_UPLOAD_PART) {
+        char token[OBJECT_HEX_LEN];
+        object_hex(req->file_hash, token);
+        parallel_upload_t *pu = parallel_upload_get(token, fingerprint);
+        if (pu) parallel_upload_unref(pu);
+        return pu != NULL;
+    }
+    if (req->command == CMD_DOWNLOAD && (req->flags & REQ_FLAG_RANGE)) {
+        char key[RANGE_PARENT_KEY_LEN];
+        range_parent_key(fingerprint, req->filename, key, sizeof(key));
+        pthread_mutex_lock(&pending_clients_mutex);
+        bool open = g_hash_table_contains(g_range_parents, key);
+        pthread_mutex_unlock(&pending_clients_mutex);
+        return open;
+    }
+    return false;
+}
+
 // Обработка клиентского соединения
 void *handle_client(void *arg) {
     client_info_t *info = (client_info_t *)arg;
@@ -1089,6 +2541,7 @@ void *handle_client(void *arg) {
     char client_fingerprint[65] = {0};
     pthread_mutex_t state_mutex = PTHREAD_MUTEX_INITIALIZER;
     pthread_cond_t state_cond = PTHREAD_COND_INITIALIZER;
+    char range_parent[RANGE_PARENT_KEY_LEN] = {0}; // отметка в g_range_parents
 
     // SSL Setup
     ssl = SSL_new(g_ssl_ctx);
@@ -1107,6 +2560,9 @@ void *handle_client(void *arg) {
         free(info);
         return NULL;
     }
+    if (tls_session_count(ssl)) {
+        logger(LOG_DEBUG, "TLS session resumed");
+    }
 
     X509 *client_cert = SSL_get_peer_certificate(ssl);
     if (!client_cert) {
@@ -1130,7 +2586,15 @@ void *handle_client(void *arg) {
 
         switch (state) {
             case CLIENT_STATE_WAITING_CONNECT:
-                if (req.command == CMD_CONNECT) {
+                if (additional_stream_allowed(&req, client_fingerprint)) {
+                    logger(LOG_INFO, "Client %s opened an additional stream (command %d).", client_fingerprint, req.command);
+                    if (req.command == CMD_UPLOAD_PART) {
+                        handle_upload_part_request(ssl, &req, client_fingerprint);
+                    } else {
+                        handle_download_request(ssl, &req, client_fingerprint);
+                    }
+                    state = CLIENT_STATE_ERROR; // Одна команда: соединение закрывается
+                } else if (req.command == CMD_CONNECT) {
                     logger(LOG_INFO, "Client %s requested connection handshake.", client_fingerprint);
                     state = CLIENT_STATE_WAITING_APPROVAL;
 
@@ -1201,12 +2665,29 @@ void *handle_client(void *arg) {
                         logger(LOG_INFO, "Upload request for: %s (size: %lld)", req.filename, req.filesize);
                         handle_upload_request(ssl, &req, client_fingerprint);
                         break;
+                    case CMD_UPLOAD_STATUS:
+                        handle_upload_status_request(ssl, &req, client_fingerprint);
+                        break;
+                    case CMD_UPLOAD_CHUNKED:
+                        logger(LOG_INFO, "Chunked upload request for: %s (size: %lld)", req.filename, req.filesize);
+                        if (!handle_chunked_upload_request(ssl, &req, client_fingerprint)) {
+                            state = CLIENT_STATE_ERROR;
+                        }
+                        break;
+                    case CMD_UPLOAD_PART:
+                        if (!handle_upload_part_request(ssl, &req, client_fingerprint)) {
+                            state = CLIENT_STATE_ERROR;
+                        }
+                        break;
                     case CMD_LIST:
                         logger(LOG_INFO, "List request from %s", client_fingerprint);
-                        handle_list_request(ssl, client_fingerprint);
+                        handle_list_request(ssl, &req, client_fingerprint);
                         break;
                     case CMD_DOWNLOAD:
                         logger(LOG_INFO, "Download request for: %s (offset: %lld) from %s", req.filename, req.offset, client_fingerprint);
+                        if (req.flags & REQ_FLAG_RANGE) {
+                            range_parent_set(range_parent, sizeof(range_parent), client_fingerprint, req.filename);
+                        }
                         handle_download_request(ssl, &req, client_fingerprint);
                         break;
                     default:
@@ -1221,6 +2702,13 @@ void *handle_client(void *arg) {
                 state = CLIENT_STATE_ERROR;
                 break;
         }
+
+        // Пока соединение ждёт следующую команду, клиент MongoDB возвращается в пул:
+        // иначе каждое открытое соединение держало бы своего и пул бы кончился.
+        // Если следующая команда уже пришла, клиент и кеш коллекций остаются.
+        if (SSL_pending(ssl) == 0) {
+            mongo_pool_release_thread();
+        }
     }
 
     // Удаление из списка ожидания при выходе, если всё ещё там 
@@ -1229,6 +2717,7 @@ void *handle_client(void *arg) {
         logger(LOG_DEBUG, "Client %s removed from pending list on exit.", client_fingerprint);
     }
     pthread_mutex_unlock(&pending_clients_mutex);
+    range_parent_set(range_parent, sizeof(range_parent), client_fingerprint, "");
 
     // Завершение соединения 
     SSL_shutdown(ssl);
@@ -1320,41 +2809,87 @@ static bool init_ssl(void) {
     
     SSL_CTX_set_verify(g_ssl_ctx, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, NULL);
     SSL_CTX_set_verify_depth(g_ssl_ctx, 1);
+
+    // Возобновление сессий: тикеты с ротацией ключей и общий кеш для всех потоков клиентов,
+    // чтобы переподключения и дополнительные потоки (--streams) не повторяли полный mTLS
+    if (tls_session_server_init(g_ssl_ctx, "exchange-server") != 0) {
+        logger(LOG_ERROR, "Failed to generate TLS session ticket key");
+        return false;
+    }
     
     logger(LOG_INFO, "SSL initialization completed successfully");
     return true;
 }
 
+// Сообщения фоновой записи событий
+static void log_event_writer(const char *message) {
+    logger(LOG_WARNING, "Event writer: %s", message);
+}
+
+// Создаёт индексы коллекции файлов и проверяет, что горячие запросы их используют.
+// Планы только выбираются (queryPlanner), запросы не выполняются: это дёшево и на
+// большой коллекции. Задержки по мере роста коллекции меряет src/db/query_bench.
+static void check_file_indexes(void) {
+    mongoc_collection_t *files = files_collection();
+    bson_error_t error;
+    if (!file_queries_ensure_indexes(files, &error)) {
+        logger(LOG_WARNING, "Failed to create file indexes: [code=%d] %s", error.code, error.message);
+    }
+
+    // Значения не важны: план зависит от формы запроса
+    const char *sample = "0000000000000000000000000000000000000000000000000000000000000000";
+    struct {
+        const char *name;
+        bson_t *filter;
+        bson_t *opts;
+    } queries[] = {
+        { "LIST", file_queries_list_filter(sample, NULL), file_queries_list_opts() },
+        { "filename lookup", BCON_NEW("filename", BCON_UTF8("sample"), "deleted", BCON_BOOL(false)), NULL },
+        { "content lookup", BCON_NEW("blake3", BCON_UTF8(sample), "size", BCON_INT64(0), "deleted", BCON_BOOL(false)), NULL },
+    };
+
+    for (size_t i = 0; i < sizeof(queries) / sizeof(queries[0]); i++) {
+        file_query_plan_t plan;
+        if (!file_queries_explain(files, queries[i].filter, queries[i].opts, false, &plan, &error)) {
+            logger(LOG_WARNING, "Explain of %s query failed: %s", queries[i].name, error.message);
+        } else if (plan.collscan) {
+            logger(LOG_WARNING, "%s query scans the whole collection: %s", queries[i].name, plan.plan);
+        } else {
+            logger(LOG_INFO, "%s query plan: %s", queries[i].name, plan.plan);
+        }
+        bson_destroy(queries[i].filter);
+        if (queries[i].opts) bson_destroy(queries[i].opts);
+    }
+
+    // Главный поток дальше только принимает соединения
+    mongo_pool_release_thread();
+}
+
 // Инициализация MongoDB
 static bool init_mongodb(void) {
     mongoc_init();
     
-    g_mongo_client = mongoc_client_new(MONGODB_URI);
-    if (!g_mongo_client) {
-        logger(LOG_ERROR, "Failed to connect to MongoDB");
-        return false;
-    }
-    
-    // Проверка подключения
+    // Пул клиентов: у каждого потока свой клиент (mongoc_client_t не потокобезопасен)
     bson_error_t error;
-    bool ping_success = mongoc_client_command_simple(
-        g_mongo_client, "admin", BCON_NEW("ping", BCON_INT32(1)), NULL, NULL, &error);
-    
-    if (!ping_success) {
-        logger(LOG_ERROR, "MongoDB ping failed: %s", error.message);
-        mongoc_client_destroy(g_mongo_client);
-        g_mongo_client = NULL;
+    if (!mongo_pool_init(MONGODB_URI, "file-server", &error)) {
+        logger(LOG_ERROR, "Failed to connect to MongoDB: %s", error.message);
         return false;
     }
     
-    g_collection = mongoc_client_get_collection(g_mongo_client, DATABASE_NAME, COLLECTION_NAME);
-    if (!g_collection) {
-        logger(LOG_ERROR, "Failed to get collection");
-        mongoc_client_destroy(g_mongo_client);
-        g_mongo_client = NULL;
-        return false;
+    event_writer_config_t events = {
+        .uri = MONGODB_URI,
+        .database = DATABASE_NAME,
+        .collection = COLLECTION_NAME,
+        .spill_path = EVENTS_SPILL_FILE,
+        .on_log = log_event_writer,
+    };
+    g_event_writer = event_writer_start(&events);
+    if (!g_event_writer) {
+        logger(LOG_WARNING, "Event writer not started, proc events are written synchronously");
     }
-    
+
+    check_file_indexes();
+
     logger(LOG_INFO, "MongoDB initialization completed successfully");
     return true;
 }
@@ -1365,7 +2900,18 @@ static bool init_cryptography(void) {
         logger(LOG_ERROR, "Failed to generate encryption key");
         return false;
     }
-    
+
+    // Идентификатор ключа для записей объектов: по нему видно, какие объекты им расшифровать
+    uint8_t digest[BLAKE3_HASH_LEN];
+    blake3_hasher hasher;
+    blake3_hasher_init(&hasher);
+    blake3_hasher_update(&hasher, g_file_crypto.key, sizeof(g_file_crypto.key));
+    blake3_hasher_finalize(&hasher, digest, sizeof(digest));
+    for (int i = 0; i < 8; i++) {
+        sprintf(&g_file_crypto.key_id[i * 2], "%02x", digest[i]);
+    }
+    explicit_bzero(&hasher, sizeof(hasher));
+
     g_file_crypto.initialized = 1;
     logger(LOG_INFO, "Cryptography initialization completed successfully");
     return true;
@@ -1390,6 +2936,16 @@ static bool create_storage_dir(void) {
         return false;
     }
     
+    if (mkdir(OBJECTS_DIR, 0755) != 0 && errno != EEXIST) {
+        logger(LOG_ERROR, "Failed to create object directory: %s", strerror(errno));
+        return false;
+    }
+
+    if (mkdir(PARTIAL_DIR, 0700) != 0 && errno != EEXIST) {
+        logger(LOG_ERROR, "Failed to create partial upload directory: %s", strerror(errno));
+        return false;
+    }
+
     logger(LOG_INFO, "Storage directory ready: %s", STORAGE_DIR);
     return true;
 }
@@ -1403,16 +2959,17 @@ static void cleanup_resources(void) {
         g_ssl_ctx = NULL;
     }
     
-    if (g_collection) {
-        mongoc_collection_destroy(g_collection);
-        g_collection = NULL;
-    }
-    
-    if (g_mongo_client) {
-        mongoc_client_destroy(g_mongo_client);
-        g_mongo_client = NULL;
+    // Записываем оставшиеся события до закрытия MongoDB
+    if (g_event_writer) {
+        event_writer_stats_t ev;
+        event_writer_stop(g_event_writer, &ev);
+        g_event_writer = NULL;
+        logger(LOG_INFO, "Proc events: %llu queued, %llu written, %llu spilled, %llu replayed, %llu failed",
+               (unsigned long long)ev.queued, (unsigned long long)ev.written, (unsigned long long)ev.spilled,
+               (unsigned long long)ev.replayed, (unsigned long long)ev.failed);
     }
-    
+
+    mongo_pool_shutdown();
     mongoc_cleanup();
     
     if (g_file_crypto.initialized) {
@@ -1566,8 +3123,32 @@ int check_client_static() {
     
     printf("Server Status:");
     printf("  Global shutdown flag: %s", g_shutdown ? "SET" : "NOT SET");
-    printf("  MongoDB connection: %s", g_mongo_client ? "ACTIVE" : "INACTIVE");
+    printf("  MongoDB connection: %s", mongo_pool_ready() ? "ACTIVE" : "INACTIVE");
     printf("  Crypto context: %s", g_file_crypto.initialized ? "INITIALIZED" : "NOT INITIALIZED");
+
+    tls_session_stats_t tls;
+    tls_session_get_stats(&tls);
+    printf("  TLS handshakes: %llu, resumed: %llu (%.1f%%)", (unsigned long long)tls.handshakes,
+           (unsigned long long)tls.resumed,
+           tls.handshakes ? 100.0 * (double)tls.resumed / (double)tls.handshakes : 0.0);
+
+    mongo_pool_stats_t pool;
+    mongo_pool_get_stats(&pool);
+    printf("  MongoDB clients taken from pool: %llu, collection handles reused: %llu, created: %llu",
+           (unsigned long long)pool.acquired, (unsigned long long)pool.collection_hits,
+           (unsigned long long)pool.collection_misses);
+
+    if (g_event_writer) {
+        event_writer_stats_t ev;
+        event_writer_get_stats(g_event_writer, &ev);
+        printf("  Proc events: queue %llu (max %llu), written %llu, spilled %llu%s, failed %llu, "
+               "flush avg %.1f ms, max %.1f ms",
+               (unsigned long long)ev.depth, (unsigned long long)ev.depth_max,
+               (unsigned long long)(ev.written + ev.replayed), (unsigned long long)ev.spilled,
+               ev.spill_pending ? " (MongoDB unavailable)" : "", (unsigned long long)ev.failed,
+               ev.flushes ? (double)ev.flush_us_total / (double)ev.flushes / 1000.0 : 0.0,
+               (double)ev.flush_us_max / 1000.0);
+    }
     return 0;
 }
 
@@ -1796,7 +3377,10 @@ int main(int argc, char* argv[]) {
 
     // --- Инициализация хеш-таблицы ожидающих клиентов ---
     pending_clients = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
-    if (!pending_clients) {
+    g_range_parents = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    g_parallel_uploads = g_hash_table_new(g_str_hash, g_str_equal);
+    g_active_partials = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    if (!pending_clients || !g_range_parents || !g_parallel_uploads || !g_active_partials) {
         logger(LOG_ERROR, "Failed to create pending clients hash table.");
         cleanup_resources();
         return EXIT_FAILURE;
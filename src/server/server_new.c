@@ -11,6 +11,7 @@
 #include <event2/bufferevent_ssl.h>
 #include <event2/listener.h>
 #include <event2/buffer.h>
+#include <event2/thread.h>
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include <glib.h>
@@ -25,15 +26,26 @@
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <pthread.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 
 #define BLAKE3_IMPLEMENTATION
 #include "blake3.h"
 
 #include "../../include/protocol.h"
 #include "../crypto/crypto_session.h"
+#include "../common/wire_codec.h"
+#include "../common/tls_session.h"
 #include "../db/mongo_ops_server.h"
 #include "admin_panel.h"
+#include "job_pool.h"
+#include "storage_io.h"
+#include "rate_limiter.h"
+#include "drr_sched.h"
 
 // Server configuration
 #define DEFAULT_PORT 1512
@@ -45,6 +57,30 @@
 #define DATABASE_NAME "file_exchange"
 #define COLLECTION_NAME "file_groups"
 #define MAX_FILE_SIZE (1024LL * 1024LL * 1024LL) // 1GB
+#define DOWNLOAD_BATCH (1024 * 1024)        // Bytes queued (or sendfile'd) per download refill
+#define DOWNLOAD_LOW_WATERMARK (256 * 1024) // Refill once the output drains below this
+#define MAX_WORKER_THREADS 64
+#define DEFAULT_IO_THREADS 4                // Job pool threads for disk work
+#define UPLOAD_WRITE_BATCH (1024 * 1024)    // Upload bytes per write job
+#define UPLOAD_MAX_BUFFERED (4 * 1024 * 1024) // Pause reading beyond this while a write runs
+#define STATS_INTERVAL_SEC 60
+#define CONN_SLAB_SIZE 64                   // connection_t objects carved per slab allocation
+#define RATE_LIMIT_TABLE_SIZE 8192          // Token bucket slots per worker
+#define RATE_LIMIT_SWEEP_SEC 10             // Idle bucket eviction interval
+#define THROTTLE_CHUNK (64 * 1024)          // Tokens a throttled transfer waits for before resuming
+#define SCHED_QUANTUM (64 * 1024)           // DRR bytes per download per round under a global cap
+#define SCHED_TICK_MS 10                    // How often the global budget is handed out
+#define SCHED_MAX_CREDIT_MS 100             // Unused global budget kept for at most this long
+#define PARTIAL_DIR STORAGE_DIR "/.partial"  // Unfinished uploads: <key>.data and <key>.state
+#define PARTIAL_KEY_LEN 64                  // Hex BLAKE3 of client, name, size and expected hash
+#define PARTIAL_MAGIC "FTPART1"
+#define UPLOAD_CHECKPOINT_BYTES (16LL * 1024 * 1024) // Save resumable state this often
+#define PARTIAL_TTL_SEC (24 * 60 * 60)      // Untouched partial uploads are deleted after this
+#define PARTIAL_SWEEP_SEC 3600
+#define MUX_MAX_STREAMS 64                  // Concurrent streams per framed (v2) connection
+#define MUX_STREAM_WINDOW (256 * 1024)      // Bytes buffered per stream and direction
+#define MUX_OUTPUT_HIGH (512 * 1024)        // Stop framing stream output above this much TLS output
+#define READ_BATCH_MAX 32                   // Requests or frames handled per read callback
 
 // Connection state
 typedef enum {
@@ -53,35 +89,165 @@ typedef enum {
     CONN_STATE_ECDH_RESPONSE,
     CONN_STATE_SESSION_KEY,
     CONN_STATE_AUTHENTICATED,
-    CONN_STATE_TRANSFERRING
+    CONN_STATE_TRANSFERRING,
+    CONN_STATE_BUSY, // Waiting for a job pool result; input stays buffered
+    CONN_STATE_MUX   // Protocol v2: input is frames for the connection's streams
 } connection_state_t;
 
-// Connection context
+struct worker;
+struct mux;
+
+typedef enum {
+    TRANSFER_NONE,
+    TRANSFER_UPLOAD,
+    TRANSFER_DOWNLOAD
+} transfer_kind_t;
+
+// Active upload or download of a connection. Embedded in connection_t and
+// reset when the transfer ends; the pending buffer and sendfile event are
+// kept for the next transfer on the same connection.
+typedef struct {
+    transfer_kind_t kind;
+    char filename[FILENAME_MAX_LEN];
+    int fd;
+    int slot;                // Registered file slot in the worker's ring, or -1
+    long long filesize;
+
+    // Upload
+    long long received;      // Bytes taken off the socket
+    long long written;       // Bytes on disk
+    struct evbuffer *pending; // Received bytes not yet handed to a write
+    int writing;             // A write (pool job or ring op) is in flight
+    blake3_hasher *hasher;   // Hash of the bytes handed to storage; a write in flight owns it
+    long long checkpointed;  // Bytes covered by the saved partial state
+    uint8_t file_hash[BLAKE3_HASH_LEN]; // Expected hash; all zeros if the client sent none
+    char partial[PARTIAL_KEY_LEN + 1];  // Partial upload key, claimed while the upload runs
+
+    // Download
+    long long start;         // Requested offset
+    long long sent;          // Bytes the socket has taken
+    long long queued;        // Bytes added to the output buffer
+    struct evbuffer_file_segment *segment;
+    struct event *sendfile_ev;
+    int reading;             // A ring read is in flight
+    int watermark;           // Write low watermark armed for ring reads
+} transfer_t;
+
+// Client address in binary form. IPv4 is stored IPv4-mapped (::ffff:a.b.c.d)
+// so both families share one key type.
 typedef struct {
+    uint8_t addr[16];
+} ip_key_t;
+
+// Connection context
+typedef struct connection {
     struct bufferevent *bev;
     struct event_base *base;
+    struct worker *worker; // Owning worker; all callbacks run on its thread
     crypto_session_t crypto_session;
-    char client_ip[INET_ADDRSTRLEN];
+    char client_ip[INET6_ADDRSTRLEN];
+    ip_key_t ip_key;
     char fingerprint[FINGERPRINT_LEN];
     char session_key_hex[65]; // Hex-encoded session key for admin panel
     time_t connected_at;
     connection_state_t state;
-    GHashTable *pending_data; // For partial transfers
+    transfer_t transfer;
+    struct event *throttle_ev; // Resumes a transfer held back by the byte limit
+    token_bucket_t bandwidth; // Per-connection byte cap (-c)
+    uint8_t fp_key[RATE_LIMITER_KEY_LEN]; // Leading bytes of the peer cert SHA-256
+    int has_fp;
+    sched_entry_t sched;      // Turn in the worker's download scheduler (-B)
+    size_t sched_grant;       // Bytes the scheduler allows in the current turn
+    int jobs_in_flight;       // Job pool jobs that still reference this connection
+    int closing;              // Closed while jobs were in flight; freed by the last one
+    struct connection *next_free; // Worker free list link while unused
+
+    // Protocol v2. A stream is a connection_t of its own whose bev is one end
+    // of a bufferevent pair; the parent frames what comes out of the other end.
+    struct mux *mux;          // Streams of a framed connection, or NULL
+    struct connection *parent; // Framed connection of a stream; NULL once detached
+    struct bufferevent *mux_end; // Parent's end of a stream's pair
+    uint32_t stream_id;       // Nonzero for streams
+    int stream_closing;       // Client sent FRAME_CLOSE: close once idle
+    int compact;              // v3: request and response headers use wire_codec.h
 } connection_t;
 
-// Rate limiting
+typedef struct mux {
+    connection_t *streams[MUX_MAX_STREAMS];
+    int count;
+    int cursor;               // Slot whose output is framed next
+    uint32_t last_id;         // Highest id opened; unknown lower ids are closed streams
+    connection_t *paused_by;  // Stream whose full window stopped reading, or NULL
+} mux_t;
+
+// Saved next to a partial upload's data file. Restores the hasher so a
+// resumed upload is verified end to end without rereading the file.
+typedef struct {
+    char magic[8];
+    uint32_t hasher_size;    // sizeof(blake3_hasher) of the build that wrote it
+    long long filesize;
+    long long committed;     // Bytes synced to the data file and covered by hasher
+    uint8_t file_hash[BLAKE3_HASH_LEN];
+    char filename[FILENAME_MAX_LEN];
+    blake3_hasher hasher;
+} upload_checkpoint_t;
+
+// Connections are carved from per-worker slabs and recycled through a free
+// list, so accepting a client does not hit malloc once the slabs are warm
+typedef struct conn_slab {
+    struct conn_slab *next;
+    connection_t conns[CONN_SLAB_SIZE];
+} conn_slab_t;
+
+// Open connections from one client address
 typedef struct {
-    uint32_t ip_address;
-    uint32_t request_count;
-    time_t window_start;
-} rate_limit_t;
+    ip_key_t key;
+    int count;
+} conn_count_t;
+
+// Worker: one thread with its own event loop, listener and connection tables.
+// A connection lives on exactly one worker, so per-worker state needs no locks.
+typedef struct worker {
+    int index;
+    pthread_t thread;
+    struct event_base *base;
+    struct evconnlistener *listener;
+    storage_io_t *io;        // io_uring ring; NULL falls back to the job pool
+    GHashTable *connections; // connection_t* -> connection_t*
+    rate_limiter_t *limiter; // Request and byte token buckets per client address
+    rate_limiter_t *fp_limiter; // Byte buckets per client certificate (-f), or NULL
+    struct event *sweep_ev;  // Evicts idle buckets every RATE_LIMIT_SWEEP_SEC
+    drr_sched_t sched;       // Fair share of the global download cap (-B)
+    struct event *sched_ev;  // Hands out the budget every SCHED_TICK_MS; NULL if uncapped
+    double sched_credit;     // Global bytes available to the scheduler
+    uint64_t sched_last_ms;
+    conn_slab_t *slabs;
+    connection_t *free_conns;
+} worker_t;
 
 // Global state
-static struct event_base *g_event_base = NULL;
+static struct event_base *g_event_base = NULL; // Main thread: signals and shutdown only
 static SSL_CTX *g_ssl_ctx = NULL;
-static GHashTable *g_connections = NULL;
-static GHashTable *g_rate_limits = NULL;
+static worker_t *g_workers = NULL;
+static int g_num_workers = 1;
+static job_pool_t *g_job_pool = NULL;
+static int g_num_io_threads = DEFAULT_IO_THREADS;
 static volatile sig_atomic_t g_shutdown = 0;
+static int g_ktls_enabled = 0; // -k: let OpenSSL offload record encryption to the kernel
+static long long g_byte_rate = 0; // -b: per-client bytes/sec per worker, 0 = unlimited
+static long long g_conn_rate = 0; // -c: per-connection bytes/sec, 0 = unlimited
+static long long g_fp_rate = 0;   // -f: per-certificate bytes/sec per worker, 0 = unlimited
+static long long g_global_rate = 0; // -B: download bytes/sec for the whole server, 0 = unlimited
+
+// Open connections per client address, shared by all workers so the limit
+// holds no matter how SO_REUSEPORT spreads a client's connections
+static GHashTable *g_conn_counts = NULL; // ip_key_t* -> conn_count_t*
+static pthread_mutex_t g_conn_counts_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Partial upload keys in use by a connection or the sweeper, so one partial
+// never has two writers
+static GHashTable *g_active_partials = NULL; // char* -> NULL
+static pthread_mutex_t g_active_partials_lock = PTHREAD_MUTEX_INITIALIZER;
 
 // MongoDB globals are defined in mongo_ops_server.c
 extern mongoc_client_t *g_mongo_client;
@@ -90,62 +256,257 @@ extern mongoc_collection_t *g_collection;
 // Logging
 static void secure_log(const char *level, const char *format, ...) {
     time_t now = time(NULL);
+    struct tm tm_now;
     char timestamp[20];
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", localtime_r(&now, &tm_now));
 
+    // Workers log concurrently; keep each line in one piece
     va_list args;
     va_start(args, format);
+    flockfile(stderr);
     fprintf(stderr, "[%s] [%s] ", timestamp, level);
     vfprintf(stderr, format, args);
     fprintf(stderr, "\n");
+    funlockfile(stderr);
     va_end(args);
 }
 
-// Rate limiting functions
-static int check_rate_limit(const char *ip) {
-    uint32_t ip_addr = inet_addr(ip);
-    rate_limit_t *limit = g_hash_table_lookup(g_rate_limits, &ip_addr);
+// Coarse clock for the rate limiter: vDSO read, no syscall per request
+static uint64_t coarse_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
 
-    time_t now = time(NULL);
+// Rate limiting functions (per worker)
+static int check_rate_limit(connection_t *conn) {
+    return !rate_limiter_allow_request(conn->worker->limiter, conn->ip_key.addr, coarse_now_ms());
+}
+
+#define CONN_FROM_SCHED(entry) ((connection_t *)((char *)(entry) - offsetof(connection_t, sched)))
+
+static guint ip_key_hash(gconstpointer key) {
+    const uint8_t *p = ((const ip_key_t *)key)->addr;
+    guint h = 2166136261u; // FNV-1a
+    for (int i = 0; i < 16; i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
+
+static gboolean ip_key_equal(gconstpointer a, gconstpointer b) {
+    return memcmp(a, b, sizeof(ip_key_t)) == 0;
+}
+
+// Fill key and the printable address from an accepted peer address
+static int ip_key_from_sockaddr(const struct sockaddr *sa, ip_key_t *key, char *ip, size_t ip_len) {
+    memset(key, 0, sizeof(*key));
+    if (sa->sa_family == AF_INET) {
+        const struct sockaddr_in *sin = (const struct sockaddr_in *)sa;
+        key->addr[10] = 0xff;
+        key->addr[11] = 0xff;
+        memcpy(&key->addr[12], &sin->sin_addr, 4);
+        return inet_ntop(AF_INET, &sin->sin_addr, ip, ip_len) ? 0 : -1;
+    }
+    if (sa->sa_family == AF_INET6) {
+        const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6 *)sa;
+        memcpy(key->addr, &sin6->sin6_addr, 16);
+        // IPv4 clients of the dual-stack listener: same key as over AF_INET,
+        // and logs and bans keep the dotted form
+        if (IN6_IS_ADDR_V4MAPPED(&sin6->sin6_addr)) {
+            return inet_ntop(AF_INET, &sin6->sin6_addr.s6_addr[12], ip, ip_len) ? 0 : -1;
+        }
+        return inet_ntop(AF_INET6, &sin6->sin6_addr, ip, ip_len) ? 0 : -1;
+    }
+    return -1;
+}
+
+// Count a new connection from key. Returns 1 (and counts nothing) if the
+// address already holds MAX_CONNECTIONS_PER_IP connections.
+static int acquire_connection_slot(const ip_key_t *key) {
+    int limited = 0;
+
+    pthread_mutex_lock(&g_conn_counts_lock);
+    conn_count_t *entry = g_hash_table_lookup(g_conn_counts, key);
+    if (!entry) {
+        entry = calloc(1, sizeof(conn_count_t));
+        if (entry) {
+            entry->key = *key;
+            g_hash_table_insert(g_conn_counts, &entry->key, entry);
+        }
+    }
+    if (!entry || entry->count >= MAX_CONNECTIONS_PER_IP) {
+        limited = 1;
+    } else {
+        entry->count++;
+    }
+    pthread_mutex_unlock(&g_conn_counts_lock);
+    return limited;
+}
 
-    if (!limit) {
-        limit = calloc(1, sizeof(rate_limit_t));
-        limit->ip_address = ip_addr;
-        limit->window_start = now;
-        g_hash_table_insert(g_rate_limits, &limit->ip_address, limit);
+static void release_connection_slot(const ip_key_t *key) {
+    pthread_mutex_lock(&g_conn_counts_lock);
+    conn_count_t *entry = g_hash_table_lookup(g_conn_counts, key);
+    if (entry && --entry->count <= 0) {
+        g_hash_table_remove(g_conn_counts, key);
     }
+    pthread_mutex_unlock(&g_conn_counts_lock);
+}
+
+// Partial uploads are keyed by who sends what, so a client can only resume
+// its own upload of the same name, size and expected hash
+static void partial_key(const char *fingerprint, const char *filename, long long filesize,
+                        const uint8_t *file_hash, char *key) {
+    uint8_t size_le[8];
+    uint8_t digest[BLAKE3_HASH_LEN];
+    for (int i = 0; i < 8; i++) {
+        size_le[i] = (uint8_t)((unsigned long long)filesize >> (8 * i));
+    }
+
+    blake3_hasher hasher;
+    blake3_hasher_init(&hasher);
+    blake3_hasher_update(&hasher, fingerprint, strlen(fingerprint) + 1);
+    blake3_hasher_update(&hasher, filename, strlen(filename) + 1);
+    blake3_hasher_update(&hasher, size_le, sizeof(size_le));
+    blake3_hasher_update(&hasher, file_hash, BLAKE3_HASH_LEN);
+    blake3_hasher_finalize(&hasher, digest, BLAKE3_HASH_LEN);
+    sodium_bin2hex(key, PARTIAL_KEY_LEN + 1, digest, BLAKE3_HASH_LEN);
+}
+
+static void partial_path(char *path, size_t len, const char *key, const char *suffix) {
+    snprintf(path, len, "%s/%s.%s", PARTIAL_DIR, key, suffix);
+}
 
-    // Reset window if expired
-    if (now - limit->window_start >= RATE_LIMIT_WINDOW_SEC) {
-        limit->request_count = 0;
-        limit->window_start = now;
+// Returns -1 if another connection (or the sweeper) holds key
+static int partial_claim(const char *key) {
+    int busy = 0;
+
+    pthread_mutex_lock(&g_active_partials_lock);
+    if (g_hash_table_contains(g_active_partials, key)) {
+        busy = 1;
+    } else {
+        char *copy = strdup(key);
+        if (copy) g_hash_table_add(g_active_partials, copy);
+        else busy = 1;
     }
+    pthread_mutex_unlock(&g_active_partials_lock);
+    return busy ? -1 : 0;
+}
+
+static void partial_release(const char *key) {
+    if (key[0] == '\0') return;
+    pthread_mutex_lock(&g_active_partials_lock);
+    g_hash_table_remove(g_active_partials, key);
+    pthread_mutex_unlock(&g_active_partials_lock);
+}
 
-    if (limit->request_count >= MAX_REQUESTS_PER_WINDOW) {
-        return 1; // Rate limited
+static void partial_remove(const char *key) {
+    char path[PATH_MAX];
+    partial_path(path, sizeof(path), key, "data");
+    unlink(path);
+    partial_path(path, sizeof(path), key, "state");
+    unlink(path);
+    partial_path(path, sizeof(path), key, "state.tmp");
+    unlink(path);
+}
+
+// Replace the saved state atomically. The data it covers must already be
+// synced, or a crash could leave a checkpoint ahead of the file.
+static int partial_save(const char *key, const upload_checkpoint_t *cp) {
+    char tmp[PATH_MAX], path[PATH_MAX];
+    partial_path(tmp, sizeof(tmp), key, "state.tmp");
+    partial_path(path, sizeof(path), key, "state");
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1) return -1;
+    const char *p = (const char *)cp;
+    size_t left = sizeof(*cp);
+    while (left > 0) {
+        ssize_t n = write(fd, p, left);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            close(fd);
+            unlink(tmp);
+            return -1;
+        }
+        p += n;
+        left -= (size_t)n;
+    }
+    if (fdatasync(fd) != 0 || close(fd) != 0) {
+        unlink(tmp);
+        return -1;
     }
+    return rename(tmp, path);
+}
 
-    limit->request_count++;
-    return 0; // OK
+// Load the saved state of key and check it belongs to this upload. State
+// written by a build with a different hasher layout is ignored.
+static int partial_load(const char *key, const char *filename, long long filesize,
+                        const uint8_t *file_hash, upload_checkpoint_t *cp) {
+    char path[PATH_MAX];
+    partial_path(path, sizeof(path), key, "state");
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return -1;
+    ssize_t n = read(fd, cp, sizeof(*cp));
+    close(fd);
+
+    if (n != (ssize_t)sizeof(*cp) ||
+        memcmp(cp->magic, PARTIAL_MAGIC, sizeof(PARTIAL_MAGIC)) != 0 ||
+        cp->hasher_size != sizeof(blake3_hasher) ||
+        cp->filesize != filesize ||
+        cp->committed <= 0 || cp->committed >= filesize ||
+        memcmp(cp->file_hash, file_hash, BLAKE3_HASH_LEN) != 0 ||
+        strncmp(cp->filename, filename, sizeof(cp->filename)) != 0) {
+        return -1;
+    }
+    return 0;
 }
 
-// Connection count per IP
-static int check_connection_limit(const char *ip) {
-    uint32_t ip_addr = inet_addr(ip);
-    int count = 0;
+static void transfer_reset(transfer_t *t) {
+    struct evbuffer *pending = t->pending;
+    struct event *sendfile_ev = t->sendfile_ev;
 
-    GHashTableIter iter;
-    gpointer key, value;
-    g_hash_table_iter_init(&iter, g_connections);
+    memset(t, 0, sizeof(*t));
+    t->kind = TRANSFER_NONE;
+    t->fd = -1;
+    t->slot = -1;
+    t->pending = pending;
+    t->sendfile_ev = sendfile_ev;
+}
 
-    while (g_hash_table_iter_next(&iter, &key, &value)) {
-        connection_t *conn = value;
-        if (inet_addr(conn->client_ip) == ip_addr) {
-            count++;
+// Take a connection from the worker's free list, growing it by one slab
+// when empty. The returned connection is zeroed except for its pending
+// buffer, which is reused across connections.
+static connection_t *conn_alloc(worker_t *worker) {
+    if (!worker->free_conns) {
+        conn_slab_t *slab = calloc(1, sizeof(conn_slab_t));
+        if (!slab) return NULL;
+        slab->next = worker->slabs;
+        worker->slabs = slab;
+        for (int i = CONN_SLAB_SIZE - 1; i >= 0; i--) {
+            slab->conns[i].next_free = worker->free_conns;
+            worker->free_conns = &slab->conns[i];
         }
     }
 
-    return count >= MAX_CONNECTIONS_PER_IP;
+    connection_t *conn = worker->free_conns;
+    struct evbuffer *pending = conn->transfer.pending;
+    if (!pending && !(pending = evbuffer_new())) return NULL;
+    worker->free_conns = conn->next_free;
+
+    memset(conn, 0, sizeof(*conn));
+    conn->worker = worker;
+    conn->transfer.pending = pending;
+    transfer_reset(&conn->transfer);
+    return conn;
+}
+
+static void conn_free(connection_t *conn) {
+    worker_t *worker = conn->worker;
+    evbuffer_drain(conn->transfer.pending, evbuffer_get_length(conn->transfer.pending));
+    conn->next_free = worker->free_conns;
+    worker->free_conns = conn;
 }
 
 // SSL context initialization
@@ -176,6 +537,27 @@ static SSL_CTX *init_ssl_context(void) {
     }
 
     SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, NULL);
+
+    // Reconnecting clients resume instead of repeating the full mTLS handshake.
+    // All workers share this context, and with it the session cache.
+    if (tls_session_server_init(ctx, "exchange-server") != 0) {
+        secure_log("ERROR", "Failed to generate TLS session ticket key");
+        SSL_CTX_free(ctx);
+        return NULL;
+    }
+
+    // Kernel TLS: OpenSSL only switches a connection to kTLS if the kernel
+    // and the negotiated cipher support it, so this is safe to request blindly
+    if (g_ktls_enabled) {
+#ifdef SSL_OP_ENABLE_KTLS
+        SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+        secure_log("INFO", "Kernel TLS requested; downloads use SSL_sendfile where available");
+#else
+        secure_log("WARNING", "Kernel TLS requested but OpenSSL lacks support; using buffered downloads");
+        g_ktls_enabled = 0;
+#endif
+    }
+
     return ctx;
 }
 
@@ -199,6 +581,17 @@ static int init_mongodb(void) {
     return 0;
 }
 
+// Response header in the connection's encoding
+static void send_response(connection_t *conn, const ResponseHeader *resp) {
+    if (!conn->compact) {
+        bufferevent_write(conn->bev, resp, sizeof(*resp));
+        return;
+    }
+    uint8_t buf[WIRE_MAX_MESSAGE];
+    size_t len = wire_encode_response(resp, buf, sizeof(buf));
+    bufferevent_write(conn->bev, buf, len);
+}
+
 // Handle ECDH key exchange initiation
 static void handle_ecdh_init(connection_t *conn, const ECDHInitPacket *packet) {
     // Generate our ECDH keys
@@ -268,7 +661,7 @@ static void handle_session_key(connection_t *conn, const SessionKeyPacket *packe
         // Send ban message
         const char *ban_message = admin_get_ban_message(session_key_hex);
         ResponseHeader resp = { .status = RESP_BANNED };
-        bufferevent_write(conn->bev, &resp, sizeof(resp));
+        send_response(conn, &resp);
 
         // Send ban message if available
         if (ban_message) {
@@ -287,390 +680,1754 @@ static void handle_session_key(connection_t *conn, const SessionKeyPacket *packe
 
     // Send success response
     ResponseHeader resp = { .status = RESP_SUCCESS };
-    bufferevent_write(conn->bev, &resp, sizeof(resp));
+    send_response(conn, &resp);
 }
 
-// Handle file upload
-static void handle_upload(connection_t *conn, const RequestHeader *req) {
-    if (conn->state != CONN_STATE_AUTHENTICATED) {
-        ResponseHeader resp = { .status = RESP_AUTH_FAILED };
-        bufferevent_write(conn->bev, &resp, sizeof(resp));
-        return;
-    }
-
-    // Decrypt metadata
+// Blocking filesystem work for one request. Filled in on the loop thread,
+// run on a job pool thread, then consumed back on the loop thread.
+typedef struct {
+    connection_t *conn;
     char filename[FILENAME_MAX_LEN];
+    char filepath[PATH_MAX];
     long long filesize;
-    char recipient[FINGERPRINT_LEN];
-
-    if (crypto_session_decrypt_metadata(&conn->crypto_session, &req->metadata,
-                                       filename, &filesize, recipient) != 0) {
-        secure_log("ERROR", "Failed to decrypt metadata for upload from %s", conn->client_ip);
-        ResponseHeader resp = { .status = RESP_ENCRYPTION_ERROR };
-        bufferevent_write(conn->bev, &resp, sizeof(resp));
-        return;
+    int64_t offset;
+    int fd;                 // Opened file; for upload writes, a borrowed copy
+    int slot;               // Registered file slot in io, or -1
+    storage_io_t *io;       // Owning worker's ring (may be NULL)
+    uint8_t *buf;           // Registered buffer of an io_uring op
+    size_t len;             // Bytes written / read by this job
+    struct evbuffer *data;  // Upload bytes to append to fd
+    int final;              // Last upload write: close fd when done
+    ResponseStatus status;  // Outcome of the work function
+    int err;                // errno of the failing call
+    GString *list;          // LIST result
+    blake3_hasher *hasher;  // Upload hash, borrowed from the transfer while the write runs
+    upload_checkpoint_t *checkpoint; // Upload state to save after this write, or loaded on open
+    uint8_t file_hash[BLAKE3_HASH_LEN];
+    char partial[PARTIAL_KEY_LEN + 1];
+} fs_job_t;
+
+static void read_cb(struct bufferevent *bev, void *ctx);
+
+static fs_job_t *fs_job_new(connection_t *conn) {
+    fs_job_t *job = calloc(1, sizeof(fs_job_t));
+    if (job) {
+        job->conn = conn;
+        job->fd = -1;
+        job->slot = -1;
+        job->io = conn->worker->io;
+        job->status = RESP_SUCCESS;
     }
+    return job;
+}
 
-    // Validate filename and size
-    if (strstr(filename, "..") || strchr(filename, '/') || strlen(filename) == 0 ||
-        filesize <= 0 || filesize > MAX_FILE_SIZE) {
-        ResponseHeader resp = { .status = RESP_PERMISSION_DENIED };
-        bufferevent_write(conn->bev, &resp, sizeof(resp));
-        return;
-    }
+static void fs_job_free(fs_job_t *job) {
+    if (job->data) evbuffer_free(job->data);
+    if (job->list) g_string_free(job->list, TRUE);
+    free(job->checkpoint);
+    free(job);
+}
 
-    // Create storage directory if needed
-    if (mkdir(STORAGE_DIR, 0755) == -1 && errno != EEXIST) {
-        secure_log("ERROR", "Failed to create storage directory");
-        ResponseHeader resp = { .status = RESP_ERROR };
-        bufferevent_write(conn->bev, &resp, sizeof(resp));
-        return;
+// Queue blocking work for a connection. The connection stays allocated
+// until every job it submitted has completed, even if the client leaves.
+static int submit_fs_job(fs_job_t *job, const char *name, job_work_fn work, job_done_fn done) {
+    if (job_pool_submit(g_job_pool, job->conn->base, name, work, done, job) != 0) {
+        secure_log("ERROR", "Failed to queue %s job for %s", name, job->conn->client_ip);
+        return -1;
     }
+    job->conn->jobs_in_flight++;
+    return 0;
+}
 
-    // Create full path
-    char filepath[PATH_MAX];
-    snprintf(filepath, sizeof(filepath), "%s/%s", STORAGE_DIR, filename);
+// First step of every completion. Returns 1 if the connection was closed
+// while the job ran; the caller must then only release the job's resources.
+static int fs_job_release(fs_job_t *job) {
+    connection_t *conn = job->conn;
+    conn->jobs_in_flight--;
+    if (!conn->closing) return 0;
+    if (conn->jobs_in_flight == 0) conn_free(conn);
+    return 1;
+}
 
-    // Check if file already exists
-    if (access(filepath, F_OK) == 0) {
-        ResponseHeader resp = { .status = RESP_PERMISSION_DENIED };
-        bufferevent_write(conn->bev, &resp, sizeof(resp));
-        return;
+// Process input that arrived while the connection waited on a job
+static void resume_input(connection_t *conn) {
+    if (evbuffer_get_length(bufferevent_get_input(conn->bev)) > 0) {
+        read_cb(conn->bev, conn);
     }
+}
 
-    // Open file for writing
-    FILE *fp = fopen(filepath, "wb");
-    if (!fp) {
-        secure_log("ERROR", "Failed to open file %s for writing", filepath);
-        ResponseHeader resp = { .status = RESP_ERROR };
-        bufferevent_write(conn->bev, &resp, sizeof(resp));
-        return;
-    }
+static void send_status(connection_t *conn, ResponseStatus status) {
+    ResponseHeader resp = { .status = status };
+    send_response(conn, &resp);
+}
 
-    // Send OK to start transfer
-    ResponseHeader resp = { .status = RESP_SUCCESS };
-    bufferevent_write(conn->bev, &resp, sizeof(resp));
+static void pump_download(connection_t *conn);
 
-    // Set connection to transferring state
-    conn->state = CONN_STATE_TRANSFERRING;
+static void throttle_cb(evutil_socket_t fd, short events, void *ctx) {
+    connection_t *conn = ctx;
+    (void)fd;
+    (void)events;
+
+    if (conn->state != CONN_STATE_TRANSFERRING) return;
+    if (conn->transfer.kind == TRANSFER_UPLOAD) {
+        bufferevent_enable(conn->bev, EV_READ);
+        read_cb(conn->bev, conn);
+    } else if (conn->transfer.kind == TRANSFER_DOWNLOAD) {
+        pump_download(conn);
+    }
+}
+
+// Streams share the per-connection cap (-c) of their TLS connection
+static token_bucket_t *conn_bandwidth(connection_t *conn) {
+    return conn->parent ? &conn->parent->bandwidth : &conn->bandwidth;
+}
 
-    // Store file info in pending data
-    GHashTable *file_info = g_hash_table_new(g_str_hash, g_str_equal);
-    g_hash_table_insert(file_info, "fp", fp);
-    g_hash_table_insert(file_info, "filesize", (gpointer)filesize);
-    g_hash_table_insert(file_info, "received", (gpointer)0LL);
-    g_hash_table_insert(file_info, "filename", g_strdup(filename));
+// A byte bucket ran dry: hold the transfer until the slowest configured
+// cap has refilled by THROTTLE_CHUNK. Uploads also stop reading from the
+// socket, so TCP flow control pushes back on the sender.
+static void throttle_transfer(connection_t *conn) {
+    if (!conn->throttle_ev) {
+        conn->throttle_ev = evtimer_new(conn->base, throttle_cb, conn);
+        if (!conn->throttle_ev) return;
+    }
+    if (conn->transfer.kind == TRANSFER_UPLOAD) {
+        bufferevent_disable(conn->bev, EV_READ);
+    }
 
-    g_hash_table_insert(conn->pending_data, "upload", file_info);
+    uint32_t ms = rate_limiter_wait_ms(conn->worker->limiter, THROTTLE_CHUNK);
+    uint32_t conn_ms = token_bucket_wait_ms(conn_bandwidth(conn), THROTTLE_CHUNK);
+    if (conn_ms > ms) ms = conn_ms;
+    if (conn->worker->fp_limiter && conn->has_fp) {
+        uint32_t fp_ms = rate_limiter_wait_ms(conn->worker->fp_limiter, THROTTLE_CHUNK);
+        if (fp_ms > ms) ms = fp_ms;
+    }
+    struct timeval tv = { ms / 1000, (ms % 1000) * 1000 };
+    event_add(conn->throttle_ev, &tv);
+}
 
-    secure_log("INFO", "Upload initiated: %s (%lld bytes) from %s", filename, filesize, conn->client_ip);
+static int transfer_is_scheduled(connection_t *conn) {
+    return conn->worker->sched_ev && conn->transfer.kind == TRANSFER_DOWNLOAD;
 }
 
-// Handle file download
-static void handle_download(connection_t *conn, const RequestHeader *req) {
-    if (conn->state != CONN_STATE_AUTHENTICATED) {
-        ResponseHeader resp = { .status = RESP_AUTH_FAILED };
-        bufferevent_write(conn->bev, &resp, sizeof(resp));
-        return;
+// Bytes of `want` this connection may move now, after the per-connection,
+// per-address and per-certificate caps and, for downloads under -B, the
+// scheduler's grant. When less is granted the transfer parks itself: on
+// the throttle timer if a cap ran dry, or in the scheduler until its turn.
+static size_t take_transfer_bytes(connection_t *conn, size_t want) {
+    worker_t *worker = conn->worker;
+    int scheduled = transfer_is_scheduled(conn);
+
+    if (scheduled) {
+        if (conn->sched_grant == 0) {
+            drr_wake(&worker->sched, &conn->sched);
+            return 0;
+        }
+        if (want > conn->sched_grant) want = conn->sched_grant;
     }
 
-    // Decrypt metadata to get filename
-    char filename[FILENAME_MAX_LEN];
-    long long dummy_filesize;
-    char dummy_recipient[FINGERPRINT_LEN];
+    uint64_t now = coarse_now_ms();
+    token_bucket_t *bandwidth = conn_bandwidth(conn);
+    size_t n = token_bucket_take(bandwidth, want, now);
 
-    if (crypto_session_decrypt_metadata(&conn->crypto_session, &req->metadata,
-                                       filename, &dummy_filesize, dummy_recipient) != 0) {
-        secure_log("ERROR", "Failed to decrypt metadata for download from %s", conn->client_ip);
-        ResponseHeader resp = { .status = RESP_ENCRYPTION_ERROR };
-        bufferevent_write(conn->bev, &resp, sizeof(resp));
-        return;
-    }
+    size_t by_ip = rate_limiter_take_bytes(worker->limiter, conn->ip_key.addr, n, now);
+    token_bucket_refund(bandwidth, n - by_ip);
+    n = by_ip;
 
-    // Validate filename
-    if (strstr(filename, "..") || strchr(filename, '/') || strlen(filename) == 0) {
-        ResponseHeader resp = { .status = RESP_PERMISSION_DENIED };
-        bufferevent_write(conn->bev, &resp, sizeof(resp));
-        return;
+    if (worker->fp_limiter && conn->has_fp) {
+        size_t by_fp = rate_limiter_take_bytes(worker->fp_limiter, conn->fp_key, n, now);
+        token_bucket_refund(bandwidth, n - by_fp);
+        rate_limiter_refund_bytes(worker->limiter, conn->ip_key.addr, n - by_fp);
+        n = by_fp;
     }
 
-    // Create full path
-    char filepath[PATH_MAX];
-    snprintf(filepath, sizeof(filepath), "%s/%s", STORAGE_DIR, filename);
+    if (n < want) throttle_transfer(conn);
+    if (scheduled) conn->sched_grant -= n;
+    return n;
+}
 
-    // Check if file exists and get size
-    struct stat st;
-    if (stat(filepath, &st) != 0) {
-        ResponseHeader resp = { .status = RESP_FILE_NOT_FOUND };
-        bufferevent_write(conn->bev, &resp, sizeof(resp));
-        return;
+// Give back bytes taken by take_transfer_bytes() that were never sent
+static void refund_transfer_bytes(connection_t *conn, size_t unused) {
+    worker_t *worker = conn->worker;
+
+    token_bucket_refund(conn_bandwidth(conn), unused);
+    rate_limiter_refund_bytes(worker->limiter, conn->ip_key.addr, unused);
+    if (worker->fp_limiter && conn->has_fp) {
+        rate_limiter_refund_bytes(worker->fp_limiter, conn->fp_key, unused);
     }
+    if (transfer_is_scheduled(conn)) conn->sched_grant += unused;
+}
 
-    long long filesize = st.st_size;
+// Scheduler turn for one download: let pump_download queue up to `grant`
+// bytes. Connections live in worker slabs, so conn stays addressable even
+// if the pump closed it.
+static size_t sched_send(sched_entry_t *entry, size_t grant) {
+    connection_t *conn = CONN_FROM_SCHED(entry);
+
+    conn->sched_grant = grant;
+    pump_download(conn);
+    size_t moved = grant - conn->sched_grant;
+    conn->sched_grant = 0;
+    return moved;
+}
 
-    // Open file for reading
-    FILE *fp = fopen(filepath, "rb");
-    if (!fp) {
-        secure_log("ERROR", "Failed to open file %s for reading", filepath);
-        ResponseHeader resp = { .status = RESP_ERROR };
-        bufferevent_write(conn->bev, &resp, sizeof(resp));
-        return;
-    }
+// Hand the global download budget accrued since the last tick to the
+// downloads waiting in the scheduler
+static void sched_tick_cb(evutil_socket_t fd, short events, void *ctx) {
+    worker_t *worker = ctx;
+    (void)fd;
+    (void)events;
 
-    // Send response with file size
-    ResponseHeader resp = { .status = RESP_SUCCESS, .filesize = filesize };
-    bufferevent_write(conn->bev, &resp, sizeof(resp));
+    double rate = (double)g_global_rate / g_num_workers;
+    uint64_t now = coarse_now_ms();
+    worker->sched_credit += (double)(now - worker->sched_last_ms) * rate / 1000.0;
+    worker->sched_last_ms = now;
 
-    // Set connection to transferring state
-    conn->state = CONN_STATE_TRANSFERRING;
+    double max_credit = rate * SCHED_MAX_CREDIT_MS / 1000.0;
+    if (worker->sched_credit > max_credit) worker->sched_credit = max_credit;
+    if (worker->sched_credit < 1.0) return;
+
+    worker->sched_credit -= (double)drr_run(&worker->sched, (size_t)worker->sched_credit);
+}
 
-    // Store file info in pending data
-    GHashTable *file_info = g_hash_table_new(g_str_hash, g_str_equal);
-    g_hash_table_insert(file_info, "fp", fp);
-    g_hash_table_insert(file_info, "filesize", (gpointer)filesize);
-    g_hash_table_insert(file_info, "sent", (gpointer)0LL);
-    g_hash_table_insert(file_info, "filename", g_strdup(filename));
+// Checkpoint of the upload's identity; the caller fills committed and hasher
+static upload_checkpoint_t *checkpoint_new(const transfer_t *t) {
+    upload_checkpoint_t *cp = calloc(1, sizeof(upload_checkpoint_t));
+    if (!cp) return NULL;
+    memcpy(cp->magic, PARTIAL_MAGIC, sizeof(PARTIAL_MAGIC));
+    cp->hasher_size = sizeof(blake3_hasher);
+    cp->filesize = t->filesize;
+    memcpy(cp->file_hash, t->file_hash, BLAKE3_HASH_LEN);
+    snprintf(cp->filename, sizeof(cp->filename), "%s", t->filename);
+    return cp;
+}
 
-    g_hash_table_insert(conn->pending_data, "download", file_info);
+// Upload: sync what was written and save it as the resume point (pool thread)
+static void upload_park_work(void *arg) {
+    fs_job_t *job = arg;
 
-    secure_log("INFO", "Download initiated: %s (%lld bytes) to %s", filename, filesize, conn->client_ip);
+    if (fdatasync(job->fd) != 0 || partial_save(job->partial, job->checkpoint) != 0) {
+        job->err = errno;
+        job->status = RESP_ERROR;
+    }
+    close(job->fd);
+    job->fd = -1;
 }
 
-// Handle file list
-static void handle_list(connection_t *conn, const RequestHeader *req) {
-    if (conn->state != CONN_STATE_AUTHENTICATED) {
-        ResponseHeader resp = { .status = RESP_AUTH_FAILED };
-        bufferevent_write(conn->bev, &resp, sizeof(resp));
-        return;
+static void upload_park_done(void *arg) {
+    fs_job_t *job = arg;
+
+    fs_job_release(job); // Only submitted by close_connection()
+    if (job->status != RESP_SUCCESS) {
+        secure_log("ERROR", "Failed to save partial upload %s: %s", job->filename, strerror(job->err));
     }
+    partial_release(job->partial);
+    fs_job_free(job);
+}
 
-    // Open storage directory
-    DIR *dir = opendir(STORAGE_DIR);
-    if (!dir) {
-        secure_log("ERROR", "Failed to open storage directory");
-        ResponseHeader resp = { .status = RESP_ERROR };
-        bufferevent_write(conn->bev, &resp, sizeof(resp));
+// Keep a dropped upload resumable from everything written so far. Takes
+// over the fd and the partial key. During shutdown the pool is already
+// gone, so the state is saved inline.
+static void park_upload(connection_t *conn) {
+    transfer_t *t = &conn->transfer;
+    fs_job_t *job = fs_job_new(conn);
+    upload_checkpoint_t *cp = job ? checkpoint_new(t) : NULL;
+    if (!cp) {
+        if (job) fs_job_free(job);
+        close(t->fd);
+        partial_release(t->partial);
         return;
     }
+    cp->committed = t->written;
+    cp->hasher = *t->hasher;
+    job->checkpoint = cp;
+    job->fd = t->fd;
+    snprintf(job->filename, sizeof(job->filename), "%s", t->filename);
+    snprintf(job->partial, sizeof(job->partial), "%s", t->partial);
+
+    if (g_job_pool && submit_fs_job(job, "upload_park", upload_park_work, upload_park_done) == 0) {
+        return;
+    }
+    upload_park_work(job);
+    partial_release(job->partial);
+    fs_job_free(job);
+}
 
-    // Collect file list
-    GString *file_list = g_string_new("");
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL) {
-        if (entry->d_type == DT_REG) { // Regular files only
-            struct stat st;
-            char filepath[PATH_MAX];
-            snprintf(filepath, sizeof(filepath), "%s/%s", STORAGE_DIR, entry->d_name);
-
-            if (stat(filepath, &st) == 0) {
-                g_string_append_printf(file_list, "%s\t%lld\n", entry->d_name, (long long)st.st_size);
-            }
+// Drop an unfinished upload, keeping its partial state for a resume. A
+// write still in flight owns the fd, hasher and partial key and releases
+// them on completion.
+static void abort_upload(connection_t *conn) {
+    transfer_t *t = &conn->transfer;
+    if (t->kind != TRANSFER_UPLOAD) return;
+
+    if (!t->writing) {
+        storage_io_file_unregister(conn->worker->io, t->slot);
+        if (t->hasher && t->written > t->checkpointed && t->fd != -1) {
+            park_upload(conn);
+        } else {
+            if (t->fd != -1) close(t->fd);
+            partial_release(t->partial);
         }
+        free(t->hasher);
     }
-    closedir(dir);
+    evbuffer_drain(t->pending, evbuffer_get_length(t->pending));
+    transfer_reset(t);
+}
 
-    long long list_size = file_list->len;
+// Upload finished or refused after its last byte: back to command mode
+static void end_upload(connection_t *conn) {
+    transfer_t *t = &conn->transfer;
 
-    // Send response with list size
-    ResponseHeader resp = { .status = RESP_SUCCESS, .filesize = list_size };
-    bufferevent_write(conn->bev, &resp, sizeof(resp));
+    storage_io_file_unregister(conn->worker->io, t->slot);
+    partial_release(t->partial);
+    free(t->hasher);
+    transfer_reset(t);
+    conn->state = CONN_STATE_AUTHENTICATED;
+}
 
-    // Send file list data
-    if (list_size > 0) {
-        bufferevent_write(conn->bev, file_list->str, list_size);
+// Release download resources and return the connection to command mode
+static void finish_download(connection_t *conn, int success) {
+    transfer_t *t = &conn->transfer;
+    if (t->kind != TRANSFER_DOWNLOAD) return;
+
+    if (t->sendfile_ev) event_del(t->sendfile_ev);
+    drr_remove(&conn->worker->sched, &conn->sched);
+    // Slices still in the output buffer keep their own segment reference
+    if (t->segment) evbuffer_file_segment_free(t->segment);
+    storage_io_file_unregister(conn->worker->io, t->slot);
+    close(t->fd);
+    bufferevent_setwatermark(conn->bev, EV_WRITE, 0, 0);
+
+    if (success) {
+        secure_log("INFO", "Download completed: %s (%lld bytes) to %s", t->filename, t->filesize, conn->client_ip);
+    } else {
+        secure_log("ERROR", "Download aborted: %s at %lld/%lld bytes to %s", t->filename, t->sent, t->filesize, conn->client_ip);
     }
 
-    g_string_free(file_list, TRUE);
+    transfer_reset(t);
+    conn->state = CONN_STATE_AUTHENTICATED;
 }
 
-// Main request handler
-static void handle_request(connection_t *conn, const RequestHeader *req) {
-    // Rate limiting check
-    if (check_rate_limit(conn->client_ip)) {
-        ResponseHeader resp = { .status = RESP_RATE_LIMITED };
-        bufferevent_write(conn->bev, &resp, sizeof(resp));
-        return;
-    }
+// Queue one frame on a framed connection; `len` payload bytes move from `src`
+static void mux_write_frame(connection_t *conn, uint32_t stream_id, FrameType type,
+                            struct evbuffer *src, size_t len) {
+    FrameHeader hdr = { .stream_id = stream_id, .type = type, .length = (uint32_t)len };
+    uint8_t raw[FRAME_HEADER_LEN];
+    frame_header_pack(&hdr, raw);
+    struct evbuffer *out = bufferevent_get_output(conn->bev);
+    evbuffer_add(out, raw, sizeof(raw));
+    if (len > 0) evbuffer_remove_buffer(src, out, len);
+}
 
-    switch (req->command) {
-        case CMD_ECDH_INIT:
-            handle_ecdh_init(conn, (const ECDHInitPacket*)req);
-            break;
-        case CMD_SESSION_KEY:
-            handle_session_key(conn, (const SessionKeyPacket*)req);
-            break;
-        case CMD_UPLOAD:
-            handle_upload(conn, req);
-            break;
-        case CMD_DOWNLOAD:
-            handle_download(conn, req);
-            break;
-        case CMD_LIST:
-            handle_list(conn, req);
-            break;
-        case CMD_PING:
-            // Keep-alive
-            ResponseHeader resp = { .status = RESP_SUCCESS };
-            bufferevent_write(conn->bev, &resp, sizeof(resp));
-            break;
-        default: {
-            ResponseHeader resp = { .status = RESP_UNKNOWN_COMMAND };
-            bufferevent_write(conn->bev, &resp, sizeof(resp));
+// Take a stream out of its parent's table, optionally telling the client
+// it was aborted. Reading resumes if this stream's window held it up.
+static void stream_detach(connection_t *stream, int reset) {
+    connection_t *conn = stream->parent;
+    if (!conn) return;
+    stream->parent = NULL;
+
+    mux_t *mux = conn->mux;
+    for (int i = 0; i < MUX_MAX_STREAMS; i++) {
+        if (mux->streams[i] == stream) {
+            mux->streams[i] = NULL;
+            mux->count--;
             break;
         }
     }
+    if (mux->paused_by == stream) {
+        mux->paused_by = NULL;
+        bufferevent_enable(conn->bev, EV_READ);
+        bufferevent_trigger(conn->bev, EV_READ, BEV_OPT_DEFER_CALLBACKS);
+    }
+    if (reset) mux_write_frame(conn, stream->stream_id, FRAME_RESET, NULL, 0);
 }
 
-// Buffer event callbacks
-static void read_cb(struct bufferevent *bev, void *ctx) {
-    connection_t *conn = ctx;
-    struct evbuffer *input = bufferevent_get_input(bev);
-
-    size_t len = evbuffer_get_length(input);
+static void close_connection(connection_t *conn);
 
-    // Handle different packet types based on state
-    switch (conn->state) {
-        case CONN_STATE_ECDH_INIT: {
-            if (len < sizeof(ECDHInitPacket)) return;
-            ECDHInitPacket packet;
-            if (evbuffer_remove(input, &packet, sizeof(ECDHInitPacket)) != sizeof(ECDHInitPacket)) {
-                secure_log("ERROR", "Failed to read ECDH init packet from %s", conn->client_ip);
-                return;
-            }
-            handle_ecdh_init(conn, &packet);
-            break;
-        }
-        case CONN_STATE_ECDH_RESPONSE: {
-            if (len < sizeof(SessionKeyPacket)) return;
-            SessionKeyPacket packet;
-            if (evbuffer_remove(input, &packet, sizeof(SessionKeyPacket)) != sizeof(SessionKeyPacket)) {
-                secure_log("ERROR", "Failed to read session key packet from %s", conn->client_ip);
-                return;
-            }
-            handle_session_key(conn, &packet);
-            break;
-        }
-        case CONN_STATE_AUTHENTICATED: {
-            if (len < sizeof(RequestHeader)) return;
-            RequestHeader req;
-            if (evbuffer_remove(input, &req, sizeof(RequestHeader)) != sizeof(RequestHeader)) {
-                secure_log("ERROR", "Failed to read request header from %s", conn->client_ip);
-                return;
-            }
-            handle_request(conn, &req);
-            break;
-        }
-        case CONN_STATE_TRANSFERRING: {
-            // Check if this is upload or download
-            GHashTable *upload_info = g_hash_table_lookup(conn->pending_data, "upload");
-            GHashTable *download_info = g_hash_table_lookup(conn->pending_data, "download");
+// Framed connection going away: its streams go with it, without frames
+static void mux_free(connection_t *conn) {
+    mux_t *mux = conn->mux;
+    for (int i = 0; i < MUX_MAX_STREAMS; i++) {
+        connection_t *stream = mux->streams[i];
+        if (!stream) continue;
+        stream_detach(stream, 0);
+        close_connection(stream);
+    }
+    free(mux);
+    conn->mux = NULL;
+}
 
-            if (upload_info) {
-                // Handle upload data
-                FILE *fp = g_hash_table_lookup(upload_info, "fp");
-                long long filesize = (long long)g_hash_table_lookup(upload_info, "filesize");
-                long long received = (long long)g_hash_table_lookup(upload_info, "received");
+// Tear down a connection and everything attached to it
+static void close_connection(connection_t *conn) {
+    if (conn->mux) mux_free(conn);
+    stream_detach(conn, 1);
+    finish_download(conn, 0);
+    abort_upload(conn);
+    crypto_session_cleanup(&conn->crypto_session);
+    if (conn->transfer.sendfile_ev) {
+        event_free(conn->transfer.sendfile_ev);
+        conn->transfer.sendfile_ev = NULL;
+    }
+    if (conn->throttle_ev) {
+        event_free(conn->throttle_ev);
+        conn->throttle_ev = NULL;
+    }
+    bufferevent_free(conn->bev);
+    conn->bev = NULL;
+    if (conn->mux_end) {
+        bufferevent_free(conn->mux_end);
+        conn->mux_end = NULL;
+    }
+    g_hash_table_remove(conn->worker->connections, conn);
+    // Streams ride on their parent's slot
+    if (conn->stream_id == 0) release_connection_slot(&conn->ip_key);
 
-                if (!fp) {
-                    secure_log("ERROR", "No file pointer for upload from %s", conn->client_ip);
-                    evbuffer_drain(input, len);
-                    return;
-                }
+    // Jobs still in flight point at conn; the last one to complete frees it
+    if (conn->jobs_in_flight > 0) {
+        conn->closing = 1;
+        return;
+    }
+    conn_free(conn);
+}
 
-                // Read available data
-                size_t to_read = len;
-                if (received + to_read > filesize) {
-                    to_read = filesize - received;
-                }
+// Upload: open the partial data file, fresh or at the saved offset (pool
+// thread). The final name is only taken once the last byte is on disk.
+static void upload_open_work(void *arg) {
+    fs_job_t *job = arg;
 
-                if (to_read > 0) {
-                    char buffer[BUFFER_SIZE];
-                    size_t actually_read = evbuffer_remove(input, buffer, to_read);
-                    size_t written = fwrite(buffer, 1, actually_read, fp);
-                    if (written != actually_read) {
-                        secure_log("ERROR", "Failed to write file data for %s", conn->client_ip);
-                        fclose(fp);
-                        g_hash_table_remove(conn->pending_data, "upload");
-                        conn->state = CONN_STATE_AUTHENTICATED;
-                        return;
-                    }
-                    received += written;
-                    g_hash_table_insert(upload_info, "received", (gpointer)received);
-                }
+    if ((mkdir(STORAGE_DIR, 0755) == -1 && errno != EEXIST) ||
+        (mkdir(PARTIAL_DIR, 0700) == -1 && errno != EEXIST)) {
+        job->err = errno;
+        job->status = RESP_ERROR;
+        return;
+    }
 
-                // Check if upload complete
-                if (received >= filesize) {
-                    fclose(fp);
-                    char *filename = g_hash_table_lookup(upload_info, "filename");
-                    secure_log("INFO", "Upload completed: %s (%lld bytes) from %s", filename, filesize, conn->client_ip);
+    if (access(job->filepath, F_OK) == 0) {
+        job->status = RESP_PERMISSION_DENIED;
+        return;
+    }
 
-                    // Send completion response
-                    ResponseHeader resp = { .status = RESP_SUCCESS };
-                    bufferevent_write(conn->bev, &resp, sizeof(resp));
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+    if (job->offset > 0) {
+        job->checkpoint = malloc(sizeof(upload_checkpoint_t));
+        if (!job->checkpoint) {
+            job->err = ENOMEM;
+            job->status = RESP_ERROR;
+            return;
+        }
+        if (partial_load(job->partial, job->filename, job->filesize, job->file_hash, job->checkpoint) != 0 ||
+            job->checkpoint->committed != job->offset) {
+            job->status = RESP_INVALID_OFFSET;
+            return;
+        }
+    } else {
+        // Starting over: drop any saved state before the data is truncated
+        char state[PATH_MAX];
+        partial_path(state, sizeof(state), job->partial, "state");
+        unlink(state);
+        flags |= O_TRUNC;
+    }
 
-                    g_hash_table_remove(conn->pending_data, "upload");
-                    conn->state = CONN_STATE_AUTHENTICATED;
-                }
-            } else if (download_info) {
-                // Handle download - send file data
-                FILE *fp = g_hash_table_lookup(download_info, "fp");
-                long long filesize = (long long)g_hash_table_lookup(download_info, "filesize");
-                long long sent = (long long)g_hash_table_lookup(download_info, "sent");
-
-                if (!fp) {
-                    secure_log("ERROR", "No file pointer for download to %s", conn->client_ip);
-                    g_hash_table_remove(conn->pending_data, "download");
-                    conn->state = CONN_STATE_AUTHENTICATED;
-                    return;
-                }
+    char path[PATH_MAX];
+    partial_path(path, sizeof(path), job->partial, "data");
+    job->fd = open(path, flags, 0600);
+    if (job->fd == -1) {
+        job->err = errno;
+        job->status = RESP_ERROR;
+    }
+}
 
-                // Send file data in chunks
-                size_t to_send = BUFFER_SIZE;
-                if (sent + to_send > filesize) {
-                    to_send = filesize - sent;
-                }
+static void upload_open_done(void *arg) {
+    fs_job_t *job = arg;
+    connection_t *conn = job->conn;
 
-                if (to_send > 0) {
-                    char buffer[BUFFER_SIZE];
-                    size_t read_bytes = fread(buffer, 1, to_send, fp);
-                    if (read_bytes > 0) {
-                        bufferevent_write(conn->bev, buffer, read_bytes);
-                        sent += read_bytes;
-                        g_hash_table_insert(download_info, "sent", (gpointer)sent);
-                    } else {
-                        secure_log("ERROR", "Failed to read file data for %s", conn->client_ip);
-                        fclose(fp);
-                        g_hash_table_remove(conn->pending_data, "download");
-                        conn->state = CONN_STATE_AUTHENTICATED;
-                        return;
-                    }
-                }
+    if (fs_job_release(job)) {
+        if (job->fd != -1) close(job->fd);
+        partial_release(job->partial);
+        fs_job_free(job);
+        return;
+    }
 
-                // Check if download complete
-                if (sent >= filesize) {
-                    fclose(fp);
-                    char *filename = g_hash_table_lookup(download_info, "filename");
-                    secure_log("INFO", "Download completed: %s (%lld bytes) to %s", filename, filesize, conn->client_ip);
+    conn->state = CONN_STATE_AUTHENTICATED;
+    blake3_hasher *hasher = NULL;
+    if (job->status == RESP_SUCCESS && !(hasher = malloc(sizeof(blake3_hasher)))) {
+        close(job->fd);
+        job->err = ENOMEM;
+        job->status = RESP_ERROR;
+    }
+    if (job->status != RESP_SUCCESS) {
+        if (job->status == RESP_ERROR) {
+            secure_log("ERROR", "Failed to open partial upload for %s: %s", job->filepath, strerror(job->err));
+        }
+        partial_release(job->partial);
+        send_status(conn, job->status);
+        fs_job_free(job);
+        resume_input(conn);
+        return;
+    }
+
+    // OK to start the transfer; filesize tells the client where it resumes
+    ResponseHeader resp = { .status = RESP_SUCCESS, .filesize = job->offset };
+    send_response(conn, &resp);
+
+    // Set connection to transferring state
+    conn->state = CONN_STATE_TRANSFERRING;
+
+    transfer_t *t = &conn->transfer;
+    t->kind = TRANSFER_UPLOAD;
+    snprintf(t->filename, sizeof(t->filename), "%s", job->filename);
+    t->fd = job->fd;
+    t->slot = storage_io_file_register(conn->worker->io, job->fd);
+    t->filesize = job->filesize;
+    t->received = job->offset;
+    t->written = job->offset;
+    t->checkpointed = job->offset;
+    t->hasher = hasher;
+    if (job->checkpoint) {
+        *t->hasher = job->checkpoint->hasher;
+    } else {
+        blake3_hasher_init(t->hasher);
+    }
+    memcpy(t->file_hash, job->file_hash, BLAKE3_HASH_LEN);
+    snprintf(t->partial, sizeof(t->partial), "%s", job->partial);
+
+    if (job->offset > 0) {
+        secure_log("INFO", "Upload resumed: %s at %lld/%lld bytes from %s", job->filename,
+                   (long long)job->offset, job->filesize, conn->client_ip);
+    } else {
+        secure_log("INFO", "Upload initiated: %s (%lld bytes) from %s", job->filename, job->filesize, conn->client_ip);
+    }
+    fs_job_free(job);
+    resume_input(conn);
+}
+
+// Last batch is written: verify the hash and move the data to its final
+// name. link() fails on an existing name, so a file that appeared since the
+// upload started is never replaced.
+static void upload_publish(fs_job_t *job) {
+    static const uint8_t no_hash[BLAKE3_HASH_LEN];
+    char path[PATH_MAX];
+
+    if (memcmp(job->file_hash, no_hash, BLAKE3_HASH_LEN) != 0) {
+        uint8_t digest[BLAKE3_HASH_LEN];
+        blake3_hasher_finalize(job->hasher, digest, BLAKE3_HASH_LEN);
+        if (memcmp(digest, job->file_hash, BLAKE3_HASH_LEN) != 0) {
+            partial_remove(job->partial);
+            job->status = RESP_INTEGRITY_ERROR;
+            return;
+        }
+    }
+
+    partial_path(path, sizeof(path), job->partial, "data");
+    if (link(path, job->filepath) != 0) {
+        job->err = errno;
+        job->status = (errno == EEXIST) ? RESP_PERMISSION_DENIED : RESP_ERROR;
+    }
+    partial_remove(job->partial);
+}
+
+// Upload: append one batch at its file offset, then save a checkpoint or
+// publish the file if the batch asks for it (pool thread)
+static void upload_write_work(void *arg) {
+    fs_job_t *job = arg;
+    off_t off = job->offset;
+
+    // Hashed here rather than on the loop; only this job touches the hasher
+    struct evbuffer_ptr pos;
+    evbuffer_ptr_set(job->data, &pos, 0, EVBUFFER_PTR_SET);
+    for (;;) {
+        struct evbuffer_iovec vec[16];
+        int n = evbuffer_peek(job->data, -1, &pos, vec, 16);
+        if (n > 16) n = 16;
+        size_t hashed = 0;
+        for (int i = 0; i < n; i++) {
+            blake3_hasher_update(job->hasher, vec[i].iov_base, vec[i].iov_len);
+            hashed += vec[i].iov_len;
+        }
+        if (n < 16 || evbuffer_ptr_set(job->data, &pos, hashed, EVBUFFER_PTR_ADD) != 0) break;
+    }
+
+    while (evbuffer_get_length(job->data) > 0) {
+        struct evbuffer_iovec vec[16];
+        struct iovec iov[16];
+        int n = evbuffer_peek(job->data, -1, NULL, vec, 16);
+        if (n > 16) n = 16;
+        for (int i = 0; i < n; i++) {
+            iov[i].iov_base = vec[i].iov_base;
+            iov[i].iov_len = vec[i].iov_len;
+        }
+
+        ssize_t written = pwritev(job->fd, iov, n, off);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            job->err = errno;
+            job->status = RESP_ERROR;
+            return;
+        }
+        evbuffer_drain(job->data, (size_t)written);
+        off += written;
+        job->len += (size_t)written;
+    }
+
+    if (job->checkpoint) {
+        job->checkpoint->committed = off;
+        job->checkpoint->hasher = *job->hasher;
+        if (fdatasync(job->fd) != 0 || partial_save(job->partial, job->checkpoint) != 0) {
+            // Not fatal: a resume starts from the previous checkpoint
+            free(job->checkpoint);
+            job->checkpoint = NULL;
+        }
+    }
+
+    if (job->final) {
+        if (fdatasync(job->fd) != 0 || close(job->fd) != 0) {
+            job->err = errno;
+            job->status = RESP_ERROR;
+            close(job->fd);
+            job->fd = -1;
+            return;
+        }
+        job->fd = -1;
+        upload_publish(job);
+    }
+}
+
+static void upload_write_done(void *arg);
+
+// Upload: io_uring completion for a batch written from a registered buffer
+static void upload_write_io_done(void *ctx, int res) {
+    fs_job_t *job = ctx;
+
+    storage_io_buf_put(job->io, job->buf);
+    job->buf = NULL;
+
+    // storage_io reports a write as the whole length or an error; anything else is a lost write
+    if (res < 0 || (size_t)res != job->len) {
+        job->err = res < 0 ? -res : EIO;
+        job->status = RESP_ERROR;
+    }
+    upload_write_done(job);
+}
+
+static void flush_upload(connection_t *conn);
+
+static void upload_write_done(void *arg) {
+    fs_job_t *job = arg;
+    connection_t *conn = job->conn;
+
+    if (fs_job_release(job)) {
+        // The transfer was reset when the connection closed; the job holds the rest
+        storage_io_file_unregister(job->io, job->slot);
+        if (job->fd != -1) close(job->fd);
+        free(job->hasher);
+        partial_release(job->partial);
+        fs_job_free(job);
+        return;
+    }
+
+    transfer_t *t = &conn->transfer;
+    t->writing = 0;
+
+    if (job->final && job->fd == -1 && job->status != RESP_ERROR) {
+        // Every byte arrived but the file was refused; the client can carry on
+        secure_log("WARNING", "Upload rejected: %s from %s (%s)", job->filename, conn->client_ip,
+                   job->status == RESP_INTEGRITY_ERROR ? "hash mismatch" : "name taken");
+        end_upload(conn);
+        send_status(conn, job->status);
+        fs_job_free(job);
+        resume_input(conn);
+        return;
+    }
+
+    if (job->status != RESP_SUCCESS) {
+        // The client is still streaming file bytes and cannot resync
+        secure_log("ERROR", "Failed to write file data for %s: %s", conn->client_ip, strerror(job->err));
+        if (job->fd == -1) {
+            // close() itself failed on the final batch; the fd is gone already
+            t->fd = -1;
+        }
+        // The hash ran ahead of the file; resume from the last checkpoint instead
+        free(t->hasher);
+        t->hasher = NULL;
+        send_status(conn, RESP_ERROR);
+        fs_job_free(job);
+        close_connection(conn);
+        return;
+    }
+
+    t->written += (long long)job->len;
+    if (job->checkpoint) t->checkpointed = job->checkpoint->committed;
+
+    if (!job->final) {
+        fs_job_free(job);
+        bufferevent_enable(conn->bev, EV_READ);
+        flush_upload(conn);
+        return;
+    }
+
+    // Last batch is on disk under its final name
+    secure_log("INFO", "Upload completed: %s (%lld bytes) from %s", job->filename, job->filesize, conn->client_ip);
+    end_upload(conn);
+
+    // Send completion response
+    send_status(conn, RESP_SUCCESS);
+    fs_job_free(job);
+    resume_input(conn);
+}
+
+// Try to write the next batch through the worker's io_uring ring, copying
+// it into a registered buffer. Returns 0 if submitted, -1 to use the pool.
+static int flush_upload_io(connection_t *conn, fs_job_t *job) {
+    transfer_t *t = &conn->transfer;
+    storage_io_t *io = conn->worker->io;
+    uint8_t *buf = storage_io_buf_get(io);
+    if (!buf) return -1;
+
+    size_t n = evbuffer_get_length(t->pending);
+    if (n > STORAGE_IO_BUF_SIZE) n = STORAGE_IO_BUF_SIZE;
+    evbuffer_remove(t->pending, buf, n);
+
+    job->buf = buf;
+    job->len = n;
+
+    if (storage_io_write(io, job->fd, job->slot, buf, n, job->offset, upload_write_io_done, job) != 0) {
+        // Ring full: put the bytes back for the pool path
+        evbuffer_prepend(t->pending, buf, n);
+        storage_io_buf_put(io, buf);
+        job->buf = NULL;
+        job->len = 0;
+        return -1;
+    }
+    // The ring only reads buf, so hashing it alongside the write is safe
+    blake3_hasher_update(t->hasher, buf, n);
+    conn->jobs_in_flight++;
+    return 0;
+}
+
+// Hand buffered upload bytes to storage: the io_uring ring when the worker
+// has one, otherwise a pwritev job on the pool. One write per upload is in
+// flight at a time so batches land in order; meanwhile new data collects in
+// the pending buffer and reading pauses once UPLOAD_MAX_BUFFERED is reached.
+// Batches that save a checkpoint or finish the upload always use the pool,
+// since they fsync and rename.
+static void flush_upload(connection_t *conn) {
+    transfer_t *t = &conn->transfer;
+    size_t pending_len = evbuffer_get_length(t->pending);
+
+    if (t->writing) {
+        if (pending_len >= UPLOAD_MAX_BUFFERED) {
+            bufferevent_disable(conn->bev, EV_READ);
+        }
+        return;
+    }
+
+    int final = t->received >= t->filesize;
+    size_t batch = conn->worker->io ? STORAGE_IO_BUF_SIZE : UPLOAD_WRITE_BATCH;
+    if (pending_len < batch && !final) return;
+
+    fs_job_t *job = fs_job_new(conn);
+    if (!job) {
+        send_status(conn, RESP_ERROR);
+        close_connection(conn);
+        return;
+    }
+    job->fd = t->fd;
+    job->slot = t->slot;
+    job->offset = t->written;
+    job->filesize = t->filesize;
+    snprintf(job->filename, sizeof(job->filename), "%s", t->filename);
+    // Either path: if the connection closes mid-write, the job releases these
+    job->hasher = t->hasher;
+    memcpy(job->file_hash, t->file_hash, BLAKE3_HASH_LEN);
+    snprintf(job->partial, sizeof(job->partial), "%s", t->partial);
+    snprintf(job->filepath, sizeof(job->filepath), "%s/%s", STORAGE_DIR, t->filename);
+
+    int checkpoint = !final && t->written + (long long)pending_len - t->checkpointed >= UPLOAD_CHECKPOINT_BYTES;
+    if (!final && !checkpoint && flush_upload_io(conn, job) == 0) {
+        t->writing = 1;
+        return;
+    }
+
+    // Checkpoints are best effort: without memory for one, just write
+    if (checkpoint) job->checkpoint = checkpoint_new(t);
+
+    struct evbuffer *next = evbuffer_new();
+    if (!next) {
+        fs_job_free(job);
+        send_status(conn, RESP_ERROR);
+        close_connection(conn);
+        return;
+    }
+    job->data = t->pending;
+    job->final = final;
+    t->pending = next;
+
+    if (submit_fs_job(job, "upload_write", upload_write_work, upload_write_done) != 0) {
+        t->pending = job->data;
+        job->data = NULL;
+        evbuffer_free(next);
+        fs_job_free(job);
+        send_status(conn, RESP_ERROR);
+        close_connection(conn);
+        return;
+    }
+    t->writing = 1;
+}
+
+// Handle file upload
+static void handle_upload(connection_t *conn, const RequestHeader *req) {
+    if (conn->state != CONN_STATE_AUTHENTICATED) {
+        send_status(conn, RESP_AUTH_FAILED);
+        return;
+    }
+
+    // Decrypt metadata
+    char filename[FILENAME_MAX_LEN];
+    long long filesize;
+    char recipient[FINGERPRINT_LEN];
+
+    if (crypto_session_decrypt_metadata(&conn->crypto_session, &req->metadata,
+                                       filename, &filesize, recipient) != 0) {
+        secure_log("ERROR", "Failed to decrypt metadata for upload from %s", conn->client_ip);
+        send_status(conn, RESP_ENCRYPTION_ERROR);
+        return;
+    }
+
+    // Validate filename and size
+    if (strstr(filename, "..") || strchr(filename, '/') || strlen(filename) == 0 ||
+        filesize <= 0 || filesize > MAX_FILE_SIZE) {
+        send_status(conn, RESP_PERMISSION_DENIED);
+        return;
+    }
+    if (req->offset < 0 || req->offset >= filesize) {
+        send_status(conn, RESP_INVALID_OFFSET);
+        return;
+    }
+
+    // Opening the partial touches the disk: do it on the job pool
+    fs_job_t *job = fs_job_new(conn);
+    if (!job) {
+        send_status(conn, RESP_ERROR);
+        return;
+    }
+    snprintf(job->filename, sizeof(job->filename), "%s", filename);
+    snprintf(job->filepath, sizeof(job->filepath), "%s/%s", STORAGE_DIR, filename);
+    job->filesize = filesize;
+    job->offset = req->offset;
+    memcpy(job->file_hash, req->file_hash, BLAKE3_HASH_LEN);
+    partial_key(conn->fingerprint, filename, filesize, req->file_hash, job->partial);
+
+    // Another connection is still writing this partial (or the server has
+    // not yet noticed the old connection drop)
+    if (partial_claim(job->partial) != 0) {
+        fs_job_free(job);
+        send_status(conn, RESP_FAILURE);
+        return;
+    }
+
+    if (submit_fs_job(job, "upload_open", upload_open_work, upload_open_done) != 0) {
+        partial_release(job->partial);
+        fs_job_free(job);
+        send_status(conn, RESP_ERROR);
+        return;
+    }
+    conn->state = CONN_STATE_BUSY;
+}
+
+// Upload status: read the saved offset of a partial upload (pool thread)
+static void upload_status_work(void *arg) {
+    fs_job_t *job = arg;
+
+    job->checkpoint = malloc(sizeof(upload_checkpoint_t));
+    if (job->checkpoint &&
+        partial_load(job->partial, job->filename, job->filesize, job->file_hash, job->checkpoint) == 0) {
+        job->offset = job->checkpoint->committed;
+    }
+}
+
+static void upload_status_done(void *arg) {
+    fs_job_t *job = arg;
+    connection_t *conn = job->conn;
+
+    if (fs_job_release(job)) {
+        fs_job_free(job);
+        return;
+    }
+
+    conn->state = CONN_STATE_AUTHENTICATED;
+    ResponseHeader resp = { .status = RESP_SUCCESS, .filesize = job->offset };
+    send_response(conn, &resp);
+    fs_job_free(job);
+    resume_input(conn);
+}
+
+// Handle upload status: how many bytes of this upload the server already
+// holds (0 if none). The client resumes by sending CMD_UPLOAD with that offset.
+static void handle_upload_status(connection_t *conn, const RequestHeader *req) {
+    if (conn->state != CONN_STATE_AUTHENTICATED) {
+        send_status(conn, RESP_AUTH_FAILED);
+        return;
+    }
+
+    char filename[FILENAME_MAX_LEN];
+    long long filesize;
+    char recipient[FINGERPRINT_LEN];
+
+    if (crypto_session_decrypt_metadata(&conn->crypto_session, &req->metadata,
+                                       filename, &filesize, recipient) != 0) {
+        secure_log("ERROR", "Failed to decrypt metadata for upload status from %s", conn->client_ip);
+        send_status(conn, RESP_ENCRYPTION_ERROR);
+        return;
+    }
+
+    if (strstr(filename, "..") || strchr(filename, '/') || strlen(filename) == 0 ||
+        filesize <= 0 || filesize > MAX_FILE_SIZE) {
+        send_status(conn, RESP_PERMISSION_DENIED);
+        return;
+    }
+
+    fs_job_t *job = fs_job_new(conn);
+    if (!job) {
+        send_status(conn, RESP_ERROR);
+        return;
+    }
+    snprintf(job->filename, sizeof(job->filename), "%s", filename);
+    job->filesize = filesize;
+    memcpy(job->file_hash, req->file_hash, BLAKE3_HASH_LEN);
+    partial_key(conn->fingerprint, filename, filesize, req->file_hash, job->partial);
+
+    if (submit_fs_job(job, "upload_status", upload_status_work, upload_status_done) != 0) {
+        fs_job_free(job);
+        send_status(conn, RESP_ERROR);
+        return;
+    }
+    conn->state = CONN_STATE_BUSY;
+}
+
+// True when this connection's TLS records are built by the kernel, so
+// SSL_sendfile can move file pages to the socket without a userspace copy
+static int download_uses_ktls(connection_t *conn) {
+#ifdef SSL_OP_ENABLE_KTLS
+    if (!g_ktls_enabled) return 0;
+    SSL *ssl = bufferevent_openssl_get_ssl(conn->bev);
+    return ssl && BIO_get_ktls_send(SSL_get_wbio(ssl));
+#else
+    (void)conn;
+    return 0;
+#endif
+}
+
+static void sendfile_ready_cb(evutil_socket_t fd, short events, void *ctx);
+
+// Download finished normally: back to command mode, then serve anything
+// the client pipelined behind the request
+static void complete_download(connection_t *conn) {
+    finish_download(conn, 1);
+    resume_input(conn);
+}
+
+// Download: io_uring read completion; the registered buffer is handed to
+// the output by reference and returns to the ring once OpenSSL drained it
+static void download_read_done(void *ctx, int res) {
+    fs_job_t *job = ctx;
+    connection_t *conn = job->conn;
+
+    if (fs_job_release(job)) {
+        storage_io_buf_put(job->io, job->buf);
+        fs_job_free(job);
+        return;
+    }
+
+    transfer_t *t = &conn->transfer;
+    t->reading = 0;
+
+    if (res <= 0 || evbuffer_add_reference(bufferevent_get_output(conn->bev), job->buf, (size_t)res,
+                                           storage_io_buf_release, job->io) != 0) {
+        secure_log("ERROR", "Failed to read file data for %s: %s", conn->client_ip,
+                   res < 0 ? strerror(-res) : "short file");
+        storage_io_buf_put(job->io, job->buf);
+        fs_job_free(job);
+        close_connection(conn);
+        return;
+    }
+
+    t->queued = job->offset + res;
+    if (t->queued >= t->filesize) {
+        bufferevent_setwatermark(conn->bev, EV_WRITE, 0, 0);
+    }
+    fs_job_free(job);
+    pump_download(conn);
+}
+
+// Download through the worker's ring: one read of up to
+// STORAGE_IO_BUF_SIZE in flight, issued whenever the output drops to the
+// low watermark. Returns 1 when every registered buffer is held by slow
+// clients and the caller should use the mapped segment, -1 on error.
+static int pump_download_io(connection_t *conn) {
+    transfer_t *t = &conn->transfer;
+    struct evbuffer *output = bufferevent_get_output(conn->bev);
+
+    if (!t->watermark) {
+        t->watermark = 1;
+        bufferevent_setwatermark(conn->bev, EV_WRITE, DOWNLOAD_LOW_WATERMARK, 0);
+    }
+
+    size_t pending = evbuffer_get_length(output);
+    if (pending > DOWNLOAD_LOW_WATERMARK) return 0;
+    t->sent = t->queued - (long long)pending;
+
+    uint8_t *buf = storage_io_buf_get(conn->worker->io);
+    if (!buf) return 1;
+
+    long long left = t->filesize - t->queued;
+    size_t len = take_transfer_bytes(conn, (size_t)left < STORAGE_IO_BUF_SIZE ? (size_t)left : STORAGE_IO_BUF_SIZE);
+    if (len == 0) {
+        storage_io_buf_put(conn->worker->io, buf); // Parked until the caps allow more
+        return 0;
+    }
+
+    fs_job_t *job = fs_job_new(conn);
+    if (!job) {
+        storage_io_buf_put(conn->worker->io, buf);
+        return -1;
+    }
+    job->buf = buf;
+    job->fd = t->fd;
+    job->slot = t->slot;
+    job->offset = t->queued;
+    job->filesize = t->filesize;
+    job->len = len;
+
+    if (storage_io_read(job->io, job->fd, job->slot, buf, job->len, job->offset, download_read_done, job) != 0) {
+        storage_io_buf_put(job->io, buf);
+        fs_job_free(job);
+        return -1;
+    }
+    conn->jobs_in_flight++;
+    t->reading = 1;
+    return 0;
+}
+
+// Push the next part of an active download. Called once when the download
+// starts and again from write_cb / sendfile_ready_cb as the socket drains.
+static void pump_download(connection_t *conn) {
+    transfer_t *t = &conn->transfer;
+    if (t->kind != TRANSFER_DOWNLOAD) return;
+
+    struct evbuffer *output = bufferevent_get_output(conn->bev);
+
+    if (download_uses_ktls(conn)) {
+        // The response header is still queued in the bufferevent; file bytes
+        // must not overtake it. write_cb calls back in once it is flushed.
+        if (evbuffer_get_length(output) > 0) return;
+
+        SSL *ssl = bufferevent_openssl_get_ssl(conn->bev);
+        size_t remaining = (size_t)(t->filesize - t->sent);
+        size_t wanted = remaining < DOWNLOAD_BATCH ? remaining : DOWNLOAD_BATCH;
+        size_t granted = take_transfer_bytes(conn, wanted);
+        if (granted == 0) return; // Parked until the caps allow more
+        size_t budget = granted;
+        while (t->sent < t->filesize && budget > 0) {
+            size_t left = (size_t)(t->filesize - t->sent);
+            size_t want = left < budget ? left : budget;
+            ossl_ssize_t n = SSL_sendfile(ssl, t->fd, (off_t)t->sent, want, 0);
+            if (n > 0) {
+                t->sent += n;
+                budget -= (size_t)n;
+                continue;
+            }
+            if (SSL_get_error(ssl, (int)n) == SSL_ERROR_WANT_WRITE) {
+                // Bytes the socket did not take go back to the caps
+                refund_transfer_bytes(conn, budget);
+                break;
+            }
+
+            secure_log("ERROR", "SSL_sendfile failed for %s: %s", conn->client_ip,
+                       ERR_reason_error_string(ERR_get_error()));
+            // The client is mid-stream and cannot resync, so drop it
+            close_connection(conn);
+            return;
+        }
+
+        if (t->sent >= t->filesize) {
+            complete_download(conn);
+            return;
+        }
+
+        // Socket buffer full or batch used up: continue when writable so
+        // other connections on this loop get a turn in between
+        if (budget == 0 && granted < wanted) return; // Parked by take_transfer_bytes
+        if (!t->sendfile_ev) {
+            t->sendfile_ev = event_new(conn->base, bufferevent_getfd(conn->bev), EV_WRITE, sendfile_ready_cb, conn);
+        }
+        event_add(t->sendfile_ev, NULL);
+        return;
+    }
+
+    // Buffered fallback: the file is mapped once as an evbuffer segment and
+    // appended to the output in DOWNLOAD_BATCH slices, so OpenSSL encrypts
+    // straight from the page cache. The write low watermark makes write_cb
+    // fire while a quarter batch is still queued, keeping the socket busy
+    // without ever buffering more than batch + watermark per connection.
+    if (t->queued < t->filesize && conn->worker->io) {
+        if (t->reading) return;
+        int rc = pump_download_io(conn);
+        if (rc < 0) close_connection(conn);
+        if (rc <= 0) return;
+        // No registered buffer free: queue a mapped slice instead
+    }
+    if (t->queued < t->filesize) {
+        if (!t->segment) {
+            t->segment = evbuffer_file_segment_new(t->fd, t->start, t->filesize - t->start, 0);
+            if (!t->segment) {
+                secure_log("ERROR", "Failed to map file data for %s", conn->client_ip);
+                close_connection(conn);
+                return;
+            }
+            bufferevent_setwatermark(conn->bev, EV_WRITE, DOWNLOAD_LOW_WATERMARK, 0);
+        }
+
+        size_t pending = evbuffer_get_length(output);
+        if (pending > DOWNLOAD_LOW_WATERMARK) return;
+        t->sent = t->queued - (long long)pending;
+
+        long long n = t->filesize - t->queued < DOWNLOAD_BATCH ? t->filesize - t->queued : DOWNLOAD_BATCH;
+        n = (long long)take_transfer_bytes(conn, (size_t)n);
+        if (n == 0) return; // Parked until the caps allow more
+        if (evbuffer_add_file_segment(output, t->segment, t->queued - t->start, n) != 0) {
+            secure_log("ERROR", "Failed to queue file data for %s", conn->client_ip);
+            close_connection(conn);
+            return;
+        }
+        t->queued += n;
+
+        // Start reading the next slice now so OpenSSL does not fault on
+        // cold pages of the mapping while running on the loop thread
+        if (t->queued < t->filesize) {
+            posix_fadvise(t->fd, t->queued, DOWNLOAD_BATCH, POSIX_FADV_WILLNEED);
+        }
+
+        // Last slice queued: wake up only when the output is fully flushed
+        if (t->queued >= t->filesize) {
+            bufferevent_setwatermark(conn->bev, EV_WRITE, 0, 0);
+        }
+        return;
+    }
+
+    // Everything queued and the output is empty: the transfer is done
+    if (evbuffer_get_length(output) == 0) {
+        t->sent = t->filesize;
+        complete_download(conn);
+    }
+}
+
+static void sendfile_ready_cb(evutil_socket_t fd, short events, void *ctx) {
+    (void)fd;
+    (void)events;
+    pump_download(ctx);
+}
+
+// Download: open and validate the file (pool thread)
+static void download_open_work(void *arg) {
+    fs_job_t *job = arg;
+
+    job->fd = open(job->filepath, O_RDONLY | O_CLOEXEC);
+    if (job->fd == -1) {
+        job->err = errno;
+        job->status = RESP_FILE_NOT_FOUND;
+        return;
+    }
+
+    struct stat st;
+    if (fstat(job->fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        job->status = RESP_FILE_NOT_FOUND;
+        return;
+    }
+
+    job->filesize = st.st_size;
+    if (job->offset < 0 || (job->offset > 0 && job->offset >= job->filesize)) {
+        job->status = RESP_INVALID_OFFSET;
+        return;
+    }
+
+    posix_fadvise(job->fd, job->offset, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+static void download_open_done(void *arg) {
+    fs_job_t *job = arg;
+    connection_t *conn = job->conn;
+
+    if (fs_job_release(job)) {
+        if (job->fd != -1) close(job->fd);
+        fs_job_free(job);
+        return;
+    }
+
+    conn->state = CONN_STATE_AUTHENTICATED;
+    if (job->status != RESP_SUCCESS) {
+        if (job->fd != -1) close(job->fd);
+        send_status(conn, job->status);
+        fs_job_free(job);
+        resume_input(conn);
+        return;
+    }
+
+    // Send response with file size
+    ResponseHeader resp = { .status = RESP_SUCCESS, .filesize = job->filesize };
+    send_response(conn, &resp);
+
+    // Set connection to transferring state
+    conn->state = CONN_STATE_TRANSFERRING;
+
+    transfer_t *t = &conn->transfer;
+    t->kind = TRANSFER_DOWNLOAD;
+    snprintf(t->filename, sizeof(t->filename), "%s", job->filename);
+    t->fd = job->fd;
+    t->slot = storage_io_file_register(conn->worker->io, job->fd);
+    t->filesize = job->filesize;
+    t->start = job->offset;
+    t->sent = job->offset;
+    t->queued = job->offset;
+
+    secure_log("INFO", "Download initiated: %s (%lld bytes from offset %lld, %s) to %s",
+               job->filename, job->filesize, (long long)job->offset,
+               download_uses_ktls(conn) ? "kTLS sendfile" : "buffered", conn->client_ip);
+    fs_job_free(job);
+
+    pump_download(conn);
+}
+
+// Handle file download
+static void handle_download(connection_t *conn, const RequestHeader *req) {
+    if (conn->state != CONN_STATE_AUTHENTICATED) {
+        send_status(conn, RESP_AUTH_FAILED);
+        return;
+    }
+
+    // Decrypt metadata to get filename
+    char filename[FILENAME_MAX_LEN];
+    long long dummy_filesize;
+    char dummy_recipient[FINGERPRINT_LEN];
+
+    if (crypto_session_decrypt_metadata(&conn->crypto_session, &req->metadata,
+                                       filename, &dummy_filesize, dummy_recipient) != 0) {
+        secure_log("ERROR", "Failed to decrypt metadata for download from %s", conn->client_ip);
+        send_status(conn, RESP_ENCRYPTION_ERROR);
+        return;
+    }
+
+    // Validate filename
+    if (strstr(filename, "..") || strchr(filename, '/') || strlen(filename) == 0) {
+        send_status(conn, RESP_PERMISSION_DENIED);
+        return;
+    }
+
+    // open/fstat may block on the disk: do them on the job pool
+    fs_job_t *job = fs_job_new(conn);
+    if (!job) {
+        send_status(conn, RESP_ERROR);
+        return;
+    }
+    snprintf(job->filename, sizeof(job->filename), "%s", filename);
+    snprintf(job->filepath, sizeof(job->filepath), "%s/%s", STORAGE_DIR, filename);
+    job->offset = req->offset;
+
+    if (submit_fs_job(job, "download_open", download_open_work, download_open_done) != 0) {
+        fs_job_free(job);
+        send_status(conn, RESP_ERROR);
+        return;
+    }
+    conn->state = CONN_STATE_BUSY;
+}
+
+// List: scan the storage directory (pool thread)
+static void list_work(void *arg) {
+    fs_job_t *job = arg;
+
+    DIR *dir = opendir(STORAGE_DIR);
+    if (!dir) {
+        job->err = errno;
+        job->status = RESP_ERROR;
+        return;
+    }
+
+    // Collect file list
+    job->list = g_string_new("");
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_type == DT_REG) { // Regular files only
+            struct stat st;
+            char filepath[PATH_MAX];
+            snprintf(filepath, sizeof(filepath), "%s/%s", STORAGE_DIR, entry->d_name);
+
+            if (stat(filepath, &st) == 0) {
+                g_string_append_printf(job->list, "%s\t%lld\n", entry->d_name, (long long)st.st_size);
+            }
+        }
+    }
+    closedir(dir);
+}
+
+static void list_done(void *arg) {
+    fs_job_t *job = arg;
+    connection_t *conn = job->conn;
+
+    if (fs_job_release(job)) {
+        fs_job_free(job);
+        return;
+    }
+
+    conn->state = CONN_STATE_AUTHENTICATED;
+    if (job->status != RESP_SUCCESS) {
+        secure_log("ERROR", "Failed to open storage directory: %s", strerror(job->err));
+        send_status(conn, RESP_ERROR);
+    } else {
+        long long list_size = job->list->len;
+
+        // Send response with list size
+        ResponseHeader resp = { .status = RESP_SUCCESS, .filesize = list_size };
+        send_response(conn, &resp);
+
+        // Send file list data
+        if (list_size > 0) {
+            bufferevent_write(conn->bev, job->list->str, list_size);
+        }
+    }
+
+    fs_job_free(job);
+    resume_input(conn);
+}
+
+// Handle file list
+static void handle_list(connection_t *conn, const RequestHeader *req) {
+    (void)req;
+    if (conn->state != CONN_STATE_AUTHENTICATED) {
+        send_status(conn, RESP_AUTH_FAILED);
+        return;
+    }
+
+    fs_job_t *job = fs_job_new(conn);
+    if (!job) {
+        send_status(conn, RESP_ERROR);
+        return;
+    }
+    if (submit_fs_job(job, "list", list_work, list_done) != 0) {
+        fs_job_free(job);
+        send_status(conn, RESP_ERROR);
+        return;
+    }
+    conn->state = CONN_STATE_BUSY;
+}
+
+static void write_cb(struct bufferevent *bev, void *ctx);
+static void event_cb(struct bufferevent *bev, short events, void *ctx);
+
+// A stream the client closed is released once its last response has been
+// framed and nothing is left in flight
+static void stream_check_done(connection_t *stream) {
+    if (!stream->parent || !stream->stream_closing) return;
+    if (stream->state != CONN_STATE_AUTHENTICATED || stream->jobs_in_flight > 0) return;
+    if (evbuffer_get_length(bufferevent_get_input(stream->bev)) > 0 ||
+        evbuffer_get_length(bufferevent_get_output(stream->bev)) > 0 ||
+        evbuffer_get_length(bufferevent_get_input(stream->mux_end)) > 0 ||
+        evbuffer_get_length(bufferevent_get_output(stream->mux_end)) > 0) {
+        return;
+    }
+
+    mux_write_frame(stream->parent, stream->stream_id, FRAME_CLOSE, NULL, 0);
+    stream_detach(stream, 0);
+    close_connection(stream);
+}
+
+// Frame stream output round robin, at most FRAME_MAX_PAYLOAD per stream per
+// turn, so transfers on one connection interleave instead of queueing
+static void mux_flush(connection_t *conn) {
+    mux_t *mux = conn->mux;
+    struct evbuffer *out = bufferevent_get_output(conn->bev);
+
+    int idle = 0; // Slots in a row with nothing to send
+    while (evbuffer_get_length(out) < MUX_OUTPUT_HIGH && idle < MUX_MAX_STREAMS) {
+        connection_t *stream = mux->streams[mux->cursor];
+        mux->cursor = (mux->cursor + 1) % MUX_MAX_STREAMS;
+
+        struct evbuffer *src = stream ? bufferevent_get_input(stream->mux_end) : NULL;
+        size_t len = src ? evbuffer_get_length(src) : 0;
+        if (len == 0) {
+            idle++;
+            continue;
+        }
+        idle = 0;
+        if (len > FRAME_MAX_PAYLOAD) len = FRAME_MAX_PAYLOAD;
+        mux_write_frame(conn, stream->stream_id, FRAME_DATA, src, len);
+    }
+
+    for (int i = 0; i < MUX_MAX_STREAMS && conn->mux; i++) {
+        if (conn->mux->streams[i]) stream_check_done(conn->mux->streams[i]);
+    }
+}
+
+// Stream produced output
+static void mux_end_read_cb(struct bufferevent *bev, void *ctx) {
+    connection_t *stream = ctx;
+    (void)bev;
+    if (stream->parent) mux_flush(stream->parent);
+}
+
+// Stream consumed input: resume reading frames if its window had filled
+static void mux_end_write_cb(struct bufferevent *bev, void *ctx) {
+    connection_t *stream = ctx;
+    connection_t *conn = stream->parent;
+    if (!conn || conn->mux->paused_by != stream) return;
+    if (evbuffer_get_length(bufferevent_get_output(bev)) > MUX_STREAM_WINDOW) return;
+
+    conn->mux->paused_by = NULL;
+    bufferevent_enable(conn->bev, EV_READ);
+    bufferevent_trigger(conn->bev, EV_READ, BEV_OPT_DEFER_CALLBACKS);
+}
+
+// New stream: an authenticated connection of its own that shares the
+// parent's session, identity and connection slot
+static connection_t *stream_open(connection_t *conn, uint32_t stream_id) {
+    mux_t *mux = conn->mux;
+    if (mux->count >= MUX_MAX_STREAMS) return NULL;
+
+    connection_t *stream = conn_alloc(conn->worker);
+    if (!stream) return NULL;
+
+    struct bufferevent *pair[2];
+    if (bufferevent_pair_new(conn->base, BEV_OPT_CLOSE_ON_FREE | BEV_OPT_DEFER_CALLBACKS, pair) != 0) {
+        conn_free(stream);
+        return NULL;
+    }
+
+    stream->bev = pair[0];
+    stream->mux_end = pair[1];
+    stream->base = conn->base;
+    stream->crypto_session = conn->crypto_session;
+    memcpy(stream->client_ip, conn->client_ip, sizeof(stream->client_ip));
+    stream->ip_key = conn->ip_key;
+    memcpy(stream->fingerprint, conn->fingerprint, sizeof(stream->fingerprint));
+    memcpy(stream->session_key_hex, conn->session_key_hex, sizeof(stream->session_key_hex));
+    memcpy(stream->fp_key, conn->fp_key, sizeof(stream->fp_key));
+    stream->has_fp = conn->has_fp;
+    stream->connected_at = time(NULL);
+    stream->state = CONN_STATE_AUTHENTICATED;
+    stream->parent = conn;
+    stream->stream_id = stream_id;
+    stream->compact = conn->compact;
+
+    // Read high watermarks bound what each side of the pair buffers; once
+    // the stream's input is full, DATA piles up on the parent's end and
+    // mux_read() stops reading the socket
+    bufferevent_setcb(pair[0], read_cb, write_cb, event_cb, stream);
+    bufferevent_setwatermark(pair[0], EV_READ, 0, MUX_STREAM_WINDOW);
+    bufferevent_enable(pair[0], EV_READ | EV_WRITE);
+    bufferevent_setcb(pair[1], mux_end_read_cb, mux_end_write_cb, NULL, stream);
+    bufferevent_setwatermark(pair[1], EV_READ, 0, MUX_STREAM_WINDOW);
+    bufferevent_setwatermark(pair[1], EV_WRITE, MUX_STREAM_WINDOW / 2, 0);
+    bufferevent_enable(pair[1], EV_READ | EV_WRITE);
+
+    for (int i = 0; i < MUX_MAX_STREAMS; i++) {
+        if (!mux->streams[i]) {
+            mux->streams[i] = stream;
+            break;
+        }
+    }
+    mux->count++;
+    mux->last_id = stream_id;
+    return stream;
+}
+
+static connection_t *mux_find(mux_t *mux, uint32_t stream_id) {
+    for (int i = 0; i < MUX_MAX_STREAMS; i++) {
+        if (mux->streams[i] && mux->streams[i]->stream_id == stream_id) return mux->streams[i];
+    }
+    return NULL;
+}
 
-                    g_hash_table_remove(conn->pending_data, "download");
-                    conn->state = CONN_STATE_AUTHENTICATED;
+// Apply one complete frame whose header has been drained. Returns -1 on a
+// protocol violation, which closes the whole connection.
+static int mux_frame(connection_t *conn, const FrameHeader *hdr) {
+    mux_t *mux = conn->mux;
+    struct evbuffer *input = bufferevent_get_input(conn->bev);
+    connection_t *stream = mux_find(mux, hdr->stream_id);
+
+    switch (hdr->type) {
+        case FRAME_DATA: {
+            if (!stream && hdr->stream_id <= mux->last_id) {
+                // Closed or refused stream; the client has not seen that yet
+                evbuffer_drain(input, hdr->length);
+                return 0;
+            }
+            if (!stream) {
+                stream = stream_open(conn, hdr->stream_id);
+                if (!stream) {
+                    mux->last_id = hdr->stream_id;
+                    evbuffer_drain(input, hdr->length);
+                    mux_write_frame(conn, hdr->stream_id, FRAME_RESET, NULL, 0);
+                    secure_log("WARNING", "Refused stream %u from %s", hdr->stream_id, conn->client_ip);
+                    return 0;
                 }
-            } else {
-                secure_log("ERROR", "No transfer info found for transferring connection %s", conn->client_ip);
-                evbuffer_drain(input, len);
+            } else if (stream->stream_closing) {
+                return -1;
             }
-            break;
+
+            struct evbuffer *dst = bufferevent_get_output(stream->mux_end);
+            evbuffer_remove_buffer(input, dst, hdr->length);
+            if (evbuffer_get_length(dst) > MUX_STREAM_WINDOW) {
+                mux->paused_by = stream;
+                bufferevent_disable(conn->bev, EV_READ);
+            }
+            return 0;
         }
+        case FRAME_CLOSE:
+            if (stream) {
+                stream->stream_closing = 1;
+                stream_check_done(stream);
+            }
+            return 0;
+        case FRAME_RESET:
+            if (stream) {
+                stream_detach(stream, 0);
+                close_connection(stream);
+            }
+            return 0;
         default:
-            // Drain buffer to prevent accumulation
-            evbuffer_drain(input, len);
+            return -1;
+    }
+}
+
+// Demultiplex the complete frames in the input to their streams, up to
+// READ_BATCH_MAX per call
+static void mux_read(connection_t *conn) {
+    struct evbuffer *input = bufferevent_get_input(conn->bev);
+
+    for (int handled = 0; conn->mux && !conn->mux->paused_by; handled++) {
+        if (evbuffer_get_length(input) < FRAME_HEADER_LEN) return;
+        if (handled == READ_BATCH_MAX) {
+            bufferevent_trigger(conn->bev, EV_READ, BEV_OPT_DEFER_CALLBACKS);
+            return;
+        }
+
+        FrameHeader hdr;
+        if (frame_header_unpack(evbuffer_pullup(input, FRAME_HEADER_LEN), &hdr) != 0) {
+            secure_log("ERROR", "Malformed frame from %s", conn->client_ip);
+            close_connection(conn);
+            return;
+        }
+        if (evbuffer_get_length(input) < FRAME_HEADER_LEN + (size_t)hdr.length) return;
+
+        evbuffer_drain(input, FRAME_HEADER_LEN);
+        if (mux_frame(conn, &hdr) != 0) {
+            secure_log("ERROR", "Protocol violation on stream %u from %s", hdr.stream_id, conn->client_ip);
+            close_connection(conn);
+            return;
+        }
+    }
+}
+
+// Version negotiation: reply with the highest version both sides speak.
+// Everything after a v2 or v3 reply is framed, in both directions.
+static void handle_hello(connection_t *conn, const RequestHeader *req) {
+    if (conn->state != CONN_STATE_AUTHENTICATED || conn->stream_id != 0) {
+        send_status(conn, RESP_ERROR);
+        return;
+    }
+
+    long long version = req->offset < PROTOCOL_VERSION_MAX ? req->offset : PROTOCOL_VERSION_MAX;
+    if (version < PROTOCOL_VERSION_1) version = PROTOCOL_VERSION_1;
+    if (version >= PROTOCOL_VERSION_FRAMED && !(conn->mux = calloc(1, sizeof(mux_t)))) {
+        version = PROTOCOL_VERSION_1;
+    }
+
+    ResponseHeader resp = { .status = RESP_SUCCESS, .filesize = version };
+    send_response(conn, &resp);
+    if (!conn->mux) return;
+
+    // read_cb() goes on with any frames pipelined behind the request
+    conn->state = CONN_STATE_MUX;
+    conn->compact = version >= PROTOCOL_VERSION_COMPACT;
+    bufferevent_setwatermark(conn->bev, EV_WRITE, MUX_OUTPUT_HIGH / 2, 0);
+    secure_log("INFO", "Protocol v%lld negotiated with %s", version, conn->client_ip);
+}
+
+// Main request handler
+static void handle_request(connection_t *conn, const RequestHeader *req) {
+    // Rate limiting check
+    if (check_rate_limit(conn)) {
+        ResponseHeader resp = { .status = RESP_RATE_LIMITED };
+        send_response(conn, &resp);
+        return;
+    }
+
+    switch (req->command) {
+        case CMD_ECDH_INIT:
+            handle_ecdh_init(conn, (const ECDHInitPacket*)req);
+            break;
+        case CMD_SESSION_KEY:
+            handle_session_key(conn, (const SessionKeyPacket*)req);
+            break;
+        case CMD_UPLOAD:
+            handle_upload(conn, req);
+            break;
+        case CMD_UPLOAD_STATUS:
+            handle_upload_status(conn, req);
             break;
+        case CMD_DOWNLOAD:
+            handle_download(conn, req);
+            break;
+        case CMD_LIST:
+            handle_list(conn, req);
+            break;
+        case CMD_HELLO:
+            handle_hello(conn, req);
+            break;
+        case CMD_PING:
+            // Keep-alive
+            ResponseHeader resp = { .status = RESP_SUCCESS };
+            send_response(conn, &resp);
+            break;
+        default: {
+            ResponseHeader resp = { .status = RESP_UNKNOWN_COMMAND };
+            send_response(conn, &resp);
+            break;
+        }
+    }
+}
+
+// Contiguous view of the first `len` input bytes: in place when the buffer
+// happens to be aligned for the packet type (the usual case), else copied
+static const void *peek_packet(struct evbuffer *input, size_t len, size_t align, void *copy) {
+    const unsigned char *p = evbuffer_pullup(input, (ev_ssize_t)len);
+    if (!p || ((uintptr_t)p & (align - 1)) == 0) return p;
+    memcpy(copy, p, len);
+    return copy;
+}
+
+// Buffer event callbacks. Every complete packet in the input is handled,
+// up to READ_BATCH_MAX per callback; a deferred read picks up the rest so a
+// pipelining client cannot starve the others on this worker.
+static void read_cb(struct bufferevent *bev, void *ctx) {
+    connection_t *conn = ctx;
+    struct evbuffer *input = bufferevent_get_input(bev);
+
+    for (int handled = 0; ; handled++) {
+        size_t len = evbuffer_get_length(input);
+        size_t consumed = 0;
+        if (len == 0) return;
+        if (handled == READ_BATCH_MAX) {
+            bufferevent_trigger(bev, EV_READ, BEV_OPT_DEFER_CALLBACKS);
+            return;
+        }
+
+        // Handlers read the packet in place; it is drained once they return
+        switch (conn->state) {
+            case CONN_STATE_ECDH_INIT: {
+                ECDHInitPacket copy;
+                if (len < sizeof(copy)) return;
+                handle_ecdh_init(conn, peek_packet(input, sizeof(copy), _Alignof(ECDHInitPacket), &copy));
+                consumed = sizeof(copy);
+                break;
+            }
+            case CONN_STATE_ECDH_RESPONSE: {
+                SessionKeyPacket copy;
+                if (len < sizeof(copy)) return;
+                handle_session_key(conn, peek_packet(input, sizeof(copy), _Alignof(SessionKeyPacket), &copy));
+                consumed = sizeof(copy);
+                break;
+            }
+            case CONN_STATE_AUTHENTICATED: {
+                RequestHeader copy;
+                if (conn->compact) {
+                    // Decoded from its varint form; the message may not be complete yet
+                    size_t avail = len < WIRE_MAX_MESSAGE ? len : WIRE_MAX_MESSAGE;
+                    ssize_t n = wire_decode_request(evbuffer_pullup(input, (ev_ssize_t)avail), avail, &copy);
+                    if (n == 0) return;
+                    if (n < 0) {
+                        secure_log("ERROR", "Malformed request from %s", conn->client_ip);
+                        close_connection(conn);
+                        return;
+                    }
+                    handle_request(conn, &copy);
+                    consumed = (size_t)n;
+                    break;
+                }
+                if (len < sizeof(copy)) return;
+                handle_request(conn, peek_packet(input, sizeof(copy), _Alignof(RequestHeader), &copy));
+                consumed = sizeof(copy);
+                break;
+            }
+            case CONN_STATE_TRANSFERRING: {
+                transfer_t *t = &conn->transfer;
+
+                if (t->kind == TRANSFER_UPLOAD) {
+                    // Move file bytes into the pending batch; flush_upload writes them out
+                    size_t to_read = len;
+                    if (t->received + (long long)to_read > t->filesize) {
+                        to_read = t->filesize - t->received;
+                    }
+
+                    // Less than to_read means a cap ran dry and reading is paused
+                    size_t granted = to_read > 0 ? take_transfer_bytes(conn, to_read) : 0;
+                    if (granted > 0) {
+                        evbuffer_remove_buffer(input, t->pending, granted);
+                        t->received += granted;
+                    }
+
+                    flush_upload(conn);
+                } else if (t->kind == TRANSFER_DOWNLOAD) {
+                    // Downloads are driven by write_cb; leave any early input
+                    // (e.g. a pipelined request) queued until the transfer ends
+                    return;
+                } else {
+                    secure_log("ERROR", "No transfer info found for transferring connection %s", conn->client_ip);
+                    evbuffer_drain(input, len);
+                }
+                return;
+            }
+            case CONN_STATE_BUSY:
+                // resume_input() picks this up when the pending job completes
+                return;
+            case CONN_STATE_MUX:
+                mux_read(conn);
+                return;
+            default:
+                // Drain buffer to prevent accumulation
+                evbuffer_drain(input, len);
+                return;
+        }
+
+        if (conn->bev != bev) return; // The handler closed the connection
+        evbuffer_drain(input, consumed);
+    }
+}
+
+// Identify the client by its certificate for per-certificate caps
+static void set_peer_fingerprint(connection_t *conn) {
+    SSL *ssl = bufferevent_openssl_get_ssl(conn->bev);
+    X509 *cert = ssl ? SSL_get_peer_certificate(ssl) : NULL;
+    if (!cert) return;
+
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_len = 0;
+    if (X509_digest(cert, EVP_sha256(), digest, &digest_len) == 1 && digest_len >= RATE_LIMITER_KEY_LEN) {
+        sodium_bin2hex(conn->fingerprint, sizeof(conn->fingerprint), digest, digest_len);
+        memcpy(conn->fp_key, digest, RATE_LIMITER_KEY_LEN);
+        conn->has_fp = 1;
     }
+    X509_free(cert);
 }
 
 static void event_cb(struct bufferevent *bev, short events, void *ctx) {
     connection_t *conn = ctx;
 
+    // TLS handshake finished; the connection stays open
+    if (events & BEV_EVENT_CONNECTED) {
+        SSL *ssl = bufferevent_openssl_get_ssl(bev);
+        if (ssl) tls_session_count(ssl);
+        set_peer_fingerprint(conn);
+        return;
+    }
+
     if (events & BEV_EVENT_EOF) {
         secure_log("INFO", "Connection closed by %s", conn->client_ip);
     } else if (events & BEV_EVENT_ERROR) {
@@ -680,27 +2437,38 @@ static void event_cb(struct bufferevent *bev, short events, void *ctx) {
         secure_log("INFO", "Connection timeout for %s", conn->client_ip);
     }
 
-    // Cleanup connection
-    crypto_session_cleanup(&conn->crypto_session);
-    if (conn->pending_data) {
-        g_hash_table_destroy(conn->pending_data);
+    close_connection(conn);
+}
+
+// Output drained to the low watermark: keep an active download moving
+static void write_cb(struct bufferevent *bev, void *ctx) {
+    connection_t *conn = ctx;
+    (void)bev;
+
+    if (conn->state == CONN_STATE_TRANSFERRING &&
+        conn->transfer.kind == TRANSFER_DOWNLOAD) {
+        pump_download(conn);
+    } else if (conn->state == CONN_STATE_MUX) {
+        mux_flush(conn);
     }
-    bufferevent_free(bev);
-    g_hash_table_remove(g_connections, conn);
-    free(conn);
+    if (conn->bev && conn->parent) stream_check_done(conn);
 }
 
 // Accept callback
 static void accept_cb(struct evconnlistener *listener, evutil_socket_t fd,
                      struct sockaddr *sa, int socklen, void *ctx) {
-    struct event_base *base = ctx;
-    struct sockaddr_in *sin = (struct sockaddr_in *)sa;
+    worker_t *worker = ctx;
+    struct event_base *base = worker->base;
 
-    // Check connection limits
-    char ip[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &sin->sin_addr, ip, sizeof(ip));
+    char ip[INET6_ADDRSTRLEN];
+    ip_key_t key;
+    if (ip_key_from_sockaddr(sa, &key, ip, sizeof(ip)) != 0) {
+        close(fd);
+        return;
+    }
 
-    if (check_connection_limit(ip)) {
+    // Check connection limits
+    if (acquire_connection_slot(&key)) {
         close(fd);
         secure_log("WARNING", "Connection limit exceeded for %s", ip);
         return;
@@ -712,14 +2480,16 @@ static void accept_cb(struct evconnlistener *listener, evutil_socket_t fd,
 
     if (!bev) {
         close(fd);
+        release_connection_slot(&key);
         secure_log("ERROR", "Failed to create bufferevent for %s", ip);
         return;
     }
 
     // Create connection context
-    connection_t *conn = calloc(1, sizeof(connection_t));
+    connection_t *conn = conn_alloc(worker);
     if (!conn) {
         bufferevent_free(bev);
+        release_connection_slot(&key);
         secure_log("ERROR", "Failed to allocate connection context for %s", ip);
         return;
     }
@@ -727,36 +2497,292 @@ static void accept_cb(struct evconnlistener *listener, evutil_socket_t fd,
     conn->bev = bev;
     conn->base = base;
     strcpy(conn->client_ip, ip);
+    conn->ip_key = key;
+    token_bucket_init(&conn->bandwidth, (double)g_conn_rate,
+                      (double)(g_conn_rate > THROTTLE_CHUNK ? g_conn_rate : THROTTLE_CHUNK), coarse_now_ms());
     conn->connected_at = time(NULL);
     conn->state = CONN_STATE_ECDH_INIT;
-    conn->pending_data = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_hash_table_destroy);
 
     // Set callbacks
-    bufferevent_setcb(bev, read_cb, NULL, event_cb, conn);
+    bufferevent_setcb(bev, read_cb, write_cb, event_cb, conn);
     bufferevent_enable(bev, EV_READ | EV_WRITE);
     bufferevent_set_timeouts(bev, NULL, NULL); // No timeouts for now
 
     // Add to connections table
-    g_hash_table_insert(g_connections, conn, conn);
+    g_hash_table_insert(worker->connections, conn, conn);
 
-    secure_log("INFO", "New connection from %s", ip);
+    secure_log("INFO", "New connection from %s (worker %d)", ip, worker->index);
 }
 
-// Signal handler
+// Signal handler (main thread): stop every worker loop, then the main loop
 static void signal_cb(evutil_socket_t sig, short events, void *ctx) {
     struct event_base *base = ctx;
     secure_log("INFO", "Received signal %d, shutting down", sig);
     g_shutdown = 1;
+    for (int i = 0; i < g_num_workers; i++) {
+        if (g_workers[i].base) event_base_loopexit(g_workers[i].base, NULL);
+    }
     event_base_loopexit(base, NULL);
 }
 
+// Job pool hook: runs on a pool thread for jobs above JOB_POOL_SLOW_US
+static void log_slow_job(const char *name, uint64_t queue_wait_us, uint64_t run_us) {
+    secure_log("WARNING", "Slow %s job: queued %llu us, ran %llu us", name,
+               (unsigned long long)queue_wait_us, (unsigned long long)run_us);
+}
+
+static void log_job_stats(void) {
+    job_pool_stats_t st;
+    job_pool_get_stats(g_job_pool, &st);
+    uint64_t n = st.completed ? st.completed : 1;
+    secure_log("INFO", "Job pool: %llu submitted, %llu done, wait avg/max %llu/%llu us, "
+               "run avg/max %llu/%llu us, %llu slow",
+               (unsigned long long)st.submitted, (unsigned long long)st.completed,
+               (unsigned long long)(st.queue_wait_us_total / n), (unsigned long long)st.queue_wait_us_max,
+               (unsigned long long)(st.run_us_total / n), (unsigned long long)st.run_us_max,
+               (unsigned long long)st.slow_jobs);
+}
+
+static void log_tls_stats(void) {
+    tls_session_stats_t st;
+    tls_session_get_stats(&st);
+    secure_log("INFO", "TLS: %llu handshakes, %llu resumed (%.1f%%), %llu ticket keys",
+               (unsigned long long)st.handshakes, (unsigned long long)st.resumed,
+               st.handshakes ? 100.0 * (double)st.resumed / (double)st.handshakes : 0.0,
+               (unsigned long long)st.key_rotations);
+}
+
+static void stats_cb(evutil_socket_t fd, short events, void *ctx) {
+    (void)fd;
+    (void)events;
+    (void)ctx;
+    log_job_stats();
+    log_tls_stats();
+}
+
+// Delete partial uploads nobody has touched for PARTIAL_TTL_SEC (pool thread).
+// Claiming each key first keeps the sweeper away from uploads in progress.
+static void partial_sweep_work(void *arg) {
+    int *removed = arg;
+    static const char *const suffixes[] = { "data", "state", "state.tmp" };
+
+    DIR *dir = opendir(PARTIAL_DIR);
+    if (!dir) return;
+
+    time_t now = time(NULL);
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char *dot = strchr(entry->d_name, '.');
+        if (!dot || dot - entry->d_name != PARTIAL_KEY_LEN) continue;
+
+        char key[PARTIAL_KEY_LEN + 1];
+        memcpy(key, entry->d_name, PARTIAL_KEY_LEN);
+        key[PARTIAL_KEY_LEN] = '\0';
+        if (partial_claim(key) != 0) continue;
+
+        // A key's files are judged together by the newest of them
+        time_t newest = 0;
+        for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+            char path[PATH_MAX];
+            struct stat st;
+            partial_path(path, sizeof(path), key, suffixes[i]);
+            if (stat(path, &st) == 0 && st.st_mtime > newest) newest = st.st_mtime;
+        }
+        if (newest != 0 && now - newest > PARTIAL_TTL_SEC) {
+            partial_remove(key);
+            (*removed)++;
+        }
+        partial_release(key);
+    }
+    closedir(dir);
+}
+
+static void partial_sweep_done(void *arg) {
+    int *removed = arg;
+    if (*removed > 0) {
+        secure_log("INFO", "Expired %d stale partial upload(s)", *removed);
+    }
+    free(removed);
+}
+
+static void partial_sweep_cb(evutil_socket_t fd, short events, void *ctx) {
+    (void)fd;
+    (void)events;
+    (void)ctx;
+
+    int *removed = calloc(1, sizeof(int));
+    if (!removed) return;
+    if (job_pool_submit(g_job_pool, g_event_base, "partial_sweep", partial_sweep_work,
+                        partial_sweep_done, removed) != 0) {
+        free(removed);
+    }
+}
+
+// Drop token buckets of clients that have been idle long enough to refill
+static void sweep_cb(evutil_socket_t fd, short events, void *ctx) {
+    worker_t *worker = ctx;
+    (void)fd;
+    (void)events;
+    uint64_t now = coarse_now_ms();
+    rate_limiter_expire(worker->limiter, now);
+    if (worker->fp_limiter) rate_limiter_expire(worker->fp_limiter, now);
+}
+
+static void *worker_main(void *arg) {
+    worker_t *worker = arg;
+    event_base_dispatch(worker->base);
+    return NULL;
+}
+
+// Listening socket on port: dual-stack [::] so IPv6 and IPv4 clients share it,
+// or plain IPv4 when the kernel has no IPv6. Returns -1 on failure.
+static evutil_socket_t bind_listen_socket(int port, int reuse_port) {
+    struct sockaddr_in6 sin6;
+    memset(&sin6, 0, sizeof(sin6));
+    sin6.sin6_family = AF_INET6;
+    sin6.sin6_addr = in6addr_any;
+    sin6.sin6_port = htons(port);
+
+    struct sockaddr_in sin;
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_ANY);
+    sin.sin_port = htons(port);
+
+    const struct sockaddr *addr = (const struct sockaddr *)&sin6;
+    socklen_t addr_len = sizeof(sin6);
+    evutil_socket_t fd = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd >= 0) {
+        // Do not depend on net.ipv6.bindv6only
+        int off = 0;
+        if (setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off)) != 0) {
+            close(fd);
+            return -1;
+        }
+    } else if (errno == EAFNOSUPPORT) {
+        addr = (const struct sockaddr *)&sin;
+        addr_len = sizeof(sin);
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    }
+    if (fd < 0) return -1;
+
+    int on = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0 ||
+        (reuse_port && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0) ||
+        bind(fd, addr, addr_len) != 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+// Create a worker's loop and listener. With more than one worker every
+// listener binds the same port with SO_REUSEPORT and the kernel spreads
+// incoming connections across them.
+static int worker_init(worker_t *worker, int index, int port) {
+    worker->index = index;
+    worker->base = event_base_new();
+    if (!worker->base) {
+        secure_log("ERROR", "Failed to create event base for worker %d", index);
+        return -1;
+    }
+
+    // Optional: without a ring, file I/O stays on the job pool
+    worker->io = storage_io_new(worker->base);
+    if (index == 0) {
+        secure_log("INFO", "File I/O backend: %s", worker->io ? "io_uring" : "job pool");
+    }
+
+    worker->connections = g_hash_table_new(g_direct_hash, g_direct_equal);
+    rate_limiter_config_t limits = {
+        .request_rate = (double)MAX_REQUESTS_PER_WINDOW / RATE_LIMIT_WINDOW_SEC,
+        .request_burst = MAX_REQUESTS_PER_WINDOW,
+        .byte_rate = (double)g_byte_rate,
+        .byte_burst = (double)(g_byte_rate > THROTTLE_CHUNK ? g_byte_rate : THROTTLE_CHUNK),
+        .capacity = RATE_LIMIT_TABLE_SIZE,
+    };
+    worker->limiter = rate_limiter_new(&limits);
+    if (worker->limiter && g_fp_rate > 0) {
+        rate_limiter_config_t fp_limits = limits;
+        fp_limits.byte_rate = (double)g_fp_rate;
+        fp_limits.byte_burst = (double)(g_fp_rate > THROTTLE_CHUNK ? g_fp_rate : THROTTLE_CHUNK);
+        worker->fp_limiter = rate_limiter_new(&fp_limits);
+        if (!worker->fp_limiter) {
+            secure_log("ERROR", "Failed to set up certificate limits for worker %d", index);
+            return -1;
+        }
+    }
+    worker->sweep_ev = event_new(worker->base, -1, EV_PERSIST, sweep_cb, worker);
+    struct timeval sweep_interval = { RATE_LIMIT_SWEEP_SEC, 0 };
+    if (!worker->limiter || !worker->sweep_ev || event_add(worker->sweep_ev, &sweep_interval) != 0) {
+        secure_log("ERROR", "Failed to set up rate limiting for worker %d", index);
+        return -1;
+    }
+
+    // Global cap: downloads take turns through deficit round robin, so small
+    // files are not stuck behind large ones when the budget is short
+    drr_init(&worker->sched, SCHED_QUANTUM, sched_send);
+    if (g_global_rate > 0) {
+        struct timeval tick = { 0, SCHED_TICK_MS * 1000 };
+        worker->sched_last_ms = coarse_now_ms();
+        worker->sched_ev = event_new(worker->base, -1, EV_PERSIST, sched_tick_cb, worker);
+        if (!worker->sched_ev || event_add(worker->sched_ev, &tick) != 0) {
+            secure_log("ERROR", "Failed to start download scheduler for worker %d", index);
+            return -1;
+        }
+    }
+
+    evutil_socket_t fd = bind_listen_socket(port, g_num_workers > 1);
+    if (fd < 0) {
+        secure_log("ERROR", "Failed to bind port %d for worker %d: %s", port, index, strerror(errno));
+        return -1;
+    }
+    worker->listener = evconnlistener_new(worker->base, accept_cb, worker, LEV_OPT_CLOSE_ON_FREE, -1, fd);
+    if (!worker->listener) {
+        close(fd);
+        secure_log("ERROR", "Failed to create listener for worker %d: %s", index,
+                   evutil_socket_error_to_string(EVUTIL_SOCKET_ERROR()));
+        return -1;
+    }
+    return 0;
+}
+
+// Called after the worker thread has been joined
+static void worker_cleanup(worker_t *worker) {
+    if (worker->connections) {
+        GList *conns = g_hash_table_get_keys(worker->connections);
+        for (GList *l = conns; l; l = l->next) {
+            close_connection(l->data);
+        }
+        g_list_free(conns);
+        g_hash_table_destroy(worker->connections);
+    }
+    if (worker->sweep_ev) event_free(worker->sweep_ev);
+    if (worker->sched_ev) event_free(worker->sched_ev);
+    rate_limiter_free(worker->limiter);
+    rate_limiter_free(worker->fp_limiter);
+    while (worker->slabs) {
+        conn_slab_t *slab = worker->slabs;
+        worker->slabs = slab->next;
+        for (int i = 0; i < CONN_SLAB_SIZE; i++) {
+            if (slab->conns[i].transfer.pending) evbuffer_free(slab->conns[i].transfer.pending);
+        }
+        free(slab);
+    }
+    if (worker->listener) evconnlistener_free(worker->listener);
+    storage_io_free(worker->io);
+    if (worker->base) event_base_free(worker->base);
+}
+
 // Main function
 int main(int argc, char *argv[]) {
     int port = DEFAULT_PORT;
 
     // Parse arguments with getopt
     int opt;
-    while ((opt = getopt(argc, argv, "p:")) != -1) {
+    while ((opt = getopt(argc, argv, "p:kt:j:b:c:f:B:")) != -1) {
         switch (opt) {
             case 'p':
                 port = atoi(optarg);
@@ -765,8 +2791,42 @@ int main(int argc, char *argv[]) {
                     return EXIT_FAILURE;
                 }
                 break;
+            case 'k':
+                g_ktls_enabled = 1;
+                break;
+            case 't':
+                g_num_workers = atoi(optarg);
+                if (g_num_workers <= 0 || g_num_workers > MAX_WORKER_THREADS) {
+                    fprintf(stderr, "Invalid thread count: %s (1-%d)\n", optarg, MAX_WORKER_THREADS);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'j':
+                g_num_io_threads = atoi(optarg);
+                if (g_num_io_threads <= 0 || g_num_io_threads > MAX_WORKER_THREADS) {
+                    fprintf(stderr, "Invalid I/O thread count: %s (1-%d)\n", optarg, MAX_WORKER_THREADS);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'b':
+            case 'c':
+            case 'f':
+            case 'B': {
+                long long rate = atoll(optarg);
+                if (rate < 0) {
+                    fprintf(stderr, "Invalid byte rate: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                if (opt == 'b') g_byte_rate = rate;
+                else if (opt == 'c') g_conn_rate = rate;
+                else if (opt == 'f') g_fp_rate = rate;
+                else g_global_rate = rate;
+                break;
+            }
             default:
-                fprintf(stderr, "Usage: %s [-p port]\n", argv[0]);
+                fprintf(stderr, "Usage: %s [-p port] [-k] [-t threads] [-j io_threads] [-b bytes_per_sec]\n"
+                        "       [-c conn_bytes_per_sec] [-f cert_bytes_per_sec] [-B total_download_bytes_per_sec]\n",
+                        argv[0]);
                 return EXIT_FAILURE;
         }
     }
@@ -777,6 +2837,12 @@ int main(int argc, char *argv[]) {
         return EXIT_FAILURE;
     }
 
+    // Workers are stopped from the main thread, so libevent needs locking
+    if (evthread_use_pthreads() != 0) {
+        fprintf(stderr, "Failed to enable libevent threading\n");
+        return EXIT_FAILURE;
+    }
+
     // Initialize event base
     g_event_base = event_base_new();
     if (!g_event_base) {
@@ -795,9 +2861,15 @@ int main(int argc, char *argv[]) {
         return EXIT_FAILURE;
     }
 
-    // Initialize hash tables
-    g_connections = g_hash_table_new(g_direct_hash, g_direct_equal);
-    g_rate_limits = g_hash_table_new(g_int_hash, g_int_equal);
+    g_conn_counts = g_hash_table_new_full(ip_key_hash, ip_key_equal, NULL, free);
+    g_active_partials = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+
+    // Blocking disk work runs here, never on the event loops
+    g_job_pool = job_pool_new(g_num_io_threads, log_slow_job);
+    if (!g_job_pool) {
+        fprintf(stderr, "Failed to start job pool\n");
+        return EXIT_FAILURE;
+    }
 
     // Set up signal handling
     struct event *sig_int = evsignal_new(g_event_base, SIGINT, signal_cb, g_event_base);
@@ -805,35 +2877,78 @@ int main(int argc, char *argv[]) {
     evsignal_add(sig_int, NULL);
     evsignal_add(sig_term, NULL);
 
-    // Set up listener
-    struct sockaddr_in sin;
-    memset(&sin, 0, sizeof(sin));
-    sin.sin_family = AF_INET;
-    sin.sin_addr.s_addr = htonl(INADDR_ANY);
-    sin.sin_port = htons(port);
+    struct timeval stats_interval = { STATS_INTERVAL_SEC, 0 };
+    struct event *stats_ev = event_new(g_event_base, -1, EV_PERSIST, stats_cb, NULL);
+    event_add(stats_ev, &stats_interval);
 
-    struct evconnlistener *listener = evconnlistener_new_bind(
-        g_event_base, accept_cb, g_event_base,
-        LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE, -1,
-        (struct sockaddr*)&sin, sizeof(sin));
+    // Expire abandoned partial uploads now and then periodically
+    struct timeval partial_interval = { PARTIAL_SWEEP_SEC, 0 };
+    struct event *partial_ev = event_new(g_event_base, -1, EV_PERSIST, partial_sweep_cb, NULL);
+    event_add(partial_ev, &partial_interval);
+    partial_sweep_cb(-1, 0, NULL);
 
-    if (!listener) {
-        fprintf(stderr, "Failed to create listener\n");
+    // Start workers
+    g_workers = calloc(g_num_workers, sizeof(worker_t));
+    if (!g_workers) {
+        fprintf(stderr, "Failed to allocate workers\n");
         return EXIT_FAILURE;
     }
+    int started = 0;
+    for (int i = 0; i < g_num_workers; i++) {
+        if (worker_init(&g_workers[i], i, port) != 0 ||
+            pthread_create(&g_workers[i].thread, NULL, worker_main, &g_workers[i]) != 0) {
+            fprintf(stderr, "Failed to start worker %d\n", i);
+            break;
+        }
+        started++;
+    }
 
-    secure_log("INFO", "Secure file server started on port %d", port);
+    if (started == g_num_workers) {
+        secure_log("INFO", "Secure file server started on port %d with %d worker(s)", port, g_num_workers);
 
-    // Run event loop
-    event_base_dispatch(g_event_base);
+        // Main loop only waits for signals
+        event_base_dispatch(g_event_base);
+    } else {
+        for (int i = 0; i < started; i++) {
+            event_base_loopexit(g_workers[i].base, NULL);
+        }
+    }
 
     // Cleanup
-    evconnlistener_free(listener);
+    for (int i = 0; i < started; i++) {
+        pthread_join(g_workers[i].thread, NULL);
+    }
+    // Pool threads may still post completions to worker bases, so stop the
+    // pool before the bases are freed
+    log_job_stats();
+    log_tls_stats();
+    job_pool_free(g_job_pool);
+    g_job_pool = NULL; // Uploads still open save their partial state inline
+
+    // Completions the pool posted after the loops exited are still pending on
+    // the bases. Run them once so every job finishes and releases its
+    // connection before worker_cleanup; no new clients are accepted meanwhile.
+    for (int i = 0; i < started; i++) {
+        if (g_workers[i].listener) {
+            evconnlistener_free(g_workers[i].listener);
+            g_workers[i].listener = NULL;
+        }
+        event_base_loop(g_workers[i].base, EVLOOP_NONBLOCK);
+    }
+    event_base_loop(g_event_base, EVLOOP_NONBLOCK);
+
+    for (int i = 0; i < g_num_workers; i++) {
+        worker_cleanup(&g_workers[i]);
+    }
+    free(g_workers);
+    g_workers = NULL;
+    g_hash_table_destroy(g_conn_counts);
+    g_hash_table_destroy(g_active_partials);
+
     event_free(sig_int);
     event_free(sig_term);
-
-    g_hash_table_destroy(g_connections);
-    g_hash_table_destroy(g_rate_limits);
+    event_free(stats_ev);
+    event_free(partial_ev);
 
     if (g_collection) mongoc_collection_destroy(g_collection);
     if (g_mongo_client) mongoc_client_destroy(g_mongo_client);
@@ -845,5 +2960,5 @@ int main(int argc, char *argv[]) {
     event_base_free(g_event_base);
 
     secure_log("INFO", "Server shutdown complete");
-    return EXIT_SUCCESS;
+    return started == g_num_workers ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,327 @@
+/**
+ * Secure File Exchange Server - Storage I/O
+ * io_uring ring per event loop with registered buffers and files.
+ * SQEs queued during one loop iteration are submitted with a single
+ * io_uring_submit(); completions are signalled through an eventfd.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "storage_io.h"
+
+#ifdef HAVE_LIBURING
+
+#include <liburing.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+
+typedef struct {
+    storage_io_t *io;
+    storage_io_cb cb;
+    void *ctx;
+    int fd;
+    int slot;
+    int buf_index;
+    int is_write;
+    uint8_t *buf;
+    size_t len;
+    size_t done; // Bytes already written (short write resubmission)
+    off_t off;
+} storage_op_t;
+
+struct storage_io {
+    struct io_uring ring;
+    struct event *completion_ev; // eventfd readable: CQEs are ready
+    struct event *submit_ev;     // Manual: flush queued SQEs once per loop iteration
+    int efd;
+    int submit_pending;
+    int files_registered;
+
+    uint8_t *buf_mem;            // STORAGE_IO_BUF_COUNT * STORAGE_IO_BUF_SIZE
+    int free_bufs[STORAGE_IO_BUF_COUNT];
+    int free_buf_count;
+    int dead;                    // Freed while buffers were still referenced
+
+    int free_slots[STORAGE_IO_FILE_SLOTS];
+    int free_slot_count;
+};
+
+static void storage_io_destroy_memory(storage_io_t *io) {
+    free(io->buf_mem);
+    free(io);
+}
+
+static void submit_cb(evutil_socket_t fd, short events, void *ctx) {
+    storage_io_t *io = ctx;
+    (void)fd;
+    (void)events;
+
+    io->submit_pending = 0;
+    io_uring_submit(&io->ring);
+}
+
+static void schedule_submit(storage_io_t *io) {
+    if (!io->submit_pending) {
+        io->submit_pending = 1;
+        event_active(io->submit_ev, EV_TIMEOUT, 0);
+    }
+}
+
+static struct io_uring_sqe *get_sqe(storage_io_t *io) {
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&io->ring);
+    if (!sqe) {
+        // Queue full: flush what we have and try once more
+        io_uring_submit(&io->ring);
+        sqe = io_uring_get_sqe(&io->ring);
+    }
+    return sqe;
+}
+
+static int queue_op(storage_op_t *op) {
+    storage_io_t *io = op->io;
+    struct io_uring_sqe *sqe = get_sqe(io);
+    if (!sqe) return -1;
+
+    int target = op->slot >= 0 ? op->slot : op->fd;
+    if (op->is_write) {
+        io_uring_prep_write_fixed(sqe, target, op->buf + op->done, (unsigned)(op->len - op->done),
+                                  (uint64_t)(op->off + (off_t)op->done), op->buf_index);
+    } else {
+        io_uring_prep_read_fixed(sqe, target, op->buf, (unsigned)op->len, (uint64_t)op->off, op->buf_index);
+    }
+    if (op->slot >= 0) {
+        io_uring_sqe_set_flags(sqe, IOSQE_FIXED_FILE);
+    }
+    io_uring_sqe_set_data(sqe, op);
+    schedule_submit(io);
+    return 0;
+}
+
+static void completion_cb(evutil_socket_t fd, short events, void *ctx) {
+    storage_io_t *io = ctx;
+    uint64_t counter;
+    (void)events;
+
+    if (read(fd, &counter, sizeof(counter)) < 0 && errno != EAGAIN) {
+        return;
+    }
+
+    struct io_uring_cqe *cqe;
+    while (io_uring_peek_cqe(&io->ring, &cqe) == 0) {
+        storage_op_t *op = io_uring_cqe_get_data(cqe);
+        int res = cqe->res;
+        io_uring_cqe_seen(&io->ring, cqe);
+
+        // A write that made no progress would otherwise look complete
+        if (op->is_write && res == 0 && op->done < op->len) {
+            res = -EIO;
+        } else if (op->is_write && res > 0 && op->done + (size_t)res < op->len) {
+            op->done += (size_t)res;
+            if (queue_op(op) == 0) continue;
+            res = -EIO;
+        } else if (op->is_write && res > 0) {
+            res = (int)op->len;
+        }
+
+        op->cb(op->ctx, res);
+        free(op);
+    }
+}
+
+storage_io_t *storage_io_new(struct event_base *base) {
+    storage_io_t *io = calloc(1, sizeof(storage_io_t));
+    if (!io) return NULL;
+    io->efd = -1;
+
+    if (io_uring_queue_init(STORAGE_IO_DEPTH, &io->ring, 0) < 0) {
+        free(io); // ENOSYS/EPERM: kernel without io_uring or disabled by policy
+        return NULL;
+    }
+
+    // Registered buffers are pinned once instead of per request
+    if (posix_memalign((void **)&io->buf_mem, 4096, (size_t)STORAGE_IO_BUF_COUNT * STORAGE_IO_BUF_SIZE) != 0) {
+        io->buf_mem = NULL;
+        goto fail;
+    }
+    struct iovec iov[STORAGE_IO_BUF_COUNT];
+    for (int i = 0; i < STORAGE_IO_BUF_COUNT; i++) {
+        iov[i].iov_base = io->buf_mem + (size_t)i * STORAGE_IO_BUF_SIZE;
+        iov[i].iov_len = STORAGE_IO_BUF_SIZE;
+        io->free_bufs[io->free_buf_count++] = i;
+    }
+    if (io_uring_register_buffers(&io->ring, iov, STORAGE_IO_BUF_COUNT) < 0) {
+        goto fail; // Usually RLIMIT_MEMLOCK
+    }
+
+    // Registered files are optional: older kernels lack sparse tables
+    if (io_uring_register_files_sparse(&io->ring, STORAGE_IO_FILE_SLOTS) == 0) {
+        io->files_registered = 1;
+        for (int i = STORAGE_IO_FILE_SLOTS - 1; i >= 0; i--) {
+            io->free_slots[io->free_slot_count++] = i;
+        }
+    }
+
+    io->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (io->efd == -1 || io_uring_register_eventfd(&io->ring, io->efd) < 0) {
+        goto fail;
+    }
+
+    io->completion_ev = event_new(base, io->efd, EV_READ | EV_PERSIST, completion_cb, io);
+    io->submit_ev = event_new(base, -1, 0, submit_cb, io);
+    if (!io->completion_ev || !io->submit_ev || event_add(io->completion_ev, NULL) != 0) {
+        goto fail;
+    }
+    return io;
+
+fail:
+    if (io->completion_ev) event_free(io->completion_ev);
+    if (io->submit_ev) event_free(io->submit_ev);
+    if (io->efd != -1) close(io->efd);
+    io_uring_queue_exit(&io->ring);
+    storage_io_destroy_memory(io);
+    return NULL;
+}
+
+// Buffers handed to evbuffer_add_reference() may be released after the
+// ring is gone (e.g. while the event base frees its bufferevents), so the
+// buffer memory outlives the ring until the last one comes back.
+void storage_io_free(storage_io_t *io) {
+    if (!io) return;
+
+    event_free(io->completion_ev);
+    event_free(io->submit_ev);
+    io_uring_queue_exit(&io->ring);
+    close(io->efd);
+
+    if (io->free_buf_count == STORAGE_IO_BUF_COUNT) {
+        storage_io_destroy_memory(io);
+    } else {
+        io->dead = 1;
+    }
+}
+
+uint8_t *storage_io_buf_get(storage_io_t *io) {
+    if (!io || io->free_buf_count == 0) return NULL;
+    int index = io->free_bufs[--io->free_buf_count];
+    return io->buf_mem + (size_t)index * STORAGE_IO_BUF_SIZE;
+}
+
+void storage_io_buf_put(storage_io_t *io, uint8_t *buf) {
+    int index = (int)((buf - io->buf_mem) / STORAGE_IO_BUF_SIZE);
+    io->free_bufs[io->free_buf_count++] = index;
+
+    if (io->dead && io->free_buf_count == STORAGE_IO_BUF_COUNT) {
+        storage_io_destroy_memory(io);
+    }
+}
+
+void storage_io_buf_release(const void *data, size_t len, void *io) {
+    (void)len;
+    storage_io_buf_put(io, (uint8_t *)data);
+}
+
+int storage_io_file_register(storage_io_t *io, int fd) {
+    if (!io || !io->files_registered || io->free_slot_count == 0) return -1;
+
+    int slot = io->free_slots[--io->free_slot_count];
+    if (io_uring_register_files_update(&io->ring, (unsigned)slot, &fd, 1) != 1) {
+        io->free_slots[io->free_slot_count++] = slot;
+        return -1;
+    }
+    return slot;
+}
+
+void storage_io_file_unregister(storage_io_t *io, int slot) {
+    if (!io || slot < 0) return;
+
+    int none = -1;
+    io_uring_register_files_update(&io->ring, (unsigned)slot, &none, 1);
+    io->free_slots[io->free_slot_count++] = slot;
+}
+
+static int submit_op(storage_io_t *io, int is_write, int fd, int slot, uint8_t *buf, size_t len,
+                     off_t off, storage_io_cb cb, void *ctx) {
+    if (!io || !buf || len == 0 || len > STORAGE_IO_BUF_SIZE) return -1;
+
+    storage_op_t *op = calloc(1, sizeof(storage_op_t));
+    if (!op) return -1;
+    op->io = io;
+    op->cb = cb;
+    op->ctx = ctx;
+    op->fd = fd;
+    op->slot = slot;
+    op->buf_index = (int)((buf - io->buf_mem) / STORAGE_IO_BUF_SIZE);
+    op->is_write = is_write;
+    op->buf = buf;
+    op->len = len;
+    op->off = off;
+
+    if (queue_op(op) != 0) {
+        free(op);
+        return -1;
+    }
+    return 0;
+}
+
+int storage_io_read(storage_io_t *io, int fd, int slot, uint8_t *buf, size_t len, off_t off,
+                    storage_io_cb cb, void *ctx) {
+    return submit_op(io, 0, fd, slot, buf, len, off, cb, ctx);
+}
+
+int storage_io_write(storage_io_t *io, int fd, int slot, uint8_t *buf, size_t len, off_t off,
+                     storage_io_cb cb, void *ctx) {
+    return submit_op(io, 1, fd, slot, buf, len, off, cb, ctx);
+}
+
+#else // !HAVE_LIBURING
+
+storage_io_t *storage_io_new(struct event_base *base) {
+    (void)base;
+    return NULL;
+}
+
+void storage_io_free(storage_io_t *io) { (void)io; }
+
+uint8_t *storage_io_buf_get(storage_io_t *io) {
+    (void)io;
+    return NULL;
+}
+
+void storage_io_buf_put(storage_io_t *io, uint8_t *buf) {
+    (void)io;
+    (void)buf;
+}
+
+void storage_io_buf_release(const void *data, size_t len, void *io) {
+    (void)data;
+    (void)len;
+    (void)io;
+}
+
+int storage_io_file_register(storage_io_t *io, int fd) {
+    (void)io;
+    (void)fd;
+    return -1;
+}
+
+void storage_io_file_unregister(storage_io_t *io, int slot) {
+    (void)io;
+    (void)slot;
+}
+
+int storage_io_read(storage_io_t *io, int fd, int slot, uint8_t *buf, size_t len, off_t off,
+                    storage_io_cb cb, void *ctx) {
+    (void)io; (void)fd; (void)slot; (void)buf; (void)len; (void)off; (void)cb; (void)ctx;
+    return -1;
+}
+
+int storage_io_write(storage_io_t *io, int fd, int slot, uint8_t *buf, size_t len, off_t off,
+                     storage_io_cb cb, void *ctx) {
+    (void)io; (void)fd; (void)slot; (void)buf; (void)len; (void)off; (void)cb; (void)ctx;
+    return -1;
+}
+
+#endif // HAVE_LIBURING
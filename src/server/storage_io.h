@@ -0,0 +1,46 @@
+/**
+ * Storage I/O Header
+ * Optional io_uring backend for file reads/writes on an event loop.
+ * Built only with -DHAVE_LIBURING; otherwise storage_io_new() returns NULL
+ * and callers keep using the job pool (pread/pwrite) path.
+ */
+
+#ifndef STORAGE_IO_H
+#define STORAGE_IO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <event2/event.h>
+
+#define STORAGE_IO_DEPTH 64              // Submission queue entries per ring
+#define STORAGE_IO_BUF_SIZE (256 * 1024) // One registered buffer
+#define STORAGE_IO_BUF_COUNT 16          // Registered buffers per ring (pinned memory)
+#define STORAGE_IO_FILE_SLOTS 256        // Registered file table size
+
+typedef struct storage_io storage_io_t;
+
+// Completion callback, run on the ring's event_base thread.
+// res is the number of bytes transferred or -errno.
+typedef void (*storage_io_cb)(void *ctx, int res);
+
+// Function declarations
+storage_io_t *storage_io_new(struct event_base *base); // NULL if io_uring is unavailable
+void storage_io_free(storage_io_t *io);
+
+uint8_t *storage_io_buf_get(storage_io_t *io);          // NULL when every buffer is busy
+void storage_io_buf_put(storage_io_t *io, uint8_t *buf);
+void storage_io_buf_release(const void *data, size_t len, void *io); // evbuffer_add_reference cleanup
+
+int storage_io_file_register(storage_io_t *io, int fd); // Slot, or -1: ops then use fd directly
+void storage_io_file_unregister(storage_io_t *io, int slot);
+
+// buf must come from storage_io_buf_get() and len must not exceed
+// STORAGE_IO_BUF_SIZE. Short writes are resubmitted until the whole buffer
+// is on disk; a read may complete short at end of file.
+int storage_io_read(storage_io_t *io, int fd, int slot, uint8_t *buf, size_t len, off_t off,
+                    storage_io_cb cb, void *ctx);
+int storage_io_write(storage_io_t *io, int fd, int slot, uint8_t *buf, size_t len, off_t off,
+                     storage_io_cb cb, void *ctx);
+
+#endif // STORAGE_IO_H
@@ -34,6 +34,9 @@ error_status_t status(error_status_t status) {
         case MR_ERROR_INTEGRITY:
             printf("[ERROR]: integrity check failed");
             break;
+        case MR_ERROR_IO:
+            printf("[ERROR]: file I/O failed");
+            break;
         default:
             printf("[ERROR]: unknown error");
             break;
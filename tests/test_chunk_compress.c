@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/common/chunk_compress.h"
+#include "../src/common/fastcdc.h"
+
+// Global test counters
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+// Helper function to print test results
+static void test_result(const char *test_name, int passed) {
+    if (passed) {
+        printf("[PASS] %s\n", test_name);
+        tests_passed++;
+    } else {
+        printf("[FAIL] %s\n", test_name);
+        tests_failed++;
+    }
+}
+
+// Deterministic pseudo-random bytes (xorshift64)
+static void fill_random(uint8_t *buf, size_t len, uint64_t seed) {
+    uint64_t x = seed;
+    for (size_t i = 0; i < len; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        buf[i] = (uint8_t)x;
+    }
+}
+
+// Log-like text: repetitive lines with changing numbers
+static void fill_log(uint8_t *buf, size_t len) {
+    size_t pos = 0;
+    for (unsigned line = 0; pos < len; line++) {
+        char tmp[128];
+        int n = snprintf(tmp, sizeof(tmp), "2025-01-%02u 12:%02u:%02u [INFO] Request %u served in %u ms\n",
+                         line % 28 + 1, line % 60, (line * 7) % 60, line, (line * 31) % 500);
+        for (int i = 0; i < n && pos < len; i++) buf[pos++] = (uint8_t)tmp[i];
+    }
+}
+
+static void test_entropy(void) {
+    uint8_t *buf = malloc(FASTCDC_MAX_SIZE);
+
+    memset(buf, 'a', FASTCDC_MAX_SIZE);
+    test_result("Constant data has zero entropy", chunk_entropy(buf, FASTCDC_MAX_SIZE) == 0.0);
+
+    for (size_t i = 0; i < 4096; i++) buf[i] = (uint8_t)i;
+    test_result("Uniform bytes have eight bits", chunk_entropy(buf, 4096) > 7.99);
+
+    fill_random(buf, FASTCDC_MAX_SIZE, 42);
+    test_result("Random data is not compressible", !chunk_compressible(buf, FASTCDC_MAX_SIZE));
+
+    fill_log(buf, FASTCDC_MAX_SIZE);
+    test_result("Log text is compressible", chunk_compressible(buf, FASTCDC_MAX_SIZE));
+
+    // Text header followed by random bytes: the spread windows see the rest
+    fill_random(buf + 4096, FASTCDC_MAX_SIZE - 4096, 7);
+    test_result("Probe looks past the first bytes", !chunk_compressible(buf, FASTCDC_MAX_SIZE));
+
+    test_result("Tiny chunks are skipped", !chunk_compressible(buf, CHUNK_COMPRESS_MIN_SIZE - 1));
+    test_result("Empty input has zero entropy", chunk_entropy(buf, 0) == 0.0);
+    free(buf);
+}
+
+static void test_roundtrip(void) {
+    uint8_t *src = malloc(FASTCDC_MAX_SIZE);
+    uint8_t *packed = malloc(FASTCDC_MAX_SIZE);
+    uint8_t *out = malloc(FASTCDC_MAX_SIZE);
+
+    fill_log(src, FASTCDC_MAX_SIZE);
+    size_t n = chunk_compress(src, FASTCDC_MAX_SIZE, packed, FASTCDC_MAX_SIZE);
+    if (!chunk_compress_available()) {
+        test_result("Without zstd nothing is compressed", n == 0);
+        test_result("Without zstd nothing is decompressed",
+                    chunk_decompress(src, 16, out, FASTCDC_MAX_SIZE) == -1);
+        goto out;
+    }
+
+    test_result("Log text shrinks", n > 0 && n < FASTCDC_MAX_SIZE / 4);
+    test_result("Compressed chunk round trips",
+                chunk_decompress(packed, n, out, FASTCDC_MAX_SIZE) == 0 && memcmp(src, out, FASTCDC_MAX_SIZE) == 0);
+    test_result("Wrong expected size is rejected", chunk_decompress(packed, n, out, FASTCDC_MAX_SIZE - 1) == -1);
+    test_result("Truncated frame is rejected", chunk_decompress(packed, n - 1, out, FASTCDC_MAX_SIZE) == -1);
+
+    test_result("Output that does not fit is refused", chunk_compress(src, FASTCDC_MAX_SIZE, packed, 16) == 0);
+
+    fill_random(src, FASTCDC_MAX_SIZE, 99);
+    test_result("Random chunk is sent raw", chunk_compress(src, FASTCDC_MAX_SIZE, packed, FASTCDC_MAX_SIZE) == 0);
+
+    // Random hex has four bits per byte: no repeats, but entropy coding halves it
+    for (size_t i = 0; i < FASTCDC_MAX_SIZE; i++) src[i] = (uint8_t)"0123456789abcdef"[src[i] & 15];
+    size_t hex = chunk_compress(src, FASTCDC_MAX_SIZE, packed, FASTCDC_MAX_SIZE);
+    test_result("Random hex is compressed", hex > 0 && hex < FASTCDC_MAX_SIZE * 6 / 10);
+
+out:
+    free(out);
+    free(packed);
+    free(src);
+}
+
+int main(void) {
+    printf("Running chunk compression tests...\n\n");
+
+    test_entropy();
+    test_roundtrip();
+
+    printf("\nTest Results: %d passed, %d failed\n", tests_passed, tests_failed);
+
+    return tests_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <openssl/rand.h>
+
+#include "../src/crypto/chunked_gcm.h"
+
+// Global test counters
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+// Helper function to print test results
+static void test_result(const char *test_name, int passed) {
+    if (passed) {
+        printf("[PASS] %s\n", test_name);
+        tests_passed++;
+    } else {
+        printf("[FAIL] %s\n", test_name);
+        tests_failed++;
+    }
+}
+
+// Writes `len` random bytes through the writer in uneven pieces; returns the fd
+static int write_file(const uint8_t *key, const uint8_t *data, size_t len) {
+    char path[] = "/tmp/test_chunked_gcm.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) return -1;
+    unlink(path);
+
+    chunked_gcm_writer_t w;
+    if (chunked_gcm_writer_init(&w, fd, key) != MR_SUCCESS) {
+        close(fd);
+        return -1;
+    }
+    size_t off = 0;
+    size_t step = 1000;
+    while (off < len) {
+        size_t n = len - off < step ? len - off : step;
+        if (chunked_gcm_writer_update(&w, data + off, n) != MR_SUCCESS) {
+            chunked_gcm_writer_cleanup(&w);
+            close(fd);
+            return -1;
+        }
+        off += n;
+        step = step * 3 + 7; // Varying piece sizes cross record boundaries
+    }
+    error_status_t rc = chunked_gcm_writer_final(&w);
+    chunked_gcm_writer_cleanup(&w);
+    if (rc != MR_SUCCESS) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Decrypts the whole file starting at `offset` and compares with the source
+static int read_matches(int fd, const uint8_t *key, const uint8_t *data, size_t len, size_t offset) {
+    chunked_gcm_reader_t r;
+    if (chunked_gcm_reader_open(&r, fd, key) != MR_SUCCESS) return 0;
+
+    int ok = r.plaintext_size == len;
+    uint8_t *buf = malloc(r.chunk_size);
+    for (uint64_t idx = offset / r.chunk_size; ok && idx < r.chunk_count; idx++) {
+        size_t n = 0;
+        if (chunked_gcm_reader_read(&r, idx, buf, &n) != MR_SUCCESS) {
+            ok = 0;
+            break;
+        }
+        size_t start = (idx == offset / r.chunk_size) ? offset % r.chunk_size : 0;
+        ok = memcmp(buf + start, data + idx * r.chunk_size + start, n - start) == 0;
+    }
+    free(buf);
+    chunked_gcm_reader_cleanup(&r);
+    return ok;
+}
+
+static void test_roundtrip_sizes(void) {
+    uint8_t key[AES_KEY_SIZE];
+    RAND_bytes(key, sizeof(key));
+
+    size_t sizes[] = {0, 1, CHUNKED_GCM_CHUNK_SIZE - 1, CHUNKED_GCM_CHUNK_SIZE,
+                      CHUNKED_GCM_CHUNK_SIZE + 1, 5 * CHUNKED_GCM_CHUNK_SIZE + 123};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        size_t len = sizes[i];
+        uint8_t *data = malloc(len + 1);
+        RAND_bytes(data, (int)len + 1);
+
+        int fd = write_file(key, data, len);
+        char name[96];
+        snprintf(name, sizeof(name), "Round-trip of %zu bytes", len);
+        test_result(name, fd >= 0 && read_matches(fd, key, data, len, 0));
+        if (fd >= 0) close(fd);
+        free(data);
+    }
+}
+
+static void test_offset_read(void) {
+    uint8_t key[AES_KEY_SIZE];
+    RAND_bytes(key, sizeof(key));
+
+    size_t len = 3 * CHUNKED_GCM_CHUNK_SIZE + 500;
+    uint8_t *data = malloc(len);
+    RAND_bytes(data, (int)len);
+
+    int fd = write_file(key, data, len);
+    test_result("Read from mid-record offset", fd >= 0 && read_matches(fd, key, data, len, 2 * CHUNKED_GCM_CHUNK_SIZE + 17));
+    test_result("Read from last byte", fd >= 0 && read_matches(fd, key, data, len, len - 1));
+    if (fd >= 0) close(fd);
+    free(data);
+}
+
+static void test_tamper_detection(void) {
+    uint8_t key[AES_KEY_SIZE];
+    RAND_bytes(key, sizeof(key));
+
+    size_t len = 2 * CHUNKED_GCM_CHUNK_SIZE + 10;
+    uint8_t *data = malloc(len);
+    RAND_bytes(data, (int)len);
+    uint8_t *buf = malloc(CHUNKED_GCM_CHUNK_SIZE);
+
+    int fd = write_file(key, data, len);
+    chunked_gcm_reader_t r;
+    size_t n = 0;
+
+    // Flip one ciphertext byte in the second record
+    off_t pos = CHUNKED_GCM_HEADER_SIZE + CHUNKED_GCM_RECORD_SIZE(CHUNKED_GCM_CHUNK_SIZE) + 5;
+    uint8_t b;
+    pread(fd, &b, 1, pos);
+    b ^= 0x01;
+    pwrite(fd, &b, 1, pos);
+
+    test_result("Open succeeds on tampered body", chunked_gcm_reader_open(&r, fd, key) == MR_SUCCESS);
+    test_result("Untouched record still decrypts", chunked_gcm_reader_read(&r, 0, buf, &n) == MR_SUCCESS);
+    test_result("Tampered record is rejected", chunked_gcm_reader_read(&r, 1, buf, &n) == MR_ERROR_INTEGRITY && n == 0);
+    chunked_gcm_reader_cleanup(&r);
+
+    // Truncating the last record must be caught by the header/length check
+    ftruncate(fd, lseek(fd, 0, SEEK_END) - 1);
+    test_result("Truncated file is rejected", chunked_gcm_reader_open(&r, fd, key) == MR_ERROR_INTEGRITY);
+
+    close(fd);
+    free(buf);
+    free(data);
+}
+
+static void test_wrong_key(void) {
+    uint8_t key[AES_KEY_SIZE];
+    uint8_t other[AES_KEY_SIZE];
+    RAND_bytes(key, sizeof(key));
+    RAND_bytes(other, sizeof(other));
+
+    uint8_t data[100];
+    RAND_bytes(data, sizeof(data));
+    uint8_t buf[CHUNKED_GCM_CHUNK_SIZE];
+    size_t n = 0;
+
+    int fd = write_file(key, data, sizeof(data));
+    chunked_gcm_reader_t r;
+    chunked_gcm_reader_open(&r, fd, other);
+    test_result("Wrong key fails authentication", chunked_gcm_reader_read(&r, 0, buf, &n) == MR_ERROR_INTEGRITY);
+    chunked_gcm_reader_cleanup(&r);
+    close(fd);
+}
+
+static void test_not_chunked(void) {
+    char path[] = "/tmp/test_chunked_gcm.XXXXXX";
+    int fd = mkstemp(path);
+    unlink(path);
+    const char *legacy = "definitely not a chunked file, just some legacy bytes";
+    write(fd, legacy, strlen(legacy));
+
+    uint8_t key[AES_KEY_SIZE] = {0};
+    chunked_gcm_reader_t r;
+    test_result("Foreign file is reported as invalid format", chunked_gcm_reader_open(&r, fd, key) == MR_ERROR_INVALID_PARAM);
+    close(fd);
+}
+
+// Writes data up to a checkpoint, appends a torn tail, resumes and finishes
+static void test_checkpoint_resume(void) {
+    uint8_t key[AES_KEY_SIZE];
+    RAND_bytes(key, sizeof(key));
+    size_t len = 3 * CHUNKED_GCM_CHUNK_SIZE + 500;
+    uint8_t *data = malloc(len);
+    RAND_bytes(data, (int)len);
+
+    char path[] = "/tmp/test_chunked_gcm.XXXXXX";
+    int fd = mkstemp(path);
+    unlink(path);
+
+    chunked_gcm_writer_t w;
+    chunked_gcm_position_t pos;
+    chunked_gcm_writer_init(&w, fd, key);
+    chunked_gcm_writer_update(&w, data, 2 * CHUNKED_GCM_CHUNK_SIZE);
+    int ok = chunked_gcm_writer_checkpoint(&w, &pos) == MR_SUCCESS && pos.chunk_index == 2;
+    test_result("Checkpoint seals the buffered full record", ok);
+
+    // Past the checkpoint: a partial record cannot be checkpointed, and what it wrote is lost
+    chunked_gcm_writer_update(&w, data + 2 * CHUNKED_GCM_CHUNK_SIZE, CHUNKED_GCM_CHUNK_SIZE + 100);
+    chunked_gcm_position_t later;
+    test_result("Partial record is not a checkpoint", chunked_gcm_writer_checkpoint(&w, &later) == MR_ERROR_INVALID_PARAM);
+    chunked_gcm_writer_cleanup(&w);
+
+    chunked_gcm_position_t wrong = pos;
+    wrong.base_iv[0] ^= 1;
+    test_result("Resume with another IV is rejected", chunked_gcm_writer_resume(&w, fd, key, &wrong) == MR_ERROR_INTEGRITY);
+    wrong = pos;
+    wrong.chunk_index = 5;
+    test_result("Resume past the end of the file is rejected", chunked_gcm_writer_resume(&w, fd, key, &wrong) == MR_ERROR_INTEGRITY);
+
+    ok = chunked_gcm_writer_resume(&w, fd, key, &pos) == MR_SUCCESS && w.plaintext_size == 2 * CHUNKED_GCM_CHUNK_SIZE;
+    ok = ok && chunked_gcm_writer_update(&w, data + 2 * CHUNKED_GCM_CHUNK_SIZE, len - 2 * CHUNKED_GCM_CHUNK_SIZE) == MR_SUCCESS;
+    ok = ok && chunked_gcm_writer_final(&w) == MR_SUCCESS;
+    chunked_gcm_writer_cleanup(&w);
+    test_result("Resumed file decrypts to the original data", ok && read_matches(fd, key, data, len, 0));
+
+    close(fd);
+    free(data);
+}
+
+int main(void) {
+    printf("Running chunked AES-GCM storage tests...\n\n");
+
+    test_roundtrip_sizes();
+    test_offset_read();
+    test_tamper_detection();
+    test_wrong_key();
+    test_not_chunked();
+    test_checkpoint_resume();
+
+    printf("\nTest Results: %d passed, %d failed\n", tests_passed, tests_failed);
+
+    return tests_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "../src/server/drr_sched.h"
+
+// Global test counters
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+// Helper function to print test results
+static void test_result(const char *test_name, int passed) {
+    if (passed) {
+        printf("[PASS] %s\n", test_name);
+        tests_passed++;
+    } else {
+        printf("[FAIL] %s\n", test_name);
+        tests_failed++;
+    }
+}
+
+// Fake transfer: sends from `remaining`, at most `window` bytes per call
+typedef struct {
+    sched_entry_t sched;
+    size_t remaining;
+    size_t sent;
+    size_t window;
+    int finished_at; // Run in which the transfer completed
+} fake_transfer_t;
+
+static drr_sched_t g_sched;
+static int g_run;
+
+static size_t fake_send(sched_entry_t *entry, size_t grant) {
+    fake_transfer_t *t = (fake_transfer_t *)((char *)entry - offsetof(fake_transfer_t, sched));
+    size_t n = grant < t->remaining ? grant : t->remaining;
+    if (t->window && n > t->window) n = t->window;
+    t->remaining -= n;
+    t->sent += n;
+    if (t->remaining == 0) {
+        t->finished_at = g_run;
+        drr_remove(&g_sched, entry); // Done: leaves the round itself
+    }
+    return n;
+}
+
+static void test_small_transfer_latency(void) {
+    drr_init(&g_sched, 1000, fake_send);
+    fake_transfer_t big = { .remaining = 1000000, .finished_at = -1 };
+    fake_transfer_t small = { .remaining = 800, .finished_at = -1 };
+
+    drr_wake(&g_sched, &big.sched);
+    drr_wake(&g_sched, &small.sched);
+
+    // Budget for two quanta per run: the small one must not wait for the big one
+    g_run = 0;
+    size_t used = drr_run(&g_sched, 2000);
+    test_result("Small transfer finishes in its first turn", small.finished_at == 0);
+    test_result("Leftover budget goes back to the big transfer", used == 2000 && big.sent == 1200);
+    test_result("Finished transfer leaves the round", g_sched.active == 1 && !small.sched.active);
+}
+
+static void test_fair_share(void) {
+    drr_init(&g_sched, 500, fake_send);
+    fake_transfer_t a = { .remaining = 1000000, .finished_at = -1 };
+    fake_transfer_t b = { .remaining = 1000000, .finished_at = -1 };
+    fake_transfer_t c = { .remaining = 1000000, .finished_at = -1 };
+    drr_wake(&g_sched, &a.sched);
+    drr_wake(&g_sched, &b.sched);
+    drr_wake(&g_sched, &c.sched);
+
+    // Budgets that are not a multiple of the quantum still split evenly
+    for (g_run = 0; g_run < 300; g_run++) {
+        drr_run(&g_sched, 700);
+    }
+    size_t lo = a.sent, hi = a.sent;
+    size_t all[] = { b.sent, c.sent };
+    for (int i = 0; i < 2; i++) {
+        if (all[i] < lo) lo = all[i];
+        if (all[i] > hi) hi = all[i];
+    }
+    test_result("Equal transfers get equal bandwidth", hi - lo <= 500);
+    test_result("Whole budget is handed out", a.sent + b.sent + c.sent == 300 * 700);
+}
+
+static void test_blocked_entry(void) {
+    drr_init(&g_sched, 1000, fake_send);
+    fake_transfer_t slow = { .remaining = 100000, .window = 100, .finished_at = -1 };
+    fake_transfer_t fast = { .remaining = 100000, .finished_at = -1 };
+    drr_wake(&g_sched, &slow.sched);
+    drr_wake(&g_sched, &fast.sched);
+
+    g_run = 0;
+    size_t used = drr_run(&g_sched, 5000);
+    test_result("Blocked entry leaves the round", !slow.sched.active && slow.sent == 100);
+    test_result("Leftover budget goes to the others", used == 5000 && fast.sent == 4900);
+
+    drr_wake(&g_sched, &slow.sched);
+    test_result("Woken entry rejoins", slow.sched.active && g_sched.active == 2);
+    drr_wake(&g_sched, &slow.sched);
+    test_result("Waking an active entry is a no-op", g_sched.active == 2);
+}
+
+static void test_remove(void) {
+    drr_init(&g_sched, 1000, fake_send);
+    fake_transfer_t a = { .remaining = 100000, .finished_at = -1 };
+    fake_transfer_t b = { .remaining = 100000, .finished_at = -1 };
+    drr_wake(&g_sched, &a.sched);
+    drr_wake(&g_sched, &b.sched);
+
+    drr_remove(&g_sched, &a.sched);
+    drr_remove(&g_sched, &a.sched);
+    test_result("Removed entry is idle", !a.sched.active && g_sched.active == 1);
+
+    drr_run(&g_sched, 3000);
+    test_result("Removed entry gets nothing", a.sent == 0 && b.sent == 3000);
+
+    drr_remove(&g_sched, &b.sched);
+    test_result("Empty scheduler moves nothing", drr_run(&g_sched, 1000) == 0 && g_sched.cursor == NULL);
+}
+
+int main(void) {
+    printf("Running DRR scheduler tests...\n\n");
+
+    test_small_transfer_latency();
+    test_fair_share();
+    test_blocked_entry();
+    test_remove();
+
+    printf("\nTest Results: %d passed, %d failed\n", tests_passed, tests_failed);
+
+    return tests_failed == 0 ? 0 : 1;
+}
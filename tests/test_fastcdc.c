@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/common/fastcdc.h"
+
+// Global test counters
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+// Helper function to print test results
+static void test_result(const char *test_name, int passed) {
+    if (passed) {
+        printf("[PASS] %s\n", test_name);
+        tests_passed++;
+    } else {
+        printf("[FAIL] %s\n", test_name);
+        tests_failed++;
+    }
+}
+
+#define DATA_SIZE (8 * 1024 * 1024)
+#define MAX_CUTS (DATA_SIZE / FASTCDC_MIN_SIZE + 2)
+
+// Deterministic pseudo-random bytes (xorshift64)
+static void fill_random(uint8_t *buf, size_t len, uint64_t seed) {
+    uint64_t x = seed;
+    for (size_t i = 0; i < len; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        buf[i] = (uint8_t)x;
+    }
+}
+
+// Chunks the whole buffer, feeding at most `window` bytes per call like a
+// streaming reader would; returns the number of chunks
+static size_t chunk_all(const uint8_t *data, size_t len, size_t window, size_t *sizes) {
+    size_t count = 0;
+    size_t off = 0;
+    while (off < len) {
+        size_t avail = len - off < window ? len - off : window;
+        size_t n = fastcdc_cut(data + off, avail);
+        sizes[count++] = n;
+        off += n;
+    }
+    return count;
+}
+
+// Number of chunk end offsets in `a` that also appear in `b`
+static size_t shared_boundaries(const size_t *a, size_t na, const size_t *b, size_t nb, size_t shift_at, long shift) {
+    size_t shared = 0;
+    size_t ea = 0, j = 0, eb = 0;
+    for (size_t i = 0; i < na; i++) {
+        ea += a[i];
+        long expect = ea >= shift_at ? (long)ea + shift : (long)ea;
+        while (j < nb && (long)eb < expect) eb += b[j++];
+        if ((long)eb == expect) shared++;
+    }
+    return shared;
+}
+
+static void test_bounds_and_coverage(uint8_t *data, size_t *sizes) {
+    size_t count = chunk_all(data, DATA_SIZE, FASTCDC_MAX_SIZE, sizes);
+    size_t total = 0;
+    int in_bounds = 1;
+    for (size_t i = 0; i < count; i++) {
+        total += sizes[i];
+        if (sizes[i] > FASTCDC_MAX_SIZE) in_bounds = 0;
+        if (i + 1 < count && sizes[i] < FASTCDC_MIN_SIZE) in_bounds = 0;
+    }
+    test_result("Chunks cover the input exactly", total == DATA_SIZE);
+    test_result("Chunk sizes stay within min/max", in_bounds);
+
+    size_t avg = DATA_SIZE / count;
+    test_result("Average chunk size is near the target", avg > FASTCDC_AVG_SIZE / 2 && avg < FASTCDC_AVG_SIZE * 2);
+}
+
+static void test_buffering_independence(uint8_t *data, size_t *sizes) {
+    size_t *other = malloc(MAX_CUTS * sizeof(size_t));
+    size_t a = chunk_all(data, DATA_SIZE, FASTCDC_MAX_SIZE, sizes);
+    size_t b = chunk_all(data, DATA_SIZE, DATA_SIZE, other);
+    test_result("Cut points do not depend on buffer size", a == b && memcmp(sizes, other, a * sizeof(size_t)) == 0);
+    free(other);
+}
+
+static void test_edit_locality(uint8_t *data, size_t *sizes) {
+    size_t *after = malloc(MAX_CUTS * sizeof(size_t));
+    uint8_t *edited = malloc(DATA_SIZE + 100);
+    size_t at = DATA_SIZE / 2;
+
+    // Insert 100 bytes in the middle: boundaries must resynchronize
+    memcpy(edited, data, at);
+    fill_random(edited + at, 100, 42);
+    memcpy(edited + at + 100, data + at, DATA_SIZE - at);
+
+    size_t na = chunk_all(data, DATA_SIZE, FASTCDC_MAX_SIZE, sizes);
+    size_t nb = chunk_all(edited, DATA_SIZE + 100, FASTCDC_MAX_SIZE, after);
+    size_t shared = shared_boundaries(sizes, na, after, nb, at, 100);
+    test_result("Insertion only changes nearby chunks", shared + 3 >= na);
+
+    // Inputs up to the minimum size form a single chunk
+    test_result("Input below the minimum is one chunk", fastcdc_cut(data, 100) == 100);
+    test_result("Input of exactly the minimum is one chunk", fastcdc_cut(data, FASTCDC_MIN_SIZE) == FASTCDC_MIN_SIZE);
+
+    // A run of identical bytes never matches the mask: cut at the maximum
+    memset(edited, 0, FASTCDC_MAX_SIZE * 2);
+    test_result("Uniform data is cut at the maximum size", fastcdc_cut(edited, FASTCDC_MAX_SIZE * 2) == FASTCDC_MAX_SIZE);
+
+    free(edited);
+    free(after);
+}
+
+int main(void) {
+    printf("Running FastCDC tests...\n\n");
+
+    uint8_t *data = malloc(DATA_SIZE);
+    size_t *sizes = malloc(MAX_CUTS * sizeof(size_t));
+    fill_random(data, DATA_SIZE, 0x5eed);
+
+    test_bounds_and_coverage(data, sizes);
+    test_buffering_independence(data, sizes);
+    test_edit_locality(data, sizes);
+
+    free(sizes);
+    free(data);
+
+    printf("\nTest Results: %d passed, %d failed\n", tests_passed, tests_failed);
+
+    return tests_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <criterion/criterion.h>
+
+#include <mongoc/mongoc.h>
+#include <bson/bson.h>
+
+#include "../src/db/file_queries.h"
+
+// Every $or branch carries deleted:false, so it fits the branch index bounds
+Test(file_queries, list_branches_exclude_deleted) {
+    bson_t *filter = file_queries_list_filter("abc", NULL);
+
+    const char *branches[] = { "$or.0.deleted", "$or.1.deleted", "$or.2.deleted" };
+    for (size_t i = 0; i < 3; i++) {
+        bson_iter_t iter, field;
+        cr_assert(bson_iter_init(&iter, filter));
+        cr_assert(bson_iter_find_descendant(&iter, branches[i], &field), "%s", branches[i]);
+        cr_assert_not(bson_iter_bool(&field));
+    }
+
+    bson_iter_t iter, field;
+    cr_assert(bson_iter_init(&iter, filter));
+    cr_assert(bson_iter_find_descendant(&iter, "$or.0.owner_fingerprint", &field));
+    cr_assert_str_eq(bson_iter_utf8(&field, NULL), "abc");
+    cr_assert(bson_iter_init(&iter, filter));
+    cr_assert(bson_iter_find_descendant(&iter, "$or.1.recipient_fingerprint", &field));
+    cr_assert_str_eq(bson_iter_utf8(&field, NULL), "abc");
+    cr_assert(bson_iter_init(&iter, filter));
+    cr_assert(bson_iter_find_descendant(&iter, "$or.2.public", &field));
+    cr_assert(bson_iter_bool(&field));
+    cr_assert(bson_iter_init(&iter, filter));
+    cr_assert_not(bson_iter_find_descendant(&iter, "$or.3", &field));
+
+    bson_destroy(filter);
+}
+
+// LIST sorts newest first with _id as the tie-breaker, matching the index key order
+Test(file_queries, list_sort_is_newest_first) {
+    bson_t *opts = file_queries_list_opts();
+
+    bson_iter_t iter, sort;
+    cr_assert(bson_iter_init_find(&iter, opts, "sort"));
+    cr_assert(bson_iter_recurse(&iter, &sort));
+    cr_assert(bson_iter_next(&sort));
+    cr_assert_str_eq(bson_iter_key(&sort), "uploaded_at");
+    cr_assert_eq(bson_iter_as_int64(&sort), -1);
+    cr_assert(bson_iter_next(&sort));
+    cr_assert_str_eq(bson_iter_key(&sort), "_id");
+    cr_assert_eq(bson_iter_as_int64(&sort), -1);
+    cr_assert_not(bson_iter_next(&sort));
+
+    cr_assert(bson_iter_init_find(&iter, opts, "projection"));
+
+    bson_destroy(opts);
+}
+
+// A resume position bounds every branch by uploaded_at and breaks ties by _id
+Test(file_queries, list_resume_bounds_each_branch) {
+    file_list_position_t after = { .uploaded_at = 1700000000000LL };
+    memset(after.id.bytes, 0x42, sizeof(after.id.bytes));
+    bson_t *filter = file_queries_list_filter("abc", &after);
+
+    const char *bounds[] = { "$or.0.uploaded_at.$lte", "$or.1.uploaded_at.$lte", "$or.2.uploaded_at.$lte" };
+    const char *ties[] = { "$or.0.$or.1._id.$lt", "$or.1.$or.1._id.$lt", "$or.2.$or.1._id.$lt" };
+    for (size_t i = 0; i < 3; i++) {
+        bson_iter_t iter, field;
+        cr_assert(bson_iter_init(&iter, filter));
+        cr_assert(bson_iter_find_descendant(&iter, bounds[i], &field), "%s", bounds[i]);
+        cr_assert_eq(bson_iter_date_time(&field), after.uploaded_at);
+
+        cr_assert(bson_iter_init(&iter, filter));
+        cr_assert(bson_iter_find_descendant(&iter, ties[i], &field), "%s", ties[i]);
+        cr_assert(bson_oid_equal(bson_iter_oid(&field), &after.id));
+    }
+
+    bson_destroy(filter);
+}
+
+// The position of a listed document is its uploaded_at and _id
+Test(file_queries, list_position_from_document) {
+    bson_oid_t id;
+    bson_oid_init(&id, NULL);
+    bson_t *doc = BCON_NEW("_id", BCON_OID(&id), "uploaded_at", BCON_DATE_TIME(1234), "filename", BCON_UTF8("a"));
+
+    file_list_position_t pos;
+    cr_assert(file_queries_list_position(doc, &pos));
+    cr_assert_eq(pos.uploaded_at, 1234);
+    cr_assert(bson_oid_equal(&pos.id, &id));
+    bson_destroy(doc);
+
+    // Without uploaded_at there is no position to resume from
+    doc = BCON_NEW("_id", BCON_OID(&id), "filename", BCON_UTF8("a"));
+    cr_assert_not(file_queries_list_position(doc, &pos));
+    bson_destroy(doc);
+}
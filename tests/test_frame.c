@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/protocol.h"
+
+// Global test counters
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+// Helper function to print test results
+static void test_result(const char *test_name, int passed) {
+    if (passed) {
+        printf("[PASS] %s\n", test_name);
+        tests_passed++;
+    } else {
+        printf("[FAIL] %s\n", test_name);
+        tests_failed++;
+    }
+}
+
+static void test_roundtrip(void) {
+    FrameHeader in = { .stream_id = 0x01020304, .type = FRAME_DATA, .length = FRAME_MAX_PAYLOAD };
+    uint8_t raw[FRAME_HEADER_LEN];
+    frame_header_pack(&in, raw);
+
+    const uint8_t expected[FRAME_HEADER_LEN] = { 0x04, 0x03, 0x02, 0x01, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00 };
+    test_result("Header is little-endian on the wire", memcmp(raw, expected, sizeof(raw)) == 0);
+
+    FrameHeader out;
+    test_result("Valid header unpacks", frame_header_unpack(raw, &out) == 0);
+    test_result("Fields survive the round trip",
+                out.stream_id == in.stream_id && out.type == in.type && out.flags == 0 && out.length == in.length);
+
+    FrameHeader close = { .stream_id = 7, .type = FRAME_CLOSE };
+    frame_header_pack(&close, raw);
+    test_result("Empty CLOSE unpacks", frame_header_unpack(raw, &out) == 0 && out.type == FRAME_CLOSE);
+}
+
+static void test_rejects(void) {
+    uint8_t raw[FRAME_HEADER_LEN];
+    FrameHeader out;
+
+    FrameHeader zero_id = { .stream_id = 0, .type = FRAME_DATA, .length = 1 };
+    frame_header_pack(&zero_id, raw);
+    test_result("Stream 0 is rejected", frame_header_unpack(raw, &out) == -1);
+
+    FrameHeader big = { .stream_id = 1, .type = FRAME_DATA, .length = FRAME_MAX_PAYLOAD + 1 };
+    frame_header_pack(&big, raw);
+    test_result("Oversized payload is rejected", frame_header_unpack(raw, &out) == -1);
+
+    FrameHeader bad_type = { .stream_id = 1, .type = FRAME_RESET + 1 };
+    frame_header_pack(&bad_type, raw);
+    test_result("Unknown type is rejected", frame_header_unpack(raw, &out) == -1);
+
+    FrameHeader flags = { .stream_id = 1, .type = FRAME_DATA, .flags = 1, .length = 1 };
+    frame_header_pack(&flags, raw);
+    test_result("Reserved flags are rejected", frame_header_unpack(raw, &out) == -1);
+
+    FrameHeader reset = { .stream_id = 1, .type = FRAME_RESET, .length = 4 };
+    frame_header_pack(&reset, raw);
+    test_result("RESET with a payload is rejected", frame_header_unpack(raw, &out) == -1);
+}
+
+int main(void) {
+    printf("Running frame header tests...\n\n");
+
+    test_roundtrip();
+    test_rejects();
+
+    printf("\nTest Results: %d passed, %d failed\n", tests_passed, tests_failed);
+
+    return tests_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,120 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/common/mpsc_ring.h"
+
+#define PRODUCERS 4
+#define ITEMS_PER_PRODUCER 200000
+
+// Global test counters
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+// Helper function to print test results
+static void test_result(const char *test_name, int passed) {
+    if (passed) {
+        printf("[PASS] %s\n", test_name);
+        tests_passed++;
+    } else {
+        printf("[FAIL] %s\n", test_name);
+        tests_failed++;
+    }
+}
+
+typedef struct {
+    uint32_t producer;
+    uint32_t seq;
+    char pad[24]; // Items larger than a word must arrive intact
+} item_t;
+
+static void test_single_thread(void) {
+    mpsc_ring_t *ring = mpsc_ring_new(5, sizeof(item_t));
+    test_result("Capacity rounds up to a power of two", ring && mpsc_ring_capacity(ring) == 8);
+
+    item_t item = {0}, out;
+    test_result("Empty ring pops nothing", !mpsc_ring_pop(ring, &out));
+
+    int pushed = 0;
+    for (uint32_t i = 0; i < 8; i++) {
+        item.seq = i;
+        pushed += mpsc_ring_push(ring, &item);
+    }
+    test_result("Ring fills to capacity", pushed == 8 && mpsc_ring_depth(ring) == 8);
+    item.seq = 8;
+    test_result("Full ring refuses a push", !mpsc_ring_push(ring, &item));
+
+    int in_order = 1;
+    for (uint32_t i = 0; i < 8; i++) {
+        in_order &= mpsc_ring_pop(ring, &out) && out.seq == i;
+    }
+    test_result("Items come out in order", in_order && mpsc_ring_depth(ring) == 0);
+
+    // Many laps around a small ring
+    int wrapped = 1;
+    for (uint32_t i = 0; i < 1000; i++) {
+        item.seq = i;
+        snprintf(item.pad, sizeof(item.pad), "item %u", i);
+        char expect[sizeof(item.pad)];
+        memcpy(expect, item.pad, sizeof(expect));
+        wrapped &= mpsc_ring_push(ring, &item) && mpsc_ring_pop(ring, &out) &&
+                   out.seq == i && memcmp(out.pad, expect, sizeof(expect)) == 0;
+    }
+    test_result("Slots are reused after wrap-around", wrapped);
+    mpsc_ring_free(ring);
+
+    test_result("Zero capacity is rejected", mpsc_ring_new(0, sizeof(item_t)) == NULL);
+}
+
+static mpsc_ring_t *g_ring;
+
+static void *producer_main(void *arg) {
+    item_t item = {0};
+    item.producer = (uint32_t)(uintptr_t)arg;
+    for (uint32_t i = 0; i < ITEMS_PER_PRODUCER; i++) {
+        item.seq = i;
+        while (!mpsc_ring_push(g_ring, &item)) sched_yield();
+    }
+    return NULL;
+}
+
+static void test_producers(void) {
+    g_ring = mpsc_ring_new(1024, sizeof(item_t));
+    pthread_t threads[PRODUCERS];
+    for (uintptr_t p = 0; p < PRODUCERS; p++) {
+        pthread_create(&threads[p], NULL, producer_main, (void *)p);
+    }
+
+    // Each producer's items must arrive in its own order, none lost or repeated
+    uint32_t next[PRODUCERS] = {0};
+    int ordered = 1;
+    size_t received = 0;
+    item_t out;
+    while (received < (size_t)PRODUCERS * ITEMS_PER_PRODUCER) {
+        if (!mpsc_ring_pop(g_ring, &out)) {
+            sched_yield();
+            continue;
+        }
+        if (out.producer >= PRODUCERS || out.seq != next[out.producer]) ordered = 0;
+        else next[out.producer]++;
+        received++;
+    }
+    for (int p = 0; p < PRODUCERS; p++) pthread_join(threads[p], NULL);
+
+    test_result("Concurrent producers lose nothing and keep their order", ordered);
+    test_result("Ring is empty after the run", !mpsc_ring_pop(g_ring, &out) && mpsc_ring_depth(g_ring) == 0);
+    mpsc_ring_free(g_ring);
+}
+
+int main(void) {
+    printf("Running MPSC ring tests...\n\n");
+
+    test_single_thread();
+    test_producers();
+
+    printf("\nTest Results: %d passed, %d failed\n", tests_passed, tests_failed);
+
+    return tests_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <criterion/criterion.h>
+
+#include <mongoc/mongoc.h>
+#include <bson/bson.h>
+
+#include "../src/db/proc_events.h"
+
+// The selector matches the file by its full path
+Test(proc_events, selector_is_file_path) {
+    bson_t selector, update;
+    proc_event_build(&selector, &update, "/data/report.tar.gz", "upload", "success", 1000);
+
+    bson_iter_t iter;
+    cr_assert(bson_iter_init_find(&iter, &selector, "_id"));
+    cr_assert_str_eq(bson_iter_utf8(&iter, NULL), "/data/report.tar.gz");
+
+    bson_destroy(&update);
+    bson_destroy(&selector);
+}
+
+// The update is a two-stage pipeline: counter first, then the event under its number
+Test(proc_events, update_is_pipeline) {
+    bson_t selector, update;
+    proc_event_build(&selector, &update, "/data/report.tar.gz", "upload", "success", 1000);
+
+    bson_iter_t iter;
+    cr_assert(bson_iter_init_find(&iter, &update, "0"));
+    cr_assert(bson_iter_init_find(&iter, &update, "1"));
+    cr_assert_not(bson_iter_init_find(&iter, &update, "2"));
+
+    bson_iter_t field;
+    cr_assert(bson_iter_init(&iter, &update));
+    cr_assert(bson_iter_find_descendant(&iter, "0.$set.proc_seq.$add", &field));
+    cr_assert(bson_iter_init(&iter, &update));
+    cr_assert(bson_iter_find_descendant(&iter, "1.$set.proc.$mergeObjects", &field));
+
+    bson_destroy(&update);
+    bson_destroy(&selector);
+}
+
+// Name and extension are split off the path and passed as literals
+Test(proc_events, name_and_extension_are_literals) {
+    bson_t selector, update;
+    proc_event_build(&selector, &update, "/data/$report.tar.gz", "upload", "success", 1000);
+
+    bson_iter_t iter, field;
+    cr_assert(bson_iter_init(&iter, &update));
+    cr_assert(bson_iter_find_descendant(&iter, "0.$set.filename.$ifNull.1.$literal", &field));
+    cr_assert_str_eq(bson_iter_utf8(&field, NULL), "$report.tar");
+
+    cr_assert(bson_iter_init(&iter, &update));
+    cr_assert(bson_iter_find_descendant(&iter, "0.$set.extension.$ifNull.1.$literal", &field));
+    cr_assert_str_eq(bson_iter_utf8(&field, NULL), ".gz");
+
+    bson_destroy(&update);
+    bson_destroy(&selector);
+}
+
+// A leading dot is part of the name, not an extension
+Test(proc_events, dotfile_has_no_extension) {
+    bson_t selector, update;
+    proc_event_build(&selector, &update, "/home/user/.bashrc", "modified", "success", 1000);
+
+    bson_iter_t iter, field;
+    cr_assert(bson_iter_init(&iter, &update));
+    cr_assert(bson_iter_find_descendant(&iter, "0.$set.filename.$ifNull.1.$literal", &field));
+    cr_assert_str_eq(bson_iter_utf8(&field, NULL), ".bashrc");
+
+    cr_assert(bson_iter_init(&iter, &update));
+    cr_assert(bson_iter_find_descendant(&iter, "0.$set.extension.$ifNull.1.$literal", &field));
+    cr_assert_str_eq(bson_iter_utf8(&field, NULL), "");
+
+    bson_destroy(&update);
+    bson_destroy(&selector);
+}
+
+// The event keeps the proc map layout: date plus info{type_of_changes, status}
+Test(proc_events, event_layout) {
+    bson_t selector, update;
+    proc_event_build(&selector, &update, "/data/a.txt", "deleted", "n/a", 1234567);
+
+    bson_iter_t iter, stage, field;
+    cr_assert(bson_iter_init_find(&iter, &update, "1"));
+    cr_assert(bson_iter_recurse(&iter, &stage));
+    cr_assert(bson_iter_find_descendant(&stage, "$set.proc.$mergeObjects.1.$arrayToObject.0.0", &field));
+
+    bson_iter_t entry, value;
+    cr_assert(bson_iter_recurse(&field, &entry));
+    cr_assert(bson_iter_find_descendant(&entry, "v.$literal.date", &value));
+    cr_assert_eq(bson_iter_date_time(&value), 1234567);
+
+    cr_assert(bson_iter_recurse(&field, &entry));
+    cr_assert(bson_iter_find_descendant(&entry, "v.$literal.info.type_of_changes", &value));
+    cr_assert_str_eq(bson_iter_utf8(&value, NULL), "deleted");
+
+    cr_assert(bson_iter_recurse(&field, &entry));
+    cr_assert(bson_iter_find_descendant(&entry, "v.$literal.info.status", &value));
+    cr_assert_str_eq(bson_iter_utf8(&value, NULL), "n/a");
+
+    bson_destroy(&update);
+    bson_destroy(&selector);
+}
@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/server/rate_limiter.h"
+
+// Global test counters
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+// Helper function to print test results
+static void test_result(const char *test_name, int passed) {
+    if (passed) {
+        printf("[PASS] %s\n", test_name);
+        tests_passed++;
+    } else {
+        printf("[FAIL] %s\n", test_name);
+        tests_failed++;
+    }
+}
+
+static void make_key(uint8_t *key, uint32_t n) {
+    memset(key, 0, RATE_LIMITER_KEY_LEN);
+    key[10] = 0xff;
+    key[11] = 0xff;
+    key[12] = (uint8_t)(n >> 24);
+    key[13] = (uint8_t)(n >> 16);
+    key[14] = (uint8_t)(n >> 8);
+    key[15] = (uint8_t)n;
+}
+
+static void test_request_bucket(void) {
+    rate_limiter_config_t cfg = { .request_rate = 10, .request_burst = 5, .capacity = 64 };
+    rate_limiter_t *rl = rate_limiter_new(&cfg);
+    uint8_t key[RATE_LIMITER_KEY_LEN];
+    make_key(key, 1);
+
+    int allowed = 0;
+    for (int i = 0; i < 10; i++) {
+        allowed += rate_limiter_allow_request(rl, key, 1000);
+    }
+    test_result("Burst is capped at bucket size", allowed == 5);
+
+    // 10/s refills one token per 100 ms
+    test_result("No token before refill", rate_limiter_allow_request(rl, key, 1050) == 0);
+    test_result("One token after 100 ms", rate_limiter_allow_request(rl, key, 1150) == 1);
+    test_result("Only one token after 100 ms", rate_limiter_allow_request(rl, key, 1150) == 0);
+
+    // A long pause refills to the burst, not beyond it
+    allowed = 0;
+    for (int i = 0; i < 10; i++) {
+        allowed += rate_limiter_allow_request(rl, key, 60000);
+    }
+    test_result("Refill never exceeds burst", allowed == 5);
+
+    uint8_t other[RATE_LIMITER_KEY_LEN];
+    make_key(other, 2);
+    test_result("Other clients have their own bucket", rate_limiter_allow_request(rl, other, 60000) == 1);
+
+    rate_limiter_free(rl);
+}
+
+static void test_byte_bucket(void) {
+    rate_limiter_config_t cfg = { .request_rate = 1, .request_burst = 1,
+                                  .byte_rate = 1000, .byte_burst = 1500, .capacity = 64 };
+    rate_limiter_t *rl = rate_limiter_new(&cfg);
+    uint8_t key[RATE_LIMITER_KEY_LEN];
+    make_key(key, 7);
+
+    test_result("Byte burst is granted in full", rate_limiter_take_bytes(rl, key, 1000, 0) == 1000);
+    test_result("Request is cut to remaining tokens", rate_limiter_take_bytes(rl, key, 1000, 0) == 500);
+    test_result("Empty bucket grants nothing", rate_limiter_take_bytes(rl, key, 1000, 0) == 0);
+    test_result("Bytes refill at the configured rate", rate_limiter_take_bytes(rl, key, 1000, 250) == 250);
+    test_result("Wait time matches the rate", rate_limiter_wait_ms(rl, 500) == 500);
+    rate_limiter_refund_bytes(rl, key, 100);
+    test_result("Refunded bytes can be taken again", rate_limiter_take_bytes(rl, key, 1000, 250) == 100);
+
+    rate_limiter_config_t unlimited = { .request_rate = 1, .request_burst = 1, .capacity = 16 };
+    rate_limiter_t *open = rate_limiter_new(&unlimited);
+    test_result("Byte limiting can be disabled", rate_limiter_take_bytes(open, key, 1 << 30, 0) == (size_t)1 << 30);
+    test_result("Disabled byte limiting tracks no clients", rate_limiter_count(open) == 0);
+    rate_limiter_free(open);
+
+    rate_limiter_free(rl);
+}
+
+static void test_expiry(void) {
+    rate_limiter_config_t cfg = { .request_rate = 1, .request_burst = 2, .capacity = 1024 };
+    rate_limiter_t *rl = rate_limiter_new(&cfg);
+    uint8_t key[RATE_LIMITER_KEY_LEN];
+
+    for (uint32_t i = 0; i < 500; i++) {
+        make_key(key, i);
+        rate_limiter_allow_request(rl, key, 0);
+    }
+    test_result("Entries are tracked", rate_limiter_count(rl) == 500);
+    test_result("Recently used entries are kept", rate_limiter_expire(rl, 500) == 0);
+
+    // Half the clients stay active
+    for (uint32_t i = 0; i < 250; i++) {
+        make_key(key, i);
+        rate_limiter_allow_request(rl, key, 1000);
+    }
+    size_t removed = rate_limiter_expire(rl, 1500);
+    test_result("Idle entries are expired", removed == 250 && rate_limiter_count(rl) == 250);
+
+    // Everything left is still reachable after the backward shifts
+    int found = 1;
+    for (uint32_t i = 0; i < 250; i++) {
+        make_key(key, i);
+        size_t before = rate_limiter_count(rl);
+        rate_limiter_allow_request(rl, key, 1500);
+        if (rate_limiter_count(rl) != before) found = 0;
+    }
+    test_result("Remaining entries survive deletion", found);
+
+    rate_limiter_free(rl);
+}
+
+static void test_bounded_memory(void) {
+    rate_limiter_config_t cfg = { .request_rate = 1, .request_burst = 3, .capacity = 256 };
+    rate_limiter_t *rl = rate_limiter_new(&cfg);
+    uint8_t key[RATE_LIMITER_KEY_LEN];
+
+    // Flood with distinct addresses that never go idle
+    for (uint32_t i = 0; i < 100000; i++) {
+        make_key(key, i);
+        rate_limiter_allow_request(rl, key, 0);
+    }
+    test_result("Table never grows past its load limit", rate_limiter_count(rl) == 192);
+
+    // The newest client is always admitted into the table
+    make_key(key, 99999);
+    size_t before = rate_limiter_count(rl);
+    rate_limiter_allow_request(rl, key, 0);
+    test_result("Newest client is still tracked", rate_limiter_count(rl) == before);
+
+    rate_limiter_free(rl);
+}
+
+static void test_token_bucket(void) {
+    token_bucket_t b;
+    token_bucket_init(&b, 100, 50, 0);
+    test_result("Bucket starts full", token_bucket_take(&b, 80, 0) == 50);
+    test_result("Bucket refills at its rate", token_bucket_take(&b, 80, 100) == 10);
+    token_bucket_refund(&b, 5);
+    test_result("Refund is capped by the burst", token_bucket_take(&b, 80, 100) == 5);
+    test_result("Bucket wait time", token_bucket_wait_ms(&b, 50) == 500);
+
+    token_bucket_t open;
+    token_bucket_init(&open, 0, 0, 0);
+    test_result("Zero rate bucket is unlimited", token_bucket_take(&open, 12345, 0) == 12345);
+}
+
+static void test_invalid_config(void) {
+    rate_limiter_config_t bad_rate = { .request_rate = 0, .request_burst = 1, .capacity = 16 };
+    rate_limiter_config_t bad_bytes = { .request_rate = 1, .request_burst = 1, .byte_rate = 10, .capacity = 16 };
+    test_result("Zero request rate is rejected", rate_limiter_new(&bad_rate) == NULL);
+    test_result("Byte rate without burst is rejected", rate_limiter_new(&bad_bytes) == NULL);
+}
+
+int main(void) {
+    printf("Running rate limiter tests...\n\n");
+
+    test_request_bucket();
+    test_byte_bucket();
+    test_expiry();
+    test_bounded_memory();
+    test_token_bucket();
+    test_invalid_config();
+
+    printf("\nTest Results: %d passed, %d failed\n", tests_passed, tests_failed);
+
+    return tests_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+
+#include "../src/common/tls_session.h"
+
+// Run from the repository root: certificates are read from src/
+#define CACHE_FILE "/tmp/test_tls_session.pem"
+
+// Global test counters
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+// Helper function to print test results
+static void test_result(const char *test_name, int passed) {
+    if (passed) {
+        printf("[PASS] %s\n", test_name);
+        tests_passed++;
+    } else {
+        printf("[FAIL] %s\n", test_name);
+        tests_failed++;
+    }
+}
+
+static SSL_CTX *make_server_ctx(void) {
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx ||
+        SSL_CTX_use_certificate_file(ctx, "src/server-cert.pem", SSL_FILETYPE_PEM) <= 0 ||
+        SSL_CTX_use_PrivateKey_file(ctx, "src/server-key.pem", SSL_FILETYPE_PEM) <= 0 ||
+        SSL_CTX_load_verify_locations(ctx, "src/ca.pem", NULL) <= 0) {
+        return NULL;
+    }
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, NULL);
+    return tls_session_server_init(ctx, "test") == 0 ? ctx : NULL;
+}
+
+static SSL_CTX *make_client_ctx(int max_version, const char *cache) {
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    if (!ctx ||
+        SSL_CTX_use_certificate_file(ctx, "src/client-cert.pem", SSL_FILETYPE_PEM) <= 0 ||
+        SSL_CTX_use_PrivateKey_file(ctx, "src/client-key.pem", SSL_FILETYPE_PEM) <= 0 ||
+        SSL_CTX_load_verify_locations(ctx, "src/ca.pem", NULL) <= 0) {
+        return NULL;
+    }
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+    SSL_CTX_set_max_proto_version(ctx, max_version);
+    tls_session_client_init(ctx, cache);
+    return ctx;
+}
+
+// One connection over an in-memory BIO pair, including one application
+// byte so the client picks up TLS 1.3 tickets. Returns 1 if the handshake
+// was resumed, 0 if it was full, -1 on failure.
+static int connect_once(SSL_CTX *sctx, SSL_CTX *cctx, int *server_has_cert) {
+    BIO *sbio = NULL, *cbio = NULL;
+    if (BIO_new_bio_pair(&sbio, 0, &cbio, 0) != 1) return -1;
+
+    SSL *server = SSL_new(sctx);
+    SSL *client = SSL_new(cctx);
+    SSL_set_bio(server, sbio, sbio);
+    SSL_set_bio(client, cbio, cbio);
+    SSL_set_accept_state(server);
+    SSL_set_connect_state(client);
+    tls_session_client_prepare(client);
+
+    int rc = -1;
+    int sdone = 0, cdone = 0;
+    for (int i = 0; i < 50 && !(sdone && cdone); i++) {
+        if (!cdone) cdone = SSL_do_handshake(client) == 1;
+        if (!sdone) sdone = SSL_do_handshake(server) == 1;
+    }
+    if (sdone && cdone) {
+        char byte = 'x';
+        int got = 0;
+        SSL_write(server, &byte, 1);
+        for (int i = 0; i < 10 && got != 1; i++) got = SSL_read(client, &byte, 1);
+        if (got == 1) {
+            X509 *cert = SSL_get_peer_certificate(server);
+            if (server_has_cert) *server_has_cert = cert != NULL;
+            X509_free(cert);
+            tls_session_count(client);
+            rc = tls_session_count(server);
+        }
+    }
+
+    SSL_shutdown(client);
+    SSL_shutdown(server);
+    SSL_free(client);
+    SSL_free(server);
+    return rc;
+}
+
+static void test_tls13(SSL_CTX *sctx) {
+    SSL_CTX *cctx = make_client_ctx(TLS1_3_VERSION, NULL);
+    int has_cert = 0;
+    test_result("First connection is a full handshake", connect_once(sctx, cctx, NULL) == 0);
+    test_result("Reconnect resumes the session", connect_once(sctx, cctx, &has_cert) == 1);
+    test_result("Resumed session keeps the client certificate", has_cert);
+
+    tls_session_rotate_keys();
+    test_result("Ticket from the previous key still resumes", connect_once(sctx, cctx, NULL) == 1);
+
+    for (int i = 0; i < TLS_TICKET_KEYS; i++) tls_session_rotate_keys();
+    test_result("Ticket from a retired key needs a full handshake", connect_once(sctx, cctx, NULL) == 0);
+    test_result("New ticket after a full handshake resumes", connect_once(sctx, cctx, NULL) == 1);
+    SSL_CTX_free(cctx);
+}
+
+static void test_tls12(SSL_CTX *sctx) {
+    SSL_CTX *cctx = make_client_ctx(TLS1_2_VERSION, NULL);
+    connect_once(sctx, cctx, NULL);
+    test_result("TLS 1.2 resumes with a ticket", connect_once(sctx, cctx, NULL) == 1);
+
+    // Without tickets the server looks the session ID up in its cache
+    SSL_CTX_set_options(cctx, SSL_OP_NO_TICKET);
+    connect_once(sctx, cctx, NULL);
+    test_result("TLS 1.2 resumes from the server cache", connect_once(sctx, cctx, NULL) == 1);
+    SSL_CTX_free(cctx);
+}
+
+static void test_cache_file(SSL_CTX *sctx) {
+    unlink(CACHE_FILE);
+    SSL_CTX *cctx = make_client_ctx(TLS1_3_VERSION, CACHE_FILE);
+    connect_once(sctx, cctx, NULL);
+
+    struct stat st;
+    test_result("Session is saved to the cache file", stat(CACHE_FILE, &st) == 0);
+    test_result("Cache file is private", (st.st_mode & 0777) == 0600);
+
+    FILE *fp = fopen(CACHE_FILE, "r");
+    SSL_SESSION *sess = fp ? PEM_read_SSL_SESSION(fp, NULL, NULL, NULL) : NULL;
+    test_result("Saved session is resumable", sess && SSL_SESSION_is_resumable(sess));
+    if (sess) SSL_SESSION_free(sess);
+    if (fp) fclose(fp);
+    unlink(CACHE_FILE);
+    SSL_CTX_free(cctx);
+}
+
+int main(void) {
+    printf("Running TLS session tests...\n\n");
+
+    SSL_CTX *sctx = make_server_ctx();
+    if (!sctx) {
+        ERR_print_errors_fp(stderr);
+        printf("Cannot load certificates from src/\n");
+        return 1;
+    }
+
+    test_tls13(sctx);
+    test_tls12(sctx);
+    test_cache_file(sctx);
+
+    tls_session_stats_t st;
+    tls_session_get_stats(&st);
+    test_result("Handshakes are counted", st.handshakes > 0 && st.resumed > 0 && st.resumed < st.handshakes);
+    test_result("Key rotations are counted", st.key_rotations == 2 + TLS_TICKET_KEYS);
+
+    SSL_CTX_free(sctx);
+
+    printf("\nTest Results: %d passed, %d failed\n", tests_passed, tests_failed);
+
+    return tests_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/common/wire_codec.h"
+
+#define FUZZ_ROUNDS 200000
+
+// Global test counters
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+// Helper function to print test results
+static void test_result(const char *test_name, int passed) {
+    if (passed) {
+        printf("[PASS] %s\n", test_name);
+        tests_passed++;
+    } else {
+        printf("[FAIL] %s\n", test_name);
+        tests_failed++;
+    }
+}
+
+// xorshift64*: reproducible without depending on the libc rand()
+static uint64_t g_rng = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t next_rand(void) {
+    g_rng ^= g_rng >> 12;
+    g_rng ^= g_rng << 25;
+    g_rng ^= g_rng >> 27;
+    return g_rng * 0x2545f4914f6cdd1dULL;
+}
+
+// Random prefix of the array, zeros after it, so trimming is exercised
+static void fill_random(uint8_t *buf, size_t len) {
+    size_t used = next_rand() % 3 == 0 ? 0 : next_rand() % (len + 1);
+    for (size_t i = 0; i < used; i++) buf[i] = (uint8_t)next_rand();
+}
+
+static void random_request(RequestHeader *req) {
+    memset(req, 0, sizeof(*req));
+    req->command = (CommandType)(next_rand() % 200);
+    if (next_rand() & 1) req->offset = (int64_t)next_rand();
+    if (next_rand() & 1) req->flags = (uint8_t)next_rand();
+    fill_random(req->file_hash, sizeof(req->file_hash));
+    fill_random(req->packet_nonce, sizeof(req->packet_nonce));
+    fill_random(req->auth_tag, sizeof(req->auth_tag));
+    if (next_rand() & 1) {
+        EncryptedMetadata *m = &req->metadata;
+        fill_random(m->encrypted_filename, sizeof(m->encrypted_filename));
+        fill_random(m->filename_auth_tag, sizeof(m->filename_auth_tag));
+        fill_random(m->encrypted_size, sizeof(m->encrypted_size));
+        fill_random(m->size_auth_tag, sizeof(m->size_auth_tag));
+        fill_random(m->encrypted_recipient, sizeof(m->encrypted_recipient));
+        fill_random(m->recipient_auth_tag, sizeof(m->recipient_auth_tag));
+        fill_random(m->nonce, sizeof(m->nonce));
+    }
+}
+
+static void test_varint(void) {
+    uint8_t buf[WIRE_VARINT_MAX];
+    uint64_t v = 0;
+    const uint64_t samples[] = { 0, 1, 127, 128, 300, 16383, 16384, UINT32_MAX, UINT64_MAX };
+    int ok = 1;
+    for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); i++) {
+        size_t n = wire_varint_encode(samples[i], buf);
+        ok &= wire_varint_decode(buf, n, &v) == (ssize_t)n && v == samples[i];
+        ok &= wire_varint_decode(buf, n - 1, &v) == 0;
+    }
+    test_result("Varints round trip and report truncation", ok);
+    test_result("Largest varint is 10 bytes", wire_varint_encode(UINT64_MAX, buf) == WIRE_VARINT_MAX);
+
+    const uint8_t overflow[WIRE_VARINT_MAX] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x02 };
+    test_result("Varint past 64 bits is rejected", wire_varint_decode(overflow, sizeof(overflow), &v) == -1);
+    const uint8_t too_long[WIRE_VARINT_MAX + 1] = { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00 };
+    test_result("Eleven-byte varint is rejected", wire_varint_decode(too_long, sizeof(too_long), &v) == -1);
+}
+
+static void test_small_messages(void) {
+    uint8_t buf[WIRE_MAX_MESSAGE];
+    RequestHeader ping;
+    memset(&ping, 0, sizeof(ping));
+    ping.command = CMD_PING;
+    size_t n = wire_encode_request(&ping, buf, sizeof(buf));
+    test_result("PING is three bytes", n == 3);
+
+    RequestHeader out;
+    test_result("PING decodes", wire_decode_request(buf, n, &out) == (ssize_t)n && out.command == CMD_PING);
+
+    ResponseHeader resp = { .status = RESP_SUCCESS, .filesize = -5 };
+    n = wire_encode_response(&resp, buf, sizeof(buf));
+    ResponseHeader rout;
+    test_result("Negative filesize survives zigzag",
+                wire_decode_response(buf, n, &rout) == (ssize_t)n && rout.status == RESP_SUCCESS && rout.filesize == -5);
+    test_result("Short buffer is refused", wire_encode_response(&resp, buf, 2) == 0);
+}
+
+static void test_request_roundtrip(void) {
+    uint8_t buf[WIRE_MAX_MESSAGE];
+    int ok = 1, need_more = 1;
+    for (int i = 0; i < 20000; i++) {
+        RequestHeader in, out;
+        random_request(&in);
+        size_t n = wire_encode_request(&in, buf, sizeof(buf));
+        memset(&out, 0xa5, sizeof(out));
+        ok &= n > 0 && wire_decode_request(buf, n, &out) == (ssize_t)n && memcmp(&in, &out, sizeof(in)) == 0;
+        need_more &= wire_decode_request(buf, n - 1 - next_rand() % n, &out) == 0 || n == 0;
+    }
+    test_result("Random requests round trip", ok);
+    test_result("Any prefix of a message asks for more input", need_more);
+
+    RequestHeader full;
+    memset(&full, 0xff, sizeof(full));
+    full.command = CMD_UPLOAD_STATUS;
+    test_result("Fully populated request fits in one message", wire_encode_request(&full, buf, sizeof(buf)) > 0);
+}
+
+static void test_malformed(void) {
+    RequestHeader req;
+    // len 4: command 1, then command again
+    const uint8_t dup[] = { 0x04, 0x08, 0x01, 0x08, 0x02 };
+    test_result("Duplicate field is rejected", wire_decode_request(dup, sizeof(dup), &req) == -1);
+    // len 2: flags only
+    const uint8_t no_cmd[] = { 0x02, 0x18, 0x01 };
+    test_result("Missing command is rejected", wire_decode_request(no_cmd, sizeof(no_cmd), &req) == -1);
+    // File hash of 33 bytes
+    uint8_t long_hash[3 + 33] = { 0x25, 0x22, 33 };
+    long_hash[0] = 2 + 33;
+    test_result("Oversized array is rejected", wire_decode_request(long_hash, sizeof(long_hash), &req) == -1);
+    // Unknown field 9 (varint) is skipped
+    const uint8_t unknown[] = { 0x04, 0x08, 0x69, 0x48, 0x07 };
+    test_result("Unknown field is skipped",
+                wire_decode_request(unknown, sizeof(unknown), &req) == (ssize_t)sizeof(unknown) && req.command == CMD_PING);
+    // Length prefix beyond the limit
+    const uint8_t huge[] = { 0x80, 0x10 };
+    test_result("Oversized message is rejected", wire_decode_request(huge, sizeof(huge), &req) == -1);
+}
+
+// Random and mutated input: decoding must stay in bounds (run under ASan),
+// and whatever decodes must re-encode to something that decodes the same
+static void test_fuzz(void) {
+    uint8_t buf[WIRE_MAX_MESSAGE + 16];
+    uint8_t again[WIRE_MAX_MESSAGE];
+    int consistent = 1, decoded = 0;
+
+    for (int i = 0; i < FUZZ_ROUNDS; i++) {
+        size_t len;
+        if (i & 1) {
+            RequestHeader seed;
+            random_request(&seed);
+            len = wire_encode_request(&seed, buf, sizeof(buf));
+            for (int flips = 1 + (int)(next_rand() % 4); flips > 0 && len > 0; flips--) {
+                buf[next_rand() % len] ^= (uint8_t)(1u << (next_rand() % 8));
+            }
+        } else {
+            len = next_rand() % sizeof(buf);
+            for (size_t j = 0; j < len; j++) buf[j] = (uint8_t)next_rand();
+            if (len > 0) buf[0] &= 0x7f; // Mostly plausible length prefixes
+        }
+
+        RequestHeader req, req2;
+        ssize_t n = wire_decode_request(buf, len, &req);
+        if (n > 0) {
+            decoded++;
+            size_t m = wire_encode_request(&req, again, sizeof(again));
+            consistent &= (size_t)n <= len && m > 0 &&
+                          wire_decode_request(again, m, &req2) == (ssize_t)m &&
+                          memcmp(&req, &req2, sizeof(req)) == 0;
+        }
+
+        ResponseHeader resp, resp2;
+        n = wire_decode_response(buf, len, &resp);
+        if (n > 0) {
+            size_t m = wire_encode_response(&resp, again, sizeof(again));
+            consistent &= m > 0 && wire_decode_response(again, m, &resp2) == (ssize_t)m &&
+                          memcmp(&resp, &resp2, sizeof(resp)) == 0;
+        }
+    }
+    test_result("Fuzzed input decodes consistently", consistent);
+    test_result("Fuzzer reaches valid messages", decoded > 0);
+}
+
+int main(void) {
+    printf("Running wire codec tests...\n\n");
+
+    test_varint();
+    test_small_messages();
+    test_request_roundtrip();
+    test_malformed();
+    test_fuzz();
+
+    printf("\nTest Results: %d passed, %d failed\n", tests_passed, tests_failed);
+
+    return tests_failed == 0 ? 0 : 1;
+}